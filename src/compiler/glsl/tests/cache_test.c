@@ -37,6 +37,8 @@
 
 #include "util/mesa-sha1.h"
 #include "util/disk_cache.h"
+#include "util/macros.h"
+#include "util/os_time.h"
 
 bool error = false;
 
@@ -516,20 +518,332 @@ test_put_key_and_get_key(void)
 
    disk_cache_destroy(cache);
 }
+
+static bool
+cache_file_exists(const char *cache_dir, const cache_key key)
+{
+   char buf[41];
+   char *filename;
+   struct stat sb;
+   bool exists;
+
+   _mesa_sha1_format(buf, key);
+   if (asprintf(&filename, "%s/%c%c/%s", cache_dir, buf[0], buf[1],
+                buf + 2) == -1)
+      return false;
+
+   exists = stat(filename, &sb) == 0;
+   free(filename);
+
+   return exists;
+}
+
+static void
+test_single_file(void)
+{
+   struct disk_cache *cache, *cache2;
+   char blob[] = "This is a blob of thirty-seven bytes";
+   uint8_t blob_key[20];
+   char string[] = "While this string has thirty-four";
+   uint8_t string_key[20];
+   uint8_t big_key[20];
+   uint8_t *big;
+   char *result;
+   size_t size;
+   int count;
+
+#ifdef SHADER_CACHE_DISABLE_BY_DEFAULT
+   setenv("MESA_GLSL_CACHE_DISABLE", "false", 1);
+#endif /* SHADER_CACHE_DISABLE_BY_DEFAULT */
+
+   setenv("MESA_GLSL_CACHE_DIR", CACHE_TEST_TMP "/single-file", 1);
+   setenv("MESA_GLSL_CACHE_MAX_SIZE", "1M", 1);
+   unsetenv("MESA_DISK_CACHE_SINGLE_FILE");
+
+   /* Write an entry with one file per entry first. */
+   cache = disk_cache_create("test", "make_check", 0);
+   disk_cache_compute_key(cache, blob, sizeof(blob), blob_key);
+   disk_cache_compute_key(cache, string, sizeof(string), string_key);
+   disk_cache_put(cache, blob_key, blob, sizeof(blob), NULL);
+   disk_cache_wait_for_idle(cache);
+   disk_cache_destroy(cache);
+
+   expect_true(cache_file_exists(CACHE_TEST_TMP "/single-file/"
+                                 CACHE_DIR_NAME, blob_key),
+               "entry written to its own file");
+
+   /* It is moved into the database when it is read. */
+   setenv("MESA_DISK_CACHE_SINGLE_FILE", "true", 1);
+   cache = disk_cache_create("test", "make_check", 0);
+
+   result = disk_cache_get(cache, blob_key, &size);
+   expect_equal_str(blob, result, "single file get of a migrated item");
+   expect_equal(size, sizeof(blob), "single file get of a migrated item (size)");
+   free(result);
+
+   disk_cache_wait_for_idle(cache);
+   expect_false(cache_file_exists(CACHE_TEST_TMP "/single-file/"
+                                  CACHE_DIR_NAME, blob_key),
+                "migrated entry file removed");
+
+   disk_cache_put(cache, string_key, string, sizeof(string), NULL);
+   disk_cache_wait_for_idle(cache);
+
+   result = disk_cache_get(cache, string_key, &size);
+   expect_equal_str(string, result, "single file get of an existing item");
+   expect_equal(size, sizeof(string), "single file get of an existing item "
+                "(size)");
+   free(result);
+
+   /* A second cache, like another process, sees the entries of the first
+    * one, including those added after it was created.
+    */
+   cache2 = disk_cache_create("test", "make_check", 0);
+   expect_true(does_cache_contain(cache2, blob_key),
+               "single file get from a second cache");
+
+   disk_cache_remove(cache, string_key);
+   expect_false(does_cache_contain(cache, string_key),
+                "single file get of a removed item");
+
+   disk_cache_put(cache, string_key, string, sizeof(string), NULL);
+   disk_cache_wait_for_idle(cache);
+   expect_true(does_cache_contain(cache2, string_key),
+               "single file get of an item added by another cache");
+
+   disk_cache_destroy(cache2);
+   disk_cache_destroy(cache);
+
+   /* Entries persist when the cache is created again. */
+   cache = disk_cache_create("test", "make_check", 0);
+   count = 0;
+   if (does_cache_contain(cache, blob_key))
+      count++;
+   if (does_cache_contain(cache, string_key))
+      count++;
+   expect_equal(count, 2, "single file entries persist");
+   disk_cache_destroy(cache);
+
+   /* Overflowing a 1KB cache compacts the database. The data is random so
+    * that it doesn't compress to nothing.
+    */
+   setenv("MESA_GLSL_CACHE_MAX_SIZE", "1K", 1);
+   cache = disk_cache_create("test", "make_check", 0);
+
+   big = malloc(900);
+   srand(42);
+   for (unsigned i = 0; i < 900; i++)
+      big[i] = rand();
+   disk_cache_compute_key(cache, big, 900, big_key);
+
+   disk_cache_put(cache, big_key, big, 900, NULL);
+   disk_cache_wait_for_idle(cache);
+
+   result = disk_cache_get(cache, big_key, &size);
+   expect_non_null(result, "single file get after compaction");
+   expect_equal(size, 900, "single file get after compaction (size)");
+   free(result);
+   free(big);
+
+   count = 0;
+   if (does_cache_contain(cache, blob_key))
+      count++;
+   if (does_cache_contain(cache, string_key))
+      count++;
+   expect_equal(count, 0, "single file compaction with MAX_SIZE=1K");
+
+   disk_cache_destroy(cache);
+
+   unsetenv("MESA_DISK_CACHE_SINGLE_FILE");
+   setenv("MESA_GLSL_CACHE_MAX_SIZE", "1M", 1);
+}
+
+static void
+test_memory_cache(void)
+{
+   struct disk_cache *cache;
+   char blob[] = "This is a blob of thirty-seven bytes";
+   uint8_t blob_key[20];
+   uint8_t keys[8][20];
+   uint32_t values[8];
+   void *data[8];
+   size_t sizes[8];
+   char *result;
+   size_t size;
+   int count;
+
+#ifdef SHADER_CACHE_DISABLE_BY_DEFAULT
+   setenv("MESA_GLSL_CACHE_DISABLE", "false", 1);
+#endif /* SHADER_CACHE_DISABLE_BY_DEFAULT */
+
+   setenv("MESA_GLSL_CACHE_DIR", CACHE_TEST_TMP "/memory", 1);
+   setenv("MESA_DISK_CACHE_MEMORY_SIZE", "1M", 1);
+
+   cache = disk_cache_create("test", "make_check", 0);
+   disk_cache_compute_key(cache, blob, sizeof(blob), blob_key);
+   for (unsigned i = 0; i < 8; i++) {
+      values[i] = i * 1000;
+      disk_cache_compute_key(cache, &values[i], sizeof(values[i]), keys[i]);
+      disk_cache_put(cache, keys[i], &values[i], sizeof(values[i]), NULL);
+   }
+   disk_cache_put(cache, blob_key, blob, sizeof(blob), NULL);
+   disk_cache_wait_for_idle(cache);
+   disk_cache_destroy(cache);
+
+   /* An item read once is still there after the disk is wiped. */
+   cache = disk_cache_create("test", "make_check", 0);
+   expect_true(does_cache_contain(cache, blob_key),
+               "memory cache get from disk");
+
+   rmrf_local(CACHE_TEST_TMP "/memory");
+
+   result = disk_cache_get(cache, blob_key, &size);
+   expect_equal_str(blob, result, "memory cache get (pointer)");
+   expect_equal(size, sizeof(blob), "memory cache get (size)");
+   free(result);
+
+   disk_cache_remove(cache, blob_key);
+   expect_false(does_cache_contain(cache, blob_key),
+                "memory cache get of a removed item");
+
+   disk_cache_destroy(cache);
+
+   /* Batched gets return the same as single ones. */
+   cache = disk_cache_create("test", "make_check", 0);
+   for (unsigned i = 0; i < 8; i++)
+      disk_cache_put(cache, keys[i], &values[i], sizeof(values[i]), NULL);
+   disk_cache_wait_for_idle(cache);
+   disk_cache_destroy(cache);
+
+   cache = disk_cache_create("test", "make_check", 0);
+   disk_cache_prefetch(cache, keys, 4);
+   disk_cache_get_batch(cache, keys, 8, data, sizes);
+
+   count = 0;
+   for (unsigned i = 0; i < 8; i++) {
+      if (data[i] && sizes[i] == sizeof(values[i]) &&
+          memcmp(data[i], &values[i], sizeof(values[i])) == 0)
+         count++;
+      free(data[i]);
+   }
+   expect_equal(count, 8, "disk_cache_get_batch");
+
+   disk_cache_get_batch(cache, &blob_key, 1, data, sizes);
+   expect_null(data[0], "disk_cache_get_batch of a non-existent item");
+   expect_equal(sizes[0], 0, "disk_cache_get_batch of a non-existent item "
+                "(size)");
+
+   disk_cache_destroy(cache);
+
+   setenv("MESA_DISK_CACHE_MEMORY_SIZE", "0", 1);
+}
+
+/* Time lookups with one file per entry, with a single file, and with one
+ * file per entry behind the in-memory cache using batched gets. The cold
+ * pass is the first get of every key from a newly created cache, the warm
+ * pass gets them all again. Neither drops the page cache.
+ */
+static void
+bench_lookups(void)
+{
+   static const char *names[] = { "files", "single file", "files batched" };
+   const unsigned num_entries = 10000;
+   const unsigned entry_size = 4096;
+   const unsigned batch_size = 64;
+   uint8_t (*keys)[20] = malloc(num_entries * sizeof(*keys));
+   uint32_t *data = malloc(entry_size);
+   void *results[64];
+
+   setenv("MESA_GLSL_CACHE_DISABLE", "false", 1);
+   setenv("MESA_GLSL_CACHE_MAX_SIZE", "1G", 1);
+
+   for (unsigned mode = 0; mode < 3; mode++) {
+      struct disk_cache *cache;
+      bool batched = mode == 2;
+
+      rmrf_local(CACHE_TEST_TMP);
+      mkdir(CACHE_TEST_TMP, 0755);
+      setenv("MESA_GLSL_CACHE_DIR", CACHE_TEST_TMP "/bench", 1);
+      setenv("MESA_DISK_CACHE_SINGLE_FILE", mode == 1 ? "true" : "false", 1);
+      setenv("MESA_DISK_CACHE_MEMORY_SIZE", batched ? "64M" : "0", 1);
+
+      cache = disk_cache_create("test", "bench", 0);
+      for (unsigned i = 0; i < num_entries; i++) {
+         /* Half of each entry is compressible. */
+         for (unsigned j = 0; j < entry_size / 4; j++)
+            data[j] = j < entry_size / 8 ? rand() : j;
+         disk_cache_compute_key(cache, data, entry_size, keys[i]);
+         disk_cache_put(cache, keys[i], data, entry_size, NULL);
+      }
+      disk_cache_wait_for_idle(cache);
+      disk_cache_destroy(cache);
+
+      int64_t start = os_time_get_nano();
+      cache = disk_cache_create("test", "bench", 0);
+      unsigned hits = 0;
+      for (unsigned i = 0; i < num_entries; i += batch_size) {
+         unsigned n = MIN2(batch_size, num_entries - i);
+
+         if (batched) {
+            disk_cache_get_batch(cache, &keys[i], n, results, NULL);
+         } else {
+            for (unsigned j = 0; j < n; j++)
+               results[j] = disk_cache_get(cache, keys[i + j], NULL);
+         }
+
+         for (unsigned j = 0; j < n; j++) {
+            hits += results[j] != NULL;
+            free(results[j]);
+         }
+      }
+      int64_t cold = os_time_get_nano() - start;
+
+      start = os_time_get_nano();
+      for (unsigned i = 0; i < num_entries; i++)
+         hits += does_cache_contain(cache, keys[i]);
+      int64_t warm = os_time_get_nano() - start;
+
+      disk_cache_destroy(cache);
+
+      printf("%-14s %u hits, cold %6.2f us/lookup, warm %6.2f us/lookup\n",
+             names[mode], hits,
+             cold / 1000.0 / num_entries, warm / 1000.0 / num_entries);
+   }
+
+   unsetenv("MESA_DISK_CACHE_SINGLE_FILE");
+   unsetenv("MESA_DISK_CACHE_MEMORY_SIZE");
+   free(keys);
+   free(data);
+}
 #endif /* ENABLE_SHADER_CACHE */
 
 int
-main(void)
+main(int argc, char **argv)
 {
 #ifdef ENABLE_SHADER_CACHE
    int err;
 
+   if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+      bench_lookups();
+      rmrf_local(CACHE_TEST_TMP);
+      return 0;
+   }
+
+   /* Most tests check which items were evicted from the disk, keep the
+    * in-memory cache out of the way. test_memory_cache() enables it.
+    */
+   setenv("MESA_DISK_CACHE_MEMORY_SIZE", "0", 1);
+
    test_disk_cache_create();
 
    test_put_and_get();
 
    test_put_key_and_get_key();
 
+   test_single_file();
+
+   test_memory_cache();
+
    err = rmrf_local(CACHE_TEST_TMP);
    expect_equal(err, 0, "Removing " CACHE_TEST_TMP " again");
 #endif /* ENABLE_SHADER_CACHE */
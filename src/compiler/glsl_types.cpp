@@ -26,6 +26,7 @@
 #include "compiler/glsl/glsl_parser_extras.h"
 #include "glsl_types.h"
 #include "util/hash_table.h"
+#include "util/u_atomic.h"
 #include "util/u_string.h"
 
 
@@ -43,6 +44,90 @@ hash_table *glsl_type::subroutine_types = NULL;
  */
 static uint32_t glsl_type_users = 0;
 
+/* Compiler threads look up the same array, struct and interface types over
+ * and over, so each thread keeps a small direct-mapped cache of the types it
+ * got back from the tables above and only takes hash_mutex on a miss.
+ *
+ * Interned types are never freed while there are users, so a cached pointer
+ * stays valid until the last glsl_type_singleton_decref(). That one bumps the
+ * generation, which makes every thread drop its cache on its next lookup.
+ */
+static uint32_t glsl_type_cache_generation = 0;
+
+#define ARRAY_CACHE_SIZE 128
+#define MATRIX_CACHE_SIZE 32
+#define RECORD_CACHE_SIZE 32
+
+struct array_cache_entry {
+   const glsl_type *base;
+   unsigned length;
+   unsigned explicit_stride;
+   const glsl_type *type;
+};
+
+struct matrix_cache_entry {
+   uint32_t key;
+   unsigned explicit_stride;
+   unsigned explicit_alignment;
+   const glsl_type *type;
+};
+
+struct record_cache_entry {
+   uint32_t hash;
+   const glsl_type *type;
+};
+
+struct glsl_type_cache {
+   uint32_t generation;
+   struct array_cache_entry arrays[ARRAY_CACHE_SIZE];
+   struct matrix_cache_entry matrices[MATRIX_CACHE_SIZE];
+   struct record_cache_entry structs[RECORD_CACHE_SIZE];
+   struct record_cache_entry interfaces[RECORD_CACHE_SIZE];
+   struct record_cache_entry subroutines[RECORD_CACHE_SIZE];
+   struct record_cache_entry functions[RECORD_CACHE_SIZE];
+};
+
+static thread_local struct glsl_type_cache glsl_type_cache;
+
+static struct glsl_type_cache *
+get_type_cache()
+{
+   struct glsl_type_cache *cache = &glsl_type_cache;
+   const uint32_t generation = p_atomic_read(&glsl_type_cache_generation);
+
+   if (unlikely(cache->generation != generation)) {
+      memset(cache, 0, sizeof(*cache));
+      cache->generation = generation;
+   }
+
+   return cache;
+}
+
+static struct record_cache_entry *
+record_cache_lookup(struct record_cache_entry *entries, uint32_t hash,
+                    const glsl_type *key,
+                    bool (*compare)(const void *, const void *))
+{
+   struct record_cache_entry *entry =
+      &entries[hash & (RECORD_CACHE_SIZE - 1)];
+
+   if (entry->type && entry->hash == hash && compare(key, entry->type))
+      return entry;
+
+   return NULL;
+}
+
+static void
+record_cache_add(struct record_cache_entry *entries, uint32_t hash,
+                 const glsl_type *type)
+{
+   struct record_cache_entry *entry =
+      &entries[hash & (RECORD_CACHE_SIZE - 1)];
+
+   entry->hash = hash;
+   entry->type = type;
+}
+
 glsl_type::glsl_type(GLenum gl_type,
                      glsl_base_type base_type, unsigned vector_elements,
                      unsigned matrix_columns, const char *name,
@@ -566,6 +651,9 @@ glsl_type_singleton_decref()
       glsl_type::subroutine_types = NULL;
    }
 
+   /* Types cached by other threads are gone now. */
+   p_atomic_inc(&glsl_type_cache_generation);
+
    mtx_unlock(&glsl_type::hash_mutex);
 }
 
@@ -677,6 +765,18 @@ glsl_type::get_instance(unsigned base_type, unsigned rows, unsigned columns,
          assert(explicit_stride % explicit_alignment == 0);
       }
 
+      struct glsl_type_cache *cache = get_type_cache();
+      const uint32_t cache_key =
+         base_type | (rows << 8) | (columns << 16) | (row_major << 24);
+      struct matrix_cache_entry *cache_entry =
+         &cache->matrices[(cache_key ^ explicit_stride ^
+                           (explicit_alignment << 4)) %
+                          MATRIX_CACHE_SIZE];
+      if (cache_entry->type && cache_entry->key == cache_key &&
+          cache_entry->explicit_stride == explicit_stride &&
+          cache_entry->explicit_alignment == explicit_alignment)
+         return cache_entry->type;
+
       const glsl_type *bare_type = get_instance(base_type, rows, columns);
 
       assert(columns > 1 || (rows > 1 && !row_major));
@@ -717,6 +817,11 @@ glsl_type::get_instance(unsigned base_type, unsigned rows, unsigned columns,
 
       mtx_unlock(&glsl_type::hash_mutex);
 
+      cache_entry->key = cache_key;
+      cache_entry->explicit_stride = explicit_stride;
+      cache_entry->explicit_alignment = explicit_alignment;
+      cache_entry->type = t;
+
       return t;
    }
 
@@ -1115,6 +1220,15 @@ glsl_type::get_array_instance(const glsl_type *base,
                               unsigned array_size,
                               unsigned explicit_stride)
 {
+   struct glsl_type_cache *cache = get_type_cache();
+   struct array_cache_entry *cache_entry =
+      &cache->arrays[(_mesa_hash_pointer(base) ^ array_size ^
+                      (explicit_stride << 8)) % ARRAY_CACHE_SIZE];
+   if (cache_entry->type && cache_entry->base == base &&
+       cache_entry->length == array_size &&
+       cache_entry->explicit_stride == explicit_stride)
+      return cache_entry->type;
+
    /* Generate a name using the base type pointer in the key.  This is
     * done because the name of the base type may not be unique across
     * shaders.  For example, two shaders may have different record types
@@ -1149,6 +1263,11 @@ glsl_type::get_array_instance(const glsl_type *base,
 
    mtx_unlock(&glsl_type::hash_mutex);
 
+   cache_entry->base = base;
+   cache_entry->length = array_size;
+   cache_entry->explicit_stride = explicit_stride;
+   cache_entry->type = t;
+
    return t;
 }
 
@@ -1332,6 +1451,13 @@ glsl_type::get_struct_instance(const glsl_struct_field *fields,
                                bool packed, unsigned explicit_alignment)
 {
    const glsl_type key(fields, num_fields, name, packed, explicit_alignment);
+   const uint32_t hash = record_key_hash(&key);
+
+   struct glsl_type_cache *cache = get_type_cache();
+   struct record_cache_entry *cache_entry =
+      record_cache_lookup(cache->structs, hash, &key, record_key_compare);
+   if (cache_entry)
+      return cache_entry->type;
 
    mtx_lock(&glsl_type::hash_mutex);
    assert(glsl_type_users > 0);
@@ -1341,13 +1467,14 @@ glsl_type::get_struct_instance(const glsl_struct_field *fields,
                                              record_key_compare);
    }
 
-   const struct hash_entry *entry = _mesa_hash_table_search(struct_types,
-                                                            &key);
+   const struct hash_entry *entry =
+      _mesa_hash_table_search_pre_hashed(struct_types, hash, &key);
    if (entry == NULL) {
       const glsl_type *t = new glsl_type(fields, num_fields, name, packed,
                                          explicit_alignment);
 
-      entry = _mesa_hash_table_insert(struct_types, t, (void *) t);
+      entry = _mesa_hash_table_insert_pre_hashed(struct_types, hash,
+                                                 t, (void *) t);
    }
 
    assert(((glsl_type *) entry->data)->base_type == GLSL_TYPE_STRUCT);
@@ -1360,6 +1487,8 @@ glsl_type::get_struct_instance(const glsl_struct_field *fields,
 
    mtx_unlock(&glsl_type::hash_mutex);
 
+   record_cache_add(cache->structs, hash, t);
+
    return t;
 }
 
@@ -1372,6 +1501,13 @@ glsl_type::get_interface_instance(const glsl_struct_field *fields,
                                   const char *block_name)
 {
    const glsl_type key(fields, num_fields, packing, row_major, block_name);
+   const uint32_t hash = record_key_hash(&key);
+
+   struct glsl_type_cache *cache = get_type_cache();
+   struct record_cache_entry *cache_entry =
+      record_cache_lookup(cache->interfaces, hash, &key, record_key_compare);
+   if (cache_entry)
+      return cache_entry->type;
 
    mtx_lock(&glsl_type::hash_mutex);
    assert(glsl_type_users > 0);
@@ -1381,13 +1517,14 @@ glsl_type::get_interface_instance(const glsl_struct_field *fields,
                                                 record_key_compare);
    }
 
-   const struct hash_entry *entry = _mesa_hash_table_search(interface_types,
-                                                            &key);
+   const struct hash_entry *entry =
+      _mesa_hash_table_search_pre_hashed(interface_types, hash, &key);
    if (entry == NULL) {
       const glsl_type *t = new glsl_type(fields, num_fields,
                                          packing, row_major, block_name);
 
-      entry = _mesa_hash_table_insert(interface_types, t, (void *) t);
+      entry = _mesa_hash_table_insert_pre_hashed(interface_types, hash,
+                                                 t, (void *) t);
    }
 
    assert(((glsl_type *) entry->data)->base_type == GLSL_TYPE_INTERFACE);
@@ -1398,6 +1535,8 @@ glsl_type::get_interface_instance(const glsl_struct_field *fields,
 
    mtx_unlock(&glsl_type::hash_mutex);
 
+   record_cache_add(cache->interfaces, hash, t);
+
    return t;
 }
 
@@ -1405,6 +1544,13 @@ const glsl_type *
 glsl_type::get_subroutine_instance(const char *subroutine_name)
 {
    const glsl_type key(subroutine_name);
+   const uint32_t hash = record_key_hash(&key);
+
+   struct glsl_type_cache *cache = get_type_cache();
+   struct record_cache_entry *cache_entry =
+      record_cache_lookup(cache->subroutines, hash, &key, record_key_compare);
+   if (cache_entry)
+      return cache_entry->type;
 
    mtx_lock(&glsl_type::hash_mutex);
    assert(glsl_type_users > 0);
@@ -1414,12 +1560,13 @@ glsl_type::get_subroutine_instance(const char *subroutine_name)
                                                  record_key_compare);
    }
 
-   const struct hash_entry *entry = _mesa_hash_table_search(subroutine_types,
-                                                            &key);
+   const struct hash_entry *entry =
+      _mesa_hash_table_search_pre_hashed(subroutine_types, hash, &key);
    if (entry == NULL) {
       const glsl_type *t = new glsl_type(subroutine_name);
 
-      entry = _mesa_hash_table_insert(subroutine_types, t, (void *) t);
+      entry = _mesa_hash_table_insert_pre_hashed(subroutine_types, hash,
+                                                 t, (void *) t);
    }
 
    assert(((glsl_type *) entry->data)->base_type == GLSL_TYPE_SUBROUTINE);
@@ -1429,6 +1576,8 @@ glsl_type::get_subroutine_instance(const char *subroutine_name)
 
    mtx_unlock(&glsl_type::hash_mutex);
 
+   record_cache_add(cache->subroutines, hash, t);
+
    return t;
 }
 
@@ -1461,6 +1610,13 @@ glsl_type::get_function_instance(const glsl_type *return_type,
                                  unsigned num_params)
 {
    const glsl_type key(return_type, params, num_params);
+   const uint32_t hash = function_key_hash(&key);
+
+   struct glsl_type_cache *cache = get_type_cache();
+   struct record_cache_entry *cache_entry =
+      record_cache_lookup(cache->functions, hash, &key, function_key_compare);
+   if (cache_entry)
+      return cache_entry->type;
 
    mtx_lock(&glsl_type::hash_mutex);
    assert(glsl_type_users > 0);
@@ -1470,11 +1626,13 @@ glsl_type::get_function_instance(const glsl_type *return_type,
                                                function_key_compare);
    }
 
-   struct hash_entry *entry = _mesa_hash_table_search(function_types, &key);
+   struct hash_entry *entry =
+      _mesa_hash_table_search_pre_hashed(function_types, hash, &key);
    if (entry == NULL) {
       const glsl_type *t = new glsl_type(return_type, params, num_params);
 
-      entry = _mesa_hash_table_insert(function_types, t, (void *) t);
+      entry = _mesa_hash_table_insert_pre_hashed(function_types, hash,
+                                                 t, (void *) t);
    }
 
    const glsl_type *t = (const glsl_type *)entry->data;
@@ -1484,6 +1642,8 @@ glsl_type::get_function_instance(const glsl_type *return_type,
 
    mtx_unlock(&glsl_type::hash_mutex);
 
+   record_cache_add(cache->functions, hash, t);
+
    return t;
 }
 
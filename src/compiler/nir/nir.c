@@ -106,6 +106,8 @@ nir_shader_create(void *mem_ctx,
 {
    nir_shader *shader = rzalloc(mem_ctx, nir_shader);
 
+   shader->gctx = gc_context(shader);
+
    exec_list_make_empty(&shader->variables);
 
    shader->options = options;
@@ -279,6 +281,9 @@ nir_function_create(nir_shader *shader, const char *name)
 
 /* NOTE: if the instruction you are copying a src to is already added
  * to the IR, use nir_instr_rewrite_src() instead.
+ *
+ * mem_ctx is the nir_instr or nir_if owning dest, indirects are allocated
+ * next to it.
  */
 void nir_src_copy(nir_src *dest, const nir_src *src, void *mem_ctx)
 {
@@ -289,7 +294,7 @@ void nir_src_copy(nir_src *dest, const nir_src *src, void *mem_ctx)
       dest->reg.base_offset = src->reg.base_offset;
       dest->reg.reg = src->reg.reg;
       if (src->reg.indirect) {
-         dest->reg.indirect = ralloc(mem_ctx, nir_src);
+         dest->reg.indirect = gc_alloc(gc_get_context(mem_ctx), nir_src, 1);
          nir_src_copy(dest->reg.indirect, src->reg.indirect, mem_ctx);
       } else {
          dest->reg.indirect = NULL;
@@ -307,7 +312,7 @@ void nir_dest_copy(nir_dest *dest, const nir_dest *src, nir_instr *instr)
    dest->reg.base_offset = src->reg.base_offset;
    dest->reg.reg = src->reg.reg;
    if (src->reg.indirect) {
-      dest->reg.indirect = ralloc(instr, nir_src);
+      dest->reg.indirect = gc_alloc(gc_get_context(instr), nir_src, 1);
       nir_src_copy(dest->reg.indirect, src->reg.indirect, instr);
    } else {
       dest->reg.indirect = NULL;
@@ -409,6 +414,8 @@ nir_block_create(nir_shader *shader)
 
    cf_init(&block->cf_node, nir_cf_node_block);
 
+   block->shader = shader;
+
    block->successors[0] = block->successors[1] = NULL;
    block->predecessors = _mesa_pointer_set_create(block);
    block->imm_dom = NULL;
@@ -439,7 +446,7 @@ src_init(nir_src *src)
 nir_if *
 nir_if_create(nir_shader *shader)
 {
-   nir_if *if_stmt = ralloc(shader, nir_if);
+   nir_if *if_stmt = gc_alloc(shader->gctx, nir_if, 1);
 
    if_stmt->control = nir_selection_control_none;
 
@@ -517,10 +524,11 @@ nir_alu_instr *
 nir_alu_instr_create(nir_shader *shader, nir_op op)
 {
    unsigned num_srcs = nir_op_infos[op].num_inputs;
-   /* TODO: don't use rzalloc */
+   /* TODO: don't use gc_zalloc */
    nir_alu_instr *instr =
-      rzalloc_size(shader,
-                   sizeof(nir_alu_instr) + num_srcs * sizeof(nir_alu_src));
+      gc_zalloc_size(shader->gctx,
+                     sizeof(nir_alu_instr) + num_srcs * sizeof(nir_alu_src),
+                     alignof(nir_alu_instr));
 
    instr_init(&instr->instr, nir_instr_type_alu);
    instr->op = op;
@@ -534,8 +542,7 @@ nir_alu_instr_create(nir_shader *shader, nir_op op)
 nir_deref_instr *
 nir_deref_instr_create(nir_shader *shader, nir_deref_type deref_type)
 {
-   nir_deref_instr *instr =
-      rzalloc_size(shader, sizeof(nir_deref_instr));
+   nir_deref_instr *instr = gc_zalloc(shader->gctx, nir_deref_instr, 1);
 
    instr_init(&instr->instr, nir_instr_type_deref);
 
@@ -555,7 +562,7 @@ nir_deref_instr_create(nir_shader *shader, nir_deref_type deref_type)
 nir_jump_instr *
 nir_jump_instr_create(nir_shader *shader, nir_jump_type type)
 {
-   nir_jump_instr *instr = ralloc(shader, nir_jump_instr);
+   nir_jump_instr *instr = gc_alloc(shader->gctx, nir_jump_instr, 1);
    instr_init(&instr->instr, nir_instr_type_jump);
    src_init(&instr->condition);
    instr->type = type;
@@ -569,7 +576,9 @@ nir_load_const_instr_create(nir_shader *shader, unsigned num_components,
                             unsigned bit_size)
 {
    nir_load_const_instr *instr =
-      rzalloc_size(shader, sizeof(*instr) + num_components * sizeof(*instr->value));
+      gc_zalloc_size(shader->gctx,
+                     sizeof(*instr) + num_components * sizeof(*instr->value),
+                     alignof(nir_load_const_instr));
    instr_init(&instr->instr, nir_instr_type_load_const);
 
    nir_ssa_def_init(&instr->instr, &instr->def, num_components, bit_size, NULL);
@@ -581,10 +590,11 @@ nir_intrinsic_instr *
 nir_intrinsic_instr_create(nir_shader *shader, nir_intrinsic_op op)
 {
    unsigned num_srcs = nir_intrinsic_infos[op].num_srcs;
-   /* TODO: don't use rzalloc */
+   /* TODO: don't use gc_zalloc */
    nir_intrinsic_instr *instr =
-      rzalloc_size(shader,
-                  sizeof(nir_intrinsic_instr) + num_srcs * sizeof(nir_src));
+      gc_zalloc_size(shader->gctx,
+                     sizeof(nir_intrinsic_instr) + num_srcs * sizeof(nir_src),
+                     alignof(nir_intrinsic_instr));
 
    instr_init(&instr->instr, nir_instr_type_intrinsic);
    instr->intrinsic = op;
@@ -603,8 +613,9 @@ nir_call_instr_create(nir_shader *shader, nir_function *callee)
 {
    const unsigned num_params = callee->num_params;
    nir_call_instr *instr =
-      rzalloc_size(shader, sizeof(*instr) +
-                   num_params * sizeof(instr->params[0]));
+      gc_zalloc_size(shader->gctx,
+                     sizeof(*instr) + num_params * sizeof(instr->params[0]),
+                     alignof(nir_call_instr));
 
    instr_init(&instr->instr, nir_instr_type_call);
    instr->callee = callee;
@@ -626,13 +637,13 @@ static int8_t default_tg4_offsets[4][2] =
 nir_tex_instr *
 nir_tex_instr_create(nir_shader *shader, unsigned num_srcs)
 {
-   nir_tex_instr *instr = rzalloc(shader, nir_tex_instr);
+   nir_tex_instr *instr = gc_zalloc(shader->gctx, nir_tex_instr, 1);
    instr_init(&instr->instr, nir_instr_type_tex);
 
    dest_init(&instr->dest);
 
    instr->num_srcs = num_srcs;
-   instr->src = ralloc_array(instr, nir_tex_src, num_srcs);
+   instr->src = gc_alloc(shader->gctx, nir_tex_src, num_srcs);
    for (unsigned i = 0; i < num_srcs; i++)
       src_init(&instr->src[i].src);
 
@@ -648,8 +659,8 @@ nir_tex_instr_add_src(nir_tex_instr *tex,
                       nir_tex_src_type src_type,
                       nir_src src)
 {
-   nir_tex_src *new_srcs = rzalloc_array(tex, nir_tex_src,
-                                         tex->num_srcs + 1);
+   nir_tex_src *new_srcs = gc_zalloc(gc_get_context(tex), nir_tex_src,
+                                     tex->num_srcs + 1);
 
    for (unsigned i = 0; i < tex->num_srcs; i++) {
       new_srcs[i].src_type = tex->src[i].src_type;
@@ -657,7 +668,7 @@ nir_tex_instr_add_src(nir_tex_instr *tex,
                          &tex->src[i].src);
    }
 
-   ralloc_free(tex->src);
+   gc_free(tex->src);
    tex->src = new_srcs;
 
    tex->src[tex->num_srcs].src_type = src_type;
@@ -693,7 +704,7 @@ nir_tex_instr_has_explicit_tg4_offsets(nir_tex_instr *tex)
 nir_phi_instr *
 nir_phi_instr_create(nir_shader *shader)
 {
-   nir_phi_instr *instr = ralloc(shader, nir_phi_instr);
+   nir_phi_instr *instr = gc_alloc(shader->gctx, nir_phi_instr, 1);
    instr_init(&instr->instr, nir_instr_type_phi);
 
    dest_init(&instr->dest);
@@ -701,10 +712,34 @@ nir_phi_instr_create(nir_shader *shader)
    return instr;
 }
 
+/**
+ * Adds a new source to a NIR phi instruction.
+ *
+ * Note that this does not update the def/use relationship for src, assuming
+ * that the instr is not in the shader.  If it is, you have to do:
+ *
+ * list_addtail(&phi_src->src.use_link, &src.ssa->uses);
+ */
+nir_phi_src *
+nir_phi_instr_add_src(nir_phi_instr *instr, nir_block *pred, nir_src src)
+{
+   nir_phi_src *phi_src = gc_zalloc(gc_get_context(instr), nir_phi_src, 1);
+   phi_src->pred = pred;
+   phi_src->src = src;
+   phi_src->src.parent_instr = &instr->instr;
+   exec_list_push_tail(&instr->srcs, &phi_src->node);
+
+   nir_instr_mark_changed(&instr->instr,
+                          nir_change_phi | nir_src_change_class(&src));
+
+   return phi_src;
+}
+
 nir_parallel_copy_instr *
 nir_parallel_copy_instr_create(nir_shader *shader)
 {
-   nir_parallel_copy_instr *instr = ralloc(shader, nir_parallel_copy_instr);
+   nir_parallel_copy_instr *instr = gc_alloc(shader->gctx,
+                                             nir_parallel_copy_instr, 1);
    instr_init(&instr->instr, nir_instr_type_parallel_copy);
 
    exec_list_make_empty(&instr->entries);
@@ -717,7 +752,7 @@ nir_ssa_undef_instr_create(nir_shader *shader,
                            unsigned num_components,
                            unsigned bit_size)
 {
-   nir_ssa_undef_instr *instr = ralloc(shader, nir_ssa_undef_instr);
+   nir_ssa_undef_instr *instr = gc_alloc(shader->gctx, nir_ssa_undef_instr, 1);
    instr_init(&instr->instr, nir_instr_type_ssa_undef);
 
    nir_ssa_def_init(&instr->instr, &instr->def, num_components, bit_size, NULL);
@@ -858,14 +893,33 @@ nir_cursors_equal(nir_cursor a, nir_cursor b)
    return a.block == b.block && a.option == b.option;
 }
 
+/* Inserting or removing an instruction changes the instruction itself and
+ * the uses of everything it reads, see nir_instr_mark_changed().
+ */
+static nir_change_class
+instr_changes(nir_instr *instr)
+{
+   nir_change_class changes = (nir_change_class)(1 << instr->type);
+   if (instr->type == nir_instr_type_jump)
+      changes |= nir_change_cf;
+
+   return changes;
+}
+
+struct add_use_state {
+   nir_instr *instr;
+   nir_change_class changes;
+};
+
 static bool
-add_use_cb(nir_src *src, void *state)
+add_use_cb(nir_src *src, void *void_state)
 {
-   nir_instr *instr = state;
+   struct add_use_state *state = void_state;
 
-   src->parent_instr = instr;
+   src->parent_instr = state->instr;
    list_addtail(&src->use_link,
                 src->is_ssa ? &src->ssa->uses : &src->reg.reg->uses);
+   state->changes |= nir_src_change_class(src);
 
    return true;
 }
@@ -900,12 +954,19 @@ add_reg_def_cb(nir_dest *dest, void *state)
    return true;
 }
 
-static void
+static nir_change_class
 add_defs_uses(nir_instr *instr)
 {
-   nir_foreach_src(instr, add_use_cb, instr);
+   struct add_use_state state = {
+      .instr = instr,
+      .changes = instr_changes(instr),
+   };
+
+   nir_foreach_src(instr, add_use_cb, &state);
    nir_foreach_dest(instr, add_reg_def_cb, instr);
    nir_foreach_ssa_def(instr, add_ssa_def_cb, instr);
+
+   return state.changes;
 }
 
 void
@@ -918,7 +979,6 @@ nir_instr_insert(nir_cursor cursor, nir_instr *instr)
          assert(exec_list_is_empty(&cursor.block->instr_list));
 
       instr->block = cursor.block;
-      add_defs_uses(instr);
       exec_list_push_head(&cursor.block->instr_list, &instr->node);
       break;
    case nir_cursor_after_block: {
@@ -928,14 +988,12 @@ nir_instr_insert(nir_cursor cursor, nir_instr *instr)
       (void) last;
 
       instr->block = cursor.block;
-      add_defs_uses(instr);
       exec_list_push_tail(&cursor.block->instr_list, &instr->node);
       break;
    }
    case nir_cursor_before_instr:
       assert(instr->type != nir_instr_type_jump);
       instr->block = cursor.instr->block;
-      add_defs_uses(instr);
       exec_node_insert_node_before(&cursor.instr->node, &instr->node);
       break;
    case nir_cursor_after_instr:
@@ -947,16 +1005,19 @@ nir_instr_insert(nir_cursor cursor, nir_instr *instr)
          assert(cursor.instr == nir_block_last_instr(cursor.instr->block));
 
       instr->block = cursor.instr->block;
-      add_defs_uses(instr);
       exec_node_insert_after(&cursor.instr->node, &instr->node);
       break;
    }
 
+   const nir_change_class changes = add_defs_uses(instr);
+
    if (instr->type == nir_instr_type_jump)
       nir_handle_add_jump(instr->block);
 
    nir_function_impl *impl = nir_cf_node_get_function(&instr->block->cf_node);
    impl->valid_metadata &= ~nir_metadata_instr_index;
+
+   nir_shader_mark_changed(instr->block->shader, changes);
 }
 
 static bool
@@ -968,10 +1029,12 @@ src_is_valid(const nir_src *src)
 static bool
 remove_use_cb(nir_src *src, void *state)
 {
-   (void) state;
+   nir_change_class *changes = state;
 
-   if (src_is_valid(src))
+   if (src_is_valid(src)) {
       list_del(&src->use_link);
+      *changes |= nir_src_change_class(src);
+   }
 
    return true;
 }
@@ -987,16 +1050,21 @@ remove_def_cb(nir_dest *dest, void *state)
    return true;
 }
 
-static void
+static nir_change_class
 remove_defs_uses(nir_instr *instr)
 {
+   nir_change_class changes = instr_changes(instr);
+
    nir_foreach_dest(instr, remove_def_cb, instr);
-   nir_foreach_src(instr, remove_use_cb, instr);
+   nir_foreach_src(instr, remove_use_cb, &changes);
+
+   return changes;
 }
 
 void nir_instr_remove_v(nir_instr *instr)
 {
-   remove_defs_uses(instr);
+   nir_instr_mark_changed(instr, remove_defs_uses(instr));
+
    exec_node_remove(&instr->node);
 
    if (instr->type == nir_instr_type_jump) {
@@ -1005,6 +1073,74 @@ void nir_instr_remove_v(nir_instr *instr)
    }
 }
 
+static bool
+free_src_indirect(nir_src *src, UNUSED void *state)
+{
+   /* Clear the pointer too, nir_foreach_src() visits the indirect next. */
+   if (!src->is_ssa && src->reg.indirect) {
+      gc_free(src->reg.indirect);
+      src->reg.indirect = NULL;
+   }
+
+   return true;
+}
+
+static bool
+free_dest_indirect(nir_dest *dest, UNUSED void *state)
+{
+   if (!dest->is_ssa && dest->reg.indirect) {
+      gc_free(dest->reg.indirect);
+      dest->reg.indirect = NULL;
+   }
+
+   return true;
+}
+
+static bool
+free_ssa_def_name(nir_ssa_def *def, UNUSED void *state)
+{
+   gc_free((char *)def->name);
+   def->name = NULL;
+
+   return true;
+}
+
+void
+nir_instr_free(nir_instr *instr)
+{
+   nir_foreach_dest(instr, free_dest_indirect, NULL);
+   nir_foreach_src(instr, free_src_indirect, NULL);
+   nir_foreach_ssa_def(instr, free_ssa_def_name, NULL);
+
+   switch (instr->type) {
+   case nir_instr_type_tex:
+      gc_free(nir_instr_as_tex(instr)->src);
+      break;
+
+   case nir_instr_type_phi: {
+      nir_phi_instr *phi = nir_instr_as_phi(instr);
+      nir_foreach_phi_src_safe(phi_src, phi)
+         gc_free(phi_src);
+      break;
+   }
+
+   default:
+      break;
+   }
+
+   gc_free(instr);
+}
+
+void
+nir_instr_free_list(struct exec_list *list)
+{
+   struct exec_node *node;
+   while ((node = exec_list_pop_head(list))) {
+      nir_instr *removed_instr = exec_node_data(nir_instr, node, node);
+      nir_instr_free(removed_instr);
+   }
+}
+
 /*@}*/
 
 void
@@ -1515,6 +1651,10 @@ nir_instr_rewrite_src(nir_instr *instr, nir_src *src, nir_src new_src)
 {
    assert(!src_is_valid(src) || src->parent_instr == instr);
 
+   nir_instr_mark_changed(instr, (nir_change_class)(1 << instr->type) |
+                                 nir_src_change_class(src) |
+                                 nir_src_change_class(&new_src));
+
    src_remove_all_uses(src);
    *src = new_src;
    src_add_all_uses(src, instr, NULL);
@@ -1525,6 +1665,11 @@ nir_instr_move_src(nir_instr *dest_instr, nir_src *dest, nir_src *src)
 {
    assert(!src_is_valid(dest) || dest->parent_instr == dest_instr);
 
+   nir_instr_mark_changed(dest_instr,
+                          (nir_change_class)(1 << dest_instr->type) |
+                          nir_src_change_class(dest) |
+                          nir_src_change_class(src));
+
    src_remove_all_uses(dest);
    src_remove_all_uses(src);
    *dest = *src;
@@ -1538,6 +1683,10 @@ nir_if_rewrite_condition(nir_if *if_stmt, nir_src new_src)
    nir_src *src = &if_stmt->condition;
    assert(!src_is_valid(src) || src->parent_if == if_stmt);
 
+   nir_cf_node_mark_changed(&if_stmt->cf_node,
+                            nir_change_cf | nir_src_change_class(src) |
+                            nir_src_change_class(&new_src));
+
    src_remove_all_uses(src);
    *src = new_src;
    src_add_all_uses(src, NULL, if_stmt);
@@ -1558,6 +1707,9 @@ nir_instr_rewrite_dest(nir_instr *instr, nir_dest *dest, nir_dest new_dest)
    /* We can't re-write with an SSA def */
    assert(!new_dest.is_ssa);
 
+   /* Register defs aren't tracked per instruction type. */
+   nir_instr_mark_changed(instr, nir_change_all);
+
    nir_dest_copy(dest, &new_dest, instr);
 
    dest->reg.parent_instr = instr;
@@ -1573,7 +1725,14 @@ nir_ssa_def_init(nir_instr *instr, nir_ssa_def *def,
                  unsigned num_components,
                  unsigned bit_size, const char *name)
 {
-   def->name = ralloc_strdup(instr, name);
+   if (name) {
+      size_t len = strlen(name) + 1;
+      char *copy = gc_alloc(gc_get_context(instr), char, len);
+      memcpy(copy, name, len);
+      def->name = copy;
+   } else {
+      def->name = NULL;
+   }
    def->parent_instr = instr;
    list_inithead(&def->uses);
    list_inithead(&def->if_uses);
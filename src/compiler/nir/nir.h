@@ -2661,6 +2661,9 @@ typedef struct nir_block {
     */
    BITSET_WORD *live_in;
    BITSET_WORD *live_out;
+
+   /** The shader the block belongs to, for nir_instr_mark_changed() */
+   struct nir_shader *shader;
 } nir_block;
 
 static inline bool
@@ -2875,6 +2878,32 @@ typedef enum {
 } nir_metadata;
 MESA_DEFINE_CPP_ENUM_BITFIELD_OPERATORS(nir_metadata)
 
+/**
+ * Kinds of IR whose changes are tracked for NIR_LOOP_PASS()
+ *
+ * There is one class per nir_instr_type plus one for control flow.  An
+ * instruction counts as changed when it is inserted, removed or has a source
+ * rewritten, and also when the list of uses of one of its SSA defs changes.
+ */
+typedef enum {
+   nir_change_alu = (1 << nir_instr_type_alu),
+   nir_change_deref = (1 << nir_instr_type_deref),
+   nir_change_call = (1 << nir_instr_type_call),
+   nir_change_tex = (1 << nir_instr_type_tex),
+   nir_change_intrinsic = (1 << nir_instr_type_intrinsic),
+   nir_change_load_const = (1 << nir_instr_type_load_const),
+   nir_change_jump = (1 << nir_instr_type_jump),
+   nir_change_ssa_undef = (1 << nir_instr_type_ssa_undef),
+   nir_change_phi = (1 << nir_instr_type_phi),
+   nir_change_parallel_copy = (1 << nir_instr_type_parallel_copy),
+   nir_change_cf = (1 << (nir_instr_type_parallel_copy + 1)),
+
+   nir_change_all = (1 << (nir_instr_type_parallel_copy + 2)) - 1,
+} nir_change_class;
+MESA_DEFINE_CPP_ENUM_BITFIELD_OPERATORS(nir_change_class)
+
+#define NIR_NUM_CHANGE_CLASSES (nir_instr_type_parallel_copy + 2)
+
 typedef struct {
    nir_cf_node cf_node;
 
@@ -3453,6 +3482,20 @@ typedef struct nir_shader {
 
    unsigned printf_info_count;
    nir_printf_info *printf_info;
+
+   /** Allocator for instructions, nir_ifs and the memory hanging off them
+    * (tex sources, phi sources, indirects and SSA def names).  Those can't
+    * be used as ralloc contexts.
+    */
+   gc_ctx *gctx;
+
+   /** Change tracking for NIR_LOOP_PASS(), see nir_shader_mark_changed().
+    *
+    * change_seq is bumped on every change and class_change_seq holds its
+    * value at the last change to each nir_change_class.
+    */
+   uint32_t change_seq;
+   uint32_t class_change_seq[NIR_NUM_CHANGE_CLASSES];
 } nir_shader;
 
 #define nir_foreach_function(func, shader) \
@@ -3558,6 +3601,44 @@ void nir_metadata_preserve(nir_function_impl *impl, nir_metadata preserved);
 /** Preserves all metadata for the given shader */
 void nir_shader_preserve_all_metadata(nir_shader *shader);
 
+/** records a change to the given classes of IR for NIR_LOOP_PASS() */
+static inline void
+nir_shader_mark_changed(nir_shader *shader, nir_change_class changes)
+{
+   unsigned mask = changes & nir_change_all;
+   if (!mask)
+      return;
+
+   shader->change_seq++;
+   while (mask) {
+      const int i = u_bit_scan(&mask);
+      shader->class_change_seq[i] = shader->change_seq;
+   }
+}
+
+/** nir_shader_mark_changed() for the shader the CF node is in, if any */
+void nir_cf_node_mark_changed(nir_cf_node *node, nir_change_class changes);
+
+/** nir_shader_mark_changed() for the shader the instruction is in, if any */
+static inline void
+nir_instr_mark_changed(nir_instr *instr, nir_change_class changes)
+{
+   if (instr->block)
+      nir_shader_mark_changed(instr->block->shader, changes);
+}
+
+/** Returns the change class of an SSA value's parent instruction. */
+static inline nir_change_class
+nir_src_change_class(const nir_src *src)
+{
+   if (src->is_ssa)
+      return src->ssa ? (nir_change_class)(1 << src->ssa->parent_instr->type) :
+                        (nir_change_class)0;
+
+   /* Register uses aren't tracked per instruction type. */
+   return src->reg.reg ? nir_change_all : (nir_change_class)0;
+}
+
 /** creates an instruction with default swizzle/writemask/etc. with NULL registers */
 nir_alu_instr *nir_alu_instr_create(nir_shader *shader, nir_op op);
 
@@ -3579,6 +3660,8 @@ nir_call_instr *nir_call_instr_create(nir_shader *shader,
 nir_tex_instr *nir_tex_instr_create(nir_shader *shader, unsigned num_srcs);
 
 nir_phi_instr *nir_phi_instr_create(nir_shader *shader);
+nir_phi_src *nir_phi_instr_add_src(nir_phi_instr *instr, nir_block *pred,
+                                   nir_src src);
 
 nir_parallel_copy_instr *nir_parallel_copy_instr_create(nir_shader *shader);
 
@@ -3831,6 +3914,10 @@ nir_instr_remove(nir_instr *instr)
 
 /** @} */
 
+/** Frees an instruction that was removed from the IR, or never inserted. */
+void nir_instr_free(nir_instr *instr);
+void nir_instr_free_list(struct exec_list *list);
+
 nir_ssa_def *nir_instr_ssa_def(nir_instr *instr);
 
 typedef bool (*nir_foreach_ssa_def_cb)(nir_ssa_def *def, void *state);
@@ -3864,11 +3951,14 @@ bool nir_srcs_equal(nir_src src1, nir_src src2);
 bool nir_instrs_equal(const nir_instr *instr1, const nir_instr *instr2);
 
 static inline void
-nir_instr_rewrite_src_ssa(ASSERTED nir_instr *instr,
+nir_instr_rewrite_src_ssa(nir_instr *instr,
                           nir_src *src, nir_ssa_def *new_ssa)
 {
    assert(src->parent_instr == instr);
    assert(src->is_ssa && src->ssa);
+   nir_instr_mark_changed(instr, (nir_change_class)(1 << instr->type) |
+                                 nir_src_change_class(src) |
+                                 (nir_change_class)(1 << new_ssa->parent_instr->type));
    list_del(&src->use_link);
    src->ssa = new_ssa;
    list_addtail(&src->use_link, &new_ssa->uses);
@@ -3878,11 +3968,14 @@ void nir_instr_rewrite_src(nir_instr *instr, nir_src *src, nir_src new_src);
 void nir_instr_move_src(nir_instr *dest_instr, nir_src *dest, nir_src *src);
 
 static inline void
-nir_if_rewrite_condition_ssa(ASSERTED nir_if *if_stmt,
+nir_if_rewrite_condition_ssa(nir_if *if_stmt,
                              nir_src *src, nir_ssa_def *new_ssa)
 {
    assert(src->parent_if == if_stmt);
    assert(src->is_ssa && src->ssa);
+   nir_cf_node_mark_changed(&if_stmt->cf_node,
+                            nir_change_cf | nir_src_change_class(src) |
+                            (nir_change_class)(1 << new_ssa->parent_instr->type));
    list_del(&src->use_link);
    src->ssa = new_ssa;
    list_addtail(&src->use_link, &new_ssa->if_uses);
@@ -4086,6 +4179,11 @@ static inline bool should_serialize_deserialize_nir(void) { return false; }
 static inline bool should_print_nir(nir_shader *shader) { return false; }
 #endif /* NDEBUG */
 
+bool nir_pass_stats_enabled(void);
+int64_t nir_pass_stats_start(void);
+void nir_pass_stats_end(const char *pass_name, int64_t start, bool progress);
+void nir_pass_stats_skip(const char *pass_name);
+
 #define _PASS(pass, nir, do_pass) do {                               \
    if (should_skip_nir(#pass)) {                                     \
       printf("skipping %s\n", #pass);                                \
@@ -4105,7 +4203,12 @@ static inline bool should_print_nir(nir_shader *shader) { return false; }
    nir_metadata_set_validation_flag(nir);                            \
    if (should_print_nir(nir))                                           \
       printf("%s\n", #pass);                                         \
-   if (pass(nir, ##__VA_ARGS__)) {                                   \
+   const int64_t _nir_pass_start =                                  \
+      nir_pass_stats_enabled() ? nir_pass_stats_start() : 0;        \
+   const bool _nir_pass_progress = pass(nir, ##__VA_ARGS__);         \
+   if (nir_pass_stats_enabled())                                     \
+      nir_pass_stats_end(#pass, _nir_pass_start, _nir_pass_progress); \
+   if (_nir_pass_progress) {                                         \
       nir_validate_shader(nir, "after " #pass);                      \
       progress = true;                                               \
       if (should_print_nir(nir))                                        \
@@ -4117,12 +4220,47 @@ static inline bool should_print_nir(nir_shader *shader) { return false; }
 #define NIR_PASS_V(nir, pass, ...) _PASS(pass, nir,                  \
    if (should_print_nir(nir))                                           \
       printf("%s\n", #pass);                                         \
+   const int64_t _nir_pass_start =                                  \
+      nir_pass_stats_enabled() ? nir_pass_stats_start() : 0;        \
    pass(nir, ##__VA_ARGS__);                                         \
+   if (nir_pass_stats_enabled())                                     \
+      nir_pass_stats_end(#pass, _nir_pass_start, false);             \
    nir_validate_shader(nir, "after " #pass);                         \
    if (should_print_nir(nir))                                           \
       nir_print_shader(nir, stdout);                                 \
 )
 
+bool nir_loop_pass_should_run(struct hash_table *skip, const void *site,
+                              nir_shader *shader, nir_change_class changes);
+void nir_loop_pass_finish(struct hash_table *skip, const void *site,
+                          nir_shader *shader, nir_change_class changes,
+                          uint32_t change_seq, bool progress);
+
+/**
+ * NIR_PASS() for optimization loops which run until nothing makes progress
+ *
+ * The pass is skipped when it already ran at this spot without progress and
+ * none of the classes of IR in "changes" changed since then.  "changes" has
+ * to cover everything the pass looks at, and the extra arguments must stay
+ * the same for as long as "skip" is used.  "skip" is a pointer hash table
+ * from _mesa_pointer_hash_table_create() that the loop owns.
+ */
+#define NIR_LOOP_PASS(progress, skip, nir, changes, pass, ...) do {     \
+   static char _nir_loop_pass_site;                                    \
+   if (nir_loop_pass_should_run(skip, &_nir_loop_pass_site,            \
+                                nir, changes)) {                       \
+      bool _nir_loop_pass_progress = false;                            \
+      const uint32_t _nir_loop_pass_seq = (nir)->change_seq;           \
+      NIR_PASS(_nir_loop_pass_progress, nir, pass, ##__VA_ARGS__);     \
+      nir_loop_pass_finish(skip, &_nir_loop_pass_site, nir, changes,   \
+                           _nir_loop_pass_seq, _nir_loop_pass_progress); \
+      if (_nir_loop_pass_progress)                                     \
+         progress = true;                                              \
+   } else if (nir_pass_stats_enabled()) {                              \
+      nir_pass_stats_skip(#pass);                                      \
+   }                                                                   \
+} while (0)
+
 #define NIR_SKIP(name) should_skip_nir(#name)
 
 /** An instruction filtering callback
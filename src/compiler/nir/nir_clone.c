@@ -244,7 +244,7 @@ __clone_src(clone_state *state, void *ninstr_or_if,
    } else {
       nsrc->reg.reg = remap_reg(state, src->reg.reg);
       if (src->reg.indirect) {
-         nsrc->reg.indirect = ralloc(ninstr_or_if, nir_src);
+         nsrc->reg.indirect = gc_alloc(state->ns->gctx, nir_src, 1);
          __clone_src(state, ninstr_or_if, nsrc->reg.indirect, src->reg.indirect);
       }
       nsrc->reg.base_offset = src->reg.base_offset;
@@ -264,7 +264,7 @@ __clone_dst(clone_state *state, nir_instr *ninstr,
    } else {
       ndst->reg.reg = remap_reg(state, dst->reg.reg);
       if (dst->reg.indirect) {
-         ndst->reg.indirect = ralloc(ninstr, nir_src);
+         ndst->reg.indirect = gc_alloc(state->ns->gctx, nir_src, 1);
          __clone_src(state, ninstr, ndst->reg.indirect, dst->reg.indirect);
       }
       ndst->reg.base_offset = dst->reg.base_offset;
@@ -448,7 +448,7 @@ clone_phi(clone_state *state, const nir_phi_instr *phi, nir_block *nblk)
    nir_instr_insert_after_block(nblk, &nphi->instr);
 
    foreach_list_typed(nir_phi_src, src, node, &phi->srcs) {
-      nir_phi_src *nsrc = ralloc(nphi, nir_phi_src);
+      nir_phi_src *nsrc = gc_alloc(state->ns->gctx, nir_phi_src, 1);
 
       /* Just copy the old source for now. */
       memcpy(nsrc, src, sizeof(*src));
@@ -805,8 +805,16 @@ nir_shader_replace(nir_shader *dst, nir_shader *src)
    /* Re-parent all of src's ralloc children to dst */
    ralloc_adopt(dst, src);
 
+   /* NIR_LOOP_PASS() state refers to dst's change tracking, so keep it. */
+   uint32_t class_change_seq[NIR_NUM_CHANGE_CLASSES];
+   const uint32_t change_seq = dst->change_seq;
+   memcpy(class_change_seq, dst->class_change_seq, sizeof(class_change_seq));
+
    memcpy(dst, src, sizeof(*dst));
 
+   dst->change_seq = change_seq;
+   memcpy(dst->class_change_seq, class_change_seq, sizeof(class_change_seq));
+
    /* We have to move all the linked lists over separately because we need the
     * pointers in the list elements to point to the lists in dst and not src.
     */
@@ -814,8 +822,13 @@ nir_shader_replace(nir_shader *dst, nir_shader *src)
 
    /* Now move the functions over.  This takes a tiny bit more work */
    exec_list_move_nodes_to(&src->functions, &dst->functions);
-   nir_foreach_function(function, dst)
+   nir_foreach_function(function, dst) {
       function->shader = dst;
+      if (function->impl) {
+         nir_foreach_block(block, function->impl)
+            block->shader = dst;
+      }
+   }
 
    ralloc_free(src);
 }
@@ -236,19 +236,13 @@ nir_insert_phi_undef(nir_block *block, nir_block *pred)
 
       nir_phi_instr *phi = nir_instr_as_phi(instr);
       nir_ssa_undef_instr *undef =
-         nir_ssa_undef_instr_create(ralloc_parent(phi),
+         nir_ssa_undef_instr_create(impl->function->shader,
                                     phi->dest.ssa.num_components,
                                     phi->dest.ssa.bit_size);
       nir_instr_insert_before_cf_list(&impl->body, &undef->instr);
-      nir_phi_src *src = ralloc(phi, nir_phi_src);
-      src->pred = pred;
-      src->src.parent_instr = &phi->instr;
-      src->src.is_ssa = true;
-      src->src.ssa = &undef->def;
-
+      nir_phi_src *src = nir_phi_instr_add_src(phi, pred,
+                                               nir_src_for_ssa(&undef->def));
       list_addtail(&src->src.use_link, &undef->def.uses);
-
-      exec_list_push_tail(&phi->srcs, &src->node);
    }
 }
 
@@ -608,6 +602,11 @@ nir_cf_node_insert(nir_cursor cursor, nir_cf_node *node)
       update_if_uses(node);
       insert_non_block(before, node, after);
    }
+
+   /* Instructions built into the node before it was inserted weren't
+    * tracked.
+    */
+   nir_cf_node_mark_changed(node, nir_change_all);
 }
 
 static bool
@@ -716,6 +715,7 @@ nir_cf_extract(nir_cf_list *extracted, nir_cursor begin, nir_cursor end)
 
    /* Dominance and other block-related information is toast. */
    nir_metadata_preserve(extracted->impl, nir_metadata_none);
+   nir_cf_node_mark_changed(&extracted->impl->cf_node, nir_change_all);
 
    nir_cf_node *cf_node = &block_begin->cf_node;
    nir_cf_node *cf_node_end = &block_end->cf_node;
@@ -809,6 +809,9 @@ nir_cf_reinsert(nir_cf_list *cf_list, nir_cursor cursor)
                  nir_cf_node_as_block(nir_cf_node_next(&before->cf_node)));
    stitch_blocks(nir_cf_node_as_block(nir_cf_node_prev(&after->cf_node)),
                  after);
+
+   /* Changes made to the list while it was extracted weren't tracked. */
+   nir_cf_node_mark_changed(&cursor_impl->cf_node, nir_change_all);
 }
 
 void
@@ -817,4 +820,7 @@ nir_cf_delete(nir_cf_list *cf_list)
    foreach_list_typed(nir_cf_node, node, node, &cf_list->list) {
       cleanup_cf_node(node, cf_list->impl);
    }
+
+   if (cf_list->impl)
+      nir_cf_node_mark_changed(&cf_list->impl->cf_node, nir_change_all);
 }
@@ -58,6 +58,10 @@ nir_metadata_require(nir_function_impl *impl, nir_metadata required, ...)
 void
 nir_metadata_preserve(nir_function_impl *impl, nir_metadata preserved)
 {
+   /* Passes only throw away block indices when they change control flow. */
+   if (!(preserved & nir_metadata_block_index))
+      nir_cf_node_mark_changed(&impl->cf_node, nir_change_cf);
+
    impl->valid_metadata &= preserved;
 }
 
@@ -70,6 +74,73 @@ nir_shader_preserve_all_metadata(nir_shader *shader)
    }
 }
 
+/*
+ * Tracks which classes of IR changed for NIR_LOOP_PASS().
+ */
+
+void
+nir_cf_node_mark_changed(nir_cf_node *node, nir_change_class changes)
+{
+   /* Control flow which was extracted or not inserted yet has no parent,
+    * and impls being cloned have no function yet.  Nothing is tracked for
+    * either, inserting them marks everything as changed.
+    */
+   while (node && node->type != nir_cf_node_function)
+      node = node->parent;
+
+   if (node) {
+      nir_function_impl *impl = nir_cf_node_as_function(node);
+      if (impl->function)
+         nir_shader_mark_changed(impl->function->shader, changes);
+   }
+}
+
+/**
+ * Decides whether NIR_LOOP_PASS() has to run the pass at the given call site.
+ *
+ * The skip table maps call sites to the shader's change_seq at the last run
+ * which made no progress.
+ */
+bool
+nir_loop_pass_should_run(struct hash_table *skip, const void *site,
+                         nir_shader *shader, nir_change_class changes)
+{
+   struct hash_entry *entry = _mesa_hash_table_search(skip, site);
+   if (!entry)
+      return true;
+
+   const uint32_t last_run = (uintptr_t)entry->data;
+   unsigned mask = changes & nir_change_all;
+   while (mask) {
+      const int i = u_bit_scan(&mask);
+      if (shader->class_change_seq[i] > last_run)
+         return true;
+   }
+
+   return false;
+}
+
+void
+nir_loop_pass_finish(struct hash_table *skip, const void *site,
+                     nir_shader *shader, nir_change_class changes,
+                     uint32_t change_seq, bool progress)
+{
+   if (progress) {
+      /* Passes also change instructions in place, which isn't tracked.
+       * Assume they only touch what they look at, and if nothing tracked
+       * changed at all, assume everything did.
+       */
+      if (shader->change_seq == change_seq)
+         changes = nir_change_all;
+
+      nir_shader_mark_changed(shader, changes);
+      _mesa_hash_table_remove_key(skip, site);
+   } else {
+      _mesa_hash_table_insert(skip, site,
+                              (void *)(uintptr_t)shader->change_seq);
+   }
+}
+
 #ifndef NDEBUG
 /**
  * Make sure passes properly invalidate metadata (part 1).
@@ -136,15 +136,24 @@ nir_opt_dce_impl(nir_function_impl *impl)
 
    bool progress = false;
 
+   /* Dead instructions can still use each other, so only free them once all
+    * of them are out of the use lists.
+    */
+   struct exec_list dead_instrs;
+   exec_list_make_empty(&dead_instrs);
+
    nir_foreach_block(block, impl) {
       nir_foreach_instr_safe(instr, block) {
          if (!instr->pass_flags) {
             nir_instr_remove(instr);
+            exec_list_push_tail(&dead_instrs, &instr->node);
             progress = true;
          }
       }
    }
 
+   nir_instr_free_list(&dead_instrs);
+
    if (progress) {
       nir_metadata_preserve(impl, nir_metadata_block_index |
                                   nir_metadata_dominance);
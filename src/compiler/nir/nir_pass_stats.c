@@ -0,0 +1,147 @@
+/*
+ * Copyright © 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "nir.h"
+#include "util/debug.h"
+#include "util/os_time.h"
+#include "util/simple_mtx.h"
+
+/*
+ * Per-pass statistics for NIR_PASS_STATS.
+ *
+ * NIR_PASS(), NIR_PASS_V() and NIR_LOOP_PASS() record every run, and the
+ * totals are printed to stderr when the process exits.
+ */
+
+struct pass_stats {
+   const char *name;
+   unsigned runs;
+   unsigned progress;
+   unsigned skipped;
+   int64_t time_ns;
+};
+
+static struct hash_table *pass_stats_table;
+static simple_mtx_t pass_stats_lock = _SIMPLE_MTX_INITIALIZER_NP;
+
+static int
+compare_pass_time(const void *a, const void *b)
+{
+   const struct pass_stats *sa = *(const struct pass_stats **)a;
+   const struct pass_stats *sb = *(const struct pass_stats **)b;
+
+   if (sa->time_ns != sb->time_ns)
+      return sa->time_ns < sb->time_ns ? 1 : -1;
+
+   return strcmp(sa->name, sb->name);
+}
+
+static void
+pass_stats_print(void)
+{
+   simple_mtx_lock(&pass_stats_lock);
+
+   const unsigned count = pass_stats_table->entries;
+   struct pass_stats **stats = malloc(count * sizeof(*stats));
+   unsigned i = 0;
+   if (stats) {
+      hash_table_foreach(pass_stats_table, entry)
+         stats[i++] = entry->data;
+      qsort(stats, count, sizeof(*stats), compare_pass_time);
+
+      fprintf(stderr, "NIR pass statistics, slowest first:\n");
+      fprintf(stderr, "%-40s %10s %10s %10s %12s\n",
+              "pass", "runs", "progress", "skipped", "time (ms)");
+      for (i = 0; i < count; i++) {
+         fprintf(stderr, "%-40s %10u %10u %10u %12.3f\n",
+                 stats[i]->name, stats[i]->runs, stats[i]->progress,
+                 stats[i]->skipped, stats[i]->time_ns / 1000000.0);
+      }
+      free(stats);
+   }
+
+   _mesa_hash_table_destroy(pass_stats_table, NULL);
+   pass_stats_table = NULL;
+
+   simple_mtx_unlock(&pass_stats_lock);
+}
+
+/* Must be called with pass_stats_lock held. */
+static struct pass_stats *
+get_pass_stats(const char *pass_name)
+{
+   if (!pass_stats_table) {
+      pass_stats_table = _mesa_hash_table_create(NULL, _mesa_hash_string,
+                                                 _mesa_key_string_equal);
+      atexit(pass_stats_print);
+   }
+
+   struct hash_entry *entry =
+      _mesa_hash_table_search(pass_stats_table, pass_name);
+   if (entry)
+      return entry->data;
+
+   struct pass_stats *stats = rzalloc(pass_stats_table, struct pass_stats);
+   stats->name = pass_name;
+   _mesa_hash_table_insert(pass_stats_table, pass_name, stats);
+
+   return stats;
+}
+
+bool
+nir_pass_stats_enabled(void)
+{
+   static int enabled = -1;
+   if (enabled < 0)
+      enabled = env_var_as_boolean("NIR_PASS_STATS", false);
+
+   return enabled;
+}
+
+int64_t
+nir_pass_stats_start(void)
+{
+   return os_time_get_nano();
+}
+
+void
+nir_pass_stats_end(const char *pass_name, int64_t start, bool progress)
+{
+   const int64_t time_ns = os_time_get_nano() - start;
+
+   simple_mtx_lock(&pass_stats_lock);
+   struct pass_stats *stats = get_pass_stats(pass_name);
+   stats->runs++;
+   stats->time_ns += time_ns;
+   if (progress)
+      stats->progress++;
+   simple_mtx_unlock(&pass_stats_lock);
+}
+
+void
+nir_pass_stats_skip(const char *pass_name)
+{
+   simple_mtx_lock(&pass_stats_lock);
+   get_pass_stats(pass_name)->skipped++;
+   simple_mtx_unlock(&pass_stats_lock);
+}
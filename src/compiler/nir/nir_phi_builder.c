@@ -306,11 +306,9 @@ nir_phi_builder_finish(struct nir_phi_builder *pb)
          qsort(preds, num_preds, sizeof(*preds), compare_blocks);
 
          for (unsigned i = 0; i < num_preds; i++) {
-            nir_phi_src *src = ralloc(phi, nir_phi_src);
-            src->pred = preds[i];
-            src->src = nir_src_for_ssa(
-               nir_phi_builder_value_get_block_def(val, preds[i]));
-            exec_list_push_tail(&phi->srcs, &src->node);
+            nir_phi_instr_add_src(phi, preds[i],
+               nir_src_for_ssa(
+                  nir_phi_builder_value_get_block_def(val, preds[i])));
          }
 
          nir_instr_insert(nir_before_block(phi->instr.block), &phi->instr);
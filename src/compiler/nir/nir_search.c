@@ -523,9 +523,12 @@ construct_value(nir_builder *build,
       const nir_search_variable *var = nir_search_value_as_variable(value);
       assert(state->variables_seen & (1 << var->variable));
 
+      /* Search variables are always SSA, so there is no indirect to
+       * allocate.
+       */
       nir_alu_src val = { NIR_SRC_INIT };
-      nir_alu_src_copy(&val, &state->variables[var->variable],
-                       (void *)build->shader);
+      assert(state->variables[var->variable].src.is_ssa);
+      nir_alu_src_copy(&val, &state->variables[var->variable], NULL);
       assert(!var->is_constant);
 
       for (unsigned i = 0; i < NIR_MAX_VEC_COMPONENTS; i++)
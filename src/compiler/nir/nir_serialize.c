@@ -560,7 +560,7 @@ read_src(read_ctx *ctx, nir_src *src, void *mem_ctx)
       src->reg.reg = read_lookup_object(ctx, header.any.object_idx);
       src->reg.base_offset = blob_read_uint32(ctx->blob);
       if (header.any.is_indirect) {
-         src->reg.indirect = ralloc(mem_ctx, nir_src);
+         src->reg.indirect = gc_alloc(ctx->nir->gctx, nir_src, 1);
          read_src(ctx, src->reg.indirect, mem_ctx);
       } else {
          src->reg.indirect = NULL;
@@ -784,7 +784,7 @@ read_dest(read_ctx *ctx, nir_dest *dst, nir_instr *instr,
       dst->reg.reg = read_object(ctx);
       dst->reg.base_offset = blob_read_uint32(ctx->blob);
       if (dest.reg.is_indirect) {
-         dst->reg.indirect = ralloc(instr, nir_src);
+         dst->reg.indirect = gc_alloc(ctx->nir->gctx, nir_src, 1);
          read_src(ctx, dst->reg.indirect, instr);
       }
    }
@@ -1601,7 +1601,7 @@ read_phi(read_ctx *ctx, nir_block *blk, union packed_instr header)
    nir_instr_insert_after_block(blk, &phi->instr);
 
    for (unsigned i = 0; i < header.phi.num_srcs; i++) {
-      nir_phi_src *src = ralloc(phi, nir_phi_src);
+      nir_phi_src *src = gc_alloc(ctx->nir->gctx, nir_phi_src, 1);
 
       src->src.is_ssa = true;
       src->src.ssa = (nir_ssa_def *)(uintptr_t) blob_read_uint32(ctx->blob);
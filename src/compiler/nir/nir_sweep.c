@@ -33,6 +33,10 @@
  * The expectation is that drivers should call this when finished compiling the shader
  * (after any optimization, lowering, and so on).  However, it's also fine to call it
  * earlier, and even many times, trading CPU cycles for memory savings.
+ *
+ * Instructions and nir_ifs live in nir_shader::gctx rather than in the ralloc
+ * tree, so they are marked live in the gc context instead of being stolen
+ * back, and everything left unmarked there is swept along with the rubbish.
  */
 
 #define steal_list(mem_ctx, type, list) \
@@ -44,7 +48,7 @@ static bool
 sweep_src_indirect(nir_src *src, void *nir)
 {
    if (!src->is_ssa && src->reg.indirect)
-      ralloc_steal(nir, src->reg.indirect);
+      gc_mark_live(((nir_shader *)nir)->gctx, src->reg.indirect);
 
    return true;
 }
@@ -53,11 +57,46 @@ static bool
 sweep_dest_indirect(nir_dest *dest, void *nir)
 {
    if (!dest->is_ssa && dest->reg.indirect)
-      ralloc_steal(nir, dest->reg.indirect);
+      gc_mark_live(((nir_shader *)nir)->gctx, dest->reg.indirect);
+
+   return true;
+}
+
+static bool
+sweep_ssa_def_name(nir_ssa_def *def, void *nir)
+{
+   if (def->name)
+      gc_mark_live(((nir_shader *)nir)->gctx, def->name);
 
    return true;
 }
 
+static void
+sweep_instr(nir_shader *nir, nir_instr *instr)
+{
+   gc_mark_live(nir->gctx, instr);
+
+   switch (instr->type) {
+   case nir_instr_type_tex:
+      gc_mark_live(nir->gctx, nir_instr_as_tex(instr)->src);
+      break;
+
+   case nir_instr_type_phi: {
+      nir_phi_instr *phi = nir_instr_as_phi(instr);
+      nir_foreach_phi_src(phi_src, phi)
+         gc_mark_live(nir->gctx, phi_src);
+      break;
+   }
+
+   default:
+      break;
+   }
+
+   nir_foreach_src(instr, sweep_src_indirect, nir);
+   nir_foreach_dest(instr, sweep_dest_indirect, nir);
+   nir_foreach_ssa_def(instr, sweep_ssa_def_name, nir);
+}
+
 static void
 sweep_block(nir_shader *nir, nir_block *block)
 {
@@ -72,18 +111,15 @@ sweep_block(nir_shader *nir, nir_block *block)
    ralloc_free(block->live_out);
    block->live_out = NULL;
 
-   nir_foreach_instr(instr, block) {
-      ralloc_steal(nir, instr);
-
-      nir_foreach_src(instr, sweep_src_indirect, nir);
-      nir_foreach_dest(instr, sweep_dest_indirect, nir);
-   }
+   nir_foreach_instr(instr, block)
+      sweep_instr(nir, instr);
 }
 
 static void
 sweep_if(nir_shader *nir, nir_if *iff)
 {
-   ralloc_steal(nir, iff);
+   gc_mark_live(nir->gctx, iff);
+   sweep_src_indirect(&iff->condition, nir);
 
    foreach_list_typed(nir_cf_node, cf_node, node, &iff->then_list) {
       sweep_cf_node(nir, cf_node);
@@ -158,6 +194,10 @@ nir_sweep(nir_shader *nir)
    /* First, move ownership of all the memory to a temporary context; assume dead. */
    ralloc_adopt(rubbish, nir);
 
+   /* The gc context sweeps itself. */
+   ralloc_steal(nir, nir->gctx);
+   gc_sweep_start(nir->gctx);
+
    ralloc_steal(nir, (char *)nir->info.name);
    if (nir->info.label)
       ralloc_steal(nir, (char *)nir->info.label);
@@ -173,5 +213,6 @@ nir_sweep(nir_shader *nir)
    ralloc_steal(nir, nir->constant_data);
 
    /* Free everything we didn't steal back. */
+   gc_sweep_end(nir->gctx);
    ralloc_free(rubbish);
 }
@@ -234,11 +234,8 @@ convert_loop_exit_for_ssa(nir_ssa_def *def, void *void_state)
     * the block has predecessors.
     */
    set_foreach(block_after_loop->predecessors, entry) {
-      nir_phi_src *phi_src = ralloc(phi, nir_phi_src);
-      phi_src->src = nir_src_for_ssa(def);
-      phi_src->pred = (nir_block *) entry->key;
-
-      exec_list_push_tail(&phi->srcs, &phi_src->node);
+      nir_phi_instr_add_src(phi, (nir_block *)entry->key,
+                            nir_src_for_ssa(def));
    }
 
    nir_instr_insert_before_block(block_after_loop, &phi->instr);
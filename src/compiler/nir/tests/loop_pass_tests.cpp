@@ -0,0 +1,199 @@
+/*
+ * Copyright © 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include <gtest/gtest.h>
+#include "nir.h"
+#include "nir_builder.h"
+
+namespace {
+
+class nir_loop_pass_test : public ::testing::Test {
+protected:
+   nir_loop_pass_test();
+   ~nir_loop_pass_test();
+
+   /* Run count_pass at two different call sites. */
+   bool run(nir_change_class changes, bool make_progress);
+   bool run_other(nir_change_class changes, bool make_progress);
+   bool run_remove_phis();
+
+   nir_builder b;
+   struct hash_table *skip;
+   unsigned runs;
+};
+
+nir_loop_pass_test::nir_loop_pass_test()
+{
+   glsl_type_singleton_init_or_ref();
+
+   static const nir_shader_compiler_options options = { };
+   b = nir_builder_init_simple_shader(MESA_SHADER_COMPUTE, &options,
+                                     "loop pass test");
+   skip = _mesa_pointer_hash_table_create(NULL);
+   runs = 0;
+}
+
+nir_loop_pass_test::~nir_loop_pass_test()
+{
+   _mesa_hash_table_destroy(skip, NULL);
+   ralloc_free(b.shader);
+   glsl_type_singleton_decref();
+}
+
+static bool
+count_pass(nir_shader *shader, unsigned *runs, bool make_progress)
+{
+   (*runs)++;
+   nir_shader_preserve_all_metadata(shader);
+   return make_progress;
+}
+
+bool
+nir_loop_pass_test::run(nir_change_class changes, bool make_progress)
+{
+   bool progress = false;
+   NIR_LOOP_PASS(progress, skip, b.shader, changes,
+                 count_pass, &runs, make_progress);
+   return progress;
+}
+
+bool
+nir_loop_pass_test::run_other(nir_change_class changes, bool make_progress)
+{
+   bool progress = false;
+   NIR_LOOP_PASS(progress, skip, b.shader, changes,
+                 count_pass, &runs, make_progress);
+   return progress;
+}
+
+bool
+nir_loop_pass_test::run_remove_phis()
+{
+   bool progress = false;
+   NIR_LOOP_PASS(progress, skip, b.shader, nir_change_phi | nir_change_alu,
+                 nir_opt_remove_phis);
+   return progress;
+}
+
+} /* namespace */
+
+TEST_F(nir_loop_pass_test, skip_without_changes)
+{
+   nir_imm_int(&b, 1);
+
+   EXPECT_FALSE(run(nir_change_alu, false));
+   EXPECT_FALSE(run(nir_change_alu, false));
+   EXPECT_FALSE(run(nir_change_alu, false));
+
+   EXPECT_EQ(runs, 1u);
+}
+
+TEST_F(nir_loop_pass_test, rerun_after_change)
+{
+   nir_ssa_def *one = nir_imm_int(&b, 1);
+
+   EXPECT_FALSE(run(nir_change_alu, false));
+   EXPECT_FALSE(run_other(nir_change_load_const, false));
+   EXPECT_EQ(runs, 2u);
+
+   /* An undef doesn't matter to either. */
+   nir_ssa_undef(&b, 1, 32);
+   EXPECT_FALSE(run(nir_change_alu, false));
+   EXPECT_FALSE(run_other(nir_change_load_const, false));
+   EXPECT_EQ(runs, 2u);
+
+   /* Adding an iadd changes the uses of the load_const. */
+   nir_ssa_def *add = nir_iadd(&b, one, one);
+   EXPECT_FALSE(run(nir_change_alu, false));
+   EXPECT_FALSE(run_other(nir_change_load_const, false));
+   EXPECT_EQ(runs, 4u);
+
+   /* So does rewriting one of its sources. */
+   nir_ssa_def *two = nir_imm_int(&b, 2);
+   EXPECT_FALSE(run_other(nir_change_load_const, false));
+   EXPECT_EQ(runs, 5u);
+
+   nir_instr_rewrite_src(add->parent_instr,
+                         &nir_instr_as_alu(add->parent_instr)->src[1].src,
+                         nir_src_for_ssa(two));
+   EXPECT_FALSE(run(nir_change_alu, false));
+   EXPECT_FALSE(run_other(nir_change_load_const, false));
+   EXPECT_EQ(runs, 7u);
+
+   /* And removing it. */
+   nir_instr_remove(add->parent_instr);
+   EXPECT_FALSE(run(nir_change_alu, false));
+   EXPECT_FALSE(run_other(nir_change_load_const, false));
+   EXPECT_EQ(runs, 9u);
+
+   EXPECT_FALSE(run(nir_change_alu, false));
+   EXPECT_FALSE(run_other(nir_change_load_const, false));
+   EXPECT_EQ(runs, 9u);
+}
+
+TEST_F(nir_loop_pass_test, rerun_after_progress)
+{
+   /* A pass making progress is assumed to have changed what it looks at,
+    * even when nothing was tracked.
+    */
+   EXPECT_TRUE(run(nir_change_alu, true));
+   EXPECT_FALSE(run(nir_change_alu, false));
+   EXPECT_FALSE(run(nir_change_alu, false));
+
+   EXPECT_EQ(runs, 2u);
+}
+
+TEST_F(nir_loop_pass_test, control_flow)
+{
+   EXPECT_FALSE(run(nir_change_cf, false));
+
+   nir_push_if(&b, nir_imm_true(&b));
+   nir_pop_if(&b, NULL);
+   EXPECT_FALSE(run(nir_change_cf, false));
+
+   EXPECT_EQ(runs, 2u);
+}
+
+TEST_F(nir_loop_pass_test, remove_phis_after_mov_change)
+{
+   nir_ssa_def *one = nir_imm_int(&b, 1);
+   nir_ssa_def *two = nir_imm_int(&b, 2);
+
+   nir_push_if(&b, nir_ieq(&b, nir_load_local_invocation_index(&b), one));
+   nir_ssa_def *then_mov = nir_mov(&b, one);
+   nir_push_else(&b, NULL);
+   nir_ssa_def *else_mov = nir_mov(&b, two);
+   nir_pop_if(&b, NULL);
+   nir_ssa_def *phi = nir_if_phi(&b, then_mov, else_mov);
+   nir_store_global(&b, nir_imm_int64(&b, 0), 4, phi, 0x1);
+
+   EXPECT_FALSE(run_remove_phis());
+   EXPECT_FALSE(run_remove_phis());
+
+   /* Once both movs copy the same value the phi can go, although only an
+    * ALU instruction changed.
+    */
+   nir_alu_instr *mov = nir_instr_as_alu(else_mov->parent_instr);
+   nir_instr_rewrite_src(&mov->instr, &mov->src[0].src, nir_src_for_ssa(one));
+   EXPECT_TRUE(run_remove_phis());
+   EXPECT_FALSE(run_remove_phis());
+}
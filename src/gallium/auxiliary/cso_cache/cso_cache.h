@@ -168,16 +168,22 @@ void cso_set_maximum_cache_size(struct cso_cache *sc, int number);
 void cso_delete_state(struct pipe_context *pipe, void *state,
                       enum cso_cache_type type);
 
+/**
+ * FNV-1a over the words of the whole state, so that different states rarely
+ * have the same key and the memcmp in cso_find_state_template usually
+ * succeeds.  States are small, so this is cheaper than a general purpose
+ * hash.
+ */
 static inline unsigned
 cso_construct_key(void *key, int key_size)
 {
-   unsigned hash = 0, *ikey = (unsigned *)key;
+   unsigned hash = 0x811c9dc5, *ikey = (unsigned *)key;
    unsigned num_elements = key_size / 4;
 
    assert(key_size % 4 == 0);
 
    for (unsigned i = 0; i < num_elements; i++)
-      hash ^= ikey[i];
+      hash = (hash ^ ikey[i]) * 0x01000193;
 
    return hash;
 }
@@ -50,6 +50,11 @@
 #include "cso_context.h"
 
 
+/* The number of recently used CSOs of each type checked before the hash
+ * table is searched.
+ */
+#define CSO_RECENT_STATES 2
+
 /**
  * Per-shader sampler information.
  */
@@ -112,6 +117,12 @@ struct cso_context {
    unsigned min_samples, min_samples_saved;
    struct pipe_stencil_ref stencil_ref, stencil_ref_saved;
 
+   /* The most recently used CSOs of each type, in a ring. They are
+    * compared with templates before templates are hashed.
+    */
+   void *recent[CSO_CACHE_MAX][CSO_RECENT_STATES];
+   uint8_t recent_next[CSO_CACHE_MAX];
+
    /* This should be last to keep all of the above together in memory. */
    struct cso_cache cache;
 };
@@ -121,6 +132,50 @@ struct pipe_context *cso_get_pipe_context(struct cso_context *cso)
    return cso->pipe;
 }
 
+/**
+ * Return a recently used CSO of the given type whose state matches the
+ * template, or NULL.
+ *
+ * This runs before the template is hashed on every cso_set_* call, so the
+ * states are compared inline rather than with memcmp, and hits don't
+ * reorder the entries.
+ */
+static inline void *
+cso_find_recent(struct cso_context *ctx, enum cso_cache_type type,
+                const void *templ, unsigned key_size)
+{
+   const uint32_t *t = templ;
+
+   assert(key_size % 4 == 0);
+
+   for (unsigned i = 0; i < CSO_RECENT_STATES; i++) {
+      /* All CSO types start with their state. */
+      const uint32_t *state = ctx->recent[type][i];
+      unsigned j = 0;
+
+      if (!state)
+         continue;
+
+      while (j < key_size / 4 && state[j] == t[j])
+         j++;
+      if (j == key_size / 4)
+         return ctx->recent[type][i];
+   }
+   return NULL;
+}
+
+/**
+ * Add a CSO to the recently used ones, replacing the oldest.
+ */
+static inline void
+cso_add_recent(struct cso_context *ctx, enum cso_cache_type type, void *cso)
+{
+   unsigned i = ctx->recent_next[type];
+
+   ctx->recent[type][i] = cso;
+   ctx->recent_next[type] = (i + 1) % CSO_RECENT_STATES;
+}
+
 static inline boolean delete_cso(struct cso_context *ctx,
                                  void *state, enum cso_cache_type type)
 {
@@ -172,6 +227,9 @@ sanitize_hash(struct cso_hash *hash, enum cso_cache_type type,
    if (to_remove == 0)
       return;
 
+   /* Entries are about to be deleted. */
+   memset(ctx->recent[type], 0, sizeof(ctx->recent[type]));
+
    if (type == CSO_SAMPLER) {
       int i, j;
 
@@ -227,6 +285,9 @@ static void cso_init_vbuf(struct cso_context *cso, unsigned flags)
 
    u_vbuf_get_caps(cso->pipe->screen, &caps, needs64b);
 
+   if (!(flags & CSO_TRACK_BUFFER_WRITES))
+      caps.cache_translated_buffers = false;
+
    /* Enable u_vbuf if needed. */
    if (caps.fallback_always ||
        (uses_user_vertex_buffers &&
@@ -401,38 +462,45 @@ void cso_destroy_context( struct cso_context *ctx )
 enum pipe_error cso_set_blend(struct cso_context *ctx,
                               const struct pipe_blend_state *templ)
 {
-   unsigned key_size, hash_key;
-   struct cso_hash_iter iter;
+   unsigned key_size;
+   struct cso_blend *cso;
    void *handle;
 
    key_size = templ->independent_blend_enable ?
       sizeof(struct pipe_blend_state) :
       (char *)&(templ->rt[1]) - (char *)templ;
-   hash_key = cso_construct_key((void*)templ, key_size);
-   iter = cso_find_state_template(&ctx->cache, hash_key, CSO_BLEND,
-                                  (void*)templ, key_size);
-
-   if (cso_hash_iter_is_null(iter)) {
-      struct cso_blend *cso = MALLOC(sizeof(struct cso_blend));
-      if (!cso)
-         return PIPE_ERROR_OUT_OF_MEMORY;
+   cso = cso_find_recent(ctx, CSO_BLEND, templ, key_size);
 
-      memset(&cso->state, 0, sizeof cso->state);
-      memcpy(&cso->state, templ, key_size);
-      cso->data = ctx->pipe->create_blend_state(ctx->pipe, &cso->state);
+   if (!cso) {
+      unsigned hash_key = cso_construct_key((void*)templ, key_size);
+      struct cso_hash_iter iter =
+         cso_find_state_template(&ctx->cache, hash_key, CSO_BLEND,
+                                 (void*)templ, key_size);
 
-      iter = cso_insert_state(&ctx->cache, hash_key, CSO_BLEND, cso);
       if (cso_hash_iter_is_null(iter)) {
-         FREE(cso);
-         return PIPE_ERROR_OUT_OF_MEMORY;
+         cso = MALLOC(sizeof(struct cso_blend));
+         if (!cso)
+            return PIPE_ERROR_OUT_OF_MEMORY;
+
+         memset(&cso->state, 0, sizeof cso->state);
+         memcpy(&cso->state, templ, key_size);
+         cso->data = ctx->pipe->create_blend_state(ctx->pipe, &cso->state);
+
+         iter = cso_insert_state(&ctx->cache, hash_key, CSO_BLEND, cso);
+         if (cso_hash_iter_is_null(iter)) {
+            FREE(cso);
+            return PIPE_ERROR_OUT_OF_MEMORY;
+         }
+      }
+      else {
+         cso = cso_hash_iter_data(iter);
       }
 
-      handle = cso->data;
-   }
-   else {
-      handle = ((struct cso_blend *)cso_hash_iter_data(iter))->data;
+      cso_add_recent(ctx, CSO_BLEND, cso);
    }
 
+   handle = cso->data;
+
    if (ctx->blend != handle) {
       ctx->blend = handle;
       ctx->pipe->bind_blend_state(ctx->pipe, handle);
@@ -464,37 +532,41 @@ cso_set_depth_stencil_alpha(struct cso_context *ctx,
                             const struct pipe_depth_stencil_alpha_state *templ)
 {
    unsigned key_size = sizeof(struct pipe_depth_stencil_alpha_state);
-   unsigned hash_key = cso_construct_key((void*)templ, key_size);
-   struct cso_hash_iter iter = cso_find_state_template(&ctx->cache,
-                                                       hash_key,
-                                                       CSO_DEPTH_STENCIL_ALPHA,
-                                                       (void*)templ, key_size);
-   void *handle;
-
-   if (cso_hash_iter_is_null(iter)) {
-      struct cso_depth_stencil_alpha *cso =
-         MALLOC(sizeof(struct cso_depth_stencil_alpha));
-      if (!cso)
-         return PIPE_ERROR_OUT_OF_MEMORY;
+   struct cso_depth_stencil_alpha *cso =
+      cso_find_recent(ctx, CSO_DEPTH_STENCIL_ALPHA, templ, key_size);
 
-      memcpy(&cso->state, templ, sizeof(*templ));
-      cso->data = ctx->pipe->create_depth_stencil_alpha_state(ctx->pipe,
-                                                              &cso->state);
+   if (!cso) {
+      unsigned hash_key = cso_construct_key((void*)templ, key_size);
+      struct cso_hash_iter iter =
+         cso_find_state_template(&ctx->cache, hash_key,
+                                 CSO_DEPTH_STENCIL_ALPHA,
+                                 (void*)templ, key_size);
 
-      iter = cso_insert_state(&ctx->cache, hash_key,
-                              CSO_DEPTH_STENCIL_ALPHA, cso);
       if (cso_hash_iter_is_null(iter)) {
-         FREE(cso);
-         return PIPE_ERROR_OUT_OF_MEMORY;
+         cso = MALLOC(sizeof(struct cso_depth_stencil_alpha));
+         if (!cso)
+            return PIPE_ERROR_OUT_OF_MEMORY;
+
+         memcpy(&cso->state, templ, sizeof(*templ));
+         cso->data = ctx->pipe->create_depth_stencil_alpha_state(ctx->pipe,
+                                                                 &cso->state);
+
+         iter = cso_insert_state(&ctx->cache, hash_key,
+                                 CSO_DEPTH_STENCIL_ALPHA, cso);
+         if (cso_hash_iter_is_null(iter)) {
+            FREE(cso);
+            return PIPE_ERROR_OUT_OF_MEMORY;
+         }
+      }
+      else {
+         cso = cso_hash_iter_data(iter);
       }
 
-      handle = cso->data;
-   }
-   else {
-      handle = ((struct cso_depth_stencil_alpha *)
-                cso_hash_iter_data(iter))->data;
+      cso_add_recent(ctx, CSO_DEPTH_STENCIL_ALPHA, cso);
    }
 
+   void *handle = cso->data;
+
    if (ctx->depth_stencil != handle) {
       ctx->depth_stencil = handle;
       ctx->pipe->bind_depth_stencil_alpha_state(ctx->pipe, handle);
@@ -526,38 +598,43 @@ enum pipe_error cso_set_rasterizer(struct cso_context *ctx,
                                    const struct pipe_rasterizer_state *templ)
 {
    unsigned key_size = sizeof(struct pipe_rasterizer_state);
-   unsigned hash_key = cso_construct_key((void*)templ, key_size);
-   struct cso_hash_iter iter = cso_find_state_template(&ctx->cache,
-                                                       hash_key,
-                                                       CSO_RASTERIZER,
-                                                       (void*)templ, key_size);
-   void *handle = NULL;
+   struct cso_rasterizer *cso =
+      cso_find_recent(ctx, CSO_RASTERIZER, templ, key_size);
 
    /* We can't have both point_quad_rasterization (sprites) and point_smooth
     * (round AA points) enabled at the same time.
     */
    assert(!(templ->point_quad_rasterization && templ->point_smooth));
 
-   if (cso_hash_iter_is_null(iter)) {
-      struct cso_rasterizer *cso = MALLOC(sizeof(struct cso_rasterizer));
-      if (!cso)
-         return PIPE_ERROR_OUT_OF_MEMORY;
-
-      memcpy(&cso->state, templ, sizeof(*templ));
-      cso->data = ctx->pipe->create_rasterizer_state(ctx->pipe, &cso->state);
+   if (!cso) {
+      unsigned hash_key = cso_construct_key((void*)templ, key_size);
+      struct cso_hash_iter iter =
+         cso_find_state_template(&ctx->cache, hash_key, CSO_RASTERIZER,
+                                 (void*)templ, key_size);
 
-      iter = cso_insert_state(&ctx->cache, hash_key, CSO_RASTERIZER, cso);
       if (cso_hash_iter_is_null(iter)) {
-         FREE(cso);
-         return PIPE_ERROR_OUT_OF_MEMORY;
+         cso = MALLOC(sizeof(struct cso_rasterizer));
+         if (!cso)
+            return PIPE_ERROR_OUT_OF_MEMORY;
+
+         memcpy(&cso->state, templ, sizeof(*templ));
+         cso->data = ctx->pipe->create_rasterizer_state(ctx->pipe, &cso->state);
+
+         iter = cso_insert_state(&ctx->cache, hash_key, CSO_RASTERIZER, cso);
+         if (cso_hash_iter_is_null(iter)) {
+            FREE(cso);
+            return PIPE_ERROR_OUT_OF_MEMORY;
+         }
+      }
+      else {
+         cso = cso_hash_iter_data(iter);
       }
 
-      handle = cso->data;
-   }
-   else {
-      handle = ((struct cso_rasterizer *)cso_hash_iter_data(iter))->data;
+      cso_add_recent(ctx, CSO_RASTERIZER, cso);
    }
 
+   void *handle = cso->data;
+
    if (ctx->rasterizer != handle) {
       ctx->rasterizer = handle;
       ctx->pipe->bind_rasterizer_state(ctx->pipe, handle);
@@ -926,8 +1003,8 @@ static void
 cso_set_vertex_elements_direct(struct cso_context *ctx,
                                const struct cso_velems_state *velems)
 {
-   unsigned key_size, hash_key;
-   struct cso_hash_iter iter;
+   unsigned key_size;
+   struct cso_velements *cso;
    void *handle;
 
    /* Need to include the count into the stored state data too.
@@ -937,32 +1014,39 @@ cso_set_vertex_elements_direct(struct cso_context *ctx,
     */
    key_size = sizeof(struct pipe_vertex_element) * velems->count +
               sizeof(unsigned);
-   hash_key = cso_construct_key((void*)velems, key_size);
-   iter = cso_find_state_template(&ctx->cache, hash_key, CSO_VELEMENTS,
-                                  (void*)velems, key_size);
+   cso = cso_find_recent(ctx, CSO_VELEMENTS, velems, key_size);
 
-   if (cso_hash_iter_is_null(iter)) {
-      struct cso_velements *cso = MALLOC(sizeof(struct cso_velements));
-      if (!cso)
-         return;
+   if (!cso) {
+      unsigned hash_key = cso_construct_key((void*)velems, key_size);
+      struct cso_hash_iter iter =
+         cso_find_state_template(&ctx->cache, hash_key, CSO_VELEMENTS,
+                                 (void*)velems, key_size);
+
+      if (cso_hash_iter_is_null(iter)) {
+         cso = MALLOC(sizeof(struct cso_velements));
+         if (!cso)
+            return;
 
-      memcpy(&cso->state, velems, key_size);
-      cso->data = ctx->pipe->create_vertex_elements_state(ctx->pipe,
-                                                          velems->count,
+         memcpy(&cso->state, velems, key_size);
+         cso->data = ctx->pipe->create_vertex_elements_state(ctx->pipe,
+                                                             velems->count,
                                                       &cso->state.velems[0]);
 
-      iter = cso_insert_state(&ctx->cache, hash_key, CSO_VELEMENTS, cso);
-      if (cso_hash_iter_is_null(iter)) {
-         FREE(cso);
-         return;
+         iter = cso_insert_state(&ctx->cache, hash_key, CSO_VELEMENTS, cso);
+         if (cso_hash_iter_is_null(iter)) {
+            FREE(cso);
+            return;
+         }
+      }
+      else {
+         cso = cso_hash_iter_data(iter);
       }
 
-      handle = cso->data;
-   }
-   else {
-      handle = ((struct cso_velements *)cso_hash_iter_data(iter))->data;
+      cso_add_recent(ctx, CSO_VELEMENTS, cso);
    }
 
+   handle = cso->data;
+
    if (ctx->velements != handle) {
       ctx->velements = handle;
       ctx->pipe->bind_vertex_elements_state(ctx->pipe, handle);
@@ -1106,30 +1190,36 @@ cso_single_sampler(struct cso_context *ctx, enum pipe_shader_type shader_stage,
 {
    if (templ) {
       unsigned key_size = sizeof(struct pipe_sampler_state);
-      unsigned hash_key = cso_construct_key((void*)templ, key_size);
-      struct cso_sampler *cso;
-      struct cso_hash_iter iter =
-         cso_find_state_template(&ctx->cache,
-                                 hash_key, CSO_SAMPLER,
-                                 (void *) templ, key_size);
+      struct cso_sampler *cso =
+         cso_find_recent(ctx, CSO_SAMPLER, templ, key_size);
 
-      if (cso_hash_iter_is_null(iter)) {
-         cso = MALLOC(sizeof(struct cso_sampler));
-         if (!cso)
-            return;
+      if (!cso) {
+         unsigned hash_key = cso_construct_key((void*)templ, key_size);
+         struct cso_hash_iter iter =
+            cso_find_state_template(&ctx->cache,
+                                    hash_key, CSO_SAMPLER,
+                                    (void *) templ, key_size);
 
-         memcpy(&cso->state, templ, sizeof(*templ));
-         cso->data = ctx->pipe->create_sampler_state(ctx->pipe, &cso->state);
-         cso->hash_key = hash_key;
-
-         iter = cso_insert_state(&ctx->cache, hash_key, CSO_SAMPLER, cso);
          if (cso_hash_iter_is_null(iter)) {
-            FREE(cso);
-            return;
+            cso = MALLOC(sizeof(struct cso_sampler));
+            if (!cso)
+               return;
+
+            memcpy(&cso->state, templ, sizeof(*templ));
+            cso->data = ctx->pipe->create_sampler_state(ctx->pipe, &cso->state);
+            cso->hash_key = hash_key;
+
+            iter = cso_insert_state(&ctx->cache, hash_key, CSO_SAMPLER, cso);
+            if (cso_hash_iter_is_null(iter)) {
+               FREE(cso);
+               return;
+            }
          }
-      }
-      else {
-         cso = cso_hash_iter_data(iter);
+         else {
+            cso = cso_hash_iter_data(iter);
+         }
+
+         cso_add_recent(ctx, CSO_SAMPLER, cso);
       }
 
       ctx->samplers[shader_stage].cso_samplers[idx] = cso;
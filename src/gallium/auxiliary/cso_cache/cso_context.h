@@ -44,6 +44,9 @@ struct u_vbuf;
 
 #define CSO_NO_USER_VERTEX_BUFFERS (1 << 0)
 #define CSO_NO_64B_VERTEX_BUFFERS  (1 << 1)
+/* The frontend increments pipe_resource::write_count whenever it writes
+ * a buffer, which lets u_vbuf reuse translated vertex buffers. */
+#define CSO_TRACK_BUFFER_WRITES    (1 << 2)
 
 struct cso_context *cso_create_context(struct pipe_context *pipe,
                                        unsigned flags);
@@ -31,245 +31,128 @@
   */
 
 #include "util/u_debug.h"
+#include "util/u_math.h"
 #include "util/u_memory.h"
 
 #include "cso_hash.h"
 
-#ifndef MAX
-#define MAX(a, b) ((a > b) ? (a) : (b))
-#endif
+#define CSO_HASH_MIN_BITS 4
 
-static const int MinNumBits = 4;
-
-static const unsigned char prime_deltas[] = {
-   0,  0,  1,  3,  1,  5,  3,  3,  1,  9,  7,  5,  3,  9, 25,  3,
-   1, 21,  3, 21,  7, 15,  9,  5,  3, 29, 15,  0,  0,  0,  0,  0
-};
-
-static int primeForNumBits(int numBits)
-{
-   return (1 << numBits) + prime_deltas[numBits];
-}
-
-/*
-    Returns the smallest integer n such that
-    primeForNumBits(n) >= hint.
-*/
-static int countBits(int hint)
+static inline bool
+entry_is_live(const struct cso_hash_entry *entry)
 {
-   int numBits = 0;
-   int bits = hint;
-
-   while (bits > 1) {
-      bits >>= 1;
-      numBits++;
-   }
-
-   if (numBits >= (int)sizeof(prime_deltas)) {
-      numBits = sizeof(prime_deltas) - 1;
-   } else if (primeForNumBits(numBits) < hint) {
-      ++numBits;
-   }
-   return numBits;
+   return entry->value && entry->value != CSO_HASH_DELETED;
 }
 
-static struct cso_node *
-cso_hash_create_node(struct cso_hash *hash,
-                     unsigned akey, void *avalue,
-                     struct cso_node **anextNode)
+/**
+ * Reallocate the table so that it can hold at least min_size entries with
+ * a load factor of at most 1/2, and drop erased entries.
+ */
+static bool
+cso_hash_resize(struct cso_hash *hash, unsigned min_size)
 {
-   struct cso_node *node = MALLOC(sizeof(struct cso_node));
-
-   if (!node)
-      return NULL;
-
-   node->key = akey;
-   node->value = avalue;
-
-   node->next = *anextNode;
-   *anextNode = node;
-   ++hash->size;
-   return node;
-}
+   unsigned bits = MAX2(util_logbase2_ceil(MAX2(min_size, 1) * 2),
+                        CSO_HASH_MIN_BITS);
+   unsigned num_slots = 1u << bits;
+   struct cso_hash_entry *old_entries = hash->entries;
+   unsigned old_num_slots = hash->mask ? hash->mask + 1 : 0;
+   struct cso_hash_entry *entries =
+      CALLOC(num_slots, sizeof(struct cso_hash_entry));
 
-static void cso_data_rehash(struct cso_hash *hash, int hint)
-{
-   if (hint < 0) {
-      hint = countBits(-hint);
-      if (hint < MinNumBits)
-         hint = MinNumBits;
-      hash->userNumBits = (short)hint;
-      while (primeForNumBits(hint) < (hash->size >> 1))
-         ++hint;
-   } else if (hint < MinNumBits) {
-      hint = MinNumBits;
-   }
+   if (!entries)
+      return false;
 
-   if (hash->numBits != hint) {
-      struct cso_node *e = (struct cso_node *)hash;
-      struct cso_node **oldBuckets = hash->buckets;
-      int oldNumBuckets = hash->numBuckets;
-      int  i = 0;
+   hash->entries = entries;
+   hash->mask = num_slots - 1;
+   hash->shift = 32 - bits;
+   hash->num_used = hash->size;
 
-      hash->numBits = (short)hint;
-      hash->numBuckets = primeForNumBits(hint);
-      hash->buckets = MALLOC(sizeof(struct cso_node*) * hash->numBuckets);
-      for (i = 0; i < hash->numBuckets; ++i)
-         hash->buckets[i] = e;
+   for (unsigned i = 0; i < old_num_slots; i++) {
+      struct cso_hash_entry *old = &old_entries[i];
 
-      for (i = 0; i < oldNumBuckets; ++i) {
-         struct cso_node *firstNode = oldBuckets[i];
-         while (firstNode != e) {
-            unsigned h = firstNode->key;
-            struct cso_node *lastNode = firstNode;
-            struct cso_node *afterLastNode;
-            struct cso_node **beforeFirstNode;
-            
-            while (lastNode->next != e && lastNode->next->key == h)
-               lastNode = lastNode->next;
+      if (entry_is_live(old)) {
+         unsigned j = cso_hash_home_slot(hash, old->key);
 
-            afterLastNode = lastNode->next;
-            beforeFirstNode = &hash->buckets[h % hash->numBuckets];
-            while (*beforeFirstNode != e)
-               beforeFirstNode = &(*beforeFirstNode)->next;
-            lastNode->next = *beforeFirstNode;
-            *beforeFirstNode = firstNode;
-            firstNode = afterLastNode;
-         }
+         while (entries[j].value)
+            j = (j + 1) & hash->mask;
+         entries[j] = *old;
       }
-      FREE(oldBuckets);
-   }
-}
-
-static void cso_data_might_grow(struct cso_hash *hash)
-{
-   if (hash->size >= hash->numBuckets)
-      cso_data_rehash(hash, hash->numBits + 1);
-}
-
-static void cso_data_has_shrunk(struct cso_hash *hash)
-{
-   if (hash->size <= (hash->numBuckets >> 3) &&
-       hash->numBits > hash->userNumBits) {
-      int max = MAX(hash->numBits-2, hash->userNumBits);
-      cso_data_rehash(hash,  max);
    }
-}
-
-static struct cso_node *cso_data_first_node(struct cso_hash *hash)
-{
-   struct cso_node *e = (struct cso_node *)hash;
-   struct cso_node **bucket = hash->buckets;
-   int n = hash->numBuckets;
 
-   while (n--) {
-      if (*bucket != e)
-         return *bucket;
-      ++bucket;
-   }
-   return e;
+   FREE(old_entries);
+   return true;
 }
 
 struct cso_hash_iter cso_hash_insert(struct cso_hash *hash,
                                      unsigned key, void *data)
 {
-   cso_data_might_grow(hash);
+   struct cso_hash_iter iter = {hash, NULL};
 
-   struct cso_node **nextNode = cso_hash_find_node(hash, key);
-   struct cso_node *node = cso_hash_create_node(hash, key, data, nextNode);
-   if (!node) {
-      struct cso_hash_iter null_iter = {hash, 0};
-      return null_iter;
-   }
+   /* NULL and CSO_HASH_DELETED mark free slots, so they can't be stored. */
+   assert(data && data != CSO_HASH_DELETED);
+   if (!data || data == CSO_HASH_DELETED)
+      return iter;
+
+   /* Keep at least half of the slots empty, so that probe sequences stay
+    * short and always end.
+    */
+   if ((hash->num_used + 1) * 2 > (hash->mask ? hash->mask + 1 : 0) &&
+       !cso_hash_resize(hash, hash->size + 1))
+      return iter;
 
-   struct cso_hash_iter iter = {hash, node};
+   unsigned i = cso_hash_home_slot(hash, key);
+   while (entry_is_live(&hash->entries[i]))
+      i = (i + 1) & hash->mask;
+
+   iter.entry = &hash->entries[i];
+   if (!iter.entry->value)
+      hash->num_used++;
+   iter.entry->key = key;
+   iter.entry->value = data;
+   hash->size++;
    return iter;
 }
 
 void cso_hash_init(struct cso_hash *hash)
 {
-   hash->fakeNext = 0;
-   hash->buckets = 0;
+   hash->entries = NULL;
    hash->size = 0;
-   hash->userNumBits = (short)MinNumBits;
-   hash->numBits = 0;
-   hash->numBuckets = 0;
-   hash->end = (struct cso_node*)hash;
+   hash->num_used = 0;
+   hash->mask = 0;
+   hash->shift = 0;
 }
 
 void cso_hash_deinit(struct cso_hash *hash)
 {
-   struct cso_node *e_for_x = hash->end;
-   struct cso_node **bucket = hash->buckets;
-   int n = hash->numBuckets;
-
-   while (n--) {
-      struct cso_node *cur = *bucket++;
-      while (cur != e_for_x) {
-         struct cso_node *next = cur->next;
-         FREE(cur);
-         cur = next;
-      }
-   }
-   FREE(hash->buckets);
+   FREE(hash->entries);
+   cso_hash_init(hash);
 }
 
 unsigned cso_hash_iter_key(struct cso_hash_iter iter)
 {
-   if (!iter.node || iter.hash->end == iter.node)
-      return 0;
-   return iter.node->key;
-}
-
-struct cso_node *cso_hash_data_next(struct cso_node *node)
-{
-   union {
-      struct cso_node *next;
-      struct cso_node *e;
-      struct cso_hash *d;
-   } a;
-   int start;
-   struct cso_node **bucket;
-   int n;
-
-   a.next = node->next;
-   if (!a.next) {
-      debug_printf("iterating beyond the last element\n");
-      return NULL;
-   }
-   if (a.next->next)
-      return a.next;
-
-   start = (node->key % a.d->numBuckets) + 1;
-   bucket = a.d->buckets + start;
-   n = a.d->numBuckets - start;
-   while (n--) {
-      if (*bucket != a.e)
-         return *bucket;
-      ++bucket;
-   }
-   return a.e;
+   return iter.entry ? iter.entry->key : 0;
 }
 
 void *cso_hash_take(struct cso_hash *hash, unsigned akey)
 {
-   struct cso_node **node = cso_hash_find_node(hash, akey);
+   struct cso_hash_iter iter = cso_hash_find(hash, akey);
+   void *value = cso_hash_iter_data(iter);
 
-   if (*node != hash->end) {
-      void *t = (*node)->value;
-      struct cso_node *next = (*node)->next;
-      FREE(*node);
-      *node = next;
-      --hash->size;
-      cso_data_has_shrunk(hash);
-      return t;
-   }
-   return NULL;
+   if (value)
+      cso_hash_erase(hash, iter);
+   return value;
 }
 
 struct cso_hash_iter cso_hash_first_node(struct cso_hash *hash)
 {
-   struct cso_hash_iter iter = {hash, cso_data_first_node(hash)};
+   struct cso_hash_iter iter = {hash, NULL};
+
+   for (unsigned i = 0; hash->size && i <= hash->mask; i++) {
+      if (entry_is_live(&hash->entries[i])) {
+         iter.entry = &hash->entries[i];
+         break;
+      }
+   }
    return iter;
 }
 
@@ -280,25 +163,25 @@ int cso_hash_size(struct cso_hash *hash)
 
 struct cso_hash_iter cso_hash_erase(struct cso_hash *hash, struct cso_hash_iter iter)
 {
-   struct cso_hash_iter ret = iter;
-   struct cso_node *node = iter.node;
-   struct cso_node **node_ptr;
-
-   if (node == hash->end)
+   if (!iter.entry)
       return iter;
 
-   ret = cso_hash_iter_next(ret);
-   node_ptr = &hash->buckets[node->key % hash->numBuckets];
-   while (*node_ptr != node)
-      node_ptr = &(*node_ptr)->next;
-   *node_ptr = node->next;
-   FREE(node);
-   --hash->size;
-   return ret;
+   /* The probe sequence ends at an empty slot, so the slot can only be
+    * made empty if the next one is empty.
+    */
+   unsigned next = (iter.entry - hash->entries + 1) & hash->mask;
+   if (!hash->entries[next].value) {
+      iter.entry->value = NULL;
+      hash->num_used--;
+   } else {
+      iter.entry->value = CSO_HASH_DELETED;
+   }
+   hash->size--;
+
+   return cso_hash_iter_next(iter);
 }
 
 bool cso_hash_contains(struct cso_hash *hash, unsigned key)
 {
-   struct cso_node **node = cso_hash_find_node(hash, key);
-   return *node != hash->end;
+   return !cso_hash_iter_is_null(cso_hash_find(hash, key));
 }
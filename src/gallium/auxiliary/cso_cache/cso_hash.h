@@ -28,17 +28,18 @@
 /**
  * @file
  * Hash table implementation.
- * 
- * This file provides a hash implementation that is capable of dealing
- * with collisions. It stores colliding entries in linked list. All
- * functions operating on the hash return an iterator. The iterator
- * itself points to the collision list. If there wasn't any collision
- * the list will have just one entry, otherwise client code should
- * iterate over the entries to find the exact entry among ones that
- * had the same key (e.g. memcmp could be used on the data to check
- * that)
- * 
- * @author Zack Rusin <zackr@vmware.com>
+ *
+ * This is an open-addressing hash table with linear probing. The 32-bit
+ * key of each entry is stored inline next to the data pointer, so lookups
+ * only touch the entry array. The table doesn't know about the data, so
+ * several entries can have the same key. cso_hash_find returns the first
+ * entry with the given key and cso_hash_find_next returns the following
+ * ones, so that client code can find the exact entry among those that had
+ * the same key (e.g. memcmp could be used on the data to check that).
+ *
+ * Removing entries leaves a marker in their slot, so iterators stay valid
+ * while entries are erased. The markers are dropped when the table is
+ * resized.
  */
 
 #ifndef CSO_HASH_H
@@ -51,25 +52,25 @@ extern "C" {
 #endif
 
 
-struct cso_node {
-   struct cso_node *next;
-   void *value;
+/* The data pointer of an erased entry. */
+#define CSO_HASH_DELETED ((void *)(uintptr_t)1)
+
+struct cso_hash_entry {
+   void *value; /* NULL if the slot has never been used */
    unsigned key;
 };
 
 struct cso_hash_iter {
    struct cso_hash *hash;
-   struct cso_node  *node;
+   struct cso_hash_entry *entry;
 };
 
 struct cso_hash {
-   struct cso_node *fakeNext;
-   struct cso_node **buckets;
-   struct cso_node *end;
-   int size;
-   short userNumBits;
-   short numBits;
-   int numBuckets;
+   struct cso_hash_entry *entries;
+   unsigned size;      /* number of entries with data */
+   unsigned num_used;  /* number of entries with data or erased */
+   unsigned mask;      /* number of slots - 1, or 0 if there are none */
+   unsigned shift;     /* 32 - log2(number of slots) */
 };
 
 void cso_hash_init(struct cso_hash *hash);
@@ -80,10 +81,10 @@ int cso_hash_size(struct cso_hash *hash);
 
 
 /**
- * Adds a data with the given key to the hash. If entry with the given
- * key is already in the hash, this current entry is instered before it
- * in the collision list.
- * Function returns iterator pointing to the inserted item in the hash.
+ * Adds a data with the given key to the hash. If entries with the given
+ * key are already in the hash, they are kept. data must not be NULL.
+ * Function returns iterator pointing to the inserted item in the hash,
+ * or a null iterator if memory couldn't be allocated or data is NULL.
  */
 struct cso_hash_iter cso_hash_insert(struct cso_hash *hash, unsigned key,
                                      void *data);
@@ -112,63 +113,107 @@ unsigned cso_hash_iter_key(struct cso_hash_iter iter);
 
 
 /**
- * Convenience routine to iterate over the collision list while doing a memory
- * comparison to see which entry in the list is a direct copy of our template
- * and returns that entry.
+ * Convenience routine to iterate over the entries with the given key while
+ * doing a memory comparison to see which entry is a direct copy of our
+ * template and returns that entry.
  */
 void *cso_hash_find_data_from_template(struct cso_hash *hash,
 				       unsigned hash_key,
 				       void *templ,
 				       int size);
 
-struct cso_node *cso_hash_data_next(struct cso_node *node);
-
 static inline bool
 cso_hash_iter_is_null(struct cso_hash_iter iter)
 {
-   return !iter.node || iter.node == iter.hash->end;
+   return !iter.entry;
 }
 
 static inline void *
 cso_hash_iter_data(struct cso_hash_iter iter)
 {
-   if (!iter.node || iter.hash->end == iter.node)
-      return NULL;
-   return iter.node->value;
+   return iter.entry ? iter.entry->value : NULL;
 }
 
-static inline struct cso_node **
-cso_hash_find_node(struct cso_hash *hash, unsigned akey)
+/**
+ * Return an iterator pointing to the first entry with the given key at or
+ * after slot i in the probe sequence.
+ */
+static inline struct cso_hash_iter
+cso_hash_probe(struct cso_hash *hash, unsigned key, unsigned i)
 {
-   struct cso_node **node;
-
-   if (hash->numBuckets) {
-      node = &hash->buckets[akey % hash->numBuckets];
-      assert(*node == hash->end || (*node)->next);
-      while (*node != hash->end && (*node)->key != akey)
-         node = &(*node)->next;
-   } else {
-      node = &hash->end;
+   struct cso_hash_iter iter = {hash, NULL};
+
+   for (;; i = (i + 1) & hash->mask) {
+      struct cso_hash_entry *entry = &hash->entries[i];
+
+      if (!entry->value)
+         break;
+
+      if (entry->key == key && entry->value != CSO_HASH_DELETED) {
+         iter.entry = entry;
+         break;
+      }
    }
-   return node;
+   return iter;
+}
+
+/**
+ * Return the first slot of the probe sequence of a key.
+ *
+ * Keys are scrambled by Fibonacci hashing, because many keys only differ
+ * in their low or their high bits.
+ */
+static inline unsigned
+cso_hash_home_slot(struct cso_hash *hash, unsigned key)
+{
+   return (key * 2654435769u) >> hash->shift;
 }
 
 /**
- * Return an iterator pointing to the first entry in the collision list.
+ * Return an iterator pointing to the first entry with the given key.
  */
 static inline struct cso_hash_iter
 cso_hash_find(struct cso_hash *hash, unsigned key)
 {
-   struct cso_node **nextNode = cso_hash_find_node(hash, key);
-   struct cso_hash_iter iter = {hash, *nextNode};
-   return iter;
+   if (!hash->mask) {
+      struct cso_hash_iter null_iter = {hash, NULL};
+      return null_iter;
+   }
+   return cso_hash_probe(hash, key, cso_hash_home_slot(hash, key));
 }
 
+/**
+ * Return an iterator pointing to the next entry with the same key.
+ */
+static inline struct cso_hash_iter
+cso_hash_find_next(struct cso_hash_iter iter)
+{
+   struct cso_hash *hash = iter.hash;
+   unsigned i = iter.entry - hash->entries;
+
+   return cso_hash_probe(hash, iter.entry->key, (i + 1) & hash->mask);
+}
+
+/**
+ * Return an iterator pointing to the next entry in the hash, in no
+ * particular order.
+ */
 static inline struct cso_hash_iter
 cso_hash_iter_next(struct cso_hash_iter iter)
 {
-   struct cso_hash_iter next = {iter.hash, cso_hash_data_next(iter.node)};
-   return next;
+   struct cso_hash *hash = iter.hash;
+   struct cso_hash_entry *end = hash->entries + hash->mask + 1;
+   struct cso_hash_entry *entry = iter.entry + 1;
+
+   for (; entry < end; entry++) {
+      if (entry->value && entry->value != CSO_HASH_DELETED) {
+         struct cso_hash_iter next = {hash, entry};
+         return next;
+      }
+   }
+
+   struct cso_hash_iter null_iter = {hash, NULL};
+   return null_iter;
 }
 
 #ifdef	__cplusplus
@@ -52,6 +52,7 @@
 #include "gallivm/lp_bld_pack.h"
 #include "gallivm/lp_bld_format.h"
 #include "gallivm/lp_bld_misc.h"
+#include "tessellator/p_tessellator.h"
 #include "tgsi/tgsi_exec.h"
 #include "tgsi/tgsi_dump.h"
 
@@ -1891,7 +1892,7 @@ draw_llvm_generate(struct draw_llvm *llvm, struct draw_llvm_variant *variant)
    struct gallivm_state *gallivm = variant->gallivm;
    LLVMContextRef context = gallivm->context;
    LLVMTypeRef int32_type = LLVMInt32TypeInContext(context);
-   LLVMTypeRef arg_types[12];
+   LLVMTypeRef arg_types[13];
    unsigned num_arg_types = ARRAY_SIZE(arg_types);
    LLVMTypeRef func_type;
    LLVMValueRef context_ptr;
@@ -1900,7 +1901,7 @@ draw_llvm_generate(struct draw_llvm *llvm, struct draw_llvm_variant *variant)
    char func_name[64];
    struct lp_type vs_type;
    LLVMValueRef count, fetch_elts, start_or_maxelt;
-   LLVMValueRef vertex_id_offset;
+   LLVMValueRef vertex_id_offset, fetch_offset;
    LLVMValueRef stride, step, io_itr;
    LLVMValueRef ind_vec, start_vec, have_elts, fetch_max, tmp;
    LLVMValueRef io_ptr, vbuffers_ptr, vb_ptr;
@@ -1958,6 +1959,7 @@ draw_llvm_generate(struct draw_llvm *llvm, struct draw_llvm_variant *variant)
    arg_types[i++] = int32_type;                          /* start_instance */
    arg_types[i++] = LLVMPointerType(int32_type, 0);      /* fetch_elts  */
    arg_types[i++] = int32_type;                          /* draw_id */
+   arg_types[i++] = int32_type;                          /* fetch_offset */
 
    func_type = LLVMFunctionType(LLVMInt8TypeInContext(context),
                                 arg_types, num_arg_types, 0);
@@ -1995,6 +1997,12 @@ draw_llvm_generate(struct draw_llvm *llvm, struct draw_llvm_variant *variant)
    system_values.base_instance = LLVMGetParam(variant_func, 9);
    fetch_elts                = LLVMGetParam(variant_func, 10);
    system_values.draw_id     = LLVMGetParam(variant_func, 11);
+   /*
+    * Offset of the first vertex within the range starting at start, for
+    * non-indexed draws shaded in several pieces. Unlike start, it doesn't
+    * affect the first vertex the shader sees.
+    */
+   fetch_offset              = LLVMGetParam(variant_func, 12);
 
    lp_build_name(context_ptr, "context");
    lp_build_name(io_ptr, "io");
@@ -2005,6 +2013,7 @@ draw_llvm_generate(struct draw_llvm *llvm, struct draw_llvm_variant *variant)
    lp_build_name(vb_ptr, "vb");
    lp_build_name(system_values.instance_id, "instance_id");
    lp_build_name(vertex_id_offset, "vertex_id_offset");
+   lp_build_name(fetch_offset, "fetch_offset");
    lp_build_name(system_values.base_instance, "start_instance");
    lp_build_name(fetch_elts, "fetch_elts");
    lp_build_name(system_values.draw_id, "draw_id");
@@ -2058,7 +2067,8 @@ draw_llvm_generate(struct draw_llvm *llvm, struct draw_llvm_variant *variant)
    /*
     * Only needed for non-indexed path.
     */
-   start_vec = lp_build_broadcast_scalar(&blduivec, start_or_maxelt);
+   tmp = LLVMBuildAdd(builder, start_or_maxelt, fetch_offset, "");
+   start_vec = lp_build_broadcast_scalar(&blduivec, tmp);
 
    /*
     * Pre-calculate everything which is constant per shader invocation.
@@ -3887,6 +3897,8 @@ draw_tes_llvm_generate(struct draw_llvm *llvm,
    struct lp_type tes_type;
    unsigned vector_length = variant->shader->base.vector_length;
 
+   assert(vector_length <= PIPE_TESS_DOMAIN_POINT_ALIGN);
+
    memset(&system_values, 0, sizeof(system_values));
    memset(&outputs, 0, sizeof(outputs));
 
@@ -3983,26 +3995,28 @@ draw_tes_llvm_generate(struct draw_llvm *llvm,
       mask_val = generate_tes_mask_value(variant, tes_type, num_tess_coord, lp_loop.counter);
       lp_build_mask_begin(&mask, gallivm, tes_type, mask_val);
 
-      system_values.tess_coord = LLVMGetUndef(LLVMArrayType(LLVMVectorType(flt_type, vector_length), 3));
-      for (i = 0; i < 3; i++) {
-         LLVMValueRef tess_coord_chan = LLVMGetUndef(LLVMVectorType(flt_type, vector_length));
-         for (unsigned j = 0; j < vector_length; j++) {
-            LLVMValueRef idx = LLVMBuildAdd(builder, lp_loop.counter, lp_build_const_int32(gallivm, j), "");
-            LLVMValueRef tc_val;
-            if (i == 2) {
-               if (variant->shader->base.prim_mode == PIPE_PRIM_TRIANGLES) {
-                  tc_val = lp_build_const_float(gallivm, 1.0);
-                  tc_val = LLVMBuildFSub(builder, tc_val, lp_build_pointer_get(builder, tess_coord[0], idx), "");
-                  tc_val = LLVMBuildFSub(builder, tc_val, lp_build_pointer_get(builder, tess_coord[1], idx), "");
-               } else
-                  tc_val = lp_build_const_float(gallivm, 0.0);
-            } else
-               tc_val = lp_build_pointer_get(builder, tess_coord[i], idx);
-
-            tess_coord_chan = LLVMBuildInsertElement(builder, tess_coord_chan, tc_val, lp_build_const_int32(gallivm, j), "");
-         }
-         system_values.tess_coord = LLVMBuildInsertValue(builder, system_values.tess_coord, tess_coord_chan, i, "");
+      /*
+       * The tessellator stores the domain points SoA and pads them to a
+       * whole number of vectors, so load a full vector of each coordinate.
+       */
+      LLVMValueRef tc_vals[3];
+      for (i = 0; i < 2; i++) {
+         LLVMValueRef ptr = LLVMBuildGEP(builder, tess_coord[i], &lp_loop.counter, 1, "");
+         ptr = LLVMBuildBitCast(builder, ptr, LLVMPointerType(LLVMVectorType(flt_type, vector_length), 0), "");
+         tc_vals[i] = LLVMBuildLoad(builder, ptr, "");
+         LLVMSetAlignment(tc_vals[i], 4);
       }
+      if (variant->shader->base.prim_mode == PIPE_PRIM_TRIANGLES) {
+         struct lp_build_context fltvec;
+         lp_build_context_init(&fltvec, gallivm, tes_type);
+         tc_vals[2] = lp_build_sub(&fltvec, fltvec.one, tc_vals[0]);
+         tc_vals[2] = lp_build_sub(&fltvec, tc_vals[2], tc_vals[1]);
+      } else
+         tc_vals[2] = lp_build_zero(gallivm, tes_type);
+
+      system_values.tess_coord = LLVMGetUndef(LLVMArrayType(LLVMVectorType(flt_type, vector_length), 3));
+      for (i = 0; i < 3; i++)
+         system_values.tess_coord = LLVMBuildInsertValue(builder, system_values.tess_coord, tc_vals[i], i, "");
 
       struct lp_build_tgsi_params params;
       memset(&params, 0, sizeof(params));
@@ -25,9 +25,12 @@
  *
  **************************************************************************/
 
+#include "util/u_cpu_detect.h"
+#include "util/u_debug.h"
 #include "util/u_math.h"
 #include "util/u_memory.h"
 #include "util/u_prim.h"
+#include "util/u_queue.h"
 #include "draw/draw_context.h"
 #include "draw/draw_gs.h"
 #include "draw/draw_tess.h"
@@ -41,6 +44,18 @@
 #include "gallivm/lp_bld_debug.h"
 
 
+/*
+ * Large vertex batches are shaded in parallel: split into contiguous
+ * ranges of at least this many vertices, run by the helper threads and
+ * the calling thread.  The results land in the same vertex buffer as a
+ * serial run, so everything after the vertex shader is unaffected.
+ */
+#define LLVM_VS_MIN_JOB_VERTICES 128
+#define LLVM_VS_MAX_THREADS 15
+
+DEBUG_GET_ONCE_NUM_OPTION(draw_vs_threads, "DRAW_VS_THREADS", -1)
+
+
 struct llvm_middle_end {
    struct draw_pt_middle_end base;
    struct draw_context *draw;
@@ -58,6 +73,24 @@ struct llvm_middle_end {
 
    struct draw_llvm *llvm;
    struct draw_llvm_variant *current_variant;
+
+   /** helper threads for the vertex shader, if num_vs_threads > 0 */
+   struct util_queue vs_queue;
+   unsigned num_vs_threads;
+};
+
+
+/** One range of vertices to shade, see llvm_middle_end_run_vs() */
+struct llvm_vs_job {
+   struct llvm_middle_end *fpme;
+   struct vertex_header *verts;
+   const unsigned *elts;
+   unsigned count;
+   unsigned start_or_maxelt;
+   unsigned fetch_offset;
+   unsigned vid_base;
+   boolean clipped;
+   struct util_queue_fence fence;
 };
 
 
@@ -560,6 +593,114 @@ emit(struct pt_emit *emit,
 }
 
 
+static void
+llvm_vs_job_execute(void *data, int thread_index)
+{
+   struct llvm_vs_job *job = (struct llvm_vs_job *)data;
+   struct llvm_middle_end *fpme = job->fpme;
+   struct draw_context *draw = fpme->draw;
+   unsigned fpstate = util_fpstate_get();
+
+   /* Helper threads don't inherit the denorm handling draw_vbo() set up
+    * on the calling thread.
+    */
+   util_fpstate_set_denorms_to_zero(fpstate);
+
+   job->clipped = fpme->current_variant->jit_func(&fpme->llvm->jit_context,
+                                                  job->verts,
+                                                  draw->pt.user.vbuffer,
+                                                  job->count,
+                                                  job->start_or_maxelt,
+                                                  fpme->vertex_size,
+                                                  draw->pt.vertex_buffer,
+                                                  draw->instance_id,
+                                                  job->vid_base,
+                                                  draw->start_instance,
+                                                  job->elts,
+                                                  draw->pt.user.drawid,
+                                                  job->fetch_offset);
+
+   util_fpstate_set(fpstate);
+}
+
+
+/**
+ * Run fetch and the vertex shader for all the vertices of fetch_info,
+ * spreading them over the helper threads when there are enough of them.
+ * Returns whether any vertex needs clipping.
+ */
+static boolean
+llvm_middle_end_run_vs(struct llvm_middle_end *fpme,
+                       const struct draw_fetch_info *fetch_info,
+                       struct vertex_header *verts,
+                       unsigned start_or_maxelt,
+                       unsigned vid_base,
+                       const unsigned *elts)
+{
+   struct llvm_vs_job jobs[LLVM_VS_MAX_THREADS + 1];
+   const unsigned vector_length = lp_native_vector_width / 32;
+   const unsigned count = fetch_info->count;
+   unsigned num_jobs, job_size, i;
+   boolean clipped;
+
+   num_jobs = MIN2(fpme->num_vs_threads + 1,
+                   count / LLVM_VS_MIN_JOB_VERTICES);
+   num_jobs = MAX2(num_jobs, 1);
+
+   /* Ranges start on a vector boundary, so that each one only writes
+    * its own vertices.
+    */
+   job_size = align(DIV_ROUND_UP(count, num_jobs), vector_length);
+
+   for (i = 0; i < num_jobs; i++) {
+      struct llvm_vs_job *job = &jobs[i];
+      unsigned first = i * job_size;
+
+      if (first >= count) {
+         num_jobs = i;
+         break;
+      }
+
+      job->fpme = fpme;
+      job->verts = (struct vertex_header *)
+         ((char *)verts + first * fpme->vertex_size);
+      job->count = MIN2(job_size, count - first);
+      job->start_or_maxelt = start_or_maxelt;
+      job->vid_base = vid_base;
+      job->clipped = FALSE;
+      /* The shader sees start as the first vertex, so only the fetch
+       * moves with the range.
+       */
+      if (fetch_info->linear) {
+         job->fetch_offset = first;
+         job->elts = NULL;
+      }
+      else {
+         job->fetch_offset = 0;
+         job->elts = elts + first;
+      }
+   }
+
+   /* The first range runs on this thread. */
+   for (i = 1; i < num_jobs; i++) {
+      util_queue_fence_init(&jobs[i].fence);
+      util_queue_add_job(&fpme->vs_queue, &jobs[i], &jobs[i].fence,
+                         llvm_vs_job_execute, NULL, 0);
+   }
+
+   llvm_vs_job_execute(&jobs[0], 0);
+   clipped = jobs[0].clipped;
+
+   for (i = 1; i < num_jobs; i++) {
+      util_queue_fence_wait(&jobs[i].fence);
+      util_queue_fence_destroy(&jobs[i].fence);
+      clipped |= jobs[i].clipped;
+   }
+
+   return clipped;
+}
+
+
 static void
 llvm_pipeline_generic(struct draw_pt_middle_end *middle,
                       const struct draw_fetch_info *fetch_info,
@@ -621,17 +762,8 @@ llvm_pipeline_generic(struct draw_pt_middle_end *middle,
       vid_base = draw->pt.user.eltBias;
       elts = fetch_info->elts;
    }
-   clipped = fpme->current_variant->jit_func(&fpme->llvm->jit_context,
-                                             llvm_vert_info.verts,
-                                             draw->pt.user.vbuffer,
-                                             fetch_info->count,
-                                             start_or_maxelt,
-                                             fpme->vertex_size,
-                                             draw->pt.vertex_buffer,
-                                             draw->instance_id,
-                                             vid_base,
-                                             draw->start_instance,
-                                             elts, draw->pt.user.drawid);
+   clipped = llvm_middle_end_run_vs(fpme, fetch_info, llvm_vert_info.verts,
+                                    start_or_maxelt, vid_base, elts);
 
    /* Finished with fetch and vs:
     */
@@ -900,6 +1032,9 @@ llvm_middle_end_destroy(struct draw_pt_middle_end *middle)
    if (fpme->post_vs)
       draw_pt_post_vs_destroy( fpme->post_vs );
 
+   if (fpme->num_vs_threads)
+      util_queue_destroy(&fpme->vs_queue);
+
    FREE(middle);
 }
 
@@ -948,6 +1083,19 @@ draw_pt_fetch_pipeline_or_emit_llvm(struct draw_context *draw)
 
    fpme->current_variant = NULL;
 
+   /* By default leave a core to the application and rasterizer threads. */
+   {
+      long num_threads = debug_get_option_draw_vs_threads();
+      if (num_threads < 0)
+         num_threads = MIN2(util_cpu_caps.nr_cpus / 2, 4);
+      num_threads = MIN2(num_threads, LLVM_VS_MAX_THREADS);
+
+      if (num_threads > 0 &&
+          util_queue_init(&fpme->vs_queue, "drawvs", 2 * num_threads,
+                          num_threads, 0))
+         fpme->num_vs_threads = num_threads;
+   }
+
    return &fpme->base;
 
  fail:
@@ -56,6 +56,81 @@
 #include "lp_bld_bitarit.h"
 #include "lp_bld_misc.h"
 
+/*
+ * The C fallback fetch functions are referenced by name from the generated
+ * code, with the format number appended, rather than by embedding their
+ * address.  That keeps the machine code relocatable, so modules using them
+ * can be stored in the shader cache and relinked by another process.
+ */
+#define LP_FETCH_RGBA_8UNORM_PREFIX "lp_fetch_rgba_8unorm_"
+#define LP_FETCH_RGBA_FLOAT_PREFIX  "lp_fetch_rgba_float_"
+
+
+static LLVMValueRef
+lp_build_fetch_func_decl(struct gallivm_state *gallivm,
+                         const char *prefix,
+                         enum pipe_format format,
+                         LLVMTypeRef function_type)
+{
+   LLVMValueRef function;
+   char name[64];
+
+   snprintf(name, sizeof(name), "%s%u", prefix, (unsigned)format);
+
+   function = LLVMGetNamedFunction(gallivm->module, name);
+   if (!function) {
+      function = LLVMAddFunction(gallivm->module, name, function_type);
+      LLVMSetLinkage(function, LLVMExternalLinkage);
+   }
+
+   return function;
+}
+
+
+/**
+ * Resolve a symbol declared by lp_build_fetch_func_decl().
+ * Called by the JIT linker, returns NULL for any other symbol.
+ */
+void *
+lp_build_format_resolve_symbol(const char *name)
+{
+   const struct util_format_unpack_description *unpack;
+   const char *suffix;
+   unsigned format;
+
+   /* Skip the global prefix of targets such as Mach-O. */
+   if (name[0] == '_')
+      name++;
+
+   if (strncmp(name, LP_FETCH_RGBA_8UNORM_PREFIX,
+               strlen(LP_FETCH_RGBA_8UNORM_PREFIX)) == 0) {
+      suffix = name + strlen(LP_FETCH_RGBA_8UNORM_PREFIX);
+      format = strtoul(suffix, NULL, 10);
+      if (format >= PIPE_FORMAT_COUNT)
+         return NULL;
+      unpack = util_format_unpack_description(format);
+      if (!unpack || !unpack->fetch_rgba_8unorm)
+         return NULL;
+      return func_to_pointer((func_pointer) unpack->fetch_rgba_8unorm);
+   }
+
+   if (strncmp(name, LP_FETCH_RGBA_FLOAT_PREFIX,
+               strlen(LP_FETCH_RGBA_FLOAT_PREFIX)) == 0) {
+      suffix = name + strlen(LP_FETCH_RGBA_FLOAT_PREFIX);
+      format = strtoul(suffix, NULL, 10);
+      if (format >= PIPE_FORMAT_COUNT)
+         return NULL;
+      util_format_fetch_rgba_func_ptr fetch_rgba =
+         util_format_fetch_rgba_func(format);
+      if (!fetch_rgba)
+         return NULL;
+      return func_to_pointer((func_pointer) fetch_rgba);
+   }
+
+   return NULL;
+}
+
+
 /**
  * Basic swizzling.  Rearrange the order of the unswizzled array elements
  * according to the format description.  PIPE_SWIZZLE_0/ONE are supported
@@ -817,7 +892,7 @@ lp_build_fetch_rgba_aos(struct gallivm_state *gallivm,
       }
 
       /*
-       * Declare and bind format_desc->fetch_rgba_8unorm().
+       * Declare format_desc->fetch_rgba_8unorm().
        */
 
       {
@@ -837,16 +912,10 @@ lp_build_fetch_rgba_aos(struct gallivm_state *gallivm,
          function_type = LLVMFunctionType(ret_type, arg_types,
                                           ARRAY_SIZE(arg_types), 0);
 
-         if (gallivm->cache)
-            gallivm->cache->dont_cache = true;
-         /* make const pointer for the C fetch_rgba_8unorm function */
-         function = lp_build_const_int_pointer(gallivm,
-            func_to_pointer((func_pointer) unpack->fetch_rgba_8unorm));
-
-         /* cast the callee pointer to the function's type */
-         function = LLVMBuildBitCast(builder, function,
-                                     LLVMPointerType(function_type, 0),
-                                     "cast callee");
+         function = lp_build_fetch_func_decl(gallivm,
+                                             LP_FETCH_RGBA_8UNORM_PREFIX,
+                                             format_desc->format,
+                                             function_type);
       }
 
       tmp_ptr = lp_build_alloca(gallivm, i32t, "");
@@ -926,7 +995,7 @@ lp_build_fetch_rgba_aos(struct gallivm_state *gallivm,
       }
 
       /*
-       * Declare and bind unpack->fetch_rgba_float().
+       * Declare unpack->fetch_rgba_float().
        */
 
       {
@@ -936,20 +1005,20 @@ lp_build_fetch_rgba_aos(struct gallivm_state *gallivm,
           */
          LLVMTypeRef ret_type;
          LLVMTypeRef arg_types[4];
+         LLVMTypeRef function_type;
 
          ret_type = LLVMVoidTypeInContext(gallivm->context);
          arg_types[0] = pf32t;
          arg_types[1] = pi8t;
          arg_types[2] = i32t;
          arg_types[3] = i32t;
+         function_type = LLVMFunctionType(ret_type, arg_types,
+                                          ARRAY_SIZE(arg_types), 0);
 
-         if (gallivm->cache)
-            gallivm->cache->dont_cache = true;
-         function = lp_build_const_func_pointer(gallivm,
-                                                func_to_pointer((func_pointer) fetch_rgba),
-                                                ret_type,
-                                                arg_types, ARRAY_SIZE(arg_types),
-                                                format_desc->short_name);
+         function = lp_build_fetch_func_decl(gallivm,
+                                             LP_FETCH_RGBA_FLOAT_PREFIX,
+                                             format_desc->format,
+                                             function_type);
       }
 
       tmp_ptr = lp_build_alloca(gallivm, f32x4t, "");
@@ -442,9 +442,18 @@ lp_build_init(void)
       util_cpu_caps.has_avx2 = 0;
       util_cpu_caps.has_f16c = 0;
       util_cpu_caps.has_fma = 0;
+      util_cpu_caps.has_avx512f = 0;
    }
 #endif
 
+#if LLVM_VERSION_MAJOR >= 8
+   /* Needs the function attributes set in gallivm_compile_module, or LLVM
+    * splits 512-bit vectors on CPUs tuned for 256-bit ones.
+    */
+   if (util_cpu_caps.has_avx512f) {
+      lp_native_vector_width = 512;
+   } else
+#endif
    if (util_cpu_caps.has_avx2 || util_cpu_caps.has_avx) {
       lp_native_vector_width = 256;
    } else {
@@ -578,7 +587,13 @@ gallivm_compile_module(struct gallivm_state *gallivm)
       gallivm->builder = NULL;
    }
 
+   /* The object is loaded from the cache when the engine is created, so
+    * neither the optimization passes nor code generation need to run.
+    */
    if (gallivm->cache && gallivm->cache->data_size) {
+      if (gallivm_debug & GALLIVM_DEBUG_PERF)
+         debug_printf("module %s loaded from the shader cache\n",
+                      gallivm->module_name ? gallivm->module_name : "");
       goto skip_cached;
    }
 
@@ -619,6 +634,14 @@ gallivm_compile_module(struct gallivm_state *gallivm)
       LLVMAddTargetDependentFunctionAttr(func, "no-frame-pointer-elim-non-leaf", "true");
 #endif
 
+#if LLVM_VERSION_MAJOR >= 8 && (defined(PIPE_ARCH_X86) || defined(PIPE_ARCH_X86_64))
+      /* Keep 512-bit vectors in zmm registers, and masks in k registers. */
+      if (lp_native_vector_width > 256) {
+         LLVMAddTargetDependentFunctionAttr(func, "prefer-vector-width", "512");
+         LLVMAddTargetDependentFunctionAttr(func, "min-legal-vector-width", "512");
+      }
+#endif
+
       LLVMRunFunctionPassManager(gallivm->passmgr, func);
       func = LLVMGetNextFunction(func);
    }
@@ -348,6 +348,16 @@ lp_build_select(struct lp_build_context *bld,
 
       res = LLVMBuildSelect(builder, mask, a, b, "");
    }
+   else if (util_cpu_caps.has_avx512f &&
+            type.width * type.length == 512 &&
+            (type.width >= 32 || util_cpu_caps.has_avx512bw)) {
+      /* AVX-512 has no blendv, but selects on a compare result become a
+       * masked move through a k register.
+       */
+      mask = LLVMBuildICmp(builder, LLVMIntNE, mask,
+                           LLVMConstNull(LLVMTypeOf(mask)), "");
+      res = LLVMBuildSelect(builder, mask, a, b, "");
+   }
    else if (((util_cpu_caps.has_sse4_1 &&
               type.width * type.length == 128) ||
              (util_cpu_caps.has_avx &&
@@ -287,6 +287,17 @@ class ShaderMemoryManager : public DelegatingJITMemoryManager {
          // remember for later deallocation
          code->FunctionBody.push_back(Body);
       }
+
+      /*
+       * Symbols referenced by name from generated code, which are also
+       * resolved this way when linking an object loaded from the cache.
+       */
+      virtual uint64_t getSymbolAddress(const std::string &Name) {
+         void *addr = lp_build_format_resolve_symbol(Name.c_str());
+         if (addr)
+            return (uint64_t)(uintptr_t)addr;
+         return mgr()->getSymbolAddress(Name);
+      }
 };
 
 class LPObjectCache : public llvm::ObjectCache {
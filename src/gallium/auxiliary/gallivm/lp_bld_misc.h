@@ -41,10 +41,10 @@ extern "C" {
 #endif
 
 /*
- * some shaders use function pointers incorrectly so can't be relinked
- * properly. (mostly the fallback fetch shaders).
- * We should fix them, but the dont_cache flag can be set for now,
- * so they don't end up getting cached at all.
+ * Code which embeds absolute addresses can't be relinked by another
+ * process.  External functions should be declared by name and resolved
+ * at link time instead (see lp_build_format_resolve_symbol()); anything
+ * that can't do that must set the dont_cache flag so it isn't cached.
  */
 struct lp_cached_code {
    void *data;
@@ -91,6 +91,10 @@ lp_is_function(LLVMValueRef v);
 
 void
 lp_free_objcache(void *objcache);
+
+/* Implemented in lp_bld_format_aos.c */
+extern void *
+lp_build_format_resolve_symbol(const char *name);
 #ifdef __cplusplus
 }
 #endif
@@ -1268,6 +1268,16 @@ hud_parse_env_var(struct hud_context *hud, struct pipe_screen *screen,
       else if (strcmp(name, "API-thread-num-syncs") == 0) {
          hud_thread_counter_install(pane, name, HUD_COUNTER_SYNCS);
       }
+      else if (strcmp(name, "upload-bytes") == 0) {
+         hud_thread_counter_install(pane, name, HUD_COUNTER_UPLOADED_BYTES);
+         pane->type = PIPE_DRIVER_QUERY_TYPE_BYTES;
+      }
+      else if (strcmp(name, "upload-buffers") == 0) {
+         hud_thread_counter_install(pane, name, HUD_COUNTER_UPLOAD_BUFFERS);
+      }
+      else if (strcmp(name, "upload-buffers-reused") == 0) {
+         hud_thread_counter_install(pane, name, HUD_COUNTER_UPLOAD_REUSED);
+      }
       else if (strcmp(name, "main-thread-busy") == 0) {
          hud_thread_busy_install(pane, name, true);
       }
@@ -1567,6 +1577,10 @@ print_help(struct pipe_screen *screen)
    for (i = 0; i < num_cpus; i++)
       printf("    cpu%i\n", i);
 
+   puts("    upload-bytes");
+   puts("    upload-buffers");
+   puts("    upload-buffers-reused");
+
    if (has_occlusion_query(screen))
       puts("    samples-passed");
    if (has_streamout(screen))
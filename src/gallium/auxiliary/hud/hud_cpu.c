@@ -33,6 +33,7 @@
 #include "os/os_thread.h"
 #include "util/u_memory.h"
 #include "util/u_queue.h"
+#include "util/u_upload_mgr.h"
 #include <stdio.h>
 #include <inttypes.h>
 #ifdef PIPE_OS_WINDOWS
@@ -395,14 +396,52 @@ hud_thread_busy_install(struct hud_pane *pane, const char *name, bool main)
 
 struct counter_info {
    enum hud_counter counter;
-   unsigned last_value;
+   uint64_t last_value;
    int64_t last_time;
 };
 
-static unsigned get_counter(struct hud_graph *gr, enum hud_counter counter)
+static uint64_t get_upload_counter(struct u_upload_mgr *upload,
+                                   enum hud_counter counter)
+{
+   struct u_upload_stats stats;
+
+   u_upload_get_stats(upload, &stats);
+
+   switch (counter) {
+   case HUD_COUNTER_UPLOADED_BYTES:
+      return stats.bytes;
+   case HUD_COUNTER_UPLOAD_BUFFERS:
+      return stats.num_buffers;
+   case HUD_COUNTER_UPLOAD_REUSED:
+      return stats.num_reused;
+   default:
+      assert(0);
+      return 0;
+   }
+}
+
+static uint64_t get_counter(struct hud_graph *gr, struct pipe_context *pipe,
+                            enum hud_counter counter)
 {
    struct util_queue_monitoring *mon = gr->pane->hud->monitored_queue;
 
+   switch (counter) {
+   case HUD_COUNTER_UPLOADED_BYTES:
+   case HUD_COUNTER_UPLOAD_BUFFERS:
+   case HUD_COUNTER_UPLOAD_REUSED: {
+      uint64_t value = 0;
+
+      if (pipe->stream_uploader)
+         value += get_upload_counter(pipe->stream_uploader, counter);
+      if (pipe->const_uploader &&
+          pipe->const_uploader != pipe->stream_uploader)
+         value += get_upload_counter(pipe->const_uploader, counter);
+      return value;
+   }
+   default:
+      break;
+   }
+
    if (!mon || !mon->queue)
       return 0;
 
@@ -427,7 +466,7 @@ query_thread_counter(struct hud_graph *gr, struct pipe_context *pipe)
 
    if (info->last_time) {
       if (info->last_time + gr->pane->period*1000 <= now) {
-         unsigned current_value = get_counter(gr, info->counter);
+         uint64_t current_value = get_counter(gr, pipe, info->counter);
 
          hud_graph_add_value(gr, current_value - info->last_value);
          info->last_value = current_value;
@@ -435,7 +474,7 @@ query_thread_counter(struct hud_graph *gr, struct pipe_context *pipe)
       }
    } else {
       /* initialize */
-      info->last_value = get_counter(gr, info->counter);
+      info->last_value = get_counter(gr, pipe, info->counter);
       info->last_time = now;
    }
 }
@@ -38,6 +38,9 @@ enum hud_counter {
    HUD_COUNTER_OFFLOADED,
    HUD_COUNTER_DIRECT,
    HUD_COUNTER_SYNCS,
+   HUD_COUNTER_UPLOADED_BYTES,
+   HUD_COUNTER_UPLOAD_BUFFERS,
+   HUD_COUNTER_UPLOAD_REUSED,
 };
 
 struct hud_context {
@@ -24,6 +24,7 @@
 
 #include "u_indices.h"
 #include "u_indices_priv.h"
+#include "util/u_cpu_detect.h"
 
 static void translate_memcpy_ushort( const void *in,
                                      unsigned start,
@@ -54,11 +55,74 @@ static void translate_byte_to_ushort( const void *in,
 {
    uint8_t *src = (uint8_t *)in + start;
    uint16_t *dst = out;
+#if defined(USE_SSE41)
+   if (util_cpu_caps.has_sse4_1) {
+      static const uint8_t mask[1][16] = {
+         { 0, 0x80, 1, 0x80, 2, 0x80, 3, 0x80,
+           4, 0x80, 5, 0x80, 6, 0x80, 7, 0x80 },
+      };
+      unsigned n = u_index_shuffle_sse41(src, out_nr, 8,
+                                         dst, out_nr * 2, 16, mask, 1);
+      src += n * 8;
+      dst += n * 8;
+      out_nr -= n * 8;
+   }
+#endif
    while (out_nr--) {
       *dst++ = *src++;
    }
 }
 
+/**
+ * Return whether any of the \p count indices at \p in is \p restart_index.
+ */
+bool
+u_index_has_restart(const void *in, unsigned index_size, unsigned count,
+                    unsigned restart_index)
+{
+   unsigned i;
+
+   /* Smaller indices are compared with the full restart index. */
+   if (index_size < 4 && restart_index >> (index_size * 8))
+      return false;
+
+#if defined(USE_SSE41)
+   if (util_cpu_caps.has_sse4_1)
+      return u_index_has_restart_sse41(in, index_size, count, restart_index);
+#endif
+
+   /* Compare a block at a time without branching, which vectorizes. */
+#define HAS_RESTART(type)                                         \
+   for (i = 0; i + 64 <= count; i += 64) {                        \
+      const type *elts = (const type *)in + i;                    \
+      unsigned found = 0;                                         \
+      for (unsigned k = 0; k < 64; k++)                           \
+         found |= elts[k] == restart_index;                       \
+      if (found)                                                  \
+         return true;                                             \
+   }                                                              \
+   for (; i < count; i++) {                                       \
+      if (((const type *)in)[i] == restart_index)                 \
+         return true;                                             \
+   }
+
+   switch (index_size) {
+   case 1:
+      HAS_RESTART(uint8_t)
+      break;
+   case 2:
+      HAS_RESTART(uint16_t)
+      break;
+   default:
+      HAS_RESTART(uint32_t)
+      break;
+   }
+
+#undef HAS_RESTART
+
+   return false;
+}
+
 /**
  * Translate indexes when a driver can't support certain types
  * of drawing.  Example include:
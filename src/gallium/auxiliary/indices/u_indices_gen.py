@@ -69,6 +69,11 @@ intype_idx = dict(ubyte='IN_UBYTE', ushort='IN_USHORT', uint='IN_UINT')
 outtype_idx = dict(ushort='OUT_USHORT', uint='OUT_UINT')
 pv_idx = dict(first='PV_FIRST', last='PV_LAST')
 pr_idx = dict(prdisable='PR_DISABLE', prenable='PR_ENABLE')
+index_size = dict(ubyte=1, ushort=2, uint=4)
+
+# Set by vertex_offsets() to collect the vertices of a primitive instead of
+# printing them.
+recorded = None
 
 def prolog():
     print('''/* File automatically generated by u_indices_gen.py */''')
@@ -81,6 +86,7 @@ def prolog():
  */
 
 #include "indices/u_indices_priv.h"
+#include "util/u_cpu_detect.h"
 #include "util/u_debug.h"
 #include "util/u_memory.h"
 
@@ -117,31 +123,27 @@ def vert( intype, outtype, v0 ):
     else:
         return '(' + outtype + ')in[' + v0 + ']'
 
+def emit_verts( intype, outtype, ptr, verts ):
+    if recorded is not None:
+        recorded.extend(verts)
+        return
+    for k, v in enumerate(verts):
+        print('      (' + ptr + ')[' + str(k) + '] = ' + vert( intype, outtype, v ) + ';')
+
 def point( intype, outtype, ptr, v0 ):
-    print('      (' + ptr + ')[0] = ' + vert( intype, outtype, v0 ) + ';')
+    emit_verts( intype, outtype, ptr, (v0,) )
 
 def line( intype, outtype, ptr, v0, v1 ):
-    print('      (' + ptr + ')[0] = ' + vert( intype, outtype, v0 ) + ';')
-    print('      (' + ptr + ')[1] = ' + vert( intype, outtype, v1 ) + ';')
+    emit_verts( intype, outtype, ptr, (v0, v1) )
 
 def tri( intype, outtype, ptr, v0, v1, v2 ):
-    print('      (' + ptr + ')[0] = ' + vert( intype, outtype, v0 ) + ';')
-    print('      (' + ptr + ')[1] = ' + vert( intype, outtype, v1 ) + ';')
-    print('      (' + ptr + ')[2] = ' + vert( intype, outtype, v2 ) + ';')
+    emit_verts( intype, outtype, ptr, (v0, v1, v2) )
 
 def lineadj( intype, outtype, ptr, v0, v1, v2, v3 ):
-    print('      (' + ptr + ')[0] = ' + vert( intype, outtype, v0 ) + ';')
-    print('      (' + ptr + ')[1] = ' + vert( intype, outtype, v1 ) + ';')
-    print('      (' + ptr + ')[2] = ' + vert( intype, outtype, v2 ) + ';')
-    print('      (' + ptr + ')[3] = ' + vert( intype, outtype, v3 ) + ';')
+    emit_verts( intype, outtype, ptr, (v0, v1, v2, v3) )
 
 def triadj( intype, outtype, ptr, v0, v1, v2, v3, v4, v5 ):
-    print('      (' + ptr + ')[0] = ' + vert( intype, outtype, v0 ) + ';')
-    print('      (' + ptr + ')[1] = ' + vert( intype, outtype, v1 ) + ';')
-    print('      (' + ptr + ')[2] = ' + vert( intype, outtype, v2 ) + ';')
-    print('      (' + ptr + ')[3] = ' + vert( intype, outtype, v3 ) + ';')
-    print('      (' + ptr + ')[4] = ' + vert( intype, outtype, v4 ) + ';')
-    print('      (' + ptr + ')[5] = ' + vert( intype, outtype, v5 ) + ';')
+    emit_verts( intype, outtype, ptr, (v0, v1, v2, v3, v4, v5) )
 
 def do_point( intype, outtype, ptr, v0 ):
     point( intype, outtype, ptr, v0 )
@@ -226,29 +228,116 @@ def prim_restart(in_verts, out_verts, out_prims, close_func = None):
         print('         goto restart;')
         print('      }')
 
+def vertex_offsets(body):
+    '''Return the input vertices of the primitive emitted by body, as
+    offsets from i.'''
+    global recorded
+    recorded = []
+    body()
+    offsets = [eval(v, {'i': 0}) for v in recorded]
+    recorded = None
+    return offsets
+
+def simd_prologue(intype, outtype, in_step, offsets):
+    '''Convert whole groups of primitives with SSE4.1 ahead of the scalar
+    loop.  A group is a byte shuffle of up to 16 bytes of input indices or,
+    when generating, a set of constant offsets added to i.'''
+    out_size = index_size[outtype]
+    out_verts = len(offsets)
+    if intype == GENERATE:
+        group = 48 // (out_verts * out_size)
+    else:
+        in_size = index_size[intype]
+        span = max(offsets) + 1
+        if span * in_size > 16:
+            return
+        group = min((16 // in_size - span) // in_step + 1,
+                    48 // (out_verts * out_size))
+    out_bytes = group * out_verts * out_size
+    nr_vecs = (out_bytes + 15) // 16
+
+    print('#if defined(USE_SSE41)')
+    print('  if (util_cpu_caps.has_sse4_1) {')
+    print('     unsigned nr = out_nr / ' + str(out_verts) + ';')
+    print('     unsigned n;')
+    if intype == GENERATE:
+        lanes = 16 // out_size
+        elts = [p * in_step + o for p in range(group) for o in offsets]
+        elts += [0] * (nr_vecs * lanes - len(elts))
+        print('     static const ' + outtype + ' offsets[' + str(nr_vecs) + '][' + str(lanes) + '] = {')
+        for v in range(nr_vecs):
+            print('        { ' + ', '.join(str(e) for e in elts[v * lanes:(v + 1) * lanes]) + ' },')
+        print('     };')
+        print('     n = u_index_generate_sse41(start, ' + str(out_size) + ', ' + str(group * in_step) + ',')
+        print('                                out, nr * ' + str(out_verts * out_size) + ', ' + str(out_bytes) + ',')
+        print('                                offsets, ' + str(nr_vecs) + ');')
+    else:
+        masks = []
+        for b in range(nr_vecs * 16):
+            e, byte = divmod(b, out_size)
+            if e >= group * out_verts or byte >= in_size:
+                masks.append(0x80)
+            else:
+                p, v = divmod(e, out_verts)
+                masks.append((p * in_step + offsets[v]) * in_size + byte)
+        print('     static const uint8_t masks[' + str(nr_vecs) + '][16] = {')
+        for v in range(nr_vecs):
+            print('        { ' + ', '.join('0x%02x' % m for m in masks[v * 16:(v + 1) * 16]) + ' },')
+        print('     };')
+        print('     n = u_index_shuffle_sse41(in + start,')
+        print('                               nr ? ((nr - 1) * ' + str(in_step) + ' + ' + str(span) + ') * ' + str(in_size) + ' : 0, ' + str(group * in_step * in_size) + ',')
+        print('                               out, nr * ' + str(out_verts * out_size) + ', ' + str(out_bytes) + ',')
+        print('                               masks, ' + str(nr_vecs) + ');')
+    print('     i += n * ' + str(group * in_step) + ';')
+    print('     j += n * ' + str(group * out_verts) + ';')
+    print('  }')
+    print('#endif')
+
+def fixed_loop(intype, outtype, in_step, out_step, body):
+    '''Loop over primitives whose vertices are at fixed offsets from i.'''
+    print('  i = start;')
+    print('  j = 0;')
+    simd_prologue(intype, outtype, in_step, vertex_offsets(body))
+    print('  for (; j < out_nr; j+=' + str(out_step) + ', i+=' + str(in_step) + ') { ')
+    body()
+    print('   }')
+
+def restart_fast_path(intype, outtype, inpv, outpv, prim, nr, in_step, in_verts):
+    '''Without a restart index among the vertices checked by the loop, the
+    result is the same as with primitive restart disabled, so scan for one
+    first and skip the per-primitive checks if there is none.'''
+    print('  {')
+    print('     unsigned nr = ' + nr + ';')
+    print('     unsigned count = nr ? (nr - 1) * ' + str(in_step) + ' + ' + str(in_verts) + ' : 0;')
+    print('     if (start + count <= in_nr &&')
+    print('         !u_index_has_restart(in + start, sizeof(*in), count, restart_index)) {')
+    print('        ' + name( intype, outtype, inpv, outpv, PRDISABLE, prim ) + '(_in, start, in_nr, out_nr, restart_index, _out);')
+    print('        return;')
+    print('     }')
+    print('  }')
+
 def points(intype, outtype, inpv, outpv, pr):
     preamble(intype, outtype, inpv, outpv, pr, prim='points')
-    print('  for (i = start, j = 0; j < out_nr; j++, i++) { ')
-    do_point( intype, outtype, 'out+j',  'i' );
-    print('   }')
+    fixed_loop(intype, outtype, 1, 1,
+               lambda: do_point( intype, outtype, 'out+j',  'i' ))
     postamble()
 
 def lines(intype, outtype, inpv, outpv, pr):
     preamble(intype, outtype, inpv, outpv, pr, prim='lines')
-    print('  for (i = start, j = 0; j < out_nr; j+=2, i+=2) { ')
-    do_line( intype, outtype, 'out+j',  'i', 'i+1', inpv, outpv );
-    print('   }')
+    fixed_loop(intype, outtype, 2, 2,
+               lambda: do_line( intype, outtype, 'out+j',  'i', 'i+1', inpv, outpv ))
     postamble()
 
 def linestrip(intype, outtype, inpv, outpv, pr):
     preamble(intype, outtype, inpv, outpv, pr, prim='linestrip')
-    print('  for (i = start, j = 0; j < out_nr; j+=2, i++) { ')
-    do_line( intype, outtype, 'out+j',  'i', 'i+1', inpv, outpv );
-    print('   }')
+    fixed_loop(intype, outtype, 1, 2,
+               lambda: do_line( intype, outtype, 'out+j',  'i', 'i+1', inpv, outpv ))
     postamble()
 
 def lineloop(intype, outtype, inpv, outpv, pr):
     preamble(intype, outtype, inpv, outpv, pr, prim='lineloop')
+    if pr == PRENABLE:
+        restart_fast_path(intype, outtype, inpv, outpv, 'lineloop', 'out_nr > 2 ? out_nr / 2 - 1 : 0', 1, 2)
     print('  unsigned end = start;')
     print('  for (i = start, j = 0; j < out_nr - 2; j+=2, i++) { ')
     if pr == PRENABLE:
@@ -268,9 +357,8 @@ def lineloop(intype, outtype, inpv, outpv, pr):
 
 def tris(intype, outtype, inpv, outpv, pr):
     preamble(intype, outtype, inpv, outpv, pr, prim='tris')
-    print('  for (i = start, j = 0; j < out_nr; j+=3, i+=3) { ')
-    do_tri( intype, outtype, 'out+j',  'i', 'i+1', 'i+2', inpv, outpv );
-    print('   }')
+    fixed_loop(intype, outtype, 3, 3,
+               lambda: do_tri( intype, outtype, 'out+j',  'i', 'i+1', 'i+2', inpv, outpv ))
     postamble()
 
 
@@ -287,6 +375,8 @@ def tristrip(intype, outtype, inpv, outpv, pr):
 
 def trifan(intype, outtype, inpv, outpv, pr):
     preamble(intype, outtype, inpv, outpv, pr, prim='trifan')
+    if pr == PRENABLE:
+        restart_fast_path(intype, outtype, inpv, outpv, 'trifan', 'out_nr / 3', 1, 3)
     print('  for (i = start, j = 0; j < out_nr; j+=3, i++) { ')
 
     if pr == PRENABLE:
@@ -306,6 +396,8 @@ def trifan(intype, outtype, inpv, outpv, pr):
 
 def polygon(intype, outtype, inpv, outpv, pr):
     preamble(intype, outtype, inpv, outpv, pr, prim='polygon')
+    if pr == PRENABLE:
+        restart_fast_path(intype, outtype, inpv, outpv, 'polygon', 'out_nr / 3', 1, 3)
     print('  for (i = start, j = 0; j < out_nr; j+=3, i++) { ')
     if pr == PRENABLE:
         def close_func(index):
@@ -322,51 +414,54 @@ def polygon(intype, outtype, inpv, outpv, pr):
 
 def quads(intype, outtype, inpv, outpv, pr):
     preamble(intype, outtype, inpv, outpv, pr, prim='quads')
-    print('  for (i = start, j = 0; j < out_nr; j+=6, i+=4) { ')
+    body = lambda: do_quad( intype, outtype, 'out+j', 'i+0', 'i+1', 'i+2', 'i+3', inpv, outpv )
     if pr == PRENABLE:
+        restart_fast_path(intype, outtype, inpv, outpv, 'quads', 'out_nr / 6', 4, 4)
+        print('  for (i = start, j = 0; j < out_nr; j+=6, i+=4) { ')
         prim_restart(4, 3, 2)
-
-    do_quad( intype, outtype, 'out+j', 'i+0', 'i+1', 'i+2', 'i+3', inpv, outpv );
-    print('   }')
+        body()
+        print('   }')
+    else:
+        fixed_loop(intype, outtype, 4, 6, body)
     postamble()
 
 
 def quadstrip(intype, outtype, inpv, outpv, pr):
     preamble(intype, outtype, inpv, outpv, pr, prim='quadstrip')
-    print('  for (i = start, j = 0; j < out_nr; j+=6, i+=2) { ')
+    if inpv == LAST:
+        body = lambda: do_quad( intype, outtype, 'out+j', 'i+2', 'i+0', 'i+1', 'i+3', inpv, outpv )
+    else:
+        body = lambda: do_quad( intype, outtype, 'out+j', 'i+0', 'i+1', 'i+3', 'i+2', inpv, outpv )
     if pr == PRENABLE:
+        restart_fast_path(intype, outtype, inpv, outpv, 'quadstrip', 'out_nr / 6', 2, 4)
+        print('  for (i = start, j = 0; j < out_nr; j+=6, i+=2) { ')
         prim_restart(4, 3, 2)
-
-    if inpv == LAST:
-        do_quad( intype, outtype, 'out+j', 'i+2', 'i+0', 'i+1', 'i+3', inpv, outpv );
+        body()
+        print('   }')
     else:
-        do_quad( intype, outtype, 'out+j', 'i+0', 'i+1', 'i+3', 'i+2', inpv, outpv );
-    print('   }')
+        fixed_loop(intype, outtype, 2, 6, body)
     postamble()
 
 
 def linesadj(intype, outtype, inpv, outpv, pr):
     preamble(intype, outtype, inpv, outpv, pr, prim='linesadj')
-    print('  for (i = start, j = 0; j < out_nr; j+=4, i+=4) { ')
-    do_lineadj( intype, outtype, 'out+j',  'i+0', 'i+1', 'i+2', 'i+3', inpv, outpv )
-    print('  }')
+    fixed_loop(intype, outtype, 4, 4,
+               lambda: do_lineadj( intype, outtype, 'out+j',  'i+0', 'i+1', 'i+2', 'i+3', inpv, outpv ))
     postamble()
 
 
 def linestripadj(intype, outtype, inpv, outpv, pr):
     preamble(intype, outtype, inpv, outpv, pr, prim='linestripadj')
-    print('  for (i = start, j = 0; j < out_nr; j+=4, i++) {')
-    do_lineadj( intype, outtype, 'out+j',  'i+0', 'i+1', 'i+2', 'i+3', inpv, outpv )
-    print('  }')
+    fixed_loop(intype, outtype, 1, 4,
+               lambda: do_lineadj( intype, outtype, 'out+j',  'i+0', 'i+1', 'i+2', 'i+3', inpv, outpv ))
     postamble()
 
 
 def trisadj(intype, outtype, inpv, outpv, pr):
     preamble(intype, outtype, inpv, outpv, pr, prim='trisadj')
-    print('  for (i = start, j = 0; j < out_nr; j+=6, i+=6) { ')
-    do_triadj( intype, outtype, 'out+j',  'i+0', 'i+1', 'i+2', 'i+3',
-               'i+4', 'i+5', inpv, outpv )
-    print('  }')
+    fixed_loop(intype, outtype, 6, 6,
+               lambda: do_triadj( intype, outtype, 'out+j',  'i+0', 'i+1', 'i+2', 'i+3',
+                                  'i+4', 'i+5', inpv, outpv ))
     postamble()
 
 
@@ -443,6 +538,7 @@ def emit_init():
     print('  static int firsttime = 1;')
     print('  if (!firsttime) return;')
     print('  firsttime = 0;')
+    print('  util_cpu_detect();')
     emit_all_inits()
     print('}')
 
@@ -40,4 +40,25 @@
 
 #define PRIM_COUNT   (PIPE_PRIM_TRIANGLE_STRIP_ADJACENCY + 1)
 
+
+bool
+u_index_has_restart(const void *in, unsigned index_size, unsigned count,
+                    unsigned restart_index);
+
+#if defined(USE_SSE41)
+unsigned
+u_index_shuffle_sse41(const void *in, unsigned in_size, unsigned in_stride,
+                      void *out, unsigned out_size, unsigned out_stride,
+                      const uint8_t (*masks)[16], unsigned nr_vecs);
+
+unsigned
+u_index_generate_sse41(unsigned start, unsigned index_size, unsigned step,
+                       void *out, unsigned out_size, unsigned out_stride,
+                       const void *offsets, unsigned nr_vecs);
+
+bool
+u_index_has_restart_sse41(const void *in, unsigned index_size,
+                          unsigned count, unsigned restart_index);
+#endif
+
 #endif
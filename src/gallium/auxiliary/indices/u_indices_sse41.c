@@ -0,0 +1,257 @@
+/*
+ * Copyright 2021 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * on the rights to use, copy, modify, merge, publish, distribute, sub
+ * license, and/or sell copies of the Software, and to permit persons to whom
+ * the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.  IN NO EVENT SHALL
+ * VMWARE AND/OR THEIR SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file
+ * SSE4.1 helpers for the generated index translation functions.
+ *
+ * u_indices_gen.py describes a group of primitives as either a byte
+ * shuffle of at most 16 bytes of input indices, which also covers widening
+ * and narrowing the indices, or as offsets added to the first generated
+ * index.  The functions here convert as many whole groups as fit in the
+ * given input and output sizes and return how many they did, leaving the
+ * rest to the scalar loops.
+ */
+
+#include <smmintrin.h>
+
+#include "indices/u_indices_priv.h"
+#include "util/macros.h"
+
+
+static inline unsigned
+num_groups(unsigned in_size, unsigned in_stride,
+           unsigned out_size, unsigned out_stride, unsigned nr_vecs)
+{
+   /* Every group loads and stores whole vectors, which must stay inside
+    * the ranges the scalar loop would have accessed.
+    */
+   if (in_size < 16 || out_size < 16 * nr_vecs)
+      return 0;
+
+   return MIN2((in_size - 16) / in_stride,
+               (out_size - 16 * nr_vecs) / out_stride) + 1;
+}
+
+
+static ALWAYS_INLINE void
+shuffle_groups(const uint8_t *in, unsigned in_stride,
+               uint8_t *out, unsigned out_stride,
+               const __m128i *masks, unsigned nr_vecs, unsigned n)
+{
+   for (unsigned i = 0; i < n; i++) {
+      __m128i v = _mm_loadu_si128((const __m128i *)in);
+
+      for (unsigned k = 0; k < nr_vecs; k++)
+         _mm_storeu_si128((__m128i *)out + k, _mm_shuffle_epi8(v, masks[k]));
+
+      in += in_stride;
+      out += out_stride;
+   }
+}
+
+
+unsigned
+u_index_shuffle_sse41(const void *in, unsigned in_size, unsigned in_stride,
+                      void *out, unsigned out_size, unsigned out_stride,
+                      const uint8_t (*masks)[16], unsigned nr_vecs)
+{
+   unsigned n = num_groups(in_size, in_stride, out_size, out_stride, nr_vecs);
+   __m128i m[3];
+
+   assert(nr_vecs >= 1 && nr_vecs <= ARRAY_SIZE(m));
+
+   for (unsigned k = 0; k < nr_vecs; k++)
+      m[k] = _mm_loadu_si128((const __m128i *)masks[k]);
+
+   /* Keep the number of stores a constant in each loop. */
+   switch (nr_vecs) {
+   case 1:
+      shuffle_groups(in, in_stride, out, out_stride, m, 1, n);
+      break;
+   case 2:
+      shuffle_groups(in, in_stride, out, out_stride, m, 2, n);
+      break;
+   default:
+      shuffle_groups(in, in_stride, out, out_stride, m, 3, n);
+      break;
+   }
+
+   return n;
+}
+
+
+static ALWAYS_INLINE void
+generate_groups(unsigned start, bool wide, unsigned step,
+                uint8_t *out, unsigned out_stride,
+                const __m128i *offsets, unsigned nr_vecs, unsigned n)
+{
+   for (unsigned i = 0; i < n; i++) {
+      __m128i base = wide ? _mm_set1_epi32(start) : _mm_set1_epi16(start);
+
+      for (unsigned k = 0; k < nr_vecs; k++) {
+         __m128i v = wide ? _mm_add_epi32(base, offsets[k]) :
+                            _mm_add_epi16(base, offsets[k]);
+         _mm_storeu_si128((__m128i *)out + k, v);
+      }
+
+      start += step;
+      out += out_stride;
+   }
+}
+
+
+unsigned
+u_index_generate_sse41(unsigned start, unsigned index_size, unsigned step,
+                       void *out, unsigned out_size, unsigned out_stride,
+                       const void *offsets, unsigned nr_vecs)
+{
+   unsigned n = out_size >= 16 * nr_vecs ?
+                (out_size - 16 * nr_vecs) / out_stride + 1 : 0;
+   __m128i m[3];
+
+   assert(nr_vecs >= 1 && nr_vecs <= ARRAY_SIZE(m));
+
+   for (unsigned k = 0; k < nr_vecs; k++)
+      m[k] = _mm_loadu_si128((const __m128i *)offsets + k);
+
+   if (index_size == 4) {
+      switch (nr_vecs) {
+      case 1:
+         generate_groups(start, true, step, out, out_stride, m, 1, n);
+         break;
+      case 2:
+         generate_groups(start, true, step, out, out_stride, m, 2, n);
+         break;
+      default:
+         generate_groups(start, true, step, out, out_stride, m, 3, n);
+         break;
+      }
+   } else {
+      assert(index_size == 2);
+      switch (nr_vecs) {
+      case 1:
+         generate_groups(start, false, step, out, out_stride, m, 1, n);
+         break;
+      case 2:
+         generate_groups(start, false, step, out, out_stride, m, 2, n);
+         break;
+      default:
+         generate_groups(start, false, step, out, out_stride, m, 3, n);
+         break;
+      }
+   }
+
+   return n;
+}
+
+
+static ALWAYS_INLINE __m128i
+cmpeq(__m128i a, __m128i b, unsigned index_size)
+{
+   switch (index_size) {
+   case 1:
+      return _mm_cmpeq_epi8(a, b);
+   case 2:
+      return _mm_cmpeq_epi16(a, b);
+   default:
+      return _mm_cmpeq_epi32(a, b);
+   }
+}
+
+
+static ALWAYS_INLINE bool
+has_restart(const uint8_t *in, unsigned index_size, unsigned count,
+            unsigned restart_index)
+{
+   unsigned size = count * index_size;
+   unsigned i = 0;
+   __m128i r;
+
+   switch (index_size) {
+   case 1:
+      r = _mm_set1_epi8(restart_index);
+      break;
+   case 2:
+      r = _mm_set1_epi16(restart_index);
+      break;
+   default:
+      r = _mm_set1_epi32(restart_index);
+      break;
+   }
+
+   /* Test 64 bytes at a time, the early exit is only for long buffers. */
+   for (; i + 64 <= size; i += 64) {
+      const __m128i *v = (const __m128i *)(in + i);
+      __m128i eq = _mm_or_si128(
+         _mm_or_si128(cmpeq(_mm_loadu_si128(v + 0), r, index_size),
+                      cmpeq(_mm_loadu_si128(v + 1), r, index_size)),
+         _mm_or_si128(cmpeq(_mm_loadu_si128(v + 2), r, index_size),
+                      cmpeq(_mm_loadu_si128(v + 3), r, index_size)));
+      if (!_mm_testz_si128(eq, eq))
+         return true;
+   }
+
+   for (; i + 16 <= size; i += 16) {
+      __m128i eq = cmpeq(_mm_loadu_si128((const __m128i *)(in + i)), r,
+                         index_size);
+      if (!_mm_testz_si128(eq, eq))
+         return true;
+   }
+
+   for (; i < size; i += index_size) {
+      switch (index_size) {
+      case 1:
+         if (in[i] == restart_index)
+            return true;
+         break;
+      case 2:
+         if (*(const uint16_t *)(in + i) == restart_index)
+            return true;
+         break;
+      default:
+         if (*(const uint32_t *)(in + i) == restart_index)
+            return true;
+         break;
+      }
+   }
+
+   return false;
+}
+
+
+bool
+u_index_has_restart_sse41(const void *in, unsigned index_size,
+                          unsigned count, unsigned restart_index)
+{
+   switch (index_size) {
+   case 1:
+      return has_restart(in, 1, count, restart_index);
+   case 2:
+      return has_restart(in, 2, count, restart_index);
+   default:
+      assert(index_size == 4);
+      return has_restart(in, 4, count, restart_index);
+   }
+}
@@ -155,7 +155,8 @@ util_primconvert_draw_vbo(struct primconvert_context *pc,
    new_draw.start = ib_offset / new_info.index_size;
 
    if (info->index_size) {
-      trans_func(src, draw->start, draw->count, new_draw.count, info->restart_index, dst);
+      trans_func(src, draw->start, draw->start + draw->count, new_draw.count,
+                 info->restart_index, dst);
 
       if (pc->cfg.fixed_prim_restart && info->primitive_restart) {
          new_info.restart_index = (1ull << (new_info.index_size * 8)) - 1;
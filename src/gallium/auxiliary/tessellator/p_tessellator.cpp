@@ -31,6 +31,9 @@
 
 #include <new>
 
+static_assert(DOMAIN_POINT_PADDING >= PIPE_TESS_DOMAIN_POINT_ALIGN,
+              "tessellator point storage can't hold the padded points");
+
 namespace pipe_tessellator_wrap
 {
    /// Wrapper class for the CHWTessellator reference tessellator from MSFT
@@ -40,8 +43,6 @@ namespace pipe_tessellator_wrap
    private:
       typedef CHWTessellator SUPER;
       enum pipe_prim_type    prim_mode;
-      PIPE_ALIGN_VAR(32) float     domain_points_u[MAX_POINT_COUNT];
-      PIPE_ALIGN_VAR(32) float     domain_points_v[MAX_POINT_COUNT];
       uint32_t               num_domain_points;
 
    public:
@@ -108,14 +109,19 @@ namespace pipe_tessellator_wrap
 
          num_domain_points = (uint32_t)SUPER::GetPointCount();
 
-         DOMAIN_POINT *points = SUPER::GetPoints();
-         for (uint32_t i = 0; i < num_domain_points; i++) {
-            domain_points_u[i] = points[i].u;
-            domain_points_v[i] = points[i].v;
+         /* The points are already stored SoA. Zero the tail of the last
+          * vector so that whole-vector loads see well defined values.
+          */
+         float *domain_points_u = SUPER::GetPointsU();
+         float *domain_points_v = SUPER::GetPointsV();
+         uint32_t padded = align(num_domain_points, PIPE_TESS_DOMAIN_POINT_ALIGN);
+         for (uint32_t i = num_domain_points; i < padded; i++) {
+            domain_points_u[i] = 0.0f;
+            domain_points_v[i] = 0.0f;
          }
          tess_data->num_domain_points = num_domain_points;
-         tess_data->domain_points_u = &domain_points_u[0];
-         tess_data->domain_points_v = &domain_points_v[0];
+         tess_data->domain_points_u = domain_points_u;
+         tess_data->domain_points_v = domain_points_v;
 
          tess_data->num_indices = (uint32_t)SUPER::GetIndexCount();
 
@@ -39,6 +39,12 @@ struct pipe_tessellation_factors
    float pad[2];
 };
 
+/**
+ * The domain point arrays are padded with zeroes up to a multiple of
+ * this many points, so they can be read in whole SIMD vectors.
+ */
+#define PIPE_TESS_DOMAIN_POINT_ALIGN 16
+
 struct pipe_tessellator_data
 {
    uint32_t num_indices;
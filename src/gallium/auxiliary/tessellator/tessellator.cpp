@@ -434,7 +434,8 @@ FXP fxpFloor(const FXP& input)
 //---------------------------------------------------------------------------------------------------------------------------------
 CHWTessellator::CHWTessellator()
 {
-    m_Point = 0;
+    m_PointU = 0;
+    m_PointV = 0;
     m_Index = 0;
     m_NumPoints = 0;
     m_NumIndices = 0;
@@ -449,7 +450,8 @@ CHWTessellator::CHWTessellator()
 //---------------------------------------------------------------------------------------------------------------------------------
 CHWTessellator::~CHWTessellator()
 {
-    delete [] m_Point;
+    delete [] m_PointU;
+    delete [] m_PointV;
     delete [] m_Index;
 }
 
@@ -461,9 +463,10 @@ void CHWTessellator::Init(
     D3D11_TESSELLATOR_PARTITIONING       partitioning,
     D3D11_TESSELLATOR_OUTPUT_PRIMITIVE   outputPrimitive)
 {
-    if( 0 == m_Point )
+    if( 0 == m_PointU )
     {
-        m_Point = new DOMAIN_POINT[MAX_POINT_COUNT];
+        m_PointU = new float[MAX_POINT_COUNT + DOMAIN_POINT_PADDING];
+        m_PointV = new float[MAX_POINT_COUNT + DOMAIN_POINT_PADDING];
     }
     if( 0 == m_Index )
     {
@@ -734,6 +737,9 @@ void CHWTessellator::QuadProcessTessFactors( float tessFactor_Ueq0, float tessFa
 //---------------------------------------------------------------------------------------------------------------------------------
 void CHWTessellator::QuadGeneratePoints( const PROCESSED_TESS_FACTORS_QUAD& processedTessFactors )
 {
+    FXP fxpParams[MAX_POINTS_PER_AXIS];
+    FXP fxpInsideParams[QUAD_AXES][MAX_POINTS_PER_AXIS];
+
     // Generate exterior ring edge points, clockwise from top-left
     int pointOffset = 0;
     int edge;
@@ -742,12 +748,12 @@ void CHWTessellator::QuadGeneratePoints( const PROCESSED_TESS_FACTORS_QUAD& proc
         int parity = edge&0x1;
         int startPoint = 0;
         int endPoint = processedTessFactors.numPointsForOutsideEdge[edge] - 1;
+        SetTessellationParity(processedTessFactors.outsideTessFactorParity[edge]);
+        PlacePointsIn1D(processedTessFactors.outsideTessFactorCtx[edge],endPoint+1,fxpParams);
         for(int p = startPoint; p < endPoint; p++,pointOffset++) // don't include end, since next edge starts with it.
         {
-            FXP fxpParam;
             int q = ((edge==1)||(edge==2)) ? p : endPoint - p; // reverse order
-            SetTessellationParity(processedTessFactors.outsideTessFactorParity[edge]);
-            PlacePointIn1D(processedTessFactors.outsideTessFactorCtx[edge],q,fxpParam);
+            FXP fxpParam = fxpParams[q];
             if( parity )
             {
                 DefinePoint(/*U*/fxpParam,
@@ -763,6 +769,15 @@ void CHWTessellator::QuadGeneratePoints( const PROCESSED_TESS_FACTORS_QUAD& proc
         }
     }
 
+    // The inside points of every ring lie on the same two sets of 1D locations, so place them once
+    for(int axis = 0; axis < QUAD_AXES; axis++ )
+    {
+        SetTessellationParity(processedTessFactors.insideTessFactorParity[axis]);
+        PlacePointsIn1D(processedTessFactors.insideTessFactorCtx[axis],
+                        processedTessFactors.numPointsForInsideTessFactor[axis],
+                        fxpInsideParams[axis]);
+    }
+
     // Generate interior ring points, clockwise from (U==0,V==1) (bottom-left) spiralling toward center
     static const int startRing = 1;
     int minNumPointsForTessFactor = min(processedTessFactors.numPointsForInsideTessFactor[U],processedTessFactors.numPointsForInsideTessFactor[V]);
@@ -777,15 +792,11 @@ void CHWTessellator::QuadGeneratePoints( const PROCESSED_TESS_FACTORS_QUAD& proc
         {
             int parity[QUAD_AXES] = {edge&0x1,((edge+1)&0x1)};
             int perpendicularAxisPoint = (edge < 2) ? startPoint : endPoint[parity[0]];
-            FXP fxpPerpParam;
-            SetTessellationParity(processedTessFactors.insideTessFactorParity[parity[0]]);
-            PlacePointIn1D(processedTessFactors.insideTessFactorCtx[parity[0]],perpendicularAxisPoint,fxpPerpParam);
-            SetTessellationParity(processedTessFactors.insideTessFactorParity[parity[1]]);
+            FXP fxpPerpParam = fxpInsideParams[parity[0]][perpendicularAxisPoint];
             for(int p = startPoint; p < endPoint[parity[1]]; p++, pointOffset++) // don't include end: next edge starts with it.
             {
-                FXP fxpParam;
                 int q = ((edge == 1)||(edge==2)) ? p : endPoint[parity[1]] - (p - startPoint);
-                PlacePointIn1D(processedTessFactors.insideTessFactorCtx[parity[1]],q,fxpParam);
+                FXP fxpParam = fxpInsideParams[parity[1]][q];
                 if( parity[1] )
                 {
                     DefinePoint(/*U*/fxpPerpParam,
@@ -807,12 +818,9 @@ void CHWTessellator::QuadGeneratePoints( const PROCESSED_TESS_FACTORS_QUAD& proc
     {
         int startPoint = numRings;
         int endPoint = processedTessFactors.numPointsForInsideTessFactor[U] - 1 - startPoint;
-        SetTessellationParity(processedTessFactors.insideTessFactorParity[U]);
         for( int p = startPoint; p <= endPoint; p++, pointOffset++ )
         {
-            FXP fxpParam;
-            PlacePointIn1D(processedTessFactors.insideTessFactorCtx[U],p,fxpParam);
-            DefinePoint(/*U*/fxpParam,
+            DefinePoint(/*U*/fxpInsideParams[U][p],
                         /*V*/FXP_ONE_HALF, // middle
                         /*pointStorageOffset*/pointOffset);
         }
@@ -822,14 +830,11 @@ void CHWTessellator::QuadGeneratePoints( const PROCESSED_TESS_FACTORS_QUAD& proc
     {
         int startPoint = numRings;
         int endPoint;
-        FXP fxpParam;
         endPoint = processedTessFactors.numPointsForInsideTessFactor[V] - 1 - startPoint;
-        SetTessellationParity(processedTessFactors.insideTessFactorParity[V]);
         for( int p = endPoint; p >= startPoint; p--, pointOffset++ )
         {
-            PlacePointIn1D(processedTessFactors.insideTessFactorCtx[V],p,fxpParam);
             DefinePoint(/*U*/FXP_ONE_HALF, // middle
-                        /*V*/fxpParam,
+                        /*V*/fxpInsideParams[V][p],
                         /*pointStorageOffset*/pointOffset);
         }
     }
@@ -1240,6 +1245,8 @@ void CHWTessellator::TriProcessTessFactors( float tessFactor_Ueq0, float tessFac
 //---------------------------------------------------------------------------------------------------------------------------------
 void CHWTessellator::TriGeneratePoints( const PROCESSED_TESS_FACTORS_TRI& processedTessFactors )
 {
+    FXP fxpParams[MAX_POINTS_PER_AXIS];
+
     // Generate exterior ring edge points, clockwise starting from point V (VW, the U==0 edge)
     int pointOffset = 0;
     int edge;
@@ -1248,15 +1255,15 @@ void CHWTessellator::TriGeneratePoints( const PROCESSED_TESS_FACTORS_TRI& proces
         int parity = edge&0x1;
         int startPoint = 0;
         int endPoint = processedTessFactors.numPointsForOutsideEdge[edge] - 1;
+        SetTessellationParity(processedTessFactors.outsideTessFactorParity[edge]);
+        PlacePointsIn1D(processedTessFactors.outsideTessFactorCtx[edge],endPoint+1,fxpParams);
         for(int p = startPoint; p < endPoint; p++, pointOffset++) // don't include end, since next edge starts with it.
         {
-            FXP fxpParam;
             int q = (parity) ? p : endPoint - p; // whether to reverse point order given we are defining V or U (W implicit):
                                                  // edge0, VW, has V decreasing, so reverse 1D points below
                                                  // edge1, WU, has U increasing, so don't reverse 1D points  below
                                                  // edge2, UV, has U decreasing, so reverse 1D points below
-            SetTessellationParity(processedTessFactors.outsideTessFactorParity[edge]);
-            PlacePointIn1D(processedTessFactors.outsideTessFactorCtx[edge],q,fxpParam);
+            FXP fxpParam = fxpParams[q];
             if( edge == 0 )
             {
                 DefinePoint(/*U*/0,
@@ -1272,8 +1279,12 @@ void CHWTessellator::TriGeneratePoints( const PROCESSED_TESS_FACTORS_TRI& proces
         }
     }
 
-    // Generate interior ring points, clockwise spiralling in
+    // Generate interior ring points, clockwise spiralling in.
+    // All rings share the same 1D locations, so place them once.
     SetTessellationParity(processedTessFactors.insideTessFactorParity);
+    PlacePointsIn1D(processedTessFactors.insideTessFactorCtx,
+                    processedTessFactors.numPointsForInsideTessFactor,
+                    fxpParams);
     static const int startRing = 1;
     int numRings = (processedTessFactors.numPointsForInsideTessFactor >> 1);
     for(int ring = startRing; ring < numRings; ring++)
@@ -1285,20 +1296,18 @@ void CHWTessellator::TriGeneratePoints( const PROCESSED_TESS_FACTORS_TRI& proces
         {
             int parity = edge&0x1;
             int perpendicularAxisPoint = startPoint;
-            FXP fxpPerpParam;
-            PlacePointIn1D(processedTessFactors.insideTessFactorCtx,perpendicularAxisPoint,fxpPerpParam);
+            FXP fxpPerpParam = fxpParams[perpendicularAxisPoint];
             fxpPerpParam *= FXP_TWO_THIRDS; // Map location to the right size in barycentric space.
                                          // I (amarp) can draw a picture to explain.
                                          // We know this fixed point math won't over/underflow
             fxpPerpParam = (fxpPerpParam+FXP_ONE_HALF/*round*/)>>FXP_FRACTION_BITS; // get back to n.16
             for(int p = startPoint; p < endPoint; p++, pointOffset++) // don't include end: next edge starts with it.
             {
-                FXP fxpParam;
                 int q = (parity) ? p : endPoint - (p - startPoint); // whether to reverse point given we are defining V or U (W implicit):
                                                          // edge0, VW, has V decreasing, so reverse 1D points below
                                                          // edge1, WU, has U increasing, so don't reverse 1D points  below
                                                          // edge2, UV, has U decreasing, so reverse 1D points below
-                PlacePointIn1D(processedTessFactors.insideTessFactorCtx,q,fxpParam);
+                FXP fxpParam = fxpParams[q];
                 // edge0 VW, has perpendicular parameter U constant
                 // edge1 WU, has perpendicular parameter V constant
                 // edge2 UV, has perpendicular parameter W constant
@@ -1538,19 +1547,21 @@ void CHWTessellator::IsoLineProcessTessFactors( float TessFactor_V_LineDensity,
 //---------------------------------------------------------------------------------------------------------------------------------
 void CHWTessellator::IsoLineGeneratePoints( const PROCESSED_TESS_FACTORS_ISOLINE& processedTessFactors )
 {
+    // Every line uses the same U locations, so place them once
+    FXP fxpU[MAX_POINTS_PER_AXIS];
+    SetTessellationParity(processedTessFactors.lineDetailParity);
+    PlacePointsIn1D(processedTessFactors.lineDetailTessFactorCtx,processedTessFactors.numPointsPerLine,fxpU);
+
     int line, pointOffset;
     for(line = 0, pointOffset = 0; line < processedTessFactors.numLines; line++)
     {
+        FXP fxpV;
+        SetTessellationParity(processedTessFactors.lineDensityParity);
+        PlacePointIn1D(processedTessFactors.lineDensityTessFactorCtx,line,fxpV);
+
         for(int point = 0; point < processedTessFactors.numPointsPerLine; point++)
         {
-            FXP fxpU,fxpV;
-            SetTessellationParity(processedTessFactors.lineDensityParity);
-            PlacePointIn1D(processedTessFactors.lineDensityTessFactorCtx,line,fxpV);
-
-            SetTessellationParity(processedTessFactors.lineDetailParity);
-            PlacePointIn1D(processedTessFactors.lineDetailTessFactorCtx,point,fxpU);
-
-            DefinePoint(fxpU,fxpV,pointOffset++);
+            DefinePoint(fxpU[point],fxpV,pointOffset++);
         }
     }
 }
@@ -1607,12 +1618,21 @@ int CHWTessellator::GetIndexCount()
 }
 
 //---------------------------------------------------------------------------------------------------------------------------------
-// CHWTessellator::GetPoints()
+// CHWTessellator::GetPointsU()
 // User calls this.
 //---------------------------------------------------------------------------------------------------------------------------------
-DOMAIN_POINT* CHWTessellator::GetPoints()
+float* CHWTessellator::GetPointsU()
 {
-    return m_Point;
+    return m_PointU;
+}
+
+//---------------------------------------------------------------------------------------------------------------------------------
+// CHWTessellator::GetPointsV()
+// User calls this.
+//---------------------------------------------------------------------------------------------------------------------------------
+float* CHWTessellator::GetPointsV()
+{
+    return m_PointV;
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 // CHWTessellator::GetIndices()
@@ -1626,24 +1646,24 @@ int* CHWTessellator::GetIndices()
 //---------------------------------------------------------------------------------------------------------------------------------
 // CHWTessellator::DefinePoint()
 //---------------------------------------------------------------------------------------------------------------------------------
-int CHWTessellator::DefinePoint(FXP fxpU, FXP fxpV, int pointStorageOffset)
+inline int CHWTessellator::DefinePoint(FXP fxpU, FXP fxpV, int pointStorageOffset)
 {
 //    WCHAR foo[80];
 //    StringCchPrintf(foo,80,L"off:%d, uv=(%f,%f)\n",pointStorageOffset,fixedToFloat(fxpU),fixedToFloat(fxpV));
 //    OutputDebugString(foo);
-    m_Point[pointStorageOffset].u = fixedToFloat(fxpU);
-    m_Point[pointStorageOffset].v = fixedToFloat(fxpV);
+    m_PointU[pointStorageOffset] = fixedToFloat(fxpU);
+    m_PointV[pointStorageOffset] = fixedToFloat(fxpV);
     return pointStorageOffset;
 }
 
 //---------------------------------------------------------------------------------------------------------------------------------
 // CHWTessellator::DefineIndex()
 //--------------------------------------------------------------------------------------------------------------------------------
-void CHWTessellator::DefineIndex(int index, int indexStorageOffset)
+inline void CHWTessellator::DefineIndex(int index, int indexStorageOffset)
 {
     index = PatchIndexValue(index);
 //    WCHAR foo[80];
-//    StringCchPrintf(foo,80,L"off:%d, idx=%d, uv=(%f,%f)\n",indexStorageOffset,index,m_Point[index].u,m_Point[index].v);
+//    StringCchPrintf(foo,80,L"off:%d, idx=%d, uv=(%f,%f)\n",indexStorageOffset,index,m_PointU[index],m_PointV[index]);
 //    OutputDebugString(foo);
     m_Index[indexStorageOffset] = index;
 }
@@ -1651,7 +1671,7 @@ void CHWTessellator::DefineIndex(int index, int indexStorageOffset)
 //---------------------------------------------------------------------------------------------------------------------------------
 // CHWTessellator::DefineClockwiseTriangle()
 //---------------------------------------------------------------------------------------------------------------------------------
-void CHWTessellator::DefineClockwiseTriangle(int index0, int index1, int index2, int indexStorageBaseOffset)
+inline void CHWTessellator::DefineClockwiseTriangle(int index0, int index1, int index2, int indexStorageBaseOffset)
 {
     // inputs a clockwise triangle, stores a CW or CCW triangle depending on the state
     DefineIndex(index0,indexStorageBaseOffset);
@@ -1855,6 +1875,32 @@ void CHWTessellator::PlacePointIn1D( const TESS_FACTOR_CONTEXT& TessFactorCtx, i
     }
 }
 
+//---------------------------------------------------------------------------------------------------------------------------------
+// CHWTessellator::PlacePointsIn1D()
+//---------------------------------------------------------------------------------------------------------------------------------
+void CHWTessellator::PlacePointsIn1D( const TESS_FACTOR_CONTEXT& TessFactorCtx, int numPoints, FXP* fxpLocations )
+{
+    // Branch-free version of PlacePointIn1D, so the compiler can vectorize it.
+    const int numHalfTessFactorPoints = TessFactorCtx.numHalfTessFactorPoints;
+    const int flipBase = (numHalfTessFactorPoints << 1) - (Odd() ? 1 : 0);
+    const int splitPoint = TessFactorCtx.splitPointOnFloorHalfTessFactor;
+    const FXP fxpInvFloor = TessFactorCtx.fxpInvNumSegmentsOnFloorTessFactor;
+    const FXP fxpInvCeil = TessFactorCtx.fxpInvNumSegmentsOnCeilTessFactor;
+    const FXP fxpFraction = TessFactorCtx.fxpHalfTessFactorFraction;
+    for( int p = 0; p < numPoints; p++ )
+    {
+        bool bFlip = p >= numHalfTessFactorPoints;
+        int point = bFlip ? flipBase - p : p;
+        unsigned int indexOnCeilHalfTessFactor = point;
+        unsigned int indexOnFloorHalfTessFactor = indexOnCeilHalfTessFactor - (point > splitPoint ? 1 : 0);
+        FXP fxpLocation = (indexOnFloorHalfTessFactor * fxpInvFloor) * (FXP_ONE - fxpFraction) +
+                          (indexOnCeilHalfTessFactor * fxpInvCeil) * fxpFraction;
+        fxpLocation = (fxpLocation + FXP_ONE_HALF/*round*/) >> FXP_FRACTION_BITS;
+        fxpLocation = bFlip ? FXP_ONE - fxpLocation : fxpLocation;
+        fxpLocations[p] = (point == numHalfTessFactorPoints) ? FXP_ONE_HALF : fxpLocation;
+    }
+}
+
 //---------------------------------------------------------------------------------------------------------------------------------
 // CHWTessellator::StitchRegular
 //---------------------------------------------------------------------------------------------------------------------------------
@@ -2123,7 +2169,7 @@ void CHWTessellator::StitchTransition(int baseIndexOffset,
 //---------------------------------------------------------------------------------------------------------------------------------
 // CHWTessellator::PatchIndexValue()
 //--------------------------------------------------------------------------------------------------------------------------------
-int CHWTessellator::PatchIndexValue(int index)
+inline int CHWTessellator::PatchIndexValue(int index)
 {
     if( m_bUsingPatchedIndices )
     {
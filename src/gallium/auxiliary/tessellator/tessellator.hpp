@@ -37,7 +37,9 @@
 //               (3) Call C*Tessellator::Tessellate[IsoLine|Tri|Quad]Domain()
 //                      - Here you pass in TessFactors (how much to tessellate)
 //               (4) Call C*Tessellator::GetPointCount(), C*Tessellator::GetIndexCount() to see how much data was generated.
-//               (5) Call C*Tessellator::GetPoints() and C*Tessellator::GetIndices() to get pointers to the data.
+//               (5) Call C*Tessellator::GetPointsU(), C*Tessellator::GetPointsV() and C*Tessellator::GetIndices() to get
+//                   pointers to the data.  Points are stored as separate U and V arrays (SoA), each with
+//                   DOMAIN_POINT_PADDING floats of slack after the last point so they can be read in whole SIMD vectors.
 //                   The pointers are fixed for the lifetime of the object (storage for max tessellation),
 //                   so if you ::Tessellate again, the data in the buffers is overwritten.
 //               (6) There are various other Get() methods to retrieve TessFactors that have been processed from
@@ -69,6 +71,8 @@
 #define D3D11_TESSELLATOR_MAX_TESSELLATION_FACTOR 64 // max of even and odd tessFactors
 
 #define MAX_POINT_COUNT ((D3D11_TESSELLATOR_MAX_TESSELLATION_FACTOR+1)*(D3D11_TESSELLATOR_MAX_TESSELLATION_FACTOR+1))
+#define MAX_POINTS_PER_AXIS (D3D11_TESSELLATOR_MAX_TESSELLATION_FACTOR+1) // points placed along one edge or inside axis
+#define DOMAIN_POINT_PADDING 16 // extra floats allocated after the U and V point arrays
 #define MAX_INDEX_COUNT (D3D11_TESSELLATOR_MAX_TESSELLATION_FACTOR*D3D11_TESSELLATOR_MAX_TESSELLATION_FACTOR*2*3)
 
 //=================================================================================================================================
@@ -103,12 +107,6 @@ enum D3D11_TESSELLATOR_OUTPUT_PRIMITIVE
     D3D11_TESSELLATOR_OUTPUT_TRIANGLE_CCW,
 };
 
-typedef struct DOMAIN_POINT
-{
-    float u;
-    float v; // for tri, w = 1 - u - v;
-} DOMAIN_POINT;
-
 //=================================================================================================================================
 // CHWTessellator: D3D11 Tessellation Fixed Function Hardware Reference
 //=================================================================================================================================
@@ -140,8 +138,8 @@ public:
     int GetPointCount();
     int GetIndexCount();
 
-    DOMAIN_POINT* GetPoints(); // Get CHWTessellator owned pointer to vertices (UV values).
-                               // Pointer is fixed for lifetime of CHWTessellator object.
+    float* GetPointsU(); // Get CHWTessellator owned pointers to vertices (U and V values, for tri w = 1 - u - v).
+    float* GetPointsV(); // Pointers are fixed for lifetime of CHWTessellator object.
     int* GetIndices();         // Get CHWTessellator owned pointer to vertex indices.
                                // Pointer is fixed for lifetime of CHWTessellator object.
 
@@ -189,7 +187,8 @@ private:
     D3D11_TESSELLATOR_PARTITIONING       m_originalPartitioning; // user chosen partitioning
     D3D11_TESSELLATOR_PARTITIONING       m_partitioning; // current partitioning.  IsoLines overrides for line density
     D3D11_TESSELLATOR_OUTPUT_PRIMITIVE   m_outputPrimitive;
-    DOMAIN_POINT*                        m_Point; // array where we will store u/v's for the points we generate
+    float*                               m_PointU; // arrays where we will store u/v's for the points we generate
+    float*                               m_PointV;
     int*                                 m_Index; // array where we will store index topology
     int                                  m_NumPoints;
     int                                  m_NumIndices;
@@ -212,6 +211,9 @@ private:
     } TESS_FACTOR_CONTEXT;
     void ComputeTessFactorContext( FXP fxpTessFactor, TESS_FACTOR_CONTEXT& TessFactorCtx );
     void PlacePointIn1D( const TESS_FACTOR_CONTEXT& TessFactorCtx, int point, FXP& fxpLocation );
+    // Same as PlacePointIn1D for points 0..numPoints-1 at once, written so the loop vectorizes.
+    // Point generation looks the locations up instead of placing every point again for every ring.
+    void PlacePointsIn1D( const TESS_FACTOR_CONTEXT& TessFactorCtx, int numPoints, FXP* fxpLocations );
 
     int NumPointsForTessFactor(FXP fxpTessFactor);
 
@@ -400,8 +402,8 @@ public:
     int GetPointCount() {return CHWTessellator::GetPointCount();};
     int GetIndexCount() {return CHWTessellator::GetIndexCount();}
 
-    DOMAIN_POINT* GetPoints() {return CHWTessellator::GetPoints();} // Get CHLSLTessellator owned pointer to vertices (UV values).
-                               // Pointer is fixed for lifetime of CHLSLTessellator object.
+    float* GetPointsU() {return CHWTessellator::GetPointsU();} // Get CHLSLTessellator owned pointers to vertices (U and V values).
+    float* GetPointsV() {return CHWTessellator::GetPointsV();} // Pointers are fixed for lifetime of CHLSLTessellator object.
     int* GetIndices() {return CHWTessellator::GetIndices();}         // Get CHLSLTessellator owned pointer to vertex indices.
                                // Pointer is fixed for lifetime of CHLSLTessellator object.
 
@@ -42,10 +42,16 @@ struct translate *translate_create( const struct translate_key *key )
    translate = translate_sse2_create( key );
    if (translate)
       return translate;
-#else
-   (void)translate;
 #endif
 
+#ifdef LLVM_AVAILABLE
+   translate = translate_llvm_create( key );
+   if (translate)
+      return translate;
+#endif
+
+   (void)translate;
+
    return translate_generic_create( key );
 }
 
@@ -99,7 +99,8 @@ struct translate * translate_cache_find(struct translate_cache *cache,
    if (!translate) {
       /* create/insert */
       translate = translate_create(key);
-      cso_hash_insert(&cache->hash, hash_key, translate);
+      if (translate)
+         cso_hash_insert(&cache->hash, hash_key, translate);
    }
 
    return translate;
@@ -0,0 +1,741 @@
+/**************************************************************************
+ *
+ * Copyright 2021 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * @file
+ * Translate backend generating code with gallivm.
+ *
+ * Unlike translate_sse this works on every architecture LLVM supports.
+ * Each vertex is fetched as a 4 x float vector with the same code the draw
+ * module uses for vertex fetch, converted to the output format as a
+ * vector and stored.  Elements whose input and output formats match are
+ * copied as whole integers.
+ *
+ * One function is generated for each kind of index (linear, 32, 16 and
+ * 8 bit elts), all in the same module, so creating a translate costs a
+ * single LLVM compilation.  Callers are expected to go through
+ * translate_cache to amortize it.
+ */
+
+#include "util/format/u_format.h"
+#include "util/u_debug.h"
+#include "util/u_memory.h"
+#include "util/u_math.h"
+#include "pipe/p_state.h"
+#include "translate.h"
+
+#include "gallivm/lp_bld_const.h"
+#include "gallivm/lp_bld_flow.h"
+#include "gallivm/lp_bld_format.h"
+#include "gallivm/lp_bld_init.h"
+#include "gallivm/lp_bld_intr.h"
+#include "gallivm/lp_bld_struct.h"
+#include "gallivm/lp_bld_type.h"
+
+
+DEBUG_GET_ONCE_BOOL_OPTION(translate_llvm, "TRANSLATE_LLVM", TRUE)
+
+
+/**
+ * Per element input state, read by the generated code.
+ */
+struct translate_llvm_input {
+   const uint8_t *ptr;
+   uint32_t stride;
+   uint32_t max_index;
+};
+
+enum {
+   TRANSLATE_LLVM_INPUT_PTR,
+   TRANSLATE_LLVM_INPUT_STRIDE,
+   TRANSLATE_LLVM_INPUT_MAX_INDEX,
+   TRANSLATE_LLVM_INPUT_NUM_FIELDS
+};
+
+enum translate_llvm_index {
+   TRANSLATE_LLVM_LINEAR,
+   TRANSLATE_LLVM_ELTS32,
+   TRANSLATE_LLVM_ELTS16,
+   TRANSLATE_LLVM_ELTS8,
+   TRANSLATE_LLVM_NUM_INDEX
+};
+
+typedef void
+(*translate_llvm_func)(const struct translate_llvm_input *inputs,
+                       const void *elts,
+                       uint32_t start,
+                       uint32_t count,
+                       uint32_t start_instance,
+                       uint32_t instance_id,
+                       void *output_buffer);
+
+struct translate_llvm {
+   struct translate translate;
+
+   struct translate_llvm_input input[TRANSLATE_MAX_ATTRIBS];
+
+   LLVMContextRef context;
+   struct gallivm_state *gallivm;
+   translate_llvm_func func[TRANSLATE_LLVM_NUM_INDEX];
+};
+
+
+static inline struct translate_llvm *
+translate_llvm(struct translate *translate)
+{
+   return (struct translate_llvm *)translate;
+}
+
+
+/**
+ * Whether an element can be copied without conversion, and how many bytes.
+ */
+static unsigned
+element_copy_size(const struct translate_element *element)
+{
+   const struct util_format_description *desc =
+      util_format_description(element->input_format);
+
+   if (element->type == TRANSLATE_ELEMENT_INSTANCE_ID) {
+      if (element->output_format == PIPE_FORMAT_R32_USCALED ||
+          element->output_format == PIPE_FORMAT_R32_SSCALED)
+         return 4;
+      return 0;
+   }
+
+   if (element->input_format == element->output_format &&
+       desc->block.width == 1 && desc->block.height == 1 &&
+       !(desc->block.bits & 7))
+      return desc->block.bits >> 3;
+
+   return 0;
+}
+
+
+/**
+ * Formats lp_build_fetch_rgba_aos returns the same floats for as
+ * util_format_unpack_rgba.  32 bit normalized channels are converted with
+ * less precision, so they are left to translate_generic.
+ */
+static boolean
+input_format_supported(enum pipe_format format)
+{
+   const struct util_format_description *desc =
+      util_format_description(format);
+   unsigned i;
+
+   if (!desc ||
+       desc->layout != UTIL_FORMAT_LAYOUT_PLAIN ||
+       desc->block.width != 1 || desc->block.height != 1 ||
+       util_format_is_pure_integer(format))
+      return FALSE;
+
+   for (i = 0; i < desc->nr_channels; i++) {
+      if (desc->channel[i].normalized && desc->channel[i].size == 32)
+         return FALSE;
+   }
+
+   return TRUE;
+}
+
+
+/**
+ * Formats emit_output() can store: arrays of 1 to 4 identical channels,
+ * each holding one of the RGBA components.  Half floats are not included
+ * since lp_build_float_to_half truncates, while translate_generic rounds
+ * to nearest.
+ */
+static boolean
+output_format_supported(enum pipe_format format)
+{
+   const struct util_format_description *desc =
+      util_format_description(format);
+   const struct util_format_channel_description *chan;
+   unsigned used = 0;
+   unsigned i;
+
+   if (!desc ||
+       desc->layout != UTIL_FORMAT_LAYOUT_PLAIN ||
+       !desc->is_array ||
+       desc->nr_channels < 1 || desc->nr_channels > 4)
+      return FALSE;
+
+   chan = &desc->channel[0];
+   if (chan->pure_integer)
+      return FALSE;
+
+   switch (chan->type) {
+   case UTIL_FORMAT_TYPE_FLOAT:
+      if (chan->size != 32 && chan->size != 64)
+         return FALSE;
+      break;
+   case UTIL_FORMAT_TYPE_UNSIGNED:
+   case UTIL_FORMAT_TYPE_SIGNED:
+      if (chan->size != 8 && chan->size != 16 && chan->size != 32)
+         return FALSE;
+      break;
+   case UTIL_FORMAT_TYPE_FIXED:
+      if (chan->size != 32)
+         return FALSE;
+      break;
+   default:
+      return FALSE;
+   }
+
+   for (i = 0; i < 4; i++) {
+      if (desc->swizzle[i] < desc->nr_channels)
+         used |= 1 << desc->swizzle[i];
+   }
+
+   return used == (1u << desc->nr_channels) - 1;
+}
+
+
+static LLVMValueRef
+offset_ptr(struct gallivm_state *gallivm, LLVMValueRef ptr,
+           unsigned offset, LLVMTypeRef type)
+{
+   LLVMBuilderRef builder = gallivm->builder;
+
+   if (offset) {
+      LLVMValueRef index = lp_build_const_int32(gallivm, offset);
+      ptr = LLVMBuildGEP(builder, ptr, &index, 1, "");
+   }
+
+   return LLVMBuildBitCast(builder, ptr, LLVMPointerType(type, 0), "");
+}
+
+
+/**
+ * Copy size bytes from src to dst as a sequence of unaligned integer
+ * loads and stores.
+ */
+static void
+emit_copy(struct gallivm_state *gallivm,
+          LLVMValueRef src, LLVMValueRef dst, unsigned size)
+{
+   LLVMBuilderRef builder = gallivm->builder;
+   unsigned offset = 0;
+
+   while (offset < size) {
+      unsigned chunk = MIN2(util_next_power_of_two(size - offset), 16);
+      LLVMTypeRef type;
+      LLVMValueRef val;
+
+      while (chunk > size - offset)
+         chunk /= 2;
+
+      type = LLVMIntTypeInContext(gallivm->context, chunk * 8);
+      val = LLVMBuildLoad(builder, offset_ptr(gallivm, src, offset, type), "");
+      LLVMSetAlignment(val, 1);
+      val = LLVMBuildStore(builder, val,
+                           offset_ptr(gallivm, dst, offset, type));
+      LLVMSetAlignment(val, 1);
+
+      offset += chunk;
+   }
+}
+
+
+/**
+ * Store the first n elements of a 4 element vector, unaligned.
+ */
+static void
+store_elements(struct gallivm_state *gallivm,
+               LLVMValueRef vec, unsigned n, LLVMValueRef dst)
+{
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMTypeRef elem_type = LLVMGetElementType(LLVMTypeOf(vec));
+   unsigned elem_size;
+   unsigned i = 0;
+
+   /* LLVMGetIntTypeWidth is only valid on integer types */
+   if (LLVMGetTypeKind(elem_type) == LLVMFloatTypeKind)
+      elem_size = 4;
+   else if (LLVMGetTypeKind(elem_type) == LLVMDoubleTypeKind)
+      elem_size = 8;
+   else
+      elem_size = LLVMGetIntTypeWidth(elem_type) / 8;
+
+   while (i < n) {
+      unsigned len = (n - i) >= 4 ? 4 : (n - i) >= 2 ? 2 : 1;
+      LLVMValueRef val;
+
+      if (len == 4) {
+         val = vec;
+      } else if (len == 2) {
+         LLVMValueRef shuffles[2] = {
+            lp_build_const_int32(gallivm, i),
+            lp_build_const_int32(gallivm, i + 1),
+         };
+         val = LLVMBuildShuffleVector(builder, vec, LLVMGetUndef(LLVMTypeOf(vec)),
+                                      LLVMConstVector(shuffles, 2), "");
+      } else {
+         val = LLVMBuildExtractElement(builder, vec,
+                                       lp_build_const_int32(gallivm, i), "");
+      }
+
+      val = LLVMBuildStore(builder, val,
+                           offset_ptr(gallivm, dst, i * elem_size,
+                                      LLVMTypeOf(val)));
+      LLVMSetAlignment(val, 1);
+
+      i += len;
+   }
+}
+
+
+/**
+ * Convert a 4 x float RGBA vector to the output format and store it.
+ */
+static void
+emit_output(struct gallivm_state *gallivm,
+            enum pipe_format format,
+            LLVMValueRef rgba,
+            LLVMValueRef dst)
+{
+   LLVMBuilderRef builder = gallivm->builder;
+   const struct util_format_description *desc =
+      util_format_description(format);
+   const struct util_format_channel_description *chan = &desc->channel[0];
+   LLVMValueRef shuffles[4];
+   LLVMTypeRef vec_type;
+   LLVMValueRef vec;
+   unsigned i, j;
+
+   /* Put each component in the channel it is stored in */
+   for (i = 0; i < 4; i++) {
+      unsigned comp = 0;
+      for (j = 0; j < 4; j++) {
+         if (desc->swizzle[j] == i) {
+            comp = j;
+            break;
+         }
+      }
+      shuffles[i] = lp_build_const_int32(gallivm, comp);
+   }
+   vec = LLVMBuildShuffleVector(builder, rgba, LLVMGetUndef(LLVMTypeOf(rgba)),
+                                LLVMConstVector(shuffles, 4), "");
+
+   if (chan->type == UTIL_FORMAT_TYPE_FLOAT) {
+      if (chan->size == 64) {
+         vec_type = LLVMVectorType(LLVMDoubleTypeInContext(gallivm->context), 4);
+         vec = LLVMBuildFPExt(builder, vec, vec_type, "");
+      }
+   } else {
+      /* Same truncating conversions as translate_generic */
+      struct lp_type int_type = lp_int_type(lp_float32_vec4_type());
+      double scale = 1.0;
+
+      if (chan->type == UTIL_FORMAT_TYPE_FIXED)
+         scale = 65536.0;
+      else if (chan->normalized && chan->type == UTIL_FORMAT_TYPE_UNSIGNED)
+         scale = (double)((1ull << chan->size) - 1);
+      else if (chan->normalized)
+         scale = (double)((1ull << (chan->size - 1)) - 1);
+
+      if (scale != 1.0)
+         vec = LLVMBuildFMul(builder, vec,
+                             lp_build_const_vec(gallivm, lp_float32_vec4_type(),
+                                                scale), "");
+
+      vec_type = lp_build_vec_type(gallivm, int_type);
+      if (chan->type == UTIL_FORMAT_TYPE_UNSIGNED && chan->size == 32) {
+         /* fptoui gives poison for negative or too large values, which
+          * translate_generic's C casts wrap instead, so convert through
+          * 64 bit integers.
+          */
+         LLVMTypeRef i64_vec_type =
+            LLVMVectorType(LLVMInt64TypeInContext(gallivm->context), 4);
+         vec = LLVMBuildFPToSI(builder, vec, i64_vec_type, "");
+         vec = LLVMBuildTrunc(builder, vec, vec_type, "");
+      } else {
+         vec = LLVMBuildFPToSI(builder, vec, vec_type, "");
+      }
+
+      if (chan->size < 32) {
+         vec_type = LLVMVectorType(LLVMIntTypeInContext(gallivm->context,
+                                                        chan->size), 4);
+         vec = LLVMBuildTrunc(builder, vec, vec_type, "");
+      }
+   }
+
+   store_elements(gallivm, vec, desc->nr_channels, dst);
+}
+
+
+static LLVMValueRef
+generate_function(struct translate_llvm *tl,
+                  enum translate_llvm_index index_kind,
+                  LLVMTypeRef input_type)
+{
+   static const char *names[TRANSLATE_LLVM_NUM_INDEX] = {
+      "translate_linear", "translate_elts32",
+      "translate_elts16", "translate_elts8",
+   };
+   static const unsigned elt_bits[TRANSLATE_LLVM_NUM_INDEX] = {
+      32, 32, 16, 8,
+   };
+   const struct translate_key *key = &tl->translate.key;
+   struct gallivm_state *gallivm = tl->gallivm;
+   LLVMContextRef context = gallivm->context;
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMTypeRef i8_ptr_type = LLVMPointerType(LLVMInt8TypeInContext(context), 0);
+   LLVMTypeRef i32_type = LLVMInt32TypeInContext(context);
+   LLVMTypeRef elt_type = LLVMIntTypeInContext(context, elt_bits[index_kind]);
+   LLVMTypeRef arg_types[7];
+   LLVMTypeRef func_type;
+   LLVMValueRef function, inputs_arg, elts, start, count;
+   LLVMValueRef start_instance, instance_id, output;
+   LLVMValueRef input_ptr[TRANSLATE_MAX_ATTRIBS];
+   LLVMValueRef input_stride[TRANSLATE_MAX_ATTRIBS];
+   LLVMValueRef input_max_index[TRANSLATE_MAX_ATTRIBS];
+   LLVMValueRef instance_offset[TRANSLATE_MAX_ATTRIBS];
+   LLVMValueRef zero = lp_build_const_int32(gallivm, 0);
+   struct lp_build_loop_state loop;
+   LLVMBasicBlockRef block;
+   unsigned i;
+
+   arg_types[0] = LLVMPointerType(input_type, 0);  /* inputs */
+   arg_types[1] = LLVMPointerType(elt_type, 0);    /* elts */
+   arg_types[2] = i32_type;                        /* start */
+   arg_types[3] = i32_type;                        /* count */
+   arg_types[4] = i32_type;                        /* start_instance */
+   arg_types[5] = i32_type;                        /* instance_id */
+   arg_types[6] = i8_ptr_type;                     /* output_buffer */
+
+   func_type = LLVMFunctionType(LLVMVoidTypeInContext(context),
+                                arg_types, ARRAY_SIZE(arg_types), 0);
+
+   function = LLVMAddFunction(gallivm->module, names[index_kind], func_type);
+   LLVMSetFunctionCallConv(function, LLVMCCallConv);
+   for (i = 0; i < ARRAY_SIZE(arg_types); ++i)
+      if (LLVMGetTypeKind(arg_types[i]) == LLVMPointerTypeKind)
+         lp_add_function_attr(function, i + 1, LP_FUNC_ATTR_NOALIAS);
+
+   inputs_arg     = LLVMGetParam(function, 0);
+   elts           = LLVMGetParam(function, 1);
+   start          = LLVMGetParam(function, 2);
+   count          = LLVMGetParam(function, 3);
+   start_instance = LLVMGetParam(function, 4);
+   instance_id    = LLVMGetParam(function, 5);
+   output         = LLVMGetParam(function, 6);
+
+   block = LLVMAppendBasicBlockInContext(context, function, "entry");
+   LLVMPositionBuilderAtEnd(builder, block);
+
+   /* Everything that does not depend on the vertex is loaded up front */
+   for (i = 0; i < key->nr_elements; i++) {
+      const struct translate_element *element = &key->element[i];
+      LLVMValueRef input;
+
+      if (element->type != TRANSLATE_ELEMENT_NORMAL)
+         continue;
+
+      input = LLVMBuildGEP(builder, inputs_arg,
+                           &(LLVMValueRef){lp_build_const_int32(gallivm, i)},
+                           1, "");
+      input_ptr[i] = lp_build_struct_get(gallivm, input,
+                                         TRANSLATE_LLVM_INPUT_PTR, "ptr");
+      input_stride[i] = lp_build_struct_get(gallivm, input,
+                                            TRANSLATE_LLVM_INPUT_STRIDE,
+                                            "stride");
+      input_max_index[i] = lp_build_struct_get(gallivm, input,
+                                               TRANSLATE_LLVM_INPUT_MAX_INDEX,
+                                               "max_index");
+
+      if (element->instance_divisor) {
+         /* Not clamped, as in the other backends */
+         LLVMValueRef index =
+            LLVMBuildUDiv(builder, instance_id,
+                          lp_build_const_int32(gallivm,
+                                               element->instance_divisor), "");
+         index = LLVMBuildAdd(builder, start_instance, index, "");
+         instance_offset[i] = LLVMBuildMul(builder, index, input_stride[i], "");
+      }
+   }
+
+   lp_build_loop_begin(&loop, gallivm, zero);
+   {
+      LLVMValueRef elt, vertex;
+
+      if (index_kind == TRANSLATE_LLVM_LINEAR) {
+         elt = LLVMBuildAdd(builder, start, loop.counter, "");
+      } else {
+         elt = LLVMBuildLoad(builder,
+                             LLVMBuildGEP(builder, elts, &loop.counter, 1, ""),
+                             "");
+         elt = LLVMBuildZExt(builder, elt, i32_type, "");
+      }
+
+      vertex = LLVMBuildMul(builder, loop.counter,
+                            lp_build_const_int32(gallivm, key->output_stride),
+                            "");
+      vertex = LLVMBuildGEP(builder, output, &vertex, 1, "");
+
+      for (i = 0; i < key->nr_elements; i++) {
+         const struct translate_element *element = &key->element[i];
+         unsigned copy_size = element_copy_size(element);
+         LLVMValueRef dst = offset_ptr(gallivm, vertex, element->output_offset,
+                                       LLVMInt8TypeInContext(context));
+
+         if (element->type == TRANSLATE_ELEMENT_INSTANCE_ID) {
+            if (copy_size) {
+               LLVMValueRef store =
+                  LLVMBuildStore(builder, instance_id,
+                                 offset_ptr(gallivm, dst, 0, i32_type));
+               LLVMSetAlignment(store, 1);
+            } else {
+               struct lp_type f32_type = lp_float32_vec4_type();
+               LLVMValueRef id =
+                  LLVMBuildUIToFP(builder, instance_id,
+                                  LLVMFloatTypeInContext(context), "");
+               LLVMValueRef rgba =
+                  lp_build_const_aos(gallivm, f32_type, 0.0, 0.0, 0.0, 1.0,
+                                     NULL);
+               rgba = LLVMBuildInsertElement(builder, rgba, id, zero, "");
+               emit_output(gallivm, element->output_format, rgba, dst);
+            }
+         } else {
+            LLVMValueRef offset, src;
+
+            if (element->instance_divisor) {
+               offset = instance_offset[i];
+            } else {
+               /* Clamp to avoid going out of bounds */
+               LLVMValueRef index =
+                  LLVMBuildSelect(builder,
+                                  LLVMBuildICmp(builder, LLVMIntULT, elt,
+                                                input_max_index[i], ""),
+                                  elt, input_max_index[i], "");
+               /* This mul can overflow. Wraparound is ok. */
+               offset = LLVMBuildMul(builder, index, input_stride[i], "");
+            }
+
+            if (copy_size) {
+               src = LLVMBuildGEP(builder, input_ptr[i], &offset, 1, "");
+               emit_copy(gallivm, src, dst, copy_size);
+            } else {
+               const struct util_format_description *desc =
+                  util_format_description(element->input_format);
+               LLVMValueRef rgba =
+                  lp_build_fetch_rgba_aos(gallivm, desc,
+                                          lp_float32_vec4_type(),
+                                          FALSE, input_ptr[i], offset,
+                                          zero, zero, NULL);
+               emit_output(gallivm, element->output_format, rgba, dst);
+            }
+         }
+      }
+   }
+   lp_build_loop_end_cond(&loop, count, NULL, LLVMIntUGE);
+
+   LLVMBuildRetVoid(builder);
+
+   gallivm_verify_function(gallivm, function);
+
+   return function;
+}
+
+
+static void
+llvm_set_buffer(struct translate *translate,
+                unsigned buf,
+                const void *ptr,
+                unsigned stride,
+                unsigned max_index)
+{
+   struct translate_llvm *tl = translate_llvm(translate);
+   unsigned i;
+
+   for (i = 0; i < translate->key.nr_elements; i++) {
+      if (translate->key.element[i].input_buffer == buf) {
+         tl->input[i].ptr = (const uint8_t *)ptr +
+                            translate->key.element[i].input_offset;
+         tl->input[i].stride = stride;
+         tl->input[i].max_index = max_index;
+      }
+   }
+}
+
+
+static void PIPE_CDECL
+llvm_run_elts(struct translate *translate,
+              const unsigned *elts,
+              unsigned count,
+              unsigned start_instance,
+              unsigned instance_id,
+              void *output_buffer)
+{
+   struct translate_llvm *tl = translate_llvm(translate);
+
+   if (count)
+      tl->func[TRANSLATE_LLVM_ELTS32](tl->input, elts, 0, count,
+                                      start_instance, instance_id,
+                                      output_buffer);
+}
+
+
+static void PIPE_CDECL
+llvm_run_elts16(struct translate *translate,
+                const uint16_t *elts,
+                unsigned count,
+                unsigned start_instance,
+                unsigned instance_id,
+                void *output_buffer)
+{
+   struct translate_llvm *tl = translate_llvm(translate);
+
+   if (count)
+      tl->func[TRANSLATE_LLVM_ELTS16](tl->input, elts, 0, count,
+                                      start_instance, instance_id,
+                                      output_buffer);
+}
+
+
+static void PIPE_CDECL
+llvm_run_elts8(struct translate *translate,
+               const uint8_t *elts,
+               unsigned count,
+               unsigned start_instance,
+               unsigned instance_id,
+               void *output_buffer)
+{
+   struct translate_llvm *tl = translate_llvm(translate);
+
+   if (count)
+      tl->func[TRANSLATE_LLVM_ELTS8](tl->input, elts, 0, count,
+                                     start_instance, instance_id,
+                                     output_buffer);
+}
+
+
+static void PIPE_CDECL
+llvm_run(struct translate *translate,
+         unsigned start,
+         unsigned count,
+         unsigned start_instance,
+         unsigned instance_id,
+         void *output_buffer)
+{
+   struct translate_llvm *tl = translate_llvm(translate);
+
+   if (count)
+      tl->func[TRANSLATE_LLVM_LINEAR](tl->input, NULL, start, count,
+                                      start_instance, instance_id,
+                                      output_buffer);
+}
+
+
+static void
+llvm_release(struct translate *translate)
+{
+   struct translate_llvm *tl = translate_llvm(translate);
+
+   if (tl->gallivm)
+      gallivm_destroy(tl->gallivm);
+   if (tl->context)
+      LLVMContextDispose(tl->context);
+   FREE(tl);
+}
+
+
+struct translate *
+translate_llvm_create(const struct translate_key *key)
+{
+   struct translate_llvm *tl;
+   LLVMValueRef functions[TRANSLATE_LLVM_NUM_INDEX];
+   LLVMTypeRef input_types[TRANSLATE_LLVM_INPUT_NUM_FIELDS];
+   LLVMTypeRef input_type;
+   unsigned i;
+
+   if (!debug_get_option_translate_llvm())
+      return NULL;
+
+   for (i = 0; i < key->nr_elements; i++) {
+      const struct translate_element *element = &key->element[i];
+
+      if (element_copy_size(element))
+         continue;
+
+      if (element->type == TRANSLATE_ELEMENT_NORMAL &&
+          !input_format_supported(element->input_format))
+         return NULL;
+
+      if (!output_format_supported(element->output_format))
+         return NULL;
+   }
+
+   if (!lp_build_init())
+      return NULL;
+
+   tl = CALLOC_STRUCT(translate_llvm);
+   if (!tl)
+      return NULL;
+
+   tl->translate.key = *key;
+   tl->translate.release = llvm_release;
+   tl->translate.set_buffer = llvm_set_buffer;
+   tl->translate.run_elts = llvm_run_elts;
+   tl->translate.run_elts16 = llvm_run_elts16;
+   tl->translate.run_elts8 = llvm_run_elts8;
+   tl->translate.run = llvm_run;
+
+   tl->context = LLVMContextCreate();
+   if (!tl->context)
+      goto fail;
+
+   tl->gallivm = gallivm_create("translate", tl->context, NULL);
+   if (!tl->gallivm)
+      goto fail;
+
+   input_types[TRANSLATE_LLVM_INPUT_PTR] =
+      LLVMPointerType(LLVMInt8TypeInContext(tl->context), 0);
+   input_types[TRANSLATE_LLVM_INPUT_STRIDE] =
+      LLVMInt32TypeInContext(tl->context);
+   input_types[TRANSLATE_LLVM_INPUT_MAX_INDEX] =
+      LLVMInt32TypeInContext(tl->context);
+   input_type = LLVMStructTypeInContext(tl->context, input_types,
+                                        ARRAY_SIZE(input_types), 0);
+
+   for (i = 0; i < TRANSLATE_LLVM_NUM_INDEX; i++)
+      functions[i] = generate_function(tl, i, input_type);
+
+   gallivm_compile_module(tl->gallivm);
+
+   for (i = 0; i < TRANSLATE_LLVM_NUM_INDEX; i++)
+      tl->func[i] = (translate_llvm_func)
+         gallivm_jit_function(tl->gallivm, functions[i]);
+
+   gallivm_free_ir(tl->gallivm);
+
+   return &tl->translate;
+
+fail:
+   llvm_release(&tl->translate);
+   return NULL;
+}
@@ -30,6 +30,7 @@
 #include "util/u_inlines.h"
 #include "util/u_memory.h"
 #include "util/u_upload_mgr.h"
+#include "util/os_time.h"
 #include "compiler/shader_info.h"
 
 /* 0 = disabled, 1 = assertions, 2 = printfs */
@@ -144,12 +145,37 @@ is_next_call_a_mergeable_draw(struct tc_draw_single *first_info,
                  DRAW_INFO_SIZE_WITHOUT_MIN_MAX_INDEX) == 0;
 }
 
+/* Update the batch size from the time it took to execute a batch.
+ *
+ * The execution time per call slot is averaged over recent batches, weighted
+ * by their size, so that a single expensive call (e.g. a flush) doesn't
+ * shrink batches by itself.
+ */
+static void
+tc_batch_update_size(struct threaded_context *tc, unsigned num_call_slots,
+                     int64_t time)
+{
+   p_atomic_add(&tc->batch_exec_time, time);
+
+   tc->decayed_exec_time = tc->decayed_exec_time * 7 / 8 + time;
+   tc->decayed_exec_slots = tc->decayed_exec_slots * 7 / 8 + num_call_slots;
+
+   uint64_t size = tc->decayed_exec_time ?
+                   TC_BATCH_TARGET_TIME * tc->decayed_exec_slots /
+                   tc->decayed_exec_time : TC_CALLS_PER_BATCH;
+
+   p_atomic_set(&tc->batch_size,
+                CLAMP(size, TC_MIN_CALLS_PER_BATCH, TC_CALLS_PER_BATCH));
+}
+
 static void
 tc_batch_execute(void *job, UNUSED int thread_index)
 {
    struct tc_batch *batch = job;
    struct pipe_context *pipe = batch->pipe;
-   struct tc_call *last = &batch->call[batch->num_total_call_slots];
+   unsigned num_call_slots = batch->num_total_call_slots;
+   struct tc_call *last = &batch->call[num_call_slots];
+   int64_t start_time = os_time_get_nano();
 
    tc_batch_check(batch);
 
@@ -212,6 +238,9 @@ tc_batch_execute(void *job, UNUSED int thread_index)
 
    tc_batch_check(batch);
    batch->num_total_call_slots = 0;
+
+   tc_batch_update_size(batch->tc, num_call_slots,
+                        os_time_get_nano() - start_time);
 }
 
 static void
@@ -223,7 +252,10 @@ tc_batch_flush(struct threaded_context *tc)
    tc_batch_check(next);
    tc_debug_check(tc);
    tc->bytes_mapped_estimate = 0;
+   tc->merge_start = 0;
+   tc->merge_mask = 0;
    p_atomic_add(&tc->num_offloaded_slots, next->num_total_call_slots);
+   p_atomic_inc(&tc->num_batches);
 
    if (next->token) {
       next->token->tc = NULL;
@@ -248,7 +280,12 @@ tc_add_sized_call(struct threaded_context *tc, enum tc_call_id id,
 
    tc_debug_check(tc);
 
-   if (unlikely(next->num_total_call_slots + num_call_slots > TC_CALLS_PER_BATCH)) {
+   /* Any call fits into an empty batch, but non-empty batches are flushed
+    * at the adaptive batch size.
+    */
+   if (unlikely(next->num_total_call_slots + num_call_slots >
+                p_atomic_read(&tc->batch_size) &&
+                next->num_total_call_slots)) {
       tc_batch_flush(tc);
       next = &tc->batch_slots[tc->next];
       tc_assert(next->num_total_call_slots == 0);
@@ -257,7 +294,10 @@ tc_add_sized_call(struct threaded_context *tc, enum tc_call_id id,
    tc_assert(util_queue_fence_is_signalled(&next->fence));
 
    struct tc_call *call = &next->call[next->num_total_call_slots];
+   tc->last_call_slot = next->num_total_call_slots;
    next->num_total_call_slots += num_call_slots;
+   tc->merge_start = next->num_total_call_slots;
+   tc->merge_mask = 0;
 
    call->sentinel = TC_SENTINEL;
    call->call_id = id;
@@ -286,6 +326,49 @@ tc_add_small_call(struct threaded_context *tc, enum tc_call_id id)
    return tc_add_sized_call(tc, id, tc_payload_size_to_call_slots(0));
 }
 
+/* Add a fixed-size call that sets state that is only used by later draws
+ * and dispatches, such as binding a CSO.
+ *
+ * If the same call was already recorded after the last call that isn't
+ * such a state call, the new state replaces it, because nothing has used
+ * the previous state yet.
+ */
+static union tc_payload *
+tc_add_state_call(struct threaded_context *tc, enum tc_call_id id,
+                  unsigned num_call_slots)
+{
+   struct tc_batch *next = &tc->batch_slots[tc->next];
+   uint64_t bit = BITFIELD64_BIT(id % 64);
+
+   if (tc->merge_mask & bit) {
+      struct tc_call *last = &next->call[next->num_total_call_slots];
+
+      for (struct tc_call *iter = &next->call[tc->merge_start]; iter != last;
+           iter += iter->num_call_slots) {
+         if (iter->call_id == id) {
+            tc_assert(iter->num_call_slots == num_call_slots);
+            p_atomic_inc(&tc->num_merged_calls);
+            return &iter->payload;
+         }
+      }
+   }
+
+   unsigned batch = tc->next;
+   unsigned merge_start = tc->merge_start;
+   uint64_t merge_mask = tc->merge_mask;
+   union tc_payload *payload = tc_add_sized_call(tc, id, num_call_slots);
+
+   /* Only the new call is mergeable if the batch was flushed. */
+   if (tc->next == batch) {
+      tc->merge_start = merge_start;
+      tc->merge_mask = merge_mask | bit;
+   } else {
+      tc->merge_start = 0;
+      tc->merge_mask = bit;
+   }
+   return payload;
+}
+
 static bool
 tc_is_sync(struct threaded_context *tc)
 {
@@ -322,6 +405,8 @@ _tc_sync(struct threaded_context *tc, UNUSED const char *info, UNUSED const char
    if (next->num_total_call_slots) {
       p_atomic_add(&tc->num_direct_slots, next->num_total_call_slots);
       tc->bytes_mapped_estimate = 0;
+      tc->merge_start = 0;
+      tc->merge_mask = 0;
       tc_batch_execute(next, 0);
       synced = true;
    }
@@ -415,7 +500,7 @@ threaded_context_unwrap_sync(struct pipe_context *pipe)
  * simple functions
  */
 
-#define TC_FUNC1(func, m_payload, qualifier, type, deref, deref2) \
+#define TC_FUNC1_ADD(add_call, func, m_payload, qualifier, type, deref, deref2) \
    static void \
    tc_call_##func(struct pipe_context *pipe, union tc_payload *payload) \
    { \
@@ -426,19 +511,24 @@ threaded_context_unwrap_sync(struct pipe_context *pipe)
    tc_##func(struct pipe_context *_pipe, qualifier type deref param) \
    { \
       struct threaded_context *tc = threaded_context(_pipe); \
-      type *p = (type*)tc_add_sized_call(tc, TC_CALL_##func, \
-                                         tc_payload_size_to_call_slots(sizeof(type))); \
+      type *p = (type*)add_call(tc, TC_CALL_##func, \
+                                tc_payload_size_to_call_slots(sizeof(type))); \
       *p = deref(param); \
    }
 
+#define TC_FUNC1(...) TC_FUNC1_ADD(tc_add_sized_call, __VA_ARGS__)
+
+/* Same as TC_FUNC1, but redundant calls are merged. */
+#define TC_STATE_FUNC1(...) TC_FUNC1_ADD(tc_add_state_call, __VA_ARGS__)
+
 TC_FUNC1(set_active_query_state, flags, , bool, , *)
 
-TC_FUNC1(set_blend_color, blend_color, const, struct pipe_blend_color, *, )
-TC_FUNC1(set_stencil_ref, stencil_ref, const, struct pipe_stencil_ref, , *)
-TC_FUNC1(set_clip_state, clip_state, const, struct pipe_clip_state, *, )
-TC_FUNC1(set_sample_mask, sample_mask, , unsigned, , *)
-TC_FUNC1(set_min_samples, min_samples, , unsigned, , *)
-TC_FUNC1(set_polygon_stipple, polygon_stipple, const, struct pipe_poly_stipple, *, )
+TC_STATE_FUNC1(set_blend_color, blend_color, const, struct pipe_blend_color, *, )
+TC_STATE_FUNC1(set_stencil_ref, stencil_ref, const, struct pipe_stencil_ref, , *)
+TC_STATE_FUNC1(set_clip_state, clip_state, const, struct pipe_clip_state, *, )
+TC_STATE_FUNC1(set_sample_mask, sample_mask, , unsigned, , *)
+TC_STATE_FUNC1(set_min_samples, min_samples, , unsigned, , *)
+TC_STATE_FUNC1(set_polygon_stipple, polygon_stipple, const, struct pipe_poly_stipple, *, )
 
 TC_FUNC1(texture_barrier, flags, , unsigned, , *)
 TC_FUNC1(memory_barrier, flags, , unsigned, , *)
@@ -640,7 +730,7 @@ tc_render_condition(struct pipe_context *_pipe,
       return pipe->create_##name##_state(pipe, state); \
    }
 
-#define TC_CSO_BIND(name) TC_FUNC1(bind_##name##_state, cso, , void *, , *)
+#define TC_CSO_BIND(name) TC_STATE_FUNC1(bind_##name##_state, cso, , void *, , *)
 #define TC_CSO_DELETE(name) TC_FUNC1(delete_##name##_state, cso, , void *, , *)
 
 #define TC_CSO_WHOLE2(name, sname) \
@@ -2389,6 +2479,52 @@ tc_call_draw_multi(struct pipe_context *pipe, union tc_payload *payload)
 #define DRAW_INFO_SIZE_WITHOUT_INDEXBUF_AND_MIN_MAX_INDEX \
    offsetof(struct pipe_draw_info, index)
 
+/* Append draws to the previous call if it's a multi draw with the same
+ * pipe_draw_info. Return false if that's not possible.
+ */
+static bool
+tc_merge_draw_multi(struct threaded_context *tc,
+                    const struct pipe_draw_info *info,
+                    const struct pipe_draw_start_count *draws,
+                    unsigned num_draws)
+{
+   struct tc_batch *next = &tc->batch_slots[tc->next];
+
+   /* Appended draws would get a different draw ID. */
+   if (!next->num_total_call_slots || info->increment_draw_id)
+      return false;
+
+   struct tc_call *call = &next->call[tc->last_call_slot];
+   if (call->call_id != TC_CALL_draw_multi)
+      return false;
+
+   struct tc_draw_multi *p = (struct tc_draw_multi*)&call->payload;
+   if (memcmp(&p->info, info, DRAW_INFO_SIZE_WITHOUT_MIN_MAX_INDEX) != 0)
+      return false;
+
+   unsigned total_draws = p->num_draws + num_draws;
+   unsigned num_call_slots =
+      tc_payload_size_to_call_slots(sizeof(struct tc_draw_multi) +
+                                    sizeof(p->slot[0]) * total_draws);
+   if (tc->last_call_slot + num_call_slots > TC_CALLS_PER_BATCH)
+      return false;
+
+   memcpy(&p->slot[p->num_draws], draws, sizeof(draws[0]) * num_draws);
+   p->num_draws = total_draws;
+   call->num_call_slots = num_call_slots;
+   next->num_total_call_slots = tc->last_call_slot + num_call_slots;
+   tc->merge_start = next->num_total_call_slots;
+
+   /* The previous call already holds a reference. */
+   if (info->index_size && info->take_index_buffer_ownership) {
+      struct pipe_resource *indexbuf = info->index.resource;
+      pipe_resource_reference(&indexbuf, NULL);
+   }
+
+   p_atomic_inc(&tc->num_merged_calls);
+   return true;
+}
+
 void
 tc_draw_vbo(struct pipe_context *_pipe, const struct pipe_draw_info *info,
             const struct pipe_draw_indirect_info *indirect,
@@ -2454,6 +2590,9 @@ tc_draw_vbo(struct pipe_context *_pipe, const struct pipe_draw_info *info,
          p->info.max_index = draws[0].count;
       } else {
          /* Non-indexed call or indexed with a real index buffer. */
+         if (tc_merge_draw_multi(tc, info, draws, 1))
+            return;
+
          struct tc_draw_single *p =
             tc_add_struct_typed_call(tc, TC_CALL_draw_single, tc_draw_single);
          if (index_size && !info->take_index_buffer_ownership) {
@@ -2521,6 +2660,9 @@ tc_draw_vbo(struct pipe_context *_pipe, const struct pipe_draw_info *info,
       }
    } else {
       /* Non-indexed call or indexed with a real index buffer. */
+      if (tc_merge_draw_multi(tc, info, draws, num_draws))
+         return;
+
       struct tc_draw_multi *p =
          tc_add_slot_based_call(tc, TC_CALL_draw_multi, tc_draw_multi,
                                 num_draws);
@@ -3024,6 +3166,7 @@ threaded_context_create(struct pipe_context *pipe,
       goto fail;
 
    tc->use_forced_staging_uploads = true;
+   tc->batch_size = TC_CALLS_PER_BATCH;
 
    /* The queue size is the number of batches "waiting". Batches are removed
     * from the queue before being executed, so keep one tc_batch slot for that
@@ -3035,6 +3178,7 @@ threaded_context_create(struct pipe_context *pipe,
    for (unsigned i = 0; i < TC_MAX_BATCHES; i++) {
       tc->batch_slots[i].sentinel = TC_SENTINEL;
       tc->batch_slots[i].pipe = pipe;
+      tc->batch_slots[i].tc = tc;
       util_queue_fence_init(&tc->batch_slots[i].fence);
    }
 
@@ -176,6 +176,19 @@
  * The batches are ordered in a ring and reused once they are idle again.
  * The batching is necessary for low queue/mutex overhead.
  *
+ * Batches are also flushed before they are full if the driver thread is
+ * slow. The time it takes to execute batches is measured, and the number of
+ * call slots per batch is limited so that one batch takes roughly
+ * TC_BATCH_TARGET_TIME to execute. This keeps the driver thread busy and
+ * bounds the time spent waiting for queued work in a sync.
+ *
+ * Redundant calls are merged while they are recorded:
+ * - If a CSO bind or a simple state call (e.g. set_blend_color) is recorded
+ *   and the same call is already in the current batch with only other such
+ *   state calls after it, the previous call is overwritten in place.
+ * - A draw with the same pipe_draw_info as the previous multi draw is
+ *   appended to it if it is the last call in the batch.
+ *
  */
 
 #ifndef U_THREADED_CONTEXT_H
@@ -222,6 +235,23 @@ struct tc_unflushed_batch_token;
  */
 #define TC_CALLS_PER_BATCH    768
 
+/* The minimum number of call slots per batch when the batch size is reduced
+ * because the driver thread is slow.
+ *
+ * With TC_MAX_BATCHES fixed, smaller batches reduce how many calls the
+ * application can queue before it has to wait for the driver thread.
+ * Batches only shrink while they take longer than TC_BATCH_TARGET_TIME to
+ * execute, so the waiting batches still hold at least
+ * (TC_MAX_BATCHES - 2) * TC_BATCH_TARGET_TIME of driver work. This bounds
+ * the number of queued calls to a quarter of that with full batches.
+ */
+#define TC_MIN_CALLS_PER_BATCH (TC_CALLS_PER_BATCH / 4)
+
+/* The execution time per batch in nanoseconds that the batch size is
+ * adjusted for.
+ */
+#define TC_BATCH_TARGET_TIME  200000
+
 /* Threshold for when to use the queue or sync. */
 #define TC_MAX_STRING_MARKER_BYTES  512
 
@@ -342,6 +372,7 @@ struct tc_unflushed_batch_token {
 
 struct tc_batch {
    struct pipe_context *pipe;
+   struct threaded_context *tc;
    unsigned sentinel;
    unsigned num_total_call_slots;
    struct tc_unflushed_batch_token *token;
@@ -364,6 +395,9 @@ struct threaded_context {
    unsigned num_offloaded_slots;
    unsigned num_direct_slots;
    unsigned num_syncs;
+   unsigned num_batches;
+   unsigned num_merged_calls;
+   uint64_t batch_exec_time; /* nanoseconds spent executing batches */
 
    bool use_forced_staging_uploads;
 
@@ -376,6 +410,22 @@ struct threaded_context {
    struct util_queue queue;
    struct util_queue_fence *fence;
 
+   /* The number of call slots after which batches are flushed, updated by
+    * the driver thread from the measured execution time per call slot.
+    */
+   unsigned batch_size;
+   uint64_t decayed_exec_time;
+   uint64_t decayed_exec_slots;
+
+   /* Calls recorded in the current batch, used for merging redundant calls.
+    * merge_start is the first call slot after the last call that can't be
+    * merged, and merge_mask has bit (call_id % 64) set for every call
+    * recorded since then.
+    */
+   unsigned last_call_slot;
+   unsigned merge_start;
+   uint64_t merge_mask;
+
    unsigned last, next;
    struct tc_batch batch_slots[TC_MAX_BATCHES];
 };
@@ -38,6 +38,14 @@
 #include "u_upload_mgr.h"
 
 
+/* How many filled buffers are kept for reuse. */
+#define U_UPLOAD_MAX_RETIRED 4
+
+struct u_upload_retired {
+   struct pipe_resource *buffer;
+   struct pipe_fence_handle *fence; /* NULL until u_upload_fence. */
+};
+
 struct u_upload_mgr {
    struct pipe_context *pipe;
 
@@ -55,6 +63,16 @@ struct u_upload_mgr {
    unsigned offset; /* Aligned offset to the upload buffer, pointing
                      * at the first unused byte. */
    int buffer_private_refcount;
+
+   /* Filled buffers, oldest first. Only kept once u_upload_fence has been
+    * called, otherwise nothing would tell when they are idle.
+    */
+   struct u_upload_retired retired[U_UPLOAD_MAX_RETIRED];
+   unsigned num_retired;
+   bool recycle;
+   bool needs_fence;
+
+   struct u_upload_stats stats;
 };
 
 
@@ -166,28 +184,120 @@ u_upload_release_buffer(struct u_upload_mgr *upload)
 }
 
 
+static void
+u_upload_release_retired(struct u_upload_mgr *upload, unsigned i)
+{
+   struct pipe_screen *screen = upload->pipe->screen;
+   struct u_upload_retired *r = &upload->retired[i];
+
+   screen->fence_reference(screen, &r->fence, NULL);
+   pipe_resource_reference(&r->buffer, NULL);
+   memmove(r, r + 1, (upload->num_retired - i - 1) * sizeof(*r));
+   upload->num_retired--;
+}
+
+
+/* Release the filled upload buffer, or keep it for reuse. */
+static void
+u_upload_retire_buffer(struct u_upload_mgr *upload)
+{
+   struct pipe_resource *buffer = NULL;
+
+   if (!upload->buffer)
+      return;
+
+   upload->needs_fence = true;
+
+   /* Keep our own reference of the buffer. */
+   if (upload->recycle)
+      pipe_resource_reference(&buffer, upload->buffer);
+
+   u_upload_release_buffer(upload);
+
+   if (buffer) {
+      if (upload->num_retired == U_UPLOAD_MAX_RETIRED)
+         u_upload_release_retired(upload, 0);
+
+      upload->retired[upload->num_retired].buffer = buffer;
+      upload->retired[upload->num_retired].fence = NULL;
+      upload->num_retired++;
+   }
+}
+
+
+/* Return a retired buffer of at least min_size bytes that the GPU is done
+ * with and that isn't referenced anywhere else, if there is one.
+ */
+static struct pipe_resource *
+u_upload_reuse_buffer(struct u_upload_mgr *upload, unsigned min_size)
+{
+   struct pipe_screen *screen = upload->pipe->screen;
+
+   for (unsigned i = 0; i < upload->num_retired; i++) {
+      struct u_upload_retired *r = &upload->retired[i];
+      struct pipe_resource *buffer = r->buffer;
+
+      /* Later buffers were fenced by later flushes, if at all. */
+      if (!r->fence || !screen->fence_finish(screen, NULL, r->fence, 0))
+         break;
+
+      if (buffer->width0 < min_size ||
+          p_atomic_read(&buffer->reference.count) != 1)
+         continue;
+
+      /* Take over the reference of the retired entry. */
+      r->buffer = NULL;
+      u_upload_release_retired(upload, i);
+      return buffer;
+   }
+
+   return NULL;
+}
+
+
 void
 u_upload_destroy(struct u_upload_mgr *upload)
 {
    u_upload_release_buffer(upload);
+   while (upload->num_retired)
+      u_upload_release_retired(upload, 0);
    FREE(upload);
 }
 
-/* Return the allocated buffer size or 0 if it failed. */
-static unsigned
-u_upload_alloc_buffer(struct u_upload_mgr *upload, unsigned min_size)
+
+void
+u_upload_fence(struct u_upload_mgr *upload, struct pipe_fence_handle *fence)
 {
    struct pipe_screen *screen = upload->pipe->screen;
-   struct pipe_resource buffer;
-   unsigned size;
 
-   /* Release the old buffer, if present:
-    */
-   u_upload_release_buffer(upload);
+   for (unsigned i = 0; i < upload->num_retired; i++) {
+      if (!upload->retired[i].fence)
+         screen->fence_reference(screen, &upload->retired[i].fence, fence);
+   }
 
-   /* Allocate a new one:
-    */
-   size = align(MAX2(upload->default_size, min_size), 4096);
+   upload->recycle = true;
+   upload->needs_fence = false;
+}
+
+
+bool
+u_upload_needs_fence(struct u_upload_mgr *upload)
+{
+   return upload->needs_fence;
+}
+
+
+void
+u_upload_get_stats(struct u_upload_mgr *upload, struct u_upload_stats *stats)
+{
+   *stats = upload->stats;
+}
+
+static struct pipe_resource *
+u_upload_create_buffer(struct u_upload_mgr *upload, unsigned size)
+{
+   struct pipe_screen *screen = upload->pipe->screen;
+   struct pipe_resource buffer;
 
    memset(&buffer, 0, sizeof buffer);
    buffer.target = PIPE_BUFFER;
@@ -205,9 +315,34 @@ u_upload_alloc_buffer(struct u_upload_mgr *upload, unsigned min_size)
                       PIPE_RESOURCE_FLAG_MAP_COHERENT;
    }
 
-   upload->buffer = screen->resource_create(screen, &buffer);
-   if (upload->buffer == NULL)
-      return 0;
+   return screen->resource_create(screen, &buffer);
+}
+
+/* Return the allocated buffer size or 0 if it failed. */
+static unsigned
+u_upload_alloc_buffer(struct u_upload_mgr *upload, unsigned min_size)
+{
+   unsigned size;
+
+   /* Retire the old buffer, if present:
+    */
+   u_upload_retire_buffer(upload);
+
+   size = align(MAX2(upload->default_size, min_size), 4096);
+
+   /* Reuse an idle buffer or allocate a new one:
+    */
+   upload->buffer = u_upload_reuse_buffer(upload, size);
+   if (upload->buffer) {
+      size = upload->buffer->width0;
+      upload->stats.num_reused++;
+   } else {
+      upload->buffer = u_upload_create_buffer(upload, size);
+      if (upload->buffer == NULL)
+         return 0;
+
+      upload->stats.num_buffers++;
+   }
 
    /* Since atomic operations are very very slow when 2 threads are not
     * sharing the same L3 cache (which happens on AMD Zen), eliminate all
@@ -236,7 +371,7 @@ u_upload_alloc_buffer(struct u_upload_mgr *upload, unsigned min_size)
    assert(upload->buffer_private_refcount < INT32_MAX / 2);
    p_atomic_add(&upload->buffer->reference.count, upload->buffer_private_refcount);
 
-   /* Map the new buffer. */
+   /* Map the buffer. The reused ones are idle, so this doesn't stall. */
    upload->map = pipe_buffer_map_range(upload->pipe, upload->buffer,
                                        0, size, upload->map_flags,
                                        &upload->transfer);
@@ -313,6 +448,7 @@ u_upload_alloc(struct u_upload_mgr *upload,
    }
 
    upload->offset = offset + size;
+   upload->stats.bytes += size;
 }
 
 void
@@ -36,8 +36,16 @@
 #include "pipe/p_defines.h"
 
 struct pipe_context;
+struct pipe_fence_handle;
 struct pipe_resource;
 
+/** Totals since the upload manager was created. */
+struct u_upload_stats {
+   uint64_t bytes;          /**< Bytes suballocated */
+   unsigned num_buffers;    /**< Upload buffers created */
+   unsigned num_reused;     /**< Upload buffers reused after a fence */
+};
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -90,6 +98,29 @@ void u_upload_destroy( struct u_upload_mgr *upload );
  */
 void u_upload_unmap( struct u_upload_mgr *upload );
 
+/**
+ * Attach a fence to the upload buffers filled up since the last call.
+ *
+ * The first call makes the upload manager keep a few filled buffers
+ * instead of releasing them, and reuse them once their fence has
+ * signalled and the buffer isn't referenced anywhere else.
+ *
+ * \param upload           Upload manager
+ * \param fence            Fence of a flush after those buffers were used
+ */
+void u_upload_fence(struct u_upload_mgr *upload,
+                    struct pipe_fence_handle *fence);
+
+/**
+ * Whether buffers were filled up since the last u_upload_fence call, so
+ * that a fence of the next flush could be used to recycle them.
+ */
+bool u_upload_needs_fence(struct u_upload_mgr *upload);
+
+/** Return the statistics of the upload manager. */
+void u_upload_get_stats(struct u_upload_mgr *upload,
+                        struct u_upload_stats *stats);
+
 /**
  * Sub-allocate new memory from the upload buffer.
  *
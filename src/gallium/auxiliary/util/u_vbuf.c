@@ -63,6 +63,12 @@
  * the range is [start_instance, start_instance+instance_count]. For constant
  * attribs, the range is [0, 1].
  *
+ * If the frontend counts buffer writes (see u_vbuf_caps), a range of buffer
+ * resources that is drawn twice without its sources being written is
+ * translated into its own buffer, which is reused by later draws of the
+ * same range until a source buffer is written, so static geometry is no
+ * longer translated after its second draw.
+ *
  *
  * 2) User buffer uploading (u_vbuf_upload_buffers)
  *
@@ -144,6 +150,36 @@ enum {
    VB_NUM = 3
 };
 
+#define U_VBUF_NUM_CACHED_VBS          8
+#define U_VBUF_CACHED_VB_MAX_BUFFERS   4
+
+/* A vertex buffer produced by u_vbuf_translate_buffers in its own resource,
+ * which is reused by later draws as long as none of the buffers it was
+ * translated from have been written.
+ */
+struct u_vbuf_cached_vb {
+   struct translate_key key;
+   uint32_t vb_mask;
+   int start;
+   unsigned count;
+   unsigned max_index;
+
+   /* The buffers in vb_mask, in the order of their bits. */
+   struct {
+      struct pipe_resource *resource;
+      unsigned buffer_offset;
+      unsigned stride;
+      unsigned write_count;
+   } src[U_VBUF_CACHED_VB_MAX_BUFFERS];
+
+   /* NULL until the range is drawn again with the source buffers unchanged,
+    * so that ranges drawn only once, or sources written before every draw,
+    * go through the stream uploader instead of allocating a buffer each.
+    */
+   struct pipe_resource *buffer;
+   unsigned buffer_offset;
+};
+
 struct u_vbuf {
    struct u_vbuf_caps caps;
    bool has_signed_vb_offset;
@@ -184,6 +220,10 @@ struct u_vbuf {
    uint32_t nonzero_stride_vb_mask; /* each bit describes a corresp. buffer */
    /* Which buffers are allowed (supported by hardware). */
    uint32_t allowed_vb_mask;
+
+   /* Translated vertex buffers, if caps.cache_translated_buffers. */
+   struct u_vbuf_cached_vb cached_vbs[U_VBUF_NUM_CACHED_VBS];
+   unsigned next_cached_vb;
 };
 
 static void *
@@ -191,6 +231,7 @@ u_vbuf_create_vertex_elements(struct u_vbuf *mgr, unsigned count,
                               const struct pipe_vertex_element *attribs);
 static void u_vbuf_delete_vertex_elements(void *ctx, void *state,
                                           enum cso_cache_type type);
+static void u_vbuf_release_cached_vb(struct u_vbuf_cached_vb *cvb);
 
 static const struct {
    enum pipe_format from, to;
@@ -311,6 +352,19 @@ void u_vbuf_get_caps(struct pipe_screen *screen, struct u_vbuf_caps *caps,
 
    if (!caps->fallback_always && !caps->user_vertex_buffers)
       caps->fallback_only_for_user_vbuffers = true;
+
+   /* Buffers written by the GPU don't have their write_count incremented. */
+   caps->cache_translated_buffers =
+      !screen->get_param(screen, PIPE_CAP_MAX_STREAM_OUTPUT_BUFFERS) &&
+      !screen->get_param(screen, PIPE_CAP_QUERY_BUFFER_OBJECT);
+
+   for (i = 0; i < PIPE_SHADER_TYPES; i++) {
+      if (screen->get_shader_param(screen, i,
+                                   PIPE_SHADER_CAP_MAX_SHADER_BUFFERS) ||
+          screen->get_shader_param(screen, i,
+                                   PIPE_SHADER_CAP_MAX_SHADER_IMAGES))
+         caps->cache_translated_buffers = false;
+   }
 }
 
 struct u_vbuf *
@@ -397,12 +451,132 @@ void u_vbuf_destroy(struct u_vbuf *mgr)
       pipe_vertex_buffer_unreference(&mgr->vertex_buffer[i]);
    for (i = 0; i < PIPE_MAX_ATTRIBS; i++)
       pipe_vertex_buffer_unreference(&mgr->real_vertex_buffer[i]);
+   for (i = 0; i < U_VBUF_NUM_CACHED_VBS; i++)
+      u_vbuf_release_cached_vb(&mgr->cached_vbs[i]);
 
    translate_cache_destroy(mgr->translate_cache);
    cso_cache_delete(&mgr->cso_cache);
    FREE(mgr);
 }
 
+static void
+u_vbuf_release_cached_vb(struct u_vbuf_cached_vb *cvb)
+{
+   for (unsigned i = 0; i < U_VBUF_CACHED_VB_MAX_BUFFERS; i++)
+      pipe_resource_reference(&cvb->src[i].resource, NULL);
+   pipe_resource_reference(&cvb->buffer, NULL);
+   memset(cvb, 0, sizeof(*cvb));
+}
+
+/**
+ * Whether the vertex buffers in vb_mask can be translated into a buffer
+ * that is kept for later draws.
+ */
+static bool
+u_vbuf_can_cache_translation(struct u_vbuf *mgr, uint32_t vb_mask,
+                             boolean unroll_indices)
+{
+   if (!mgr->caps.cache_translated_buffers || unroll_indices ||
+       util_bitcount(vb_mask) > U_VBUF_CACHED_VB_MAX_BUFFERS)
+      return false;
+
+   while (vb_mask) {
+      struct pipe_vertex_buffer *vb = &mgr->vertex_buffer[u_bit_scan(&vb_mask)];
+
+      /* Persistently mapped buffers can be written at any time. */
+      if (vb->is_user_buffer || !vb->buffer.resource ||
+          vb->buffer.resource->flags & PIPE_RESOURCE_FLAG_MAP_PERSISTENT)
+         return false;
+   }
+   return true;
+}
+
+/**
+ * Find the cached translation of the vertex buffers in vb_mask, which might
+ * be out of date.
+ */
+static struct u_vbuf_cached_vb *
+u_vbuf_find_cached_vb(struct u_vbuf *mgr, const struct translate_key *key,
+                      uint32_t vb_mask, int start, unsigned count,
+                      unsigned max_index)
+{
+   for (unsigned i = 0; i < U_VBUF_NUM_CACHED_VBS; i++) {
+      struct u_vbuf_cached_vb *cvb = &mgr->cached_vbs[i];
+      uint32_t mask = vb_mask;
+      unsigned j = 0;
+
+      if (cvb->vb_mask != vb_mask || cvb->start != start ||
+          cvb->count != count || cvb->max_index != max_index ||
+          translate_key_compare(&cvb->key, key))
+         continue;
+
+      while (mask) {
+         struct pipe_vertex_buffer *vb = &mgr->vertex_buffer[u_bit_scan(&mask)];
+
+         if (cvb->src[j].resource != vb->buffer.resource ||
+             cvb->src[j].buffer_offset != vb->buffer_offset ||
+             cvb->src[j].stride != vb->stride)
+            break;
+         j++;
+      }
+      if (!mask && j == util_bitcount(vb_mask))
+         return cvb;
+   }
+   return NULL;
+}
+
+/**
+ * Check whether the source buffers of a cached translation were written
+ * since it was last checked.  If they were, the translated buffer is
+ * dropped, and it's translated again by the next draw that finds them
+ * unchanged.
+ */
+static bool
+u_vbuf_check_cached_vb(struct u_vbuf_cached_vb *cvb)
+{
+   bool current = true;
+
+   for (unsigned i = 0; i < U_VBUF_CACHED_VB_MAX_BUFFERS; i++) {
+      if (cvb->src[i].resource &&
+          cvb->src[i].resource->write_count != cvb->src[i].write_count) {
+         cvb->src[i].write_count = cvb->src[i].resource->write_count;
+         current = false;
+      }
+   }
+
+   if (!current)
+      pipe_resource_reference(&cvb->buffer, NULL);
+   return current;
+}
+
+static void
+u_vbuf_add_cached_vb(struct u_vbuf *mgr, const struct translate_key *key,
+                     uint32_t vb_mask, int start, unsigned count,
+                     unsigned max_index)
+{
+   struct u_vbuf_cached_vb *cvb = &mgr->cached_vbs[mgr->next_cached_vb];
+   unsigned j = 0;
+
+   mgr->next_cached_vb = (mgr->next_cached_vb + 1) % U_VBUF_NUM_CACHED_VBS;
+   u_vbuf_release_cached_vb(cvb);
+
+   memcpy(&cvb->key, key, translate_keysize(key));
+   cvb->vb_mask = vb_mask;
+   cvb->start = start;
+   cvb->count = count;
+   cvb->max_index = max_index;
+
+   while (vb_mask) {
+      struct pipe_vertex_buffer *vb = &mgr->vertex_buffer[u_bit_scan(&vb_mask)];
+
+      pipe_resource_reference(&cvb->src[j].resource, vb->buffer.resource);
+      cvb->src[j].buffer_offset = vb->buffer_offset;
+      cvb->src[j].stride = vb->stride;
+      cvb->src[j].write_count = vb->buffer.resource->write_count;
+      j++;
+   }
+}
+
 static enum pipe_error
 u_vbuf_translate_buffers(struct u_vbuf *mgr, struct translate_key *key,
                          const struct pipe_draw_info *info,
@@ -414,9 +588,28 @@ u_vbuf_translate_buffers(struct u_vbuf *mgr, struct translate_key *key,
    struct translate *tr;
    struct pipe_transfer *vb_transfer[PIPE_MAX_ATTRIBS] = {0};
    struct pipe_resource *out_buffer = NULL;
+   struct u_vbuf_cached_vb *cvb = NULL;
    uint8_t *out_map;
    unsigned out_offset, mask;
 
+   /* Reuse the previous translation if the source buffers haven't changed. */
+   if (u_vbuf_can_cache_translation(mgr, vb_mask, unroll_indices)) {
+      cvb = u_vbuf_find_cached_vb(mgr, key, vb_mask, start_vertex,
+                                  num_vertices, info->max_index);
+
+      if (!cvb) {
+         /* Only remember the range, it gets a buffer if it's drawn again. */
+         u_vbuf_add_cached_vb(mgr, key, vb_mask, start_vertex,
+                              num_vertices, info->max_index);
+      } else if (!u_vbuf_check_cached_vb(cvb)) {
+         cvb = NULL;
+      } else if (cvb->buffer) {
+         pipe_resource_reference(&out_buffer, cvb->buffer);
+         out_offset = cvb->buffer_offset;
+         goto done;
+      }
+   }
+
    /* Get a translate object. */
    tr = translate_cache_find(mgr->translate_cache, key);
 
@@ -507,6 +700,37 @@ u_vbuf_translate_buffers(struct u_vbuf *mgr, struct translate_key *key,
       if (transfer) {
          pipe_buffer_unmap(mgr->pipe, transfer);
       }
+   } else if (cvb) {
+      struct pipe_transfer *transfer;
+
+      /* Create and map a buffer to keep. */
+      out_offset = mgr->has_signed_vb_offset ?
+                      0 : key->output_stride * start_vertex;
+      out_buffer = pipe_buffer_create(mgr->pipe->screen,
+                                      PIPE_BIND_VERTEX_BUFFER,
+                                      PIPE_USAGE_DEFAULT,
+                                      out_offset +
+                                      key->output_stride * num_vertices);
+      if (!out_buffer)
+         return PIPE_ERROR_OUT_OF_MEMORY;
+
+      out_map = pipe_buffer_map_range(mgr->pipe, out_buffer, out_offset,
+                                      key->output_stride * num_vertices,
+                                      PIPE_MAP_WRITE |
+                                      PIPE_MAP_DISCARD_WHOLE_RESOURCE,
+                                      &transfer);
+      if (!out_map) {
+         pipe_resource_reference(&out_buffer, NULL);
+         return PIPE_ERROR_OUT_OF_MEMORY;
+      }
+
+      tr->run(tr, 0, num_vertices, 0, 0, out_map);
+      pipe_buffer_unmap(mgr->pipe, transfer);
+
+      out_offset -= key->output_stride * start_vertex;
+
+      pipe_resource_reference(&cvb->buffer, out_buffer);
+      cvb->buffer_offset = out_offset;
    } else {
       /* Create and map the output buffer. */
       u_upload_alloc(mgr->pipe->stream_uploader,
@@ -533,6 +757,7 @@ u_vbuf_translate_buffers(struct u_vbuf *mgr, struct translate_key *key,
       }
    }
 
+done:
    /* Setup the new vertex buffer. */
    mgr->real_vertex_buffer[out_vb].buffer_offset = out_offset;
    mgr->real_vertex_buffer[out_vb].stride = key->output_stride;
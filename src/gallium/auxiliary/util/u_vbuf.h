@@ -59,6 +59,12 @@ struct u_vbuf_caps {
 
    bool fallback_always;
    bool fallback_only_for_user_vbuffers;
+
+   /* Whether translated vertex buffers can be reused until one of their
+    * source buffers is written, which requires that all buffer writes are
+    * counted in pipe_resource::write_count, and that the GPU doesn't write
+    * buffers. */
+   bool cache_translated_buffers;
 };
 
 
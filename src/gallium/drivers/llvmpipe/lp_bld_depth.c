@@ -292,6 +292,18 @@ lp_build_stencil_op(struct lp_build_context *bld,
 
 
 
+/**
+ * Index of pixel x, y of a 4x4 stamp in a 16-wide vector, where the
+ * pixels are ordered as 2x2 quads, left to right, top to bottom (the
+ * order lp_bld_interp.c interpolates inputs in).
+ */
+static inline unsigned
+stamp_index_16(unsigned x, unsigned y)
+{
+   return (x & 1) | ((y & 1) << 1) | ((x & 2) << 1) | ((y & 2) << 2);
+}
+
+
 /**
  * Return a type that matches the depth/stencil format.
  */
@@ -458,6 +470,16 @@ lp_build_occlusion_count(struct gallivm_state *gallivm,
                                        LLVMInt32TypeInContext(context), bits);
       count = LLVMBuildZExt(builder, count, LLVMIntTypeInContext(context, 64), "");
    }
+   else if(util_cpu_caps.has_avx512f && type.length == 16) {
+      /* compare into a mask register, and count its bits */
+      const char *popcntintr = "llvm.ctpop.i16";
+      LLVMTypeRef i16t = LLVMInt16TypeInContext(context);
+      LLVMValueRef bits = LLVMBuildICmp(builder, LLVMIntNE, maskvalue,
+                                        LLVMConstNull(LLVMTypeOf(maskvalue)), "");
+      bits = LLVMBuildBitCast(builder, bits, i16t, "");
+      count = lp_build_intrinsic_unary(builder, popcntintr, i16t, bits);
+      count = LLVMBuildZExt(builder, count, LLVMIntTypeInContext(context, 64), "");
+   }
    else {
       unsigned i;
       LLVMValueRef countv = LLVMBuildAnd(builder, maskvalue, countmask, "countv");
@@ -570,11 +592,10 @@ lp_build_depth_stencil_load_swizzled(struct gallivm_state *gallivm,
          shuffles[i] = lp_build_const_int32(gallivm, i);
       }
    }
-   else {
+   else if (z_src_type.length == 8) {
       unsigned i;
       LLVMValueRef loopx2 = LLVMBuildShl(builder, loop_counter,
                                          lp_build_const_int32(gallivm, 1), "");
-      assert(z_src_type.length == 8);
       depth_offset1 = LLVMBuildMul(builder, loopx2, depth_stride, "");
       /*
        * We load 2x4 values, and need to swizzle them (order
@@ -584,20 +605,48 @@ lp_build_depth_stencil_load_swizzled(struct gallivm_state *gallivm,
          shuffles[i] = lp_build_const_int32(gallivm, (i&1) + (i&2) * 2 + (i&4) / 2);
       }
    }
+   else {
+      /* The whole 4x4 stamp, loaded row by row. */
+      LLVMValueRef rows[4];
+      unsigned x, y;
+
+      assert(z_src_type.length == 16);
+      assert(!is_1d);
+
+      zs_load_type.length = 4;
+      load_ptr_type = LLVMPointerType(lp_build_vec_type(gallivm, zs_load_type), 0);
+
+      for (y = 0; y < 4; y++) {
+         LLVMValueRef offset = LLVMBuildMul(builder,
+                                            lp_build_const_int32(gallivm, y),
+                                            depth_stride, "");
+         zs_dst_ptr = LLVMBuildGEP(builder, depth_ptr, &offset, 1, "");
+         zs_dst_ptr = LLVMBuildBitCast(builder, zs_dst_ptr, load_ptr_type, "");
+         rows[y] = LLVMBuildLoad(builder, zs_dst_ptr, "");
+         for (x = 0; x < 4; x++) {
+            shuffles[stamp_index_16(x, y)] = lp_build_const_int32(gallivm, y * 4 + x);
+         }
+      }
 
-   depth_offset2 = LLVMBuildAdd(builder, depth_offset1, depth_stride, "");
-
-   /* Load current z/stencil values from z/stencil buffer */
-   zs_dst_ptr = LLVMBuildGEP(builder, depth_ptr, &depth_offset1, 1, "");
-   zs_dst_ptr = LLVMBuildBitCast(builder, zs_dst_ptr, load_ptr_type, "");
-   zs_dst1 = LLVMBuildLoad(builder, zs_dst_ptr, "");
-   if (is_1d) {
-      zs_dst2 = lp_build_undef(gallivm, zs_load_type);
+      zs_dst1 = lp_build_concat(gallivm, rows, zs_load_type, 4);
+      zs_dst2 = zs_dst1;
    }
-   else {
-      zs_dst_ptr = LLVMBuildGEP(builder, depth_ptr, &depth_offset2, 1, "");
+
+   if (z_src_type.length != 16) {
+      depth_offset2 = LLVMBuildAdd(builder, depth_offset1, depth_stride, "");
+
+      /* Load current z/stencil values from z/stencil buffer */
+      zs_dst_ptr = LLVMBuildGEP(builder, depth_ptr, &depth_offset1, 1, "");
       zs_dst_ptr = LLVMBuildBitCast(builder, zs_dst_ptr, load_ptr_type, "");
-      zs_dst2 = LLVMBuildLoad(builder, zs_dst_ptr, "");
+      zs_dst1 = LLVMBuildLoad(builder, zs_dst_ptr, "");
+      if (is_1d) {
+         zs_dst2 = lp_build_undef(gallivm, zs_load_type);
+      }
+      else {
+         zs_dst_ptr = LLVMBuildGEP(builder, depth_ptr, &depth_offset2, 1, "");
+         zs_dst_ptr = LLVMBuildBitCast(builder, zs_dst_ptr, load_ptr_type, "");
+         zs_dst2 = LLVMBuildLoad(builder, zs_dst_ptr, "");
+      }
    }
 
    *z_fb = LLVMBuildShuffleVector(builder, zs_dst1, zs_dst2,
@@ -716,11 +765,10 @@ lp_build_depth_stencil_write_swizzled(struct gallivm_state *gallivm,
                                    lp_build_const_int32(gallivm, depth_bytes * 2), "");
       depth_offset1 = LLVMBuildAdd(builder, depth_offset1, offset2, "");
    }
-   else {
+   else if (z_src_type.length == 8) {
       unsigned i;
       LLVMValueRef loopx2 = LLVMBuildShl(builder, loop_counter,
                                          lp_build_const_int32(gallivm, 1), "");
-      assert(z_src_type.length == 8);
       depth_offset1 = LLVMBuildMul(builder, loopx2, depth_stride, "");
       /*
        * We load 2x4 values, and need to swizzle them (order
@@ -730,6 +778,12 @@ lp_build_depth_stencil_write_swizzled(struct gallivm_state *gallivm,
          shuffles[i] = lp_build_const_int32(gallivm, (i&1) + (i&2) * 2 + (i&4) / 2);
       }
    }
+   else {
+      /* The whole 4x4 stamp, stored row by row below. */
+      assert(z_src_type.length == 16);
+      assert(!is_1d);
+      depth_offset1 = lp_build_const_int32(gallivm, 0);
+   }
 
    depth_offset2 = LLVMBuildAdd(builder, depth_offset1, depth_stride, "");
 
@@ -756,6 +810,42 @@ lp_build_depth_stencil_write_swizzled(struct gallivm_state *gallivm,
                                lp_build_int_vec_type(gallivm, zs_type), "");
    }
 
+   if (z_src_type.length == 16) {
+      LLVMValueRef row_shuffles[8];
+      LLVMValueRef row, offset, ptr;
+      unsigned n = format_desc->block.bits <= 32 ? 4 : 8;
+      unsigned x, y;
+
+      zs_load_type.length = 4;
+      load_ptr_type = LLVMPointerType(lp_build_vec_type(gallivm, zs_load_type), 0);
+
+      for (y = 0; y < 4; y++) {
+         for (x = 0; x < 4; x++) {
+            unsigned i = stamp_index_16(x, y);
+            if (n == 4) {
+               row_shuffles[x] = lp_build_const_int32(gallivm, i);
+            }
+            else {
+               /* interleave z and s */
+               row_shuffles[2*x] = lp_build_const_int32(gallivm, i);
+               row_shuffles[2*x + 1] = lp_build_const_int32(gallivm, i + 16);
+            }
+         }
+         row = LLVMBuildShuffleVector(builder, z_value,
+                                      n == 4 ? z_value : s_value,
+                                      LLVMConstVector(row_shuffles, n), "");
+         row = LLVMBuildBitCast(builder, row,
+                                lp_build_vec_type(gallivm, zs_load_type), "");
+
+         offset = LLVMBuildMul(builder, lp_build_const_int32(gallivm, y),
+                               depth_stride, "");
+         ptr = LLVMBuildGEP(builder, depth_ptr, &offset, 1, "");
+         ptr = LLVMBuildBitCast(builder, ptr, load_ptr_type, "");
+         LLVMBuildStore(builder, row, ptr);
+      }
+      return;
+   }
+
    if (format_desc->block.bits <= 32) {
       if (z_src_type.length == 4) {
          zs_dst1 = lp_build_extract_range(gallivm, z_value, 0, 2);
@@ -37,9 +37,11 @@
 #include "util/u_math.h"
 #include "util/u_memory.h"
 #include "util/simple_list.h"
+#include "util/u_threaded_context.h"
 #include "util/u_upload_mgr.h"
 #include "lp_clear.h"
 #include "lp_context.h"
+#include "lp_fence.h"
 #include "lp_flush.h"
 #include "lp_perf.h"
 #include "lp_state.h"
@@ -47,6 +49,7 @@
 #include "lp_query.h"
 #include "lp_setup.h"
 #include "lp_screen.h"
+#include "lp_texture.h"
 
 /* This is only safe if there's just one concurrent context */
 #ifdef EMBEDDED_DEVICE
@@ -148,7 +151,25 @@ llvmpipe_render_condition_mem(struct pipe_context *pipe,
 static void
 llvmpipe_texture_barrier(struct pipe_context *pipe, unsigned flags)
 {
-   llvmpipe_flush(pipe, NULL, __FUNCTION__);
+   /* Scenes are rasterized asynchronously, so we have to wait for them
+    * before the framebuffer contents can be sampled.
+    */
+   llvmpipe_finish(pipe, __FUNCTION__);
+}
+
+/**
+ * Scenes flushed by another context with a fence may still be rasterizing
+ * into resources shared with this one.  There is no queue to defer the
+ * wait to, so wait on the CPU.
+ */
+static void
+llvmpipe_fence_server_sync(struct pipe_context *pipe,
+                           struct pipe_fence_handle *fence)
+{
+   struct lp_fence *f = (struct lp_fence *) fence;
+
+   if (!lp_fence_signalled(f))
+      lp_fence_wait(f);
 }
 
 static void lp_draw_disk_cache_find_shader(void *cookie,
@@ -202,6 +223,7 @@ llvmpipe_create_context(struct pipe_screen *screen, void *priv,
    llvmpipe->pipe.clear = llvmpipe_clear;
    llvmpipe->pipe.flush = do_flush;
    llvmpipe->pipe.texture_barrier = llvmpipe_texture_barrier;
+   llvmpipe->pipe.fence_server_sync = llvmpipe_fence_server_sync;
 
    llvmpipe->pipe.render_condition = llvmpipe_render_condition;
    llvmpipe->pipe.render_condition_mem = llvmpipe_render_condition_mem;
@@ -291,7 +313,17 @@ llvmpipe_create_context(struct pipe_screen *screen, void *priv,
     */
    llvmpipe->dirty |= LP_NEW_SCISSOR;
 
-   return &llvmpipe->pipe;
+   if (!(flags & PIPE_CONTEXT_PREFER_THREADED) ||
+       (flags & PIPE_CONTEXT_COMPUTE_ONLY))
+      return &llvmpipe->pipe;
+
+   /* Run state validation, binning and vertex processing on a driver
+    * thread (disable with GALLIUM_THREAD=0).
+    */
+   return threaded_context_create(&llvmpipe->pipe,
+                                  &llvmpipe_screen(screen)->transfer_pool,
+                                  llvmpipe_replace_buffer_storage,
+                                  NULL, NULL);
 
  fail:
    llvmpipe_destroy(&llvmpipe->pipe);
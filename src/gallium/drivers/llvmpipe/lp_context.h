@@ -150,6 +150,7 @@ struct llvmpipe_context {
    struct blitter_context *blitter;
 
    unsigned tex_timestamp;
+   unsigned fs_constant_writes;
 
    /** List of all fragment shader variants */
    struct lp_fs_variant_list_item fs_variants_list;
@@ -29,6 +29,8 @@
  */
 
 #include "util/u_thread.h"
+#include "util/u_cpu_detect.h"
+#include "util/u_debug.h"
 #include "util/u_memory.h"
 #include "lp_cs_tpool.h"
 
@@ -82,9 +84,30 @@ lp_cs_tpool_create(unsigned num_threads)
 
    list_inithead(&pool->workqueue);
    assert (num_threads <= LP_MAX_THREADS);
+
+   pool->threads = CALLOC(MAX2(1, num_threads), sizeof(thrd_t));
+   if (!pool->threads) {
+      cnd_destroy(&pool->new_work);
+      mtx_destroy(&pool->m);
+      FREE(pool);
+      return NULL;
+   }
+
+   bool pin_threads = debug_get_bool_option("LP_PIN_THREADS", false);
+
    pool->num_threads = num_threads;
-   for (unsigned i = 0; i < num_threads; i++)
+   for (unsigned i = 0; i < num_threads; i++) {
       pool->threads[i] = u_thread_create(lp_cs_tpool_worker, pool);
+
+      /* Same L3 cache distribution as the rasterizer threads. */
+      if (pin_threads && util_cpu_caps.num_L3_caches > 1) {
+         unsigned L3_cache = i * util_cpu_caps.num_L3_caches / num_threads;
+
+         util_set_thread_affinity(pool->threads[i],
+                                  util_cpu_caps.L3_affinity_mask[L3_cache],
+                                  NULL, util_cpu_caps.num_cpu_mask_bits);
+      }
+   }
    return pool;
 }
 
@@ -105,6 +128,7 @@ lp_cs_tpool_destroy(struct lp_cs_tpool *pool)
 
    cnd_destroy(&pool->new_work);
    mtx_destroy(&pool->m);
+   FREE(pool->threads);
    FREE(pool);
 }
 
@@ -58,6 +58,8 @@
 #define PERF_NO_BLEND       0x20  	/* disable blending */
 #define PERF_NO_DEPTH       0x40  	/* disable depth buffering entirely */
 #define PERF_NO_ALPHATEST   0x80  	/* disable alpha testing */
+#define PERF_NO_LINEAR_FS   0x100 	/* always use the JIT'ed fragment shader */
+#define PERF_NO_HIZ         0x200 	/* no hierarchical-Z culling */
 
 
 extern int LP_PERF;
@@ -83,6 +83,8 @@ llvmpipe_draw_vbo(struct pipe_context *pipe, const struct pipe_draw_info *info,
       return;
    }
 
+   llvmpipe_check_fs_constants( lp );
+
    if (lp->dirty)
       llvmpipe_update_derived( lp );
 
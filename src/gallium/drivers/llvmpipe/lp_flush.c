@@ -37,6 +37,7 @@
 #include "draw/draw_context.h"
 #include "lp_flush.h"
 #include "lp_context.h"
+#include "lp_fence.h"
 #include "lp_setup.h"
 
 
@@ -53,7 +54,22 @@ llvmpipe_flush( struct pipe_context *pipe,
    draw_flush(llvmpipe->draw);
 
    /* ask the setup module to flush */
-   lp_setup_flush(llvmpipe->setup, fence, reason);
+   if (fence) {
+      lp_setup_flush(llvmpipe->setup, fence, reason);
+   }
+   else {
+      /* Scenes are rasterized asynchronously.  Callers which don't ask
+       * for a fence expect the rendering to be complete on return, so
+       * wait for the last scene here.
+       */
+      struct lp_fence *last_fence = NULL;
+
+      lp_setup_flush(llvmpipe->setup,
+                     (struct pipe_fence_handle **)&last_fence, reason);
+      if (!lp_fence_signalled(last_fence))
+         lp_fence_wait(last_fence);
+      lp_fence_reference(&last_fence, NULL);
+   }
 
    /* Enable to dump BMPs of the color/depth buffers each frame */
    if (0) {
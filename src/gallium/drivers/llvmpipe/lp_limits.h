@@ -66,7 +66,12 @@
 
 #define LP_MAX_SAMPLES 4
 
-#define LP_MAX_THREADS 16
+/**
+ * Sanity limit on the number of rasterizer/compute threads.  Per-thread
+ * storage is sized from the actual thread count, so this doesn't cost
+ * anything on smaller machines.
+ */
+#define LP_MAX_THREADS 256
 
 
 /**
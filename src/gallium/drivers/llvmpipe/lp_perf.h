@@ -56,6 +56,10 @@ struct lp_counters
    unsigned nr_fully_covered_4;
    unsigned nr_partially_covered_4;
    unsigned nr_non_empty_4;
+   unsigned nr_linear_4;
+   unsigned nr_hiz_culled_64;
+   unsigned nr_hiz_culled_16;
+   unsigned nr_hiz_culled_4;
    unsigned nr_llvm_compiles;
    int64_t llvm_compile_time;  /**< total, in microseconds */
 
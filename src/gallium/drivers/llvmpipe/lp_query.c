@@ -32,6 +32,7 @@
 
 #include "draw/draw_context.h"
 #include "pipe/p_defines.h"
+#include "util/u_atomic.h"
 #include "util/u_memory.h"
 #include "util/os_time.h"
 #include "lp_context.h"
@@ -48,18 +49,45 @@ static struct llvmpipe_query *llvmpipe_query( struct pipe_query *p )
    return (struct llvmpipe_query *)p;
 }
 
+/**
+ * Screen-wide counter backing a driver specific query.
+ */
+static uint64_t
+lp_driver_query_value(struct llvmpipe_screen *screen, unsigned type)
+{
+   switch (type) {
+   case LP_QUERY_FS_COMPILES:
+      return p_atomic_read(&screen->num_fs_compiles);
+   case LP_QUERY_FS_COMPILE_TIME:
+      return p_atomic_read(&screen->fs_compile_time);
+   case LP_QUERY_FS_COMPILE_STALLS:
+      return p_atomic_read(&screen->num_fs_compile_stalls);
+   case LP_QUERY_FS_COMPILE_STALL_TIME:
+      return p_atomic_read(&screen->fs_compile_stall_time);
+   default:
+      assert(0);
+      return 0;
+   }
+}
+
 static struct pipe_query *
 llvmpipe_create_query(struct pipe_context *pipe, 
                       unsigned type,
                       unsigned index)
 {
+   struct llvmpipe_screen *screen = llvmpipe_screen(pipe->screen);
+   unsigned num_threads = MAX2(1, screen->num_threads);
    struct llvmpipe_query *pq;
 
-   assert(type < PIPE_QUERY_TYPES);
+   assert(type < PIPE_QUERY_TYPES ||
+          (type >= PIPE_QUERY_DRIVER_SPECIFIC && type < LP_QUERY_LAST));
 
-   pq = CALLOC_STRUCT( llvmpipe_query );
+   /* The per-thread counters are allocated along with the query. */
+   pq = CALLOC(1, sizeof(*pq) + 2 * num_threads * sizeof(uint64_t));
 
    if (pq) {
+      pq->start = (uint64_t *)(pq + 1);
+      pq->end = pq->start + num_threads;
       pq->type = type;
       pq->index = index;
    }
@@ -102,6 +130,11 @@ llvmpipe_get_query_result(struct pipe_context *pipe,
    uint64_t *result = (uint64_t *)vresult;
    int i;
 
+   if (pq->type >= PIPE_QUERY_DRIVER_SPECIFIC) {
+      *result = pq->end[0];
+      return true;
+   }
+
    if (pq->fence) {
       /* only have a fence if there was a scene */
       if (!lp_fence_signalled(pq->fence)) {
@@ -315,6 +348,10 @@ llvmpipe_get_query_result_resource(struct pipe_context *pipe,
          }
          break;
       default:
+         if (pq->type >= PIPE_QUERY_DRIVER_SPECIFIC) {
+            value = pq->end[0];
+            break;
+         }
          fprintf(stderr, "Unknown query type %d\n", pq->type);
          break;
       }
@@ -364,19 +401,31 @@ static bool
 llvmpipe_begin_query(struct pipe_context *pipe, struct pipe_query *q)
 {
    struct llvmpipe_context *llvmpipe = llvmpipe_context( pipe );
+   struct llvmpipe_screen *screen = llvmpipe_screen(pipe->screen);
+   unsigned num_threads = MAX2(1, screen->num_threads);
    struct llvmpipe_query *pq = llvmpipe_query(q);
 
+   /* Driver queries sample screen counters and never enter a scene. */
+   if (pq->type >= PIPE_QUERY_DRIVER_SPECIFIC) {
+      pq->start[0] = lp_driver_query_value(screen, pq->type);
+      return true;
+   }
+
    /* Check if the query is already in the scene.  If so, we need to
     * flush the scene now.  Real apps shouldn't re-use a query in a
-    * frame of rendering.
+    * frame of rendering.  Scenes are rasterized asynchronously, so also
+    * wait for a previously flushed scene still writing the counters.
     */
    if (pq->fence && !lp_fence_issued(pq->fence)) {
       llvmpipe_finish(pipe, __FUNCTION__);
    }
+   else if (pq->fence && !lp_fence_signalled(pq->fence)) {
+      lp_fence_wait(pq->fence);
+   }
 
 
-   memset(pq->start, 0, sizeof(pq->start));
-   memset(pq->end, 0, sizeof(pq->end));
+   memset(pq->start, 0, num_threads * sizeof(pq->start[0]));
+   memset(pq->end, 0, num_threads * sizeof(pq->end[0]));
    lp_setup_begin_query(llvmpipe->setup, pq);
 
    switch (pq->type) {
@@ -429,6 +478,12 @@ llvmpipe_end_query(struct pipe_context *pipe, struct pipe_query *q)
    struct llvmpipe_context *llvmpipe = llvmpipe_context( pipe );
    struct llvmpipe_query *pq = llvmpipe_query(q);
 
+   if (pq->type >= PIPE_QUERY_DRIVER_SPECIFIC) {
+      pq->end[0] = lp_driver_query_value(llvmpipe_screen(pipe->screen),
+                                         pq->type) - pq->start[0];
+      return true;
+   }
+
    lp_setup_end_query(llvmpipe->setup, pq);
 
    switch (pq->type) {
@@ -35,15 +35,28 @@
 
 #include <limits.h>
 #include "os/os_thread.h"
+#include "pipe/p_defines.h"
+#include "util/u_threaded_context.h"
 #include "lp_limits.h"
 
 
 struct llvmpipe_context;
 
 
+/* Driver specific queries, see llvmpipe_get_driver_query_info() */
+enum lp_query_type {
+   LP_QUERY_FS_COMPILES = PIPE_QUERY_DRIVER_SPECIFIC,
+   LP_QUERY_FS_COMPILE_TIME,
+   LP_QUERY_FS_COMPILE_STALLS,
+   LP_QUERY_FS_COMPILE_STALL_TIME,
+   LP_QUERY_LAST,
+};
+
+
 struct llvmpipe_query {
-   uint64_t start[LP_MAX_THREADS];  /* start count value for each thread */
-   uint64_t end[LP_MAX_THREADS];    /* end count value for each thread */
+   struct threaded_query base;
+   uint64_t *start;                 /* start count value for each thread */
+   uint64_t *end;                   /* end count value for each thread */
    struct lp_fence *fence;          /* fence from last scene this was binned in */
    unsigned type;                   /* PIPE_QUERY_* */
    unsigned index;
@@ -33,6 +33,7 @@
 #include "util/u_pack_color.h"
 #include "util/u_string.h"
 #include "util/u_thread.h"
+#include "util/u_cpu_detect.h"
 #include "util/u_memset.h"
 #include "util/os_time.h"
 
@@ -78,10 +79,31 @@ lp_rast_begin( struct lp_rasterizer *rast,
 }
 
 
+/**
+ * End rasterizing a scene.
+ * The scene itself is retired by the setup module once its fence has
+ * signalled, so there is nothing to release here.
+ */
 static void
 lp_rast_end( struct lp_rasterizer *rast )
 {
-   lp_scene_end_rasterization( rast->curr_scene );
+   if (LP_DEBUG & DEBUG_SCENE) {
+      unsigned num_tasks = MAX2(1, rast->num_threads);
+      unsigned total = 0;
+      unsigned i;
+
+      for (i = 0; i < num_tasks; i++)
+         total += rast->tasks[i].bins_rasterized;
+
+      debug_printf("rasterized %u bins:\n", total);
+      for (i = 0; i < num_tasks; i++) {
+         const struct lp_rasterizer_task *task = &rast->tasks[i];
+         debug_printf("  thread %u: %u bins (%.1f%%), %u cmds\n",
+                      i, task->bins_rasterized,
+                      total ? 100.0f * task->bins_rasterized / total : 0.0f,
+                      task->cmds_executed);
+      }
+   }
 
    rast->curr_scene = NULL;
 }
@@ -125,6 +147,8 @@ lp_rast_tile_begin(struct lp_rasterizer_task *task,
                          scene->zsbuf.stride * task->y +
                          scene->zsbuf.format_bytes * task->x;
    }
+
+   lp_rast_hiz_begin_tile(task);
 }
 
 
@@ -207,6 +231,8 @@ lp_rast_clear_zstencil(struct lp_rasterizer_task *task,
    if (scene->fb.zsbuf) {
       unsigned layer;
 
+      task->hiz.valid = 0;
+
       for (unsigned s = 0; s < scene->zsbuf.nr_samples; s++) {
          uint8_t *dst_layer = task->depth_tile + (s * scene->zsbuf.sample_stride);
          block_size = util_format_get_blocksize(scene->fb.zsbuf->format);
@@ -311,6 +337,7 @@ lp_rast_shade_tile(struct lp_rasterizer_task *task,
    const struct lp_rast_state *state;
    struct lp_fragment_shader_variant *variant;
    const unsigned tile_x = task->x, tile_y = task->y;
+   unsigned hiz_culled = 0;
    unsigned x, y;
 
    if (inputs->disable) {
@@ -327,6 +354,34 @@ lp_rast_shade_tile(struct lp_rasterizer_task *task,
    }
    variant = state->variant;
 
+   if (variant->linear &&
+       lp_rast_linear_shade(task, inputs, tile_x, tile_y,
+                            align(task->width, 4), align(task->height, 4),
+                            0xffff))
+      return;
+
+   /* Reject the whole tile, or else single 16x16 blocks, by depth. */
+   if (variant->hiz_cull) {
+      if (lp_rast_hiz_cull(task, inputs, tile_x, tile_y, TILE_SIZE, TILE_SIZE))
+         return;
+
+      for (unsigned i = 0; i < LP_HIZ_BLOCKS * LP_HIZ_BLOCKS; i++) {
+         unsigned bx = (i % LP_HIZ_BLOCKS) * LP_HIZ_BLOCK_SIZE;
+         unsigned by = (i / LP_HIZ_BLOCKS) * LP_HIZ_BLOCK_SIZE;
+         if (lp_rast_hiz_cull(task, inputs, tile_x + bx, tile_y + by,
+                              LP_HIZ_BLOCK_SIZE, LP_HIZ_BLOCK_SIZE))
+            hiz_culled |= 1 << i;
+      }
+   }
+
+   for (unsigned i = 0; i < LP_HIZ_BLOCKS * LP_HIZ_BLOCKS; i++) {
+      if (!(hiz_culled & (1 << i)))
+         lp_rast_hiz_depth_written(task, inputs,
+                                   tile_x + (i % LP_HIZ_BLOCKS) * LP_HIZ_BLOCK_SIZE,
+                                   tile_y + (i / LP_HIZ_BLOCKS) * LP_HIZ_BLOCK_SIZE,
+                                   LP_HIZ_BLOCK_SIZE, LP_HIZ_BLOCK_SIZE);
+   }
+
    /* render the whole 64x64 tile in 4x4 chunks */
    for (y = 0; y < task->height; y += 4){
       for (x = 0; x < task->width; x += 4) {
@@ -338,6 +393,10 @@ lp_rast_shade_tile(struct lp_rasterizer_task *task,
          unsigned depth_sample_stride = 0;
          unsigned i;
 
+         if (hiz_culled & (1 << ((y / LP_HIZ_BLOCK_SIZE) * LP_HIZ_BLOCKS +
+                                 x / LP_HIZ_BLOCK_SIZE)))
+            continue;
+
          /* color buffer */
          for (i = 0; i < scene->fb.nr_cbufs; i++){
             if (scene->fb.cbufs[i]) {
@@ -473,6 +532,12 @@ lp_rast_shade_quads_mask_sample(struct lp_rasterizer_task *task,
     * allocated 4x4 blocks hence need to filter them out here.
     */
    if ((x % TILE_SIZE) < task->width && (y % TILE_SIZE) < task->height) {
+      if (variant->linear &&
+          lp_rast_linear_shade(task, inputs, x, y, 4, 4, (unsigned)mask))
+         return;
+
+      lp_rast_hiz_depth_written(task, inputs, x, y, 4, 4);
+
       /* Propagate non-interpolated raster state. */
       task->thread_data.raster_state.viewport_index = inputs->viewport_index;
 
@@ -574,6 +639,10 @@ lp_rast_set_state(struct lp_rasterizer_task *task,
                   const union lp_rast_cmd_arg arg)
 {
    task->state = arg.state;
+
+   /* Shading needs the variant's code, which may still be compiling. */
+   if (task->state && task->state->variant)
+      lp_fs_variant_ready(task->state->variant);
 }
 
 
@@ -657,6 +726,7 @@ do_rasterize_bin(struct lp_rasterizer_task *task,
       for (k = 0; k < block->count; k++) {
          dispatch[block->cmd[k]]( task, block->arg[k] );
       }
+      task->cmds_executed += block->count;
    }
 }
 
@@ -675,6 +745,7 @@ rasterize_bin(struct lp_rasterizer_task *task,
    lp_rast_tile_begin( task, bin, x, y );
 
    do_rasterize_bin(task, bin, x, y);
+   task->bins_rasterized++;
 
    lp_rast_tile_end(task);
 
@@ -714,6 +785,8 @@ rasterize_scene(struct lp_rasterizer_task *task,
                 struct lp_scene *scene)
 {
    task->scene = scene;
+   task->bins_rasterized = 0;
+   task->cmds_executed = 0;
 
    /* Clear the cache tags. This should not always be necessary but
       simpler for now. */
@@ -807,29 +880,12 @@ lp_rast_queue_scene( struct lp_rasterizer *rast,
 }
 
 
-void
-lp_rast_finish( struct lp_rasterizer *rast )
-{
-   if (rast->num_threads == 0) {
-      /* nothing to do */
-   }
-   else {
-      int i;
-
-      /* wait for work to complete */
-      for (i = 0; i < rast->num_threads; i++) {
-         pipe_semaphore_wait(&rast->tasks[i].work_done);
-      }
-   }
-}
-
-
 /**
  * This is the thread's main entrypoint.
  * It's a simple loop:
  *   1. wait for work
  *   2. do work
- *   3. signal that we're done
+ * Completion of each scene is signalled through its fence.
  */
 static int
 thread_function(void *init_data)
@@ -888,15 +944,12 @@ thread_function(void *init_data)
          lp_rast_end( rast );
       }
 
-      /* signal done with work */
       if (debug)
          debug_printf("thread %d done working\n", task->thread_index);
-
-      pipe_semaphore_signal(&task->work_done);
    }
 
 #ifdef _WIN32
-   pipe_semaphore_signal(&task->work_done);
+   pipe_semaphore_signal(&task->exited);
 #endif
 
    return 0;
@@ -911,16 +964,33 @@ create_rast_threads(struct lp_rasterizer *rast)
 {
    unsigned i;
 
+   boolean pin_threads = debug_get_bool_option("LP_PIN_THREADS", FALSE);
+   unsigned num_threads = rast->num_threads;
+
    /* NOTE: if num_threads is zero, we won't use any threads */
-   for (i = 0; i < rast->num_threads; i++) {
+   for (i = 0; i < num_threads; i++) {
       pipe_semaphore_init(&rast->tasks[i].work_ready, 0);
-      pipe_semaphore_init(&rast->tasks[i].work_done, 0);
+#ifdef _WIN32
+      pipe_semaphore_init(&rast->tasks[i].exited, 0);
+#endif
       rast->threads[i] = u_thread_create(thread_function,
                                             (void *) &rast->tasks[i]);
       if (!rast->threads[i]) {
          rast->num_threads = i; /* previous thread is max */
          break;
       }
+
+      /* Give each L3 cache a contiguous range of threads.  Neighbouring
+       * threads tend to pick up neighbouring bins, so this keeps shared
+       * texture and framebuffer data within one cache domain.
+       */
+      if (pin_threads && util_cpu_caps.num_L3_caches > 1) {
+         unsigned L3_cache = i * util_cpu_caps.num_L3_caches / num_threads;
+
+         util_set_thread_affinity(rast->threads[i],
+                                  util_cpu_caps.L3_affinity_mask[L3_cache],
+                                  NULL, util_cpu_caps.num_cpu_mask_bits);
+      }
    }
 }
 
@@ -942,6 +1012,12 @@ lp_rast_create( unsigned num_threads )
       goto no_rast;
    }
 
+   rast->tasks = CALLOC(MAX2(1, num_threads), sizeof *rast->tasks);
+   rast->threads = CALLOC(MAX2(1, num_threads), sizeof *rast->threads);
+   if (!rast->tasks || !rast->threads) {
+      goto no_tasks;
+   }
+
    rast->full_scenes = lp_scene_queue_create();
    if (!rast->full_scenes) {
       goto no_full_scenes;
@@ -974,7 +1050,7 @@ lp_rast_create( unsigned num_threads )
    return rast;
 
 no_thread_data_cache:
-   for (i = 0; i < MAX2(1, rast->num_threads); i++) {
+   for (i = 0; i < MAX2(1, num_threads); i++) {
       if (rast->tasks[i].thread_data.cache) {
          align_free(rast->tasks[i].thread_data.cache);
       }
@@ -982,6 +1058,9 @@ no_thread_data_cache:
 
    lp_scene_queue_destroy(rast->full_scenes);
 no_full_scenes:
+no_tasks:
+   FREE(rast->threads);
+   FREE(rast->tasks);
    FREE(rast);
 no_rast:
    return NULL;
@@ -1008,7 +1087,7 @@ void lp_rast_destroy( struct lp_rasterizer *rast )
     * per https://bugs.freedesktop.org/show_bug.cgi?id=76252 */
    for (i = 0; i < rast->num_threads; i++) {
 #ifdef _WIN32
-      pipe_semaphore_wait(&rast->tasks[i].work_done);
+      pipe_semaphore_wait(&rast->tasks[i].exited);
 #else
       thrd_join(rast->threads[i], NULL);
 #endif
@@ -1017,7 +1096,9 @@ void lp_rast_destroy( struct lp_rasterizer *rast )
    /* Clean up per-thread data */
    for (i = 0; i < rast->num_threads; i++) {
       pipe_semaphore_destroy(&rast->tasks[i].work_ready);
-      pipe_semaphore_destroy(&rast->tasks[i].work_done);
+#ifdef _WIN32
+      pipe_semaphore_destroy(&rast->tasks[i].exited);
+#endif
    }
    for (i = 0; i < MAX2(1, rast->num_threads); i++) {
       align_free(rast->tasks[i].thread_data.cache);
@@ -1030,6 +1111,8 @@ void lp_rast_destroy( struct lp_rasterizer *rast )
 
    lp_scene_queue_destroy(rast->full_scenes);
 
+   FREE(rast->threads);
+   FREE(rast->tasks);
    FREE(rast);
 }
 
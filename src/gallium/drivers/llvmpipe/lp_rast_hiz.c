@@ -0,0 +1,344 @@
+/**************************************************************************
+ *
+ * Copyright 2010-2021 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+/**
+ * @file
+ * Hierarchical-Z culling.
+ *
+ * The depth range of each 16x16 block of the current depth tile is
+ * computed on demand, the first time a triangle is tested against it.
+ * Depth writes widen it by the written triangle's depth range, and it is
+ * forgotten when the block's depth changes in other ways (clears, shader
+ * written depth, a new tile or layer).  A triangle whose depth plane lies
+ * entirely behind a block's range cannot pass the depth test anywhere in
+ * that block, so neither the shader nor the depth test need to run.
+ */
+
+#include <float.h>
+#include <string.h>
+
+#include "util/format/u_format.h"
+#include "util/u_math.h"
+#include "lp_debug.h"
+#include "lp_perf.h"
+#include "lp_rast_priv.h"
+#include "lp_state_fs.h"
+
+
+/**
+ * Called at the start of each tile.  Decides whether the bound depth
+ * buffer can be decoded here, and invalidates all blocks.
+ */
+void
+lp_rast_hiz_begin_tile(struct lp_rasterizer_task *task)
+{
+   const struct lp_scene *scene = task->scene;
+   struct lp_hiz_state *hiz = &task->hiz;
+   const struct util_format_description *desc;
+   const struct util_format_channel_description *chan;
+
+   hiz->enabled = FALSE;
+   hiz->valid = 0;
+   hiz->layer = 0;
+
+   if (!scene->fb.zsbuf || !scene->zsbuf.map ||
+       scene->zsbuf.nr_samples > 1)
+      return;
+
+   desc = util_format_description(scene->fb.zsbuf->format);
+   if (!desc || !util_format_has_depth(desc) ||
+       desc->swizzle[0] >= PIPE_SWIZZLE_0)
+      return;
+
+   chan = &desc->channel[desc->swizzle[0]];
+
+   if (chan->type == UTIL_FORMAT_TYPE_FLOAT &&
+       chan->size == 32 && chan->shift == 0) {
+      hiz->is_float = TRUE;
+      hiz->eps = 1.0f / (1 << 20);
+   } else if (chan->type == UTIL_FORMAT_TYPE_UNSIGNED &&
+              chan->normalized &&
+              chan->size <= 32 && chan->shift + chan->size <= 32 &&
+              (scene->zsbuf.format_bytes == 2 ||
+               scene->zsbuf.format_bytes == 4)) {
+      hiz->is_float = FALSE;
+      hiz->shift = chan->shift;
+      hiz->mask = chan->size == 32 ? ~0u : (1u << chan->size) - 1;
+      hiz->scale = (float)(1.0 / (double)hiz->mask);
+      /* Depth is converted to unorm in float precision by the shader */
+      hiz->eps = 2.0f * hiz->scale + 1.0f / (1 << 20);
+   } else {
+      return;
+   }
+
+   hiz->enabled = TRUE;
+}
+
+
+/**
+ * The blocks overlapping the region [x, x + width) x [y, y + height) of
+ * the current tile.
+ */
+#define HIZ_BLOCK_RANGE(x, y, width, height, bx0, by0, bx1, by1)          \
+   do {                                                                  \
+      bx0 = ((x) % TILE_SIZE) / LP_HIZ_BLOCK_SIZE;                        \
+      by0 = ((y) % TILE_SIZE) / LP_HIZ_BLOCK_SIZE;                        \
+      bx1 = MIN2(((x) % TILE_SIZE) + (width) - 1, TILE_SIZE - 1) /         \
+            LP_HIZ_BLOCK_SIZE;                                           \
+      by1 = MIN2(((y) % TILE_SIZE) + (height) - 1, TILE_SIZE - 1) /        \
+            LP_HIZ_BLOCK_SIZE;                                           \
+   } while (0)
+
+
+/**
+ * Compute the depth range of block b of the current tile and layer.
+ */
+static void
+hiz_update_block(struct lp_rasterizer_task *task, unsigned b)
+{
+   const struct lp_scene *scene = task->scene;
+   struct lp_hiz_state *hiz = &task->hiz;
+   struct lp_hiz_block *block = &hiz->block[b];
+   const unsigned x0 = (b % LP_HIZ_BLOCKS) * LP_HIZ_BLOCK_SIZE;
+   const unsigned y0 = (b / LP_HIZ_BLOCKS) * LP_HIZ_BLOCK_SIZE;
+   const unsigned stride = scene->zsbuf.stride;
+   const unsigned bytes = scene->zsbuf.format_bytes;
+   const uint8_t *row;
+   unsigned w, h, i, j;
+
+   hiz->valid |= 1u << b;
+
+   /* Nothing outside the framebuffer is ever shaded. */
+   if (x0 >= task->width || y0 >= task->height) {
+      block->zmin = FLT_MAX;
+      block->zmax = -FLT_MAX;
+      return;
+   }
+
+   w = MIN2(LP_HIZ_BLOCK_SIZE, task->width - x0);
+   h = MIN2(LP_HIZ_BLOCK_SIZE, task->height - y0);
+
+   row = task->depth_tile + y0 * stride + x0 * bytes;
+   if (hiz->layer)
+      row += hiz->layer * scene->zsbuf.layer_stride;
+
+   if (hiz->is_float) {
+      float zmin = FLT_MAX, zmax = -FLT_MAX;
+      boolean nan = FALSE;
+
+      for (i = 0; i < h; i++) {
+         for (j = 0; j < w; j++) {
+            float z;
+            memcpy(&z, row + j * bytes, sizeof z);
+            nan |= z != z;
+            zmin = MIN2(z, zmin);
+            zmax = MAX2(z, zmax);
+         }
+         row += stride;
+      }
+
+      /* Nothing can be culled against a NaN */
+      block->zmin = nan ? -FLT_MAX : zmin;
+      block->zmax = nan ? FLT_MAX : zmax;
+   } else {
+      uint32_t zmin = ~0u, zmax = 0;
+
+      for (i = 0; i < h; i++) {
+         for (j = 0; j < w; j++) {
+            uint32_t z;
+            if (bytes == 2)
+               z = ((const uint16_t *)row)[j];
+            else
+               z = ((const uint32_t *)row)[j];
+            z = (z >> hiz->shift) & hiz->mask;
+            zmin = MIN2(z, zmin);
+            zmax = MAX2(z, zmax);
+         }
+         row += stride;
+      }
+
+      block->zmin = (float)zmin * hiz->scale;
+      block->zmax = (float)zmax * hiz->scale;
+   }
+}
+
+
+/**
+ * Range of the triangle's interpolated depth, after depth clamping, over
+ * the region [x, x + width) x [y, y + height).
+ */
+static void
+hiz_plane_range(const struct lp_rasterizer_task *task,
+                const struct lp_rast_shader_inputs *inputs,
+                int x, int y, unsigned width, unsigned height,
+                float *zmin, float *zmax)
+{
+   const struct lp_rast_state *state = task->state;
+   const float (*a0)[4] = GET_A0(inputs);
+   const float (*dadx)[4] = GET_DADX(inputs);
+   const float (*dady)[4] = GET_DADY(inputs);
+   float z0, zdx, zdy;
+
+   /*
+    * All pixel and sample positions lie within the closed rectangle, so
+    * the extremes are at its corners.
+    */
+   z0 = a0[0][2] + dadx[0][2] * x + dady[0][2] * y;
+   zdx = dadx[0][2] * width;
+   zdy = dady[0][2] * height;
+   *zmin = z0 + MIN2(zdx, 0.0f) + MIN2(zdy, 0.0f);
+   *zmax = z0 + MAX2(zdx, 0.0f) + MAX2(zdy, 0.0f);
+
+   if (state->variant->key.depth_clamp) {
+      const struct lp_jit_viewport *vp =
+         &state->jit_context.viewports[inputs->viewport_index];
+      *zmin = CLAMP(*zmin, vp->min_depth, vp->max_depth);
+      *zmax = CLAMP(*zmax, vp->min_depth, vp->max_depth);
+   }
+}
+
+
+/**
+ * Test the triangle's depth plane against the blocks overlapping the
+ * region [x, x + width) x [y, y + height) of the current tile.
+ * Returns TRUE if the triangle is occluded throughout the region.
+ */
+boolean
+lp_rast_hiz_test(struct lp_rasterizer_task *task,
+                 const struct lp_rast_shader_inputs *inputs,
+                 int x, int y, unsigned width, unsigned height)
+{
+   const struct lp_fragment_shader_variant *variant = task->state->variant;
+   struct lp_hiz_state *hiz = &task->hiz;
+   float tri_zmin, tri_zmax, zmin, zmax;
+   unsigned bx0, by0, bx1, by1, bx, by;
+
+   if (inputs->layer != hiz->layer) {
+      hiz->layer = inputs->layer;
+      hiz->valid = 0;
+   }
+
+   hiz_plane_range(task, inputs, x, y, width, height, &tri_zmin, &tri_zmax);
+
+   /* Unorm depth is clamped to [0, 1] before the test. */
+   if (!hiz->is_float && (tri_zmin < 0.0f || tri_zmax > 1.0f))
+      return FALSE;
+
+   /* Also rejects NaN. */
+   if (!(tri_zmin <= tri_zmax))
+      return FALSE;
+
+   HIZ_BLOCK_RANGE(x, y, width, height, bx0, by0, bx1, by1);
+
+   zmin = FLT_MAX;
+   zmax = -FLT_MAX;
+   for (by = by0; by <= by1; by++) {
+      for (bx = bx0; bx <= bx1; bx++) {
+         unsigned b = by * LP_HIZ_BLOCKS + bx;
+         if (!(hiz->valid & (1u << b)))
+            hiz_update_block(task, b);
+         zmin = MIN2(hiz->block[b].zmin, zmin);
+         zmax = MAX2(hiz->block[b].zmax, zmax);
+      }
+   }
+
+   switch (variant->key.depth.func) {
+   case PIPE_FUNC_LESS:
+   case PIPE_FUNC_LEQUAL:
+      if (!(tri_zmin > zmax + hiz->eps))
+         return FALSE;
+      break;
+   case PIPE_FUNC_GREATER:
+   case PIPE_FUNC_GEQUAL:
+      if (!(tri_zmax < zmin - hiz->eps))
+         return FALSE;
+      break;
+   default:
+      return FALSE;
+   }
+
+   if (width >= TILE_SIZE)
+      LP_COUNT(nr_hiz_culled_64);
+   else if (width >= 16)
+      LP_COUNT(nr_hiz_culled_16);
+   else
+      LP_COUNT(nr_hiz_culled_4);
+
+   return TRUE;
+}
+
+
+/**
+ * Account for the shader writing depth to the region
+ * [x, x + width) x [y, y + height) of the current tile.  Depth written by
+ * the depth test lies within the triangle's depth range over the region,
+ * so the valid blocks there are widened by it rather than recomputed.
+ */
+void
+lp_rast_hiz_write(struct lp_rasterizer_task *task,
+                  const struct lp_rast_shader_inputs *inputs,
+                  int x, int y, unsigned width, unsigned height)
+{
+   struct lp_hiz_state *hiz = &task->hiz;
+   float tri_zmin, tri_zmax;
+   unsigned bx0, by0, bx1, by1, bx, by;
+   boolean known;
+
+   /* The blocks describe another layer, which is left alone. */
+   if (inputs->layer != hiz->layer)
+      return;
+
+   hiz_plane_range(task, inputs, x, y, width, height, &tri_zmin, &tri_zmax);
+
+   /* Also rejects NaN. */
+   known = !task->state->variant->writes_shader_depth &&
+           tri_zmin <= tri_zmax;
+
+   /* Unorm depth is clamped to [0, 1] before it's written. */
+   if (!hiz->is_float) {
+      tri_zmin = CLAMP(tri_zmin, 0.0f, 1.0f);
+      tri_zmax = CLAMP(tri_zmax, 0.0f, 1.0f);
+   }
+
+   HIZ_BLOCK_RANGE(x, y, width, height, bx0, by0, bx1, by1);
+
+   for (by = by0; by <= by1; by++) {
+      for (bx = bx0; bx <= bx1; bx++) {
+         unsigned b = by * LP_HIZ_BLOCKS + bx;
+
+         if (!(hiz->valid & (1u << b)))
+            continue;
+
+         if (known) {
+            hiz->block[b].zmin = MIN2(hiz->block[b].zmin, tri_zmin);
+            hiz->block[b].zmax = MAX2(hiz->block[b].zmax, tri_zmax);
+         } else {
+            hiz->valid &= ~(1u << b);
+         }
+      }
+   }
+}
@@ -0,0 +1,460 @@
+/**************************************************************************
+ *
+ * Copyright 2010-2021 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+/**
+ * @file
+ * Linear rasterization path.
+ *
+ * Shades spans of pixels for the trivial fragment shaders recognized by
+ * lp_state_fs_analysis.c (nearest-filtered RGBA8 blits and interpolated
+ * colors) with plain C and 8-bit fixed-point blending, avoiding the
+ * overhead of the general SoA JIT'ed code, which evaluates everything in
+ * 32-bit floats.
+ *
+ * Anything that can't be handled here makes lp_rast_linear_shade() return
+ * FALSE, in which case the caller runs the JIT'ed function as usual.
+ */
+
+
+#include "util/u_math.h"
+#include "util/u_endian.h"
+#include "lp_debug.h"
+#include "lp_perf.h"
+#include "lp_rast_priv.h"
+#include "lp_state_fs.h"
+
+
+struct linear_texture
+{
+   const uint8_t *data;
+   unsigned stride;
+   int width;
+   int height;
+   float scale_s, scale_t;    /**< texture size, or 1 for unnormalized */
+   boolean repeat;
+   boolean swap_rb;           /**< texture and color buffer R/B order differ */
+   uint32_t alpha_or;         /**< 0xff000000 for formats without alpha */
+};
+
+
+/** R/B order of the RGBA8 formats accepted by llvmpipe_fs_variant_linear */
+static inline boolean
+is_bgra(enum pipe_format format)
+{
+   return format == PIPE_FORMAT_B8G8R8A8_UNORM ||
+          format == PIPE_FORMAT_B8G8R8X8_UNORM;
+}
+
+
+static inline uint32_t
+swap_rb(uint32_t p)
+{
+   return (p & 0xff00ff00) | ((p >> 16) & 0xff) | ((p & 0xff) << 16);
+}
+
+
+/**
+ * Multiply the two 8-bit lanes at bits 0-7 and 16-23 by f/255, rounding
+ * to nearest (exact for all 8-bit inputs).
+ */
+static inline uint32_t
+mul_255_lanes(uint32_t x, uint32_t f)
+{
+   uint32_t t = (x & 0x00ff00ff) * f + 0x00800080;
+   return ((t + ((t >> 8) & 0x00ff00ff)) >> 8) & 0x00ff00ff;
+}
+
+
+/** Saturating per-lane add of two values in mul_255_lanes layout */
+static inline uint32_t
+add_sat_lanes(uint32_t a, uint32_t b)
+{
+   uint32_t t = a + b;
+   t |= 0x01000100 - ((t >> 8) & 0x00010001);
+   return t & 0x00ff00ff;
+}
+
+
+static inline uint32_t
+blend_pixel(enum lp_linear_blend blend, uint32_t src, uint32_t dst)
+{
+   uint32_t sa = src >> 24;
+   uint32_t rb, ag;
+
+   switch (blend) {
+   case LP_LINEAR_BLEND_PREMUL:
+      if (sa == 0xff)
+         return src;
+      rb = add_sat_lanes(src & 0x00ff00ff,
+                         mul_255_lanes(dst, 255 - sa));
+      ag = add_sat_lanes((src >> 8) & 0x00ff00ff,
+                         mul_255_lanes(dst >> 8, 255 - sa));
+      return rb | (ag << 8);
+   case LP_LINEAR_BLEND_ALPHA:
+      if (sa == 0xff)
+         return src;
+      if (sa == 0)
+         return dst;
+      rb = add_sat_lanes(mul_255_lanes(src, sa),
+                         mul_255_lanes(dst, 255 - sa));
+      ag = add_sat_lanes(mul_255_lanes(src >> 8, sa),
+                         mul_255_lanes(dst >> 8, 255 - sa));
+      return rb | (ag << 8);
+   case LP_LINEAR_BLEND_NONE:
+   default:
+      return src;
+   }
+}
+
+
+/**
+ * Nearest texel index for a coordinate already scaled to texels.
+ * Written so that NaNs end up at texel zero.
+ */
+static inline int
+nearest_clamp(float u, int size)
+{
+   if (!(u >= 0.0f))
+      return 0;
+   if (u >= (float)size)
+      return size - 1;
+   return (int)u;
+}
+
+
+static inline int
+nearest_repeat(float s, int size)
+{
+   float f = s - floorf(s);
+   int i;
+
+   if (!(f >= 0.0f))
+      return 0;
+   i = (int)(f * (float)size);
+   return MIN2(i, size - 1);
+}
+
+
+static inline int
+wrap_fixed(int i, int size, boolean repeat)
+{
+   if (repeat) {
+      i %= size;
+      return i < 0 ? i + size : i;
+   }
+   return CLAMP(i, 0, size - 1);
+}
+
+
+static inline uint32_t
+fetch_texel(const struct linear_texture *tex, int i, int j)
+{
+   const uint32_t *row = (const uint32_t *)(tex->data + j * tex->stride);
+   uint32_t p = row[i] | tex->alpha_or;
+   return tex->swap_rb ? swap_rb(p) : p;
+}
+
+
+/**
+ * Affine mapping along the span: step texel coordinates in 16.16 fixed
+ * point, as long as they stay comfortably within range.
+ *
+ * \param oow  constant 1/w for the span
+ * \return FALSE if the coordinates are out of range
+ */
+static boolean
+blit_span_fixed(const struct lp_fragment_shader_variant *variant,
+                const struct linear_texture *tex,
+                float s0, float t0, float dsdx, float dtdx, float oow,
+                unsigned width, uint64_t mask,
+                uint32_t *dst)
+{
+   const enum lp_linear_blend blend = variant->linear_blend;
+   float u0 = s0 * oow * tex->scale_s;
+   float v0 = t0 * oow * tex->scale_t;
+   float du = dsdx * oow * tex->scale_s;
+   float dv = dtdx * oow * tex->scale_t;
+   float u1, v1;
+   int32_t u, v, iu, iv;
+   unsigned i;
+
+   if (tex->repeat) {
+      /* keep the integer parts small, they only matter modulo the size */
+      u0 -= floorf(u0 / tex->width) * tex->width;
+      v0 -= floorf(v0 / tex->height) * tex->height;
+   }
+
+   u1 = u0 + du * width;
+   v1 = v0 + dv * width;
+
+   if (!(fabsf(u0) < 16384.0f && fabsf(u1) < 16384.0f &&
+         fabsf(v0) < 16384.0f && fabsf(v1) < 16384.0f))
+      return FALSE;
+
+   u = (int32_t)(u0 * 65536.0f);
+   v = (int32_t)(v0 * 65536.0f);
+   iu = (int32_t)(du * 65536.0f);
+   iv = (int32_t)(dv * 65536.0f);
+
+   for (i = 0; i < width; i++, u += iu, v += iv) {
+      if (mask & (1ULL << i)) {
+         int ti = wrap_fixed(u >> 16, tex->width, tex->repeat);
+         int tj = wrap_fixed(v >> 16, tex->height, tex->repeat);
+         uint32_t src = fetch_texel(tex, ti, tj);
+         dst[i] = blend_pixel(blend, src, dst[i]);
+      }
+   }
+
+   return TRUE;
+}
+
+
+/**
+ * Shade a span of texels, for LP_FS_KIND_BLIT_RGBA shaders.
+ */
+static void
+blit_span(const struct lp_fragment_shader_variant *variant,
+          const struct linear_texture *tex,
+          const float (*a0)[4],
+          const float (*dadx)[4],
+          const float (*dady)[4],
+          unsigned attrib, boolean perspective,
+          int x, int y, unsigned width, uint64_t mask,
+          uint32_t *dst)
+{
+   const enum lp_linear_blend blend = variant->linear_blend;
+   const float fx0 = (float)x;
+   const float fy = (float)y;
+   unsigned i;
+
+   /*
+    * Unless 1/w (in position.w) actually varies across the primitive, the
+    * mapping is affine.
+    */
+   if (!perspective || (dadx[0][3] == 0.0f && dady[0][3] == 0.0f)) {
+      float oow = 1.0f;
+
+      if (perspective)
+         oow = 1.0f / a0[0][3];
+
+      if (blit_span_fixed(variant, tex,
+                          a0[attrib][0] + dady[attrib][0] * fy + dadx[attrib][0] * fx0,
+                          a0[attrib][1] + dady[attrib][1] * fy + dadx[attrib][1] * fx0,
+                          dadx[attrib][0], dadx[attrib][1], oow,
+                          width, mask, dst))
+         return;
+   }
+
+   for (i = 0; i < width; i++) {
+      if (mask & (1ULL << i)) {
+         const float fx = (float)(x + i);
+         float oow = 1.0f;
+         float s, t;
+         int ti, tj;
+         uint32_t src;
+
+         if (perspective)
+            oow = 1.0f / (a0[0][3] + dady[0][3] * fy + dadx[0][3] * fx);
+
+         s = (a0[attrib][0] + dady[attrib][0] * fy + dadx[attrib][0] * fx) * oow;
+         t = (a0[attrib][1] + dady[attrib][1] * fy + dadx[attrib][1] * fx) * oow;
+
+         if (tex->repeat) {
+            ti = nearest_repeat(s, tex->width);
+            tj = nearest_repeat(t, tex->height);
+         } else {
+            ti = nearest_clamp(s * tex->scale_s, tex->width);
+            tj = nearest_clamp(t * tex->scale_t, tex->height);
+         }
+
+         src = fetch_texel(tex, ti, tj);
+         dst[i] = blend_pixel(blend, src, dst[i]);
+      }
+   }
+}
+
+
+static inline uint32_t
+pack_color(const float c[4], boolean bgra)
+{
+   uint32_t r = float_to_ubyte(c[0]);
+   uint32_t g = float_to_ubyte(c[1]);
+   uint32_t b = float_to_ubyte(c[2]);
+   uint32_t a = float_to_ubyte(c[3]);
+
+   return bgra ? (b | (g << 8) | (r << 16) | (a << 24))
+               : (r | (g << 8) | (b << 16) | (a << 24));
+}
+
+
+/**
+ * Shade a span of interpolated colors, for LP_FS_KIND_COLOR shaders.
+ */
+static void
+color_span(const struct lp_fragment_shader_variant *variant,
+           const float (*a0)[4],
+           const float (*dadx)[4],
+           const float (*dady)[4],
+           unsigned attrib, boolean perspective, boolean bgra,
+           int x, int y, unsigned width, uint64_t mask,
+           uint32_t *dst)
+{
+   const enum lp_linear_blend blend = variant->linear_blend;
+   const float fy = (float)y;
+   boolean constant = TRUE;
+   unsigned i, chan;
+
+   for (chan = 0; chan < 4; chan++) {
+      if (dadx[attrib][chan] != 0.0f || dady[attrib][chan] != 0.0f)
+         constant = FALSE;
+   }
+
+   if (constant && !perspective) {
+      const uint32_t src = pack_color(a0[attrib], bgra);
+
+      for (i = 0; i < width; i++) {
+         if (mask & (1ULL << i))
+            dst[i] = blend_pixel(blend, src, dst[i]);
+      }
+      return;
+   }
+
+   for (i = 0; i < width; i++) {
+      if (mask & (1ULL << i)) {
+         const float fx = (float)(x + i);
+         float oow = 1.0f;
+         float c[4];
+
+         if (perspective)
+            oow = 1.0f / (a0[0][3] + dady[0][3] * fy + dadx[0][3] * fx);
+
+         for (chan = 0; chan < 4; chan++) {
+            c[chan] = (a0[attrib][chan] +
+                       dady[attrib][chan] * fy +
+                       dadx[attrib][chan] * fx) * oow;
+         }
+
+         dst[i] = blend_pixel(blend, pack_color(c, bgra), dst[i]);
+      }
+   }
+}
+
+
+/**
+ * Shade a rectangle of pixels with the linear path.
+ *
+ * \param x, y  window position of the rectangle, 4x4 block aligned
+ * \param width, height  rectangle size, multiples of 4, within one tile
+ * \param mask  4x4 coverage mask (bit y*4+x) when width == height == 4,
+ *              ignored otherwise (fully covered)
+ * \return FALSE if the JIT'ed shader must be used instead
+ */
+boolean
+lp_rast_linear_shade(struct lp_rasterizer_task *task,
+                     const struct lp_rast_shader_inputs *inputs,
+                     unsigned x, unsigned y,
+                     unsigned width, unsigned height,
+                     unsigned mask)
+{
+   const struct lp_scene *scene = task->scene;
+   const struct lp_rast_state *state = task->state;
+   const struct lp_fragment_shader_variant *variant = state->variant;
+   const struct lp_fragment_shader *shader = variant->shader;
+   const float (*a0)[4] = (const float (*)[4])GET_A0(inputs);
+   const float (*dadx)[4] = (const float (*)[4])GET_DADX(inputs);
+   const float (*dady)[4] = (const float (*)[4])GET_DADY(inputs);
+   const struct lp_shader_input *input = &shader->inputs[shader->kind_input];
+   const boolean dst_bgra = is_bgra(variant->key.cbuf_format[0]);
+   struct linear_texture tex;
+   boolean perspective;
+   uint8_t *color;
+   unsigned stride;
+   unsigned j;
+
+   if (!variant->linear ||
+       !UTIL_ARCH_LITTLE_ENDIAN ||
+       scene->fb_max_samples != 1 ||
+       !scene->fb.cbufs[0])
+      return FALSE;
+
+   /* Color inputs are flat or perspective depending on rasterizer state */
+   perspective = input->interp == LP_INTERP_PERSPECTIVE ||
+                 (input->interp == LP_INTERP_COLOR &&
+                  !variant->key.flatshade);
+
+   if (shader->kind == LP_FS_KIND_BLIT_RGBA) {
+      const struct lp_jit_texture *jit_tex = &state->jit_context.textures[0];
+      const struct lp_static_sampler_state *samp =
+         &variant->key.samplers[0].sampler_state;
+      const enum pipe_format format =
+         variant->key.samplers[0].texture_state.format;
+      unsigned level = jit_tex->first_level;
+
+      if (!jit_tex->base)
+         return FALSE;
+
+      tex.data = (const uint8_t *)jit_tex->base + jit_tex->mip_offsets[level];
+      tex.stride = jit_tex->row_stride[level];
+      tex.width = u_minify(jit_tex->width, level);
+      tex.height = u_minify(jit_tex->height, level);
+      tex.scale_s = samp->normalized_coords ? (float)tex.width : 1.0f;
+      tex.scale_t = samp->normalized_coords ? (float)tex.height : 1.0f;
+      tex.repeat = samp->wrap_s == PIPE_TEX_WRAP_REPEAT;
+      tex.swap_rb = is_bgra(format) != dst_bgra;
+      tex.alpha_or = (format == PIPE_FORMAT_B8G8R8X8_UNORM ||
+                      format == PIPE_FORMAT_R8G8B8X8_UNORM) ? 0xff000000 : 0;
+   }
+
+   color = lp_rast_get_color_block_pointer(task, 0, x, y, inputs->layer);
+   stride = scene->cbufs[0].stride;
+
+   for (j = 0; j < height; j++) {
+      uint64_t rowmask = ~0ULL;
+      uint32_t *dst = (uint32_t *)(color + j * stride);
+
+      if (width == 4 && height == 4) {
+         rowmask = (mask >> (4 * j)) & 0xf;
+         if (!rowmask)
+            continue;
+      }
+
+      if (shader->kind == LP_FS_KIND_BLIT_RGBA)
+         blit_span(variant, &tex, a0, dadx, dady, input->src_index,
+                   perspective, x, y + j, width, rowmask, dst);
+      else
+         color_span(variant, a0, dadx, dady, input->src_index,
+                    perspective, dst_bgra, x, y + j, width, rowmask, dst);
+   }
+
+   /* Match the JIT'ed code, which counts one invocation per 4x4 block */
+   if (shader->info.base.num_instructions > 1)
+      task->thread_data.ps_invocations += (width / 4) * (height / 4);
+
+   LP_COUNT_ADD(nr_linear_4, (width / 4) * (height / 4));
+
+   return TRUE;
+}
@@ -76,6 +76,34 @@ extern const struct lp_rasterizer_task *jit_task;
 struct lp_rasterizer;
 struct cmd_bin;
 
+
+/**
+ * Hierarchical-Z: the depth range of each 16x16 block of the current
+ * depth tile, so that blocks a triangle cannot pass the depth test in
+ * are rejected before running the shader.  See lp_rast_hiz.c.
+ */
+#define LP_HIZ_BLOCK_SIZE 16
+#define LP_HIZ_BLOCKS (TILE_SIZE / LP_HIZ_BLOCK_SIZE)
+
+struct lp_hiz_block
+{
+   float zmin, zmax;
+};
+
+struct lp_hiz_state
+{
+   boolean enabled;      /**< single-sampled depth buffer we can decode */
+   boolean is_float;
+   unsigned shift, mask; /**< depth bits of a unorm texel */
+   float scale;          /**< unorm to float */
+   float eps;            /**< slack for rounding in the shader's depth test */
+
+   unsigned layer;       /**< layer the blocks below describe */
+   unsigned valid;       /**< bitmask of valid blocks, by * LP_HIZ_BLOCKS + bx */
+   struct lp_hiz_block block[LP_HIZ_BLOCKS * LP_HIZ_BLOCKS];
+};
+
+
 /**
  * Per-thread rasterization state
  */
@@ -91,6 +119,8 @@ struct lp_rasterizer_task
    uint8_t *color_tiles[PIPE_MAX_COLOR_BUFS];
    uint8_t *depth_tile;
 
+   struct lp_hiz_state hiz;
+
    /** "back" pointer */
    struct lp_rasterizer *rast;
 
@@ -100,8 +130,15 @@ struct lp_rasterizer_task
    /** Non-interpolated passthru state and occlude counter for visible pixels */
    struct lp_jit_thread_data thread_data;
 
+   /** Load balancing statistics for the current scene (LP_DEBUG=scene) */
+   unsigned bins_rasterized;
+   unsigned cmds_executed;
+
    pipe_semaphore work_ready;
-   pipe_semaphore work_done;
+#ifdef _WIN32
+   /** Signalled when the thread exits, see lp_rast_destroy() */
+   pipe_semaphore exited;
+#endif
 };
 
 
@@ -121,11 +158,11 @@ struct lp_rasterizer
    /** The scene currently being rasterized by the threads */
    struct lp_scene *curr_scene;
 
-   /** A task object for each rasterization thread */
-   struct lp_rasterizer_task tasks[LP_MAX_THREADS];
+   /** A task object for each rasterization thread (at least one) */
+   struct lp_rasterizer_task *tasks;
 
    unsigned num_threads;
-   thrd_t threads[LP_MAX_THREADS];
+   thrd_t *threads;
 
    /** For synchronizing the rasterization threads */
    util_barrier barrier;
@@ -142,6 +179,59 @@ lp_rast_shade_quads_mask(struct lp_rasterizer_task *task,
                          unsigned x, unsigned y,
                          unsigned mask);
 
+void
+lp_rast_hiz_begin_tile(struct lp_rasterizer_task *task);
+
+boolean
+lp_rast_hiz_test(struct lp_rasterizer_task *task,
+                 const struct lp_rast_shader_inputs *inputs,
+                 int x, int y, unsigned width, unsigned height);
+
+
+/**
+ * Whether the triangle certainly fails the depth test everywhere in the
+ * given region of the current tile, so that it needn't be shaded there.
+ */
+static inline boolean
+lp_rast_hiz_cull(struct lp_rasterizer_task *task,
+                 const struct lp_rast_shader_inputs *inputs,
+                 int x, int y, unsigned width, unsigned height)
+{
+   if (!task->hiz.enabled || !task->state->variant->hiz_cull)
+      return FALSE;
+
+   return lp_rast_hiz_test(task, inputs, x, y, width, height);
+}
+
+
+void
+lp_rast_hiz_write(struct lp_rasterizer_task *task,
+                  const struct lp_rast_shader_inputs *inputs,
+                  int x, int y, unsigned width, unsigned height);
+
+
+/**
+ * Update the depth ranges of the given region of the current tile before
+ * the shader may write depth there.
+ */
+static inline void
+lp_rast_hiz_depth_written(struct lp_rasterizer_task *task,
+                          const struct lp_rast_shader_inputs *inputs,
+                          int x, int y, unsigned width, unsigned height)
+{
+   if (!task->state->variant->writes_depth || !task->hiz.valid)
+      return;
+
+   lp_rast_hiz_write(task, inputs, x, y, width, height);
+}
+
+boolean
+lp_rast_linear_shade(struct lp_rasterizer_task *task,
+                     const struct lp_rast_shader_inputs *inputs,
+                     unsigned x, unsigned y,
+                     unsigned width, unsigned height,
+                     unsigned mask);
+
 
 /**
  * Get the pointer to a 4x4 color block (within a 64x64 tile).
@@ -270,6 +360,12 @@ lp_rast_shade_quads_all( struct lp_rasterizer_task *task,
     * allocated 4x4 blocks hence need to filter them out here.
     */
    if ((x % TILE_SIZE) < task->width && (y % TILE_SIZE) < task->height) {
+      if (variant->linear &&
+          lp_rast_linear_shade(task, inputs, x, y, 4, 4, 0xffff))
+         return;
+
+      lp_rast_hiz_depth_written(task, inputs, x, y, 4, 4);
+
       /* Propagate non-interpolated raster state. */
       task->thread_data.raster_state.viewport_index = inputs->viewport_index;
 
@@ -323,6 +323,8 @@ TAG(lp_rast_triangle)(struct lp_rasterizer_task *task,
       partial_mask &= ~(1 << i);
 
       LP_COUNT(nr_partially_covered_16);
+      if (lp_rast_hiz_cull(task, &tri->inputs, px, py, 16, 16))
+         continue;
       TAG(do_block_16)(task, tri, plane, px, py, cx);
    }
 
@@ -338,6 +340,8 @@ TAG(lp_rast_triangle)(struct lp_rasterizer_task *task,
       inmask &= ~(1 << i);
 
       LP_COUNT(nr_fully_covered_16);
+      if (lp_rast_hiz_cull(task, &tri->inputs, px, py, 16, 16))
+         continue;
       block_full_16(task, tri, px, py);
    }
 }
@@ -366,6 +370,9 @@ TRI_16(struct lp_rasterizer_task *task,
    x += task->x;
    y += task->y;
 
+   if (lp_rast_hiz_cull(task, &tri->inputs, x, y, 16, 16))
+      return;
+
    for (j = 0; j < NR_PLANES; j++) {
       const int dcdx = -plane[j].dcdx * 4;
       const int dcdy = plane[j].dcdy * 4;
@@ -431,6 +438,9 @@ TRI_4(struct lp_rasterizer_task *task,
    const int y = task->y + (mask >> 8);
    unsigned j;
 
+   if (lp_rast_hiz_cull(task, &tri->inputs, x, y, 4, 4))
+      return;
+
    /* Iterate over partials:
     */
    {
@@ -29,6 +29,7 @@
 #include "util/u_math.h"
 #include "util/u_memory.h"
 #include "util/u_inlines.h"
+#include "util/u_atomic.h"
 #include "util/simple_list.h"
 #include "util/format/u_format.h"
 #include "lp_scene.h"
@@ -72,7 +73,7 @@ lp_scene_create( struct pipe_context *pipe )
    scene->data.head =
       CALLOC_STRUCT(data_block);
 
-   (void) mtx_init(&scene->mutex, mtx_plain);
+   STATIC_ASSERT(TILES_X * TILES_Y <= (1 << 16));
 
 #ifdef DEBUG
    /* Do some scene limit sanity checks here */
@@ -100,7 +101,6 @@ void
 lp_scene_destroy(struct lp_scene *scene)
 {
    lp_fence_reference(&scene->fence, NULL);
-   mtx_destroy(&scene->mutex);
    assert(scene->data.head->next == NULL);
    FREE(scene->data.head);
    FREE(scene);
@@ -530,61 +530,117 @@ lp_scene_is_resource_referenced(const struct lp_scene *scene,
 
 
 
-/** advance curr_x,y to the next bin */
-static boolean
-next_bin(struct lp_scene *scene)
+/**
+ * Number of cost classes used to order bins.  Bins are classified by
+ * log2 of their command count, so everything with 2^(N-1) or more
+ * commands ends up in the most expensive class.
+ */
+#define BIN_COST_CLASSES 8
+
+
+static unsigned
+bin_cost_class(const struct cmd_bin *bin)
+{
+   const struct cmd_block *block;
+   unsigned count = 0;
+
+   for (block = bin->head; block; block = block->next)
+      count += block->count;
+
+   if (!count)
+      return 0;
+
+   return MIN2(util_logbase2(count) + 1, BIN_COST_CLASSES - 1);
+}
+
+
+/**
+ * Build the order in which bins are handed out to the rasterizer threads.
+ *
+ * Empty bins are dropped.  The remaining bins are sorted (stably) so that
+ * the most expensive ones are started first, which keeps a single heavy
+ * tile from being picked up last and leaving the other threads idle.
+ * Within a cost class bins are visited in Morton order, so consecutive
+ * bins, which are likely to be picked up by different threads at about
+ * the same time, touch neighbouring textures and framebuffer memory.
+ */
+static void
+build_bin_order(struct lp_scene *scene)
 {
-   scene->curr_x++;
-   if (scene->curr_x >= scene->tiles_x) {
-      scene->curr_x = 0;
-      scene->curr_y++;
+   unsigned class_count[BIN_COST_CLASSES] = {0};
+   unsigned class_start[BIN_COST_CLASSES];
+   uint8_t *bin_class = scene->bin_class;
+   uint16_t *morton_order = scene->bin_morton_order;
+   unsigned dim = util_next_power_of_two(MAX2(scene->tiles_x, scene->tiles_y));
+   unsigned num_bins = 0;
+   unsigned i, c, start;
+
+   for (i = 0; i < dim * dim; i++) {
+      unsigned x = 0, y = 0, bit;
+
+      /* de-interleave the morton code */
+      for (bit = 0; (1u << bit) < dim; bit++) {
+         x |= ((i >> (2 * bit)) & 1) << bit;
+         y |= ((i >> (2 * bit + 1)) & 1) << bit;
+      }
+
+      if (x < scene->tiles_x && y < scene->tiles_y) {
+         const struct cmd_bin *bin = lp_scene_get_bin(scene, x, y);
+         unsigned idx = x + y * TILES_X;
+
+         if (!bin->head)
+            continue;
+
+         c = bin_cost_class(bin);
+         bin_class[idx] = c;
+         class_count[c]++;
+         morton_order[num_bins++] = idx;
+      }
    }
-   if (scene->curr_y >= scene->tiles_y) {
-      /* no more bins */
-      return FALSE;
+
+   /* Counting sort, most expensive class first. */
+   start = 0;
+   for (c = BIN_COST_CLASSES; c-- > 0;) {
+      class_start[c] = start;
+      start += class_count[c];
    }
-   return TRUE;
+
+   for (i = 0; i < num_bins; i++) {
+      unsigned idx = morton_order[i];
+      scene->bin_order[class_start[bin_class[idx]]++] = idx;
+   }
+
+   scene->num_bins = num_bins;
 }
 
 
 void
 lp_scene_bin_iter_begin( struct lp_scene *scene )
 {
-   scene->curr_x = scene->curr_y = -1;
+   p_atomic_set(&scene->bin_next, 0);
 }
 
 
 /**
  * Return pointer to next bin to be rendered.
- * The lp_scene::curr_x and ::curr_y fields will be advanced.
  * Multiple rendering threads will call this function to get a chunk
- * of work (a bin) to work on.
+ * of work (a bin) to work on.  Bins are dispensed lock-free from the
+ * order built by lp_scene_end_binning().
  */
 struct cmd_bin *
 lp_scene_bin_iter_next( struct lp_scene *scene , int *x, int *y)
 {
-   struct cmd_bin *bin = NULL;
-
-   mtx_lock(&scene->mutex);
+   unsigned i = p_atomic_inc_return(&scene->bin_next) - 1;
+   unsigned idx;
 
-   if (scene->curr_x < 0) {
-      /* first bin */
-      scene->curr_x = 0;
-      scene->curr_y = 0;
-   }
-   else if (!next_bin(scene)) {
-      /* no more bins left */
-      goto end;
-   }
+   if (i >= scene->num_bins)
+      return NULL;
 
-   bin = lp_scene_get_bin(scene, scene->curr_x, scene->curr_y);
-   *x = scene->curr_x;
-   *y = scene->curr_y;
+   idx = scene->bin_order[i];
+   *x = idx % TILES_X;
+   *y = idx / TILES_X;
 
-end:
-   /*printf("return bin %p at %d, %d\n", (void *) bin, *bin_x, *bin_y);*/
-   mtx_unlock(&scene->mutex);
-   return bin;
+   return lp_scene_get_bin(scene, *x, *y);
 }
 
 
@@ -638,12 +694,15 @@ void lp_scene_begin_binning(struct lp_scene *scene,
 
 void lp_scene_end_binning( struct lp_scene *scene )
 {
+   build_bin_order(scene);
+
    if (LP_DEBUG & DEBUG_SCENE) {
       debug_printf("rasterize scene:\n");
       debug_printf("  scene_size: %u\n",
                    scene->scene_size);
       debug_printf("  data size: %u\n",
                    lp_scene_data_size(scene));
+      debug_printf("  non-empty bins: %u\n", scene->num_bins);
 
       if (0)
          lp_debug_bins( scene );
@@ -185,8 +185,18 @@ struct lp_scene {
     */
    unsigned tiles_x, tiles_y;
 
-   int curr_x, curr_y;  /**< for iterating over bins */
-   mtx_t mutex;
+   /**
+    * Order in which the rasterizer threads pick up bins, built once at
+    * the end of binning.  Only non-empty bins are listed, most expensive
+    * first.  Each entry is x + y * TILES_X.
+    */
+   uint16_t bin_order[TILES_X * TILES_Y];
+   unsigned num_bins;  /**< number of valid bin_order entries */
+   unsigned bin_next;  /**< next bin_order entry, advanced atomically */
+
+   /** Scratch space for building bin_order, too big for the stack */
+   uint8_t bin_class[TILES_X * TILES_Y];
+   uint16_t bin_morton_order[TILES_X * TILES_Y];
 
    struct cmd_bin tile[TILES_X][TILES_Y];
    struct data_block_list data;
@@ -51,6 +51,8 @@
 #include "lp_limits.h"
 #include "lp_rast.h"
 #include "lp_cs_tpool.h"
+#include "lp_flush.h"
+#include "lp_query.h"
 
 #include "frontend/sw_winsys.h"
 
@@ -89,6 +91,8 @@ static const struct debug_named_value lp_perf_flags[] = {
    { "no_blend",       PERF_NO_BLEND, NULL },
    { "no_depth",       PERF_NO_DEPTH, NULL },
    { "no_alphatest",   PERF_NO_ALPHATEST, NULL },
+   { "no_linear_fs",   PERF_NO_LINEAR_FS, NULL },
+   { "no_hiz",         PERF_NO_HIZ, NULL },
    DEBUG_NAMED_VALUE_END
 };
 
@@ -726,6 +730,14 @@ llvmpipe_flush_frontbuffer(struct pipe_screen *_screen,
    struct llvmpipe_resource *texture = llvmpipe_resource(resource);
 
    assert(texture->dt);
+
+   /* make sure rasterization of any in-flight scene is complete */
+   if (_pipe) {
+      _pipe = threaded_context_unwrap_sync(_pipe);
+      llvmpipe_flush_resource(_pipe, resource, 0, TRUE, TRUE, FALSE,
+                              __FUNCTION__);
+   }
+
    if (texture->dt)
       winsys->displaytarget_display(winsys, texture->dt, context_private, sub_box);
 }
@@ -736,6 +748,9 @@ llvmpipe_destroy_screen( struct pipe_screen *_screen )
    struct llvmpipe_screen *screen = llvmpipe_screen(_screen);
    struct sw_winsys *winsys = screen->winsys;
 
+   if (screen->num_compile_threads)
+      util_queue_destroy(&screen->fs_compile_queue);
+
    if (screen->cs_tpool)
       lp_cs_tpool_destroy(screen->cs_tpool);
 
@@ -753,6 +768,8 @@ llvmpipe_destroy_screen( struct pipe_screen *_screen )
 
    glsl_type_singleton_decref();
 
+   slab_destroy_parent(&screen->transfer_pool);
+
    mtx_destroy(&screen->rast_mutex);
    mtx_destroy(&screen->cs_mutex);
    FREE(screen);
@@ -805,6 +822,37 @@ llvmpipe_get_timestamp(struct pipe_screen *_screen)
    return os_time_get_nano();
 }
 
+static int
+llvmpipe_get_driver_query_info(struct pipe_screen *_screen,
+                               unsigned index,
+                               struct pipe_driver_query_info *info)
+{
+#define QUERY(NAME, ENUM, UNITS) \
+   {NAME, ENUM, {0}, UNITS, PIPE_DRIVER_QUERY_RESULT_TYPE_CUMULATIVE, 0, 0x0}
+
+   static const struct pipe_driver_query_info queries[] = {
+      QUERY("fs-compiles", LP_QUERY_FS_COMPILES,
+            PIPE_DRIVER_QUERY_TYPE_UINT64),
+      QUERY("fs-compile-time", LP_QUERY_FS_COMPILE_TIME,
+            PIPE_DRIVER_QUERY_TYPE_MICROSECONDS),
+      QUERY("fs-compile-stalls", LP_QUERY_FS_COMPILE_STALLS,
+            PIPE_DRIVER_QUERY_TYPE_UINT64),
+      QUERY("fs-compile-stall-time", LP_QUERY_FS_COMPILE_STALL_TIME,
+            PIPE_DRIVER_QUERY_TYPE_MICROSECONDS),
+   };
+#undef QUERY
+
+   if (!info)
+      return ARRAY_SIZE(queries);
+
+   if (index >= ARRAY_SIZE(queries))
+      return 0;
+
+   *info = queries[index];
+   return 1;
+}
+
+
 static void lp_disk_cache_create(struct llvmpipe_screen *screen)
 {
    struct mesa_sha1 ctx;
@@ -818,6 +866,8 @@ static void lp_disk_cache_create(struct llvmpipe_screen *screen)
       return;
 
    _mesa_sha1_update(&ctx, &gallivm_perf, sizeof(gallivm_perf));
+   /* the vector width shapes all the generated code */
+   _mesa_sha1_update(&ctx, &lp_native_vector_width, sizeof(lp_native_vector_width));
    _mesa_sha1_final(&ctx, sha1);
    disk_cache_format_hex_id(cache_id, sha1, 20 * 2);
 
@@ -912,6 +962,7 @@ llvmpipe_create_screen(struct sw_winsys *winsys)
    screen->base.fence_finish = llvmpipe_fence_finish;
 
    screen->base.get_timestamp = llvmpipe_get_timestamp;
+   screen->base.get_driver_query_info = llvmpipe_get_driver_query_info;
 
    screen->base.finalize_nir = llvmpipe_finalize_nir;
 
@@ -944,6 +995,20 @@ llvmpipe_create_screen(struct sw_winsys *winsys)
    }
    (void) mtx_init(&screen->cs_mutex, mtx_plain);
 
+#ifndef USE_GLOBAL_LLVM_CONTEXT
+   screen->num_compile_threads =
+      debug_get_num_option("LP_COMPILE_THREADS", MIN2(screen->num_threads, 4));
+   if (screen->num_compile_threads &&
+       !util_queue_init(&screen->fs_compile_queue, "lpfs", 64,
+                        screen->num_compile_threads,
+                        UTIL_QUEUE_INIT_RESIZE_IF_FULL |
+                        UTIL_QUEUE_INIT_USE_MINIMUM_PRIORITY))
+      screen->num_compile_threads = 0;
+#endif
+
+   slab_create_parent(&screen->transfer_pool,
+                      sizeof(struct llvmpipe_transfer), 16);
+
    lp_disk_cache_create(screen);
    return &screen->base;
 }
@@ -37,6 +37,8 @@
 #include "pipe/p_screen.h"
 #include "pipe/p_defines.h"
 #include "os/os_thread.h"
+#include "util/u_queue.h"
+#include "util/slab.h"
 #include "gallivm/lp_bld.h"
 #include "gallivm/lp_bld_misc.h"
 
@@ -61,6 +63,21 @@ struct llvmpipe_screen
    struct lp_cs_tpool *cs_tpool;
    mtx_t cs_mutex;
 
+   /* Fragment shader variants are compiled on these threads, see
+    * LP_COMPILE_THREADS.  Zero threads means compiling synchronously.
+    */
+   struct util_queue fs_compile_queue;
+   unsigned num_compile_threads;
+
+   /* Compile statistics, exposed as driver queries (times in usecs). */
+   uint64_t num_fs_compiles;
+   uint64_t fs_compile_time;
+   uint64_t num_fs_compile_stalls;
+   uint64_t fs_compile_stall_time;
+
+   /* Threaded context transfers */
+   struct slab_parent_pool transfer_pool;
+
    bool use_tgsi;
    bool allow_cl;
 
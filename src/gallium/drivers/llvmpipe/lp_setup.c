@@ -64,26 +64,77 @@ static boolean set_scene_state( struct lp_setup_context *, enum setup_state,
 static boolean try_update_scene_state( struct lp_setup_context *setup );
 
 
+/**
+ * Wait for the scene at setup->scene_idx to be rasterized so it can be
+ * reused for binning.
+ */
+static void
+lp_setup_wait_empty_scene(struct lp_setup_context *setup)
+{
+   struct lp_scene *scene = setup->scenes[setup->scene_idx];
+
+   if (scene->fence) {
+      if (LP_DEBUG & DEBUG_SETUP)
+         debug_printf("%s: wait for scene %d\n",
+                      __FUNCTION__, scene->fence->id);
+
+      lp_fence_wait(scene->fence);
+      lp_scene_end_rasterization(scene);
+   }
+}
+
+
+/**
+ * Find a scene which isn't being rasterized anymore.  Scenes whose
+ * fence has signalled are retired here, on the setup thread, so that
+ * resource and shader references are released by the context which
+ * took them.  If all scenes are busy a new one is created, up to
+ * MAX_SCENES, after which we block on the oldest one.
+ */
 static void
 lp_setup_get_empty_scene(struct lp_setup_context *setup)
 {
+   unsigned i;
+
    assert(setup->scene == NULL);
 
-   setup->scene_idx++;
-   setup->scene_idx %= ARRAY_SIZE(setup->scenes);
+   /* Scenes are rasterized in the order they were queued, so starting
+    * the search at the oldest one (the one after the last used) gives
+    * the best chance of finding an idle scene.
+    */
+   for (i = 0; i < setup->num_active_scenes; i++) {
+      unsigned idx = (setup->scene_idx + 1 + i) % setup->num_active_scenes;
+      struct lp_scene *scene = setup->scenes[idx];
 
-   setup->scene = setup->scenes[setup->scene_idx];
+      if (scene->fence) {
+         if (!lp_fence_signalled(scene->fence))
+            continue;
+         lp_scene_end_rasterization(scene);
+      }
 
-   if (setup->scene->fence) {
-      if (LP_DEBUG & DEBUG_SETUP)
-         debug_printf("%s: wait for scene %d\n",
-                      __FUNCTION__, setup->scene->fence->id);
+      setup->scene_idx = idx;
+      break;
+   }
 
-      lp_fence_wait(setup->scene->fence);
+   if (i == setup->num_active_scenes) {
+      struct lp_scene *scene = NULL;
+
+      if (setup->num_active_scenes < MAX_SCENES)
+         scene = lp_scene_create(setup->pipe);
+
+      if (scene) {
+         setup->scene_idx = setup->num_active_scenes++;
+         setup->scenes[setup->scene_idx] = scene;
+      }
+      else {
+         setup->scene_idx = (setup->scene_idx + 1) % setup->num_active_scenes;
+         lp_setup_wait_empty_scene(setup);
+      }
    }
 
-   lp_scene_begin_binning(setup->scene, &setup->fb);
+   setup->scene = setup->scenes[setup->scene_idx];
 
+   lp_scene_begin_binning(setup->scene, &setup->fb);
 }
 
 
@@ -166,23 +217,16 @@ lp_setup_rasterize_scene( struct lp_setup_context *setup )
    if (setup->last_fence)
       setup->last_fence->issued = TRUE;
 
-   mtx_lock(&screen->rast_mutex);
-
-   /* FIXME: We enqueue the scene then wait on the rasterizer to finish.
-    * This means we never actually run any vertex stuff in parallel to
-    * rasterization (not in the same context at least) which is what the
-    * multiple scenes per setup is about - when we get a new empty scene
-    * any old one is already empty again because we waited here for
-    * raster tasks to be finished. Ideally, we shouldn't need to wait here
-    * and rely on fences elsewhere when waiting is necessary.
-    * Certainly, lp_scene_end_rasterization() would need to be deferred too
-    * and there's probably other bits why this doesn't actually work.
+   /* Don't wait for the rasterizer here: the scene stays in flight
+    * while we bin the next one.  It is retired (and its resource
+    * references dropped) once its fence has signalled, see
+    * lp_setup_get_empty_scene().  llvmpipe_flush() waits for it when
+    * the caller doesn't ask for a fence.
     */
+   mtx_lock(&screen->rast_mutex);
    lp_rast_queue_scene(screen->rast, scene);
-   lp_rast_finish(screen->rast);
    mtx_unlock(&screen->rast_mutex);
 
-   lp_scene_end_rasterization(setup->scene);
    lp_setup_reset( setup );
 
    LP_DBG(DEBUG_SETUP, "%s done \n", __FUNCTION__);
@@ -1081,9 +1125,25 @@ lp_setup_is_resource_referenced( const struct lp_setup_context *setup,
       return LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE;
    }
 
-   /* check textures referenced by the scene */
-   for (i = 0; i < ARRAY_SIZE(setup->scenes); i++) {
-      if (lp_scene_is_resource_referenced(setup->scenes[i], texture)) {
+   /* check resources referenced by the scenes, including the render
+    * targets of scenes still being rasterized
+    */
+   for (i = 0; i < setup->num_active_scenes; i++) {
+      struct lp_scene *scene = setup->scenes[i];
+      unsigned j;
+
+      /* already rasterized, just not retired yet */
+      if (scene->fence && lp_fence_signalled(scene->fence))
+         continue;
+
+      for (j = 0; j < scene->fb.nr_cbufs; j++) {
+         if (scene->fb.cbufs[j] && scene->fb.cbufs[j]->texture == texture)
+            return LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE;
+      }
+      if (scene->fb.zsbuf && scene->fb.zsbuf->texture == texture)
+         return LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE;
+
+      if (lp_scene_is_resource_referenced(scene, texture)) {
          return LP_REFERENCED_FOR_READ;
       }
    }
@@ -1422,13 +1482,14 @@ lp_setup_destroy( struct lp_setup_context *setup )
       pipe_resource_reference(&setup->ssbos[i].current.buffer, NULL);
    }
 
-   /* free the scenes in the 'empty' queue */
-   for (i = 0; i < ARRAY_SIZE(setup->scenes); i++) {
+   /* wait for any scenes still in flight, then free them */
+   for (i = 0; i < setup->num_active_scenes; i++) {
       struct lp_scene *scene = setup->scenes[i];
 
       if (scene->fence)
          lp_fence_wait(scene->fence);
 
+      lp_scene_end_rasterization(scene);
       lp_scene_destroy(scene);
    }
 
@@ -1449,7 +1510,6 @@ lp_setup_create( struct pipe_context *pipe,
 {
    struct llvmpipe_screen *screen = llvmpipe_screen(pipe->screen);
    struct lp_setup_context *setup;
-   unsigned i;
 
    setup = CALLOC_STRUCT(lp_setup_context);
    if (!setup) {
@@ -1472,13 +1532,12 @@ lp_setup_create( struct pipe_context *pipe,
    draw_set_rasterize_stage(draw, setup->vbuf);
    draw_set_render(draw, &setup->base);
 
-   /* create some empty scenes */
-   for (i = 0; i < MAX_SCENES; i++) {
-      setup->scenes[i] = lp_scene_create( pipe );
-      if (!setup->scenes[i]) {
-         goto no_scenes;
-      }
+   /* create just one scene to start with, more are created on demand */
+   setup->scenes[0] = lp_scene_create( pipe );
+   if (!setup->scenes[0]) {
+      goto no_scenes;
    }
+   setup->num_active_scenes = 1;
 
    setup->triangle = first_triangle;
    setup->line     = first_line;
@@ -1493,12 +1552,6 @@ lp_setup_create( struct pipe_context *pipe,
    return setup;
 
 no_scenes:
-   for (i = 0; i < MAX_SCENES; i++) {
-      if (setup->scenes[i]) {
-         lp_scene_destroy(setup->scenes[i]);
-      }
-   }
-
    setup->vbuf->destroy(setup->vbuf);
 no_vbuf:
    FREE(setup);
@@ -54,9 +54,11 @@
 struct lp_setup_variant;
 
 
-/** Max number of scenes */
-/* XXX: make multiple scenes per context work, see lp_setup_rasterize_scene */
-#define MAX_SCENES 1
+/** Max number of scenes in flight per context.  Scenes are created on
+ * demand, so contexts which are always rasterizer-bound only ever use
+ * one or two.
+ */
+#define MAX_SCENES 4
 
 
 
@@ -88,6 +90,7 @@ struct lp_setup_context
    struct draw_stage *vbuf;
    unsigned num_threads;
    unsigned scene_idx;
+   unsigned num_active_scenes;
    struct lp_scene *scenes[MAX_SCENES];  /**< all the scenes */
    struct lp_scene *scene;               /**< current scene being built */
 
@@ -119,6 +119,9 @@ llvmpipe_update_setup(struct llvmpipe_context *lp);
 void
 llvmpipe_update_derived(struct llvmpipe_context *llvmpipe);
 
+void
+llvmpipe_check_fs_constants(struct llvmpipe_context *llvmpipe);
+
 void
 llvmpipe_init_sampler_funcs(struct llvmpipe_context *llvmpipe);
 
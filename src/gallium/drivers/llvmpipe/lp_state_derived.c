@@ -25,6 +25,7 @@
  * 
  **************************************************************************/
 
+#include "util/u_atomic.h"
 #include "util/u_math.h"
 #include "util/u_memory.h"
 #include "pipe/p_shader_tokens.h"
@@ -35,6 +36,7 @@
 #include "lp_screen.h"
 #include "lp_setup.h"
 #include "lp_state.h"
+#include "lp_texture.h"
 
 
 
@@ -173,6 +175,38 @@ compute_vertex_info(struct llvmpipe_context *llvmpipe)
 }
 
 
+/**
+ * Check whether the bound fragment shader constant buffers were written.
+ * Transfers can't flag the context themselves, as the threaded context may
+ * map and unmap on the application thread, and persistently mapped buffers
+ * can be written at any time.
+ */
+void
+llvmpipe_check_fs_constants(struct llvmpipe_context *llvmpipe)
+{
+   unsigned writes = 0;
+   boolean persistent = FALSE;
+   unsigned i;
+
+   for (i = 0; i < ARRAY_SIZE(llvmpipe->constants[PIPE_SHADER_FRAGMENT]); i++) {
+      struct pipe_resource *buffer =
+         llvmpipe->constants[PIPE_SHADER_FRAGMENT][i].buffer;
+
+      if (buffer) {
+         struct llvmpipe_resource *lpr = llvmpipe_resource(buffer);
+         writes += p_atomic_read(&lpr->constant_writes);
+         persistent |= p_atomic_read(&lpr->persistent_write_maps) != 0;
+      }
+   }
+
+   /* Setup compares the contents, so a false positive only costs that. */
+   if (persistent || writes != llvmpipe->fs_constant_writes) {
+      llvmpipe->fs_constant_writes = writes;
+      llvmpipe->dirty |= LP_NEW_FS_CONSTANTS;
+   }
+}
+
+
 /**
  * Handle state changes.
  * Called just prior to drawing anything (pipe::draw_arrays(), etc).
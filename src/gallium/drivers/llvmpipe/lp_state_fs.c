@@ -60,6 +60,7 @@
 #include <limits.h>
 #include "pipe/p_defines.h"
 #include "util/u_inlines.h"
+#include "util/u_atomic.h"
 #include "util/u_memory.h"
 #include "util/u_pointer.h"
 #include "util/format/u_format.h"
@@ -468,7 +469,7 @@ static void fs_fb_fetch(const struct lp_build_fs_iface *iface,
    const struct util_format_description* out_format_desc = util_format_description(cbuf_format);
    struct lp_type dst_type;
    unsigned block_size = bld->type.length;
-   unsigned block_height = key->resource_1d ? 1 : 2;
+   unsigned block_height = key->resource_1d ? 1 : (block_size == 16 ? 4 : 2);
    unsigned block_width = block_size / block_height;
 
    lp_mem_type_from_format_desc(out_format_desc, &dst_type);
@@ -1485,6 +1486,11 @@ load_unswizzled_block(struct gallivm_state *gallivm,
          x = (i & 1) + ((i >> 2) << 1);
          y = (i & 2) >> 1;
       }
+      else if (block_height == 4 && dst_count == 16 && fb_fetch_twiddle) {
+         /* 2x2 quads, left to right, top to bottom */
+         x = (i & 1) | ((i >> 1) & 2);
+         y = ((i >> 1) & 1) | ((i >> 2) & 2);
+      }
 
       LLVMValueRef x_val;
       if (x_offset) {
@@ -2338,7 +2344,11 @@ generate_unswizzled_blend(struct gallivm_state *gallivm,
    undef_src_val = lp_build_undef(gallivm, fs_type);
 
    row_type.length = fs_type.length;
-   vector_width    = dst_type.floating ? lp_native_vector_width : lp_integer_vector_width;
+   /* The shader outputs are split into 8-wide halves on AVX-512 (see
+    * generate_fragment()), and the code below handles at most 256 bit
+    * vectors, so this takes the same path as AVX.
+    */
+   vector_width    = dst_type.floating ? MIN2(lp_native_vector_width, 256) : lp_integer_vector_width;
 
    /* Compute correct swizzle and count channels */
    memset(swizzle, LP_BLD_SWIZZLE_DONTCARE, TGSI_NUM_CHANNELS);
@@ -2916,8 +2926,7 @@ generate_unswizzled_blend(struct gallivm_state *gallivm,
  * 2x2 pixels.
  */
 static void
-generate_fragment(struct llvmpipe_context *lp,
-                  struct lp_fragment_shader *shader,
+generate_fragment(struct lp_fragment_shader *shader,
                   struct lp_fragment_shader_variant *variant,
                   unsigned partial_mask)
 {
@@ -2991,6 +3000,9 @@ generate_fragment(struct llvmpipe_context *lp,
    fs_type.norm = FALSE;         /* values are not limited to [0,1] or [-1,1] */
    fs_type.width = 32;           /* 32-bit float */
    fs_type.length = MIN2(lp_native_vector_width / 32, 16); /* n*4 elements per vector */
+   /* 1d resources only run the upper half of the stamp */
+   if (key->resource_1d)
+      fs_type.length = MIN2(fs_type.length, 8);
 
    memset(&blend_type, 0, sizeof blend_type);
    blend_type.floating = FALSE; /* values are integers */
@@ -3260,6 +3272,46 @@ generate_fragment(struct llvmpipe_context *lp,
 
    sampler->destroy(sampler);
    image->destroy(image);
+
+   /*
+    * The blend code works on at most 8-wide vectors, so give it each
+    * 16-wide output and mask as two halves, covering rows 0-1 and 2-3 of
+    * the stamp just like two 8-wide shader invocations would.
+    */
+   if (fs_type.length == 16) {
+      struct lp_type half_type = fs_type;
+      LLVMTypeRef half_ptr_type;
+      unsigned nr_outs = MAX2(key->nr_cbufs, dual_source_blend ? 2 : 0);
+      int idx;
+
+      half_type.length = 8;
+      half_ptr_type = LLVMPointerType(lp_build_vec_type(gallivm, half_type), 0);
+
+      for (idx = num_fs * key->coverage_samples - 1; idx >= 0; idx--) {
+         LLVMValueRef mask = fs_mask[idx];
+         fs_mask[idx * 2] = lp_build_extract_range(gallivm, mask, 0, 8);
+         fs_mask[idx * 2 + 1] = lp_build_extract_range(gallivm, mask, 8, 8);
+      }
+
+      for (unsigned s = 0; s < key->min_samples; s++) {
+         for (cbuf = 0; cbuf < nr_outs; cbuf++) {
+            for (chan = 0; chan < TGSI_NUM_CHANNELS; ++chan) {
+               for (idx = num_fs - 1; idx >= 0; idx--) {
+                  LLVMValueRef ptr = fs_out_color[s][cbuf][chan][idx];
+                  LLVMValueRef half = lp_build_const_int32(gallivm, 1);
+                  ptr = LLVMBuildBitCast(builder, ptr, half_ptr_type, "");
+                  fs_out_color[s][cbuf][chan][idx * 2] = ptr;
+                  fs_out_color[s][cbuf][chan][idx * 2 + 1] =
+                     LLVMBuildGEP(builder, ptr, &half, 1, "");
+               }
+            }
+         }
+      }
+
+      fs_type = half_type;
+      num_fs *= 2;
+   }
+
    /* Loop over color outputs / color buffers to do blending.
     */
    for(cbuf = 0; cbuf < key->nr_cbufs; cbuf++) {
@@ -3442,6 +3494,8 @@ lp_debug_fs_variant(struct lp_fragment_shader_variant *variant)
       nir_print_shader(variant->shader->base.ir.nir, stderr);
    dump_fs_variant_key(&variant->key);
    debug_printf("variant->opaque = %u\n", variant->opaque);
+   debug_printf("variant->linear = %u\n", variant->linear);
+   debug_printf("variant->hiz_cull = %u\n", variant->hiz_cull);
    debug_printf("\n");
 }
 
@@ -3468,34 +3522,49 @@ lp_fs_get_ir_cache_key(struct lp_fragment_shader_variant *variant,
 }
 
 /**
- * Generate a new fragment shader variant from the shader code and
- * other state indicated by the key.
+ * Stand-in for a variant whose compilation failed, so that rasterizing
+ * with it simply draws nothing.
  */
-static struct lp_fragment_shader_variant *
-generate_variant(struct llvmpipe_context *lp,
-                 struct lp_fragment_shader *shader,
-                 const struct lp_fragment_shader_variant_key *key)
+static void
+null_fragment_func(const struct lp_jit_context *context,
+                   uint32_t x, uint32_t y, uint32_t facing,
+                   const void *a0, const void *dadx, const void *dady,
+                   uint8_t **color, uint8_t *depth, uint64_t mask,
+                   struct lp_jit_thread_data *thread_data,
+                   unsigned *stride, unsigned depth_stride,
+                   unsigned *color_sample_stride,
+                   unsigned depth_sample_stride)
 {
-   struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
-   struct lp_fragment_shader_variant *variant;
-   const struct util_format_description *cbuf0_format_desc = NULL;
-   boolean fullcolormask;
+}
+
+
+/**
+ * Generate and compile the code of a fragment shader variant.
+ *
+ * This runs on one of the screen's compiler threads, on a rasterizer
+ * thread which needs the variant, or synchronously when there are no
+ * compiler threads, so it must not touch the context.  Variants of the
+ * same shader are compiled one at a time since code generation lowers the
+ * shader IR in place.
+ */
+static void
+compile_variant(struct lp_fragment_shader_variant *variant)
+{
+   struct lp_fragment_shader *shader = variant->shader;
+   struct llvmpipe_screen *screen = variant->screen;
+   LLVMContextRef context;
    char module_name[64];
    unsigned char ir_sha1_cache_key[20];
    struct lp_cached_code cached = { 0 };
    bool needs_caching = false;
-   variant = MALLOC(sizeof *variant + shader->variant_key_size - sizeof variant->key);
-   if (!variant)
-      return NULL;
+   int64_t t0, dt;
 
-   memset(variant, 0, sizeof(*variant));
-   snprintf(module_name, sizeof(module_name), "fs%u_variant%u",
-            shader->no, shader->variants_created);
+   t0 = os_time_get();
 
-   pipe_reference_init(&variant->reference, 1);
-   lp_fs_reference(lp, &variant->shader, shader);
+   snprintf(module_name, sizeof(module_name), "fs%u_variant%u",
+            shader->no, variant->no);
 
-   memcpy(&variant->key, key, shader->variant_key_size);
+   mtx_lock(&shader->compile_mutex);
 
    if (shader->base.ir.nir) {
       lp_fs_get_ir_cache_key(variant, ir_sha1_cache_key);
@@ -3504,39 +3573,26 @@ generate_variant(struct llvmpipe_context *lp,
       if (!cached.data_size)
          needs_caching = true;
    }
-   variant->gallivm = gallivm_create(module_name, lp->context, &cached);
-   if (!variant->gallivm) {
-      FREE(variant);
-      return NULL;
-   }
 
-   variant->list_item_global.base = variant;
-   variant->list_item_local.base = variant;
-   variant->no = shader->variants_created++;
-
-
-
-   /*
-    * Determine whether we are touching all channels in the color buffer.
+#ifdef USE_GLOBAL_LLVM_CONTEXT
+   context = LLVMGetGlobalContext();
+#else
+   /* LLVM contexts are not thread safe, so each compile gets its own.  The
+    * JIT code outlives it, so it is disposed of as soon as we're done.
     */
-   fullcolormask = FALSE;
-   if (key->nr_cbufs == 1) {
-      cbuf0_format_desc = util_format_description(key->cbuf_format[0]);
-      fullcolormask = util_format_colormask_full(cbuf0_format_desc, key->blend.rt[0].colormask);
-   }
+   context = LLVMContextCreate();
+#endif
 
-   variant->opaque =
-         !key->blend.logicop_enable &&
-         !key->blend.rt[0].blend_enable &&
-         fullcolormask &&
-         !key->stencil[0].enabled &&
-         !key->alpha.enabled &&
-         !key->multisample &&
-         !key->blend.alpha_to_coverage &&
-         !key->depth.enabled &&
-         !shader->info.base.uses_kill &&
-         !shader->info.base.writes_samplemask
-      ? TRUE : FALSE;
+   variant->gallivm = gallivm_create(module_name, context, &cached);
+   if (!variant->gallivm) {
+      mtx_unlock(&shader->compile_mutex);
+#ifndef USE_GLOBAL_LLVM_CONTEXT
+      LLVMContextDispose(context);
+#endif
+      variant->jit_function[RAST_EDGE_TEST] = null_fragment_func;
+      variant->jit_function[RAST_WHOLE] = null_fragment_func;
+      return;
+   }
 
    if ((LP_DEBUG & DEBUG_FS) || (gallivm_debug & GALLIVM_DEBUG_IR)) {
       lp_debug_fs_variant(variant);
@@ -3545,15 +3601,17 @@ generate_variant(struct llvmpipe_context *lp,
    lp_jit_init_types(variant);
    
    if (variant->jit_function[RAST_EDGE_TEST] == NULL)
-      generate_fragment(lp, shader, variant, RAST_EDGE_TEST);
+      generate_fragment(shader, variant, RAST_EDGE_TEST);
 
    if (variant->jit_function[RAST_WHOLE] == NULL) {
       if (variant->opaque) {
          /* Specialized shader, which doesn't need to read the color buffer. */
-         generate_fragment(lp, shader, variant, RAST_WHOLE);
+         generate_fragment(shader, variant, RAST_WHOLE);
       }
    }
 
+   mtx_unlock(&shader->compile_mutex);
+
    /*
     * Compile everything
     */
@@ -3581,6 +3639,153 @@ generate_variant(struct llvmpipe_context *lp,
    }
 
    gallivm_free_ir(variant->gallivm);
+#ifndef USE_GLOBAL_LLVM_CONTEXT
+   LLVMContextDispose(context);
+#endif
+
+   dt = os_time_get() - t0;
+   p_atomic_inc(&screen->num_fs_compiles);
+   p_atomic_add(&screen->fs_compile_time, dt);
+   LP_COUNT_ADD(llvm_compile_time, dt);
+   LP_COUNT_ADD(nr_llvm_compiles, 2);  /* emit vs. omit in/out test */
+}
+
+
+/**
+ * Compile the variant unless another thread has already started on it.
+ */
+static bool
+try_compile_variant(struct lp_fragment_shader_variant *variant)
+{
+   if (p_atomic_cmpxchg(&variant->compile_claimed, 0, 1) != 0)
+      return false;
+
+   compile_variant(variant);
+   util_queue_fence_signal(&variant->ready);
+   return true;
+}
+
+
+static void
+compile_variant_job(void *job, int thread_index)
+{
+   try_compile_variant(job);
+}
+
+
+/**
+ * Block until a variant handed to the compiler threads is ready to run.
+ * Called by the rasterizer threads, which is where a slow compile stalls.
+ *
+ * The compiler threads run at the lowest priority and may be busy with
+ * unrelated variants, so if none of them has picked this one up yet it is
+ * compiled right here instead of waiting in line.
+ */
+void
+llvmpipe_fs_variant_wait(struct lp_fragment_shader_variant *variant)
+{
+   struct llvmpipe_screen *screen = variant->screen;
+   int64_t t0 = os_time_get();
+
+   if (!try_compile_variant(variant))
+      util_queue_fence_wait(&variant->ready);
+
+   p_atomic_inc(&screen->num_fs_compile_stalls);
+   p_atomic_add(&screen->fs_compile_stall_time, os_time_get() - t0);
+}
+
+
+/**
+ * Generate a new fragment shader variant from the shader code and
+ * other state indicated by the key.
+ *
+ * The code itself is generated asynchronously by compile_variant(); the
+ * returned variant can be bound and binned right away, as only
+ * rasterization needs the compiled functions.
+ */
+static struct lp_fragment_shader_variant *
+generate_variant(struct llvmpipe_context *lp,
+                 struct lp_fragment_shader *shader,
+                 const struct lp_fragment_shader_variant_key *key)
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
+   struct lp_fragment_shader_variant *variant;
+   const struct util_format_description *cbuf0_format_desc = NULL;
+   boolean fullcolormask;
+
+   variant = MALLOC(sizeof *variant + shader->variant_key_size - sizeof variant->key);
+   if (!variant)
+      return NULL;
+
+   memset(variant, 0, sizeof(*variant));
+
+   pipe_reference_init(&variant->reference, 1);
+   lp_fs_reference(lp, &variant->shader, shader);
+
+   memcpy(&variant->key, key, shader->variant_key_size);
+
+   variant->screen = screen;
+   variant->list_item_global.base = variant;
+   variant->list_item_local.base = variant;
+   variant->no = shader->variants_created++;
+
+   /*
+    * Determine whether we are touching all channels in the color buffer.
+    */
+   fullcolormask = FALSE;
+   if (key->nr_cbufs == 1) {
+      cbuf0_format_desc = util_format_description(key->cbuf_format[0]);
+      fullcolormask = util_format_colormask_full(cbuf0_format_desc, key->blend.rt[0].colormask);
+   }
+
+   variant->opaque =
+         !key->blend.logicop_enable &&
+         !key->blend.rt[0].blend_enable &&
+         fullcolormask &&
+         !key->stencil[0].enabled &&
+         !key->alpha.enabled &&
+         !key->multisample &&
+         !key->blend.alpha_to_coverage &&
+         !key->depth.enabled &&
+         !shader->info.base.uses_kill &&
+         !shader->info.base.writes_samplemask
+      ? TRUE : FALSE;
+
+   llvmpipe_fs_variant_linear(variant);
+
+   variant->writes_depth = key->depth.enabled && key->depth.writemask;
+   variant->writes_shader_depth = shader->info.base.writes_z;
+
+   /*
+    * Culled fragments must have no effect other than failing the depth
+    * test, and the rasterizer must be able to evaluate the depth plane.
+    */
+   variant->hiz_cull =
+         key->depth.enabled &&
+         (key->depth.func == PIPE_FUNC_LESS ||
+          key->depth.func == PIPE_FUNC_LEQUAL ||
+          key->depth.func == PIPE_FUNC_GREATER ||
+          key->depth.func == PIPE_FUNC_GEQUAL) &&
+         !key->stencil[0].enabled &&
+         !key->multisample &&
+         key->zsbuf_nr_samples <= 1 &&
+         util_format_has_depth(util_format_description(key->zsbuf_format)) &&
+         !shader->info.base.writes_z &&
+         !shader->info.base.writes_stencil &&
+         (!shader->info.base.writes_memory ||
+          shader->info.base.properties[TGSI_PROPERTY_FS_EARLY_DEPTH_STENCIL]) &&
+         !(LP_PERF & PERF_NO_HIZ);
+
+   util_queue_fence_init(&variant->ready);
+   util_queue_fence_reset(&variant->ready);
+   util_queue_fence_init(&variant->queued);
+
+   if (screen->num_compile_threads) {
+      util_queue_add_job(&screen->fs_compile_queue, variant, &variant->queued,
+                         compile_variant_job, NULL, 0);
+   } else {
+      try_compile_variant(variant);
+   }
 
    return variant;
 }
@@ -3604,6 +3809,7 @@ llvmpipe_create_fs_state(struct pipe_context *pipe,
    pipe_reference_init(&shader->reference, 1);
    shader->no = fs_no++;
    make_empty_list(&shader->variants);
+   (void) mtx_init(&shader->compile_mutex, mtx_plain);
 
    shader->base.type = templ->type;
    if (templ->type == PIPE_SHADER_IR_TGSI) {
@@ -3620,6 +3826,7 @@ llvmpipe_create_fs_state(struct pipe_context *pipe,
    shader->draw_data = draw_create_fragment_shader(llvmpipe->draw, templ);
    if (shader->draw_data == NULL) {
       FREE((void *) shader->base.tokens);
+      mtx_destroy(&shader->compile_mutex);
       FREE(shader);
       return NULL;
    }
@@ -3668,6 +3875,8 @@ llvmpipe_create_fs_state(struct pipe_context *pipe,
       shader->inputs[i].src_index = i+1;
    }
 
+   llvmpipe_fs_analyse(shader);
+
    if (LP_DEBUG & DEBUG_TGSI) {
       unsigned attrib;
       debug_printf("llvmpipe: Create fragment shader #%u %p:\n",
@@ -3734,13 +3943,20 @@ void llvmpipe_remove_shader_variant(struct llvmpipe_context *lp,
    /* remove from context's list */
    remove_from_list(&variant->list_item_global);
    lp->nr_fs_variants--;
-   lp->nr_fs_instrs -= variant->nr_instrs;
+   if (variant->nr_instrs_counted)
+      lp->nr_fs_instrs -= variant->nr_instrs;
 }
 
 void
 llvmpipe_destroy_shader_variant(struct llvmpipe_context *lp,
                                struct lp_fragment_shader_variant *variant)
 {
+   /* The compiler threads may still be working on it, or hold the job. */
+   util_queue_fence_wait(&variant->queued);
+   util_queue_fence_wait(&variant->ready);
+   util_queue_fence_destroy(&variant->queued);
+   util_queue_fence_destroy(&variant->ready);
+
    gallivm_destroy(variant->gallivm);
 
    lp_fs_reference(lp, &variant->shader, NULL);
@@ -3758,6 +3974,7 @@ llvmpipe_destroy_fs(struct llvmpipe_context *llvmpipe,
    if (shader->base.ir.nir)
       ralloc_free(shader->base.ir.nir);
    assert(shader->variants_cached == 0);
+   mtx_destroy(&shader->compile_mutex);
    FREE((void *) shader->base.tokens);
    FREE(shader);
 }
@@ -4194,7 +4411,6 @@ llvmpipe_update_fs(struct llvmpipe_context *lp)
    }
    else {
       /* variant not found, create it now */
-      int64_t t0, t1, dt;
       unsigned i;
       unsigned variants_to_cull;
 
@@ -4243,23 +4459,24 @@ llvmpipe_update_fs(struct llvmpipe_context *lp)
       /*
        * Generate the new variant.
        */
-      t0 = os_time_get();
       variant = generate_variant(lp, shader, key);
-      t1 = os_time_get();
-      dt = t1 - t0;
-      LP_COUNT_ADD(llvm_compile_time, dt);
-      LP_COUNT_ADD(nr_llvm_compiles, 2);  /* emit vs. omit in/out test */
 
       /* Put the new variant into the list */
       if (variant) {
          insert_at_head(&shader->variants, &variant->list_item_local);
          insert_at_head(&lp->fs_variants_list, &variant->list_item_global);
          lp->nr_fs_variants++;
-         lp->nr_fs_instrs += variant->nr_instrs;
          shader->variants_cached++;
       }
    }
 
+   /* Instructions are only known once the (asynchronous) compile is done. */
+   if (variant && !variant->nr_instrs_counted &&
+       util_queue_fence_is_signalled(&variant->ready)) {
+      lp->nr_fs_instrs += variant->nr_instrs;
+      variant->nr_instrs_counted = TRUE;
+   }
+
    /* Bind this variant */
    lp_setup_set_fs_variant(lp->setup, variant);
 }
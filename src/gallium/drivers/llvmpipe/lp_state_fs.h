@@ -37,10 +37,12 @@
 #include "gallivm/lp_bld_tgsi.h" /* for lp_tgsi_info */
 #include "lp_bld_interp.h" /* for struct lp_shader_input */
 #include "util/u_inlines.h"
+#include "util/u_queue.h"
 #include "lp_jit.h"
 
 struct tgsi_token;
 struct lp_fragment_shader;
+struct llvmpipe_screen;
 
 
 /** Indexes into jit_function[] array */
@@ -48,6 +50,27 @@ struct lp_fragment_shader;
 #define RAST_EDGE_TEST 1
 
 
+/**
+ * Classification of trivial fragment shaders, for which the rasterizer can
+ * bypass the JIT'ed code entirely.  See lp_state_fs_analysis.c.
+ */
+enum lp_fs_kind
+{
+   LP_FS_KIND_GENERAL = 0,
+   LP_FS_KIND_BLIT_RGBA,      /**< color = texture2D(sampler0, input.xy) */
+   LP_FS_KIND_COLOR,          /**< color = input */
+};
+
+
+/** Blend modes the linear rasterization path implements */
+enum lp_linear_blend
+{
+   LP_LINEAR_BLEND_NONE = 0,
+   LP_LINEAR_BLEND_PREMUL,    /**< ONE, INV_SRC_ALPHA */
+   LP_LINEAR_BLEND_ALPHA,     /**< SRC_ALPHA, INV_SRC_ALPHA */
+};
+
+
 struct lp_sampler_static_state
 {
    /*
@@ -140,6 +163,37 @@ struct lp_fragment_shader_variant
    struct pipe_reference reference;
    boolean opaque;
 
+   /*
+    * Whether the shader/state combination can be rasterized with the
+    * fixed-point C span code in lp_rast_linear.c instead of the JIT'ed
+    * function.
+    */
+   boolean linear;
+   enum lp_linear_blend linear_blend;
+
+   /*
+    * Whether whole blocks failing the depth test may be skipped by the
+    * hierarchical-Z check in lp_rast_hiz.c, whether the variant writes
+    * the depth buffer, and whether the depth it writes comes from the
+    * shader rather than the primitive.
+    */
+   boolean hiz_cull;
+   boolean writes_depth;
+   boolean writes_shader_depth;
+
+   /*
+    * Variants are compiled in the background by the screen's compiler
+    * threads, or by the first rasterizer thread needing one that hasn't
+    * been started on yet.  Everything above is valid as soon as the
+    * variant is created, the LLVM/JIT state below only once `ready` is
+    * signalled.
+    */
+   struct util_queue_fence ready;
+   struct util_queue_fence queued;  /**< the compiler thread job is done */
+   int compile_claimed;             /**< set by whoever compiles it */
+   struct llvmpipe_screen *screen;
+   boolean nr_instrs_counted;   /**< accounted in the context's nr_fs_instrs */
+
    struct gallivm_state *gallivm;
 
    LLVMTypeRef jit_context_ptr_type;
@@ -174,6 +228,9 @@ struct lp_fragment_shader
 
    struct lp_fs_variant_list_item variants;
 
+   /* Compiling lowers the shader IR in place, one variant at a time */
+   mtx_t compile_mutex;
+
    struct draw_fragment_shader *draw_data;
 
    /* For debugging/profiling purposes */
@@ -184,12 +241,36 @@ struct lp_fragment_shader
 
    /** Fragment shader input interpolation info */
    struct lp_shader_input inputs[PIPE_MAX_SHADER_INPUTS];
+
+   /** Trivial shader classification, and the input it reads */
+   enum lp_fs_kind kind;
+   unsigned kind_input;
 };
 
 
 void
 lp_debug_fs_variant(struct lp_fragment_shader_variant *variant);
 
+void
+llvmpipe_fs_analyse(struct lp_fragment_shader *shader);
+
+void
+llvmpipe_fs_variant_linear(struct lp_fragment_shader_variant *variant);
+
+void
+llvmpipe_fs_variant_wait(struct lp_fragment_shader_variant *variant);
+
+/**
+ * Make sure the variant's code is ready to run, blocking on its background
+ * compilation if necessary.
+ */
+static inline void
+lp_fs_variant_ready(struct lp_fragment_shader_variant *variant)
+{
+   if (unlikely(!util_queue_fence_is_signalled(&variant->ready)))
+      llvmpipe_fs_variant_wait(variant);
+}
+
 void
 llvmpipe_destroy_fs(struct llvmpipe_context *llvmpipe,
                     struct lp_fragment_shader *shader);
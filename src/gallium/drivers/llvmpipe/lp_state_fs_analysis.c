@@ -0,0 +1,422 @@
+/**************************************************************************
+ *
+ * Copyright 2010-2021 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+/**
+ * @file
+ * Fragment shader analysis.
+ *
+ * Detects the trivial shaders (textured blits and passthrough colors) used
+ * by 2D compositors and GUI toolkits, and decides which variants of those
+ * can be handled by the fixed-point span code in lp_rast_linear.c.
+ */
+
+
+#include "pipe/p_defines.h"
+#include "pipe/p_shader_tokens.h"
+#include "util/format/u_format.h"
+#include "nir.h"
+#include "lp_debug.h"
+#include "lp_state_fs.h"
+
+
+/**
+ * Whether the given channel info describes component `chan` of the input
+ * `index`.
+ */
+static boolean
+is_input_chan(const struct lp_tgsi_channel_info *info,
+              unsigned index, unsigned chan)
+{
+   return info->file == TGSI_FILE_INPUT &&
+          info->u.index == index &&
+          info->swizzle == chan;
+}
+
+
+static enum lp_fs_kind
+analyse_tgsi(const struct lp_tgsi_info *info, unsigned *input)
+{
+   const struct tgsi_shader_info *base = &info->base;
+   const struct lp_tgsi_channel_info *cbuf0 = info->cbuf[0];
+   unsigned chan;
+
+   if (base->num_outputs != 1 ||
+       base->output_semantic_name[0] != TGSI_SEMANTIC_COLOR ||
+       base->output_semantic_index[0] != 0 ||
+       base->uses_kill ||
+       info->indirect_textures ||
+       info->sampler_texture_units_different)
+      return LP_FS_KIND_GENERAL;
+
+   if (info->num_texs == 0) {
+      /* MOV OUT[0], IN[n]; END */
+      if (base->num_instructions != 2 ||
+          base->opcode_count[TGSI_OPCODE_MOV] != 1)
+         return LP_FS_KIND_GENERAL;
+
+      for (chan = 0; chan < 4; chan++) {
+         if (!is_input_chan(&cbuf0[chan], cbuf0[0].u.index, chan))
+            return LP_FS_KIND_GENERAL;
+      }
+
+      *input = cbuf0[0].u.index;
+      return LP_FS_KIND_COLOR;
+   }
+
+   if (info->num_texs == 1) {
+      /* TEX OUT[0], IN[n], SAMP[0], 2D; END */
+      const struct lp_tgsi_texture_info *tex = &info->tex[0];
+
+      if (base->num_instructions != 2 ||
+          base->opcode_count[TGSI_OPCODE_TEX] != 1 ||
+          tex->modifier != LP_BLD_TEX_MODIFIER_NONE ||
+          tex->sampler_unit != 0 ||
+          (tex->target != TGSI_TEXTURE_2D &&
+           tex->target != TGSI_TEXTURE_RECT) ||
+          !is_input_chan(&tex->coord[0], tex->coord[0].u.index, 0) ||
+          !is_input_chan(&tex->coord[1], tex->coord[0].u.index, 1))
+         return LP_FS_KIND_GENERAL;
+
+      *input = tex->coord[0].u.index;
+      return LP_FS_KIND_BLIT_RGBA;
+   }
+
+   return LP_FS_KIND_GENERAL;
+}
+
+
+/**
+ * Return the shader input variable loaded by a direct load_deref.
+ */
+static nir_variable *
+nir_src_input_var(nir_src src)
+{
+   nir_intrinsic_instr *intr;
+   nir_deref_instr *deref;
+   nir_variable *var;
+
+   if (!src.is_ssa || src.ssa->parent_instr->type != nir_instr_type_intrinsic)
+      return NULL;
+
+   intr = nir_instr_as_intrinsic(src.ssa->parent_instr);
+   if (intr->intrinsic != nir_intrinsic_load_deref)
+      return NULL;
+
+   deref = nir_src_as_deref(intr->src[0]);
+   if (deref->deref_type != nir_deref_type_var)
+      return NULL;
+
+   var = deref->var;
+   if (var->data.mode != nir_var_shader_in ||
+       var->data.location_frac != 0 ||
+       !glsl_type_is_vector_or_scalar(var->type) ||
+       glsl_get_base_type(var->type) != GLSL_TYPE_FLOAT)
+      return NULL;
+
+   return var;
+}
+
+
+/**
+ * Match the .xy components of an input, either loaded as a vec2 or
+ * swizzled out of a wider load.
+ */
+static nir_variable *
+nir_src_input_xy(nir_src src)
+{
+   nir_alu_instr *alu;
+
+   if (!src.is_ssa || src.ssa->num_components != 2)
+      return NULL;
+
+   if (src.ssa->parent_instr->type != nir_instr_type_alu)
+      return nir_src_input_var(src);
+
+   alu = nir_instr_as_alu(src.ssa->parent_instr);
+   if (alu->op == nir_op_mov) {
+      if (alu->src[0].swizzle[0] != 0 || alu->src[0].swizzle[1] != 1)
+         return NULL;
+   } else if (alu->op == nir_op_vec2) {
+      if (!nir_srcs_equal(alu->src[0].src, alu->src[1].src) ||
+          alu->src[0].swizzle[0] != 0 || alu->src[1].swizzle[0] != 1)
+         return NULL;
+   } else {
+      return NULL;
+   }
+
+   if (alu->src[0].abs || alu->src[0].negate || alu->dest.saturate)
+      return NULL;
+
+   return nir_src_input_var(alu->src[0].src);
+}
+
+
+static enum lp_fs_kind
+analyse_nir(const nir_shader *nir, unsigned *input)
+{
+   nir_function_impl *impl = nir_shader_get_entrypoint((nir_shader *)nir);
+   enum lp_fs_kind kind = LP_FS_KIND_GENERAL;
+   nir_variable *in_var = NULL;
+   nir_tex_instr *tex = NULL;
+   unsigned num_stores = 0;
+
+   if (!exec_list_is_singular(&impl->body))
+      return LP_FS_KIND_GENERAL;
+
+   nir_foreach_block(block, impl) {
+      nir_foreach_instr(instr, block) {
+         switch (instr->type) {
+         case nir_instr_type_deref:
+         case nir_instr_type_alu:
+            /* validated through their users below */
+            break;
+
+         case nir_instr_type_tex:
+            if (tex)
+               return LP_FS_KIND_GENERAL;
+            tex = nir_instr_as_tex(instr);
+            if (tex->op != nir_texop_tex ||
+                (tex->sampler_dim != GLSL_SAMPLER_DIM_2D &&
+                 tex->sampler_dim != GLSL_SAMPLER_DIM_RECT) ||
+                tex->is_array || tex->is_shadow ||
+                tex->num_srcs != 1 ||
+                tex->src[0].src_type != nir_tex_src_coord ||
+                tex->texture_index != 0 || tex->sampler_index != 0)
+               return LP_FS_KIND_GENERAL;
+            in_var = nir_src_input_xy(tex->src[0].src);
+            if (!in_var)
+               return LP_FS_KIND_GENERAL;
+            break;
+
+         case nir_instr_type_intrinsic: {
+            nir_intrinsic_instr *intr = nir_instr_as_intrinsic(instr);
+            nir_deref_instr *deref;
+            nir_variable *var;
+
+            if (intr->intrinsic == nir_intrinsic_load_deref) {
+               if (!nir_src_input_var(nir_src_for_ssa(&intr->dest.ssa)))
+                  return LP_FS_KIND_GENERAL;
+               break;
+            }
+
+            if (intr->intrinsic != nir_intrinsic_store_deref ||
+                ++num_stores > 1)
+               return LP_FS_KIND_GENERAL;
+
+            deref = nir_src_as_deref(intr->src[0]);
+            if (deref->deref_type != nir_deref_type_var)
+               return LP_FS_KIND_GENERAL;
+
+            var = deref->var;
+            if (var->data.mode != nir_var_shader_out ||
+                (var->data.location != FRAG_RESULT_COLOR &&
+                 var->data.location != FRAG_RESULT_DATA0) ||
+                var->data.index != 0 ||
+                nir_intrinsic_write_mask(intr) != 0xf ||
+                !intr->src[1].is_ssa)
+               return LP_FS_KIND_GENERAL;
+
+            if (tex && intr->src[1].ssa == &tex->dest.ssa) {
+               kind = LP_FS_KIND_BLIT_RGBA;
+            } else {
+               in_var = nir_src_input_var(intr->src[1]);
+               if (!in_var || intr->src[1].ssa->num_components != 4)
+                  return LP_FS_KIND_GENERAL;
+               kind = LP_FS_KIND_COLOR;
+            }
+            break;
+         }
+
+         default:
+            return LP_FS_KIND_GENERAL;
+         }
+      }
+   }
+
+   /* A texture lookup whose result isn't the color output */
+   if (tex && kind != LP_FS_KIND_BLIT_RGBA)
+      return LP_FS_KIND_GENERAL;
+
+   if (kind != LP_FS_KIND_GENERAL)
+      *input = in_var->data.driver_location;
+
+   return kind;
+}
+
+
+/**
+ * Classify a fragment shader.  Called once at shader creation.
+ */
+void
+llvmpipe_fs_analyse(struct lp_fragment_shader *shader)
+{
+   unsigned input = 0;
+
+   if (shader->base.type == PIPE_SHADER_IR_TGSI)
+      shader->kind = analyse_tgsi(&shader->info, &input);
+   else
+      shader->kind = analyse_nir(shader->base.ir.nir, &input);
+
+   /* Only interpolated inputs can be evaluated by the linear path */
+   if (shader->kind != LP_FS_KIND_GENERAL &&
+       (input >= shader->info.base.num_inputs ||
+        shader->inputs[input].location != TGSI_INTERPOLATE_LOC_CENTER ||
+        shader->inputs[input].cyl_wrap ||
+        shader->inputs[input].interp == LP_INTERP_POSITION ||
+        shader->inputs[input].interp == LP_INTERP_FACING))
+      shader->kind = LP_FS_KIND_GENERAL;
+
+   shader->kind_input = input;
+
+   if (LP_DEBUG & DEBUG_FS) {
+      debug_printf("llvmpipe: fs #%u kind = %s\n", shader->no,
+                   shader->kind == LP_FS_KIND_BLIT_RGBA ? "blit_rgba" :
+                   shader->kind == LP_FS_KIND_COLOR ? "color" : "general");
+   }
+}
+
+
+static boolean
+is_rgba8_unorm(enum pipe_format format)
+{
+   switch (format) {
+   case PIPE_FORMAT_B8G8R8A8_UNORM:
+   case PIPE_FORMAT_B8G8R8X8_UNORM:
+   case PIPE_FORMAT_R8G8B8A8_UNORM:
+   case PIPE_FORMAT_R8G8B8X8_UNORM:
+      return TRUE;
+   default:
+      return FALSE;
+   }
+}
+
+
+static boolean
+is_nearest_sampler(const struct lp_sampler_static_state *samp)
+{
+   const struct lp_static_sampler_state *sampler = &samp->sampler_state;
+   const struct lp_static_texture_state *texture = &samp->texture_state;
+   unsigned wrap;
+
+   if (!is_rgba8_unorm(texture->format) ||
+       (texture->target != PIPE_TEXTURE_2D &&
+        texture->target != PIPE_TEXTURE_RECT) ||
+       texture->swizzle_r != PIPE_SWIZZLE_X ||
+       texture->swizzle_g != PIPE_SWIZZLE_Y ||
+       texture->swizzle_b != PIPE_SWIZZLE_Z ||
+       texture->swizzle_a != PIPE_SWIZZLE_W)
+      return FALSE;
+
+   if (sampler->min_img_filter != PIPE_TEX_FILTER_NEAREST ||
+       sampler->mag_img_filter != PIPE_TEX_FILTER_NEAREST ||
+       sampler->min_mip_filter != PIPE_TEX_MIPFILTER_NONE ||
+       sampler->compare_mode != PIPE_TEX_COMPARE_NONE)
+      return FALSE;
+
+   if (sampler->wrap_s != sampler->wrap_t)
+      return FALSE;
+
+   wrap = sampler->wrap_s;
+   if (wrap == PIPE_TEX_WRAP_REPEAT)
+      return sampler->normalized_coords;
+
+   return wrap == PIPE_TEX_WRAP_CLAMP_TO_EDGE ||
+          wrap == PIPE_TEX_WRAP_CLAMP;
+}
+
+
+static boolean
+get_linear_blend(const struct pipe_rt_blend_state *rt,
+                 enum lp_linear_blend *blend)
+{
+   if (!rt->blend_enable) {
+      *blend = LP_LINEAR_BLEND_NONE;
+      return TRUE;
+   }
+
+   if (rt->rgb_func != PIPE_BLEND_ADD ||
+       rt->alpha_func != PIPE_BLEND_ADD ||
+       rt->rgb_dst_factor != PIPE_BLENDFACTOR_INV_SRC_ALPHA ||
+       rt->alpha_dst_factor != PIPE_BLENDFACTOR_INV_SRC_ALPHA ||
+       rt->rgb_src_factor != rt->alpha_src_factor)
+      return FALSE;
+
+   switch (rt->rgb_src_factor) {
+   case PIPE_BLENDFACTOR_ONE:
+      *blend = LP_LINEAR_BLEND_PREMUL;
+      return TRUE;
+   case PIPE_BLENDFACTOR_SRC_ALPHA:
+      *blend = LP_LINEAR_BLEND_ALPHA;
+      return TRUE;
+   default:
+      return FALSE;
+   }
+}
+
+
+/**
+ * Decide whether a variant qualifies for the linear rasterization path.
+ * Everything not explicitly handled keeps using the JIT'ed code.
+ */
+void
+llvmpipe_fs_variant_linear(struct lp_fragment_shader_variant *variant)
+{
+   const struct lp_fragment_shader *shader = variant->shader;
+   const struct lp_fragment_shader_variant_key *key = &variant->key;
+   const struct util_format_description *cbuf0_format_desc;
+
+   variant->linear = FALSE;
+
+   if (shader->kind == LP_FS_KIND_GENERAL ||
+       (LP_PERF & PERF_NO_LINEAR_FS))
+      return;
+
+   if (key->nr_cbufs != 1 ||
+       !is_rgba8_unorm(key->cbuf_format[0]) ||
+       key->multisample ||
+       key->depth.enabled ||
+       key->stencil[0].enabled ||
+       key->alpha.enabled ||
+       key->occlusion_count ||
+       key->blend.logicop_enable ||
+       key->blend.alpha_to_coverage)
+      return;
+
+   cbuf0_format_desc = util_format_description(key->cbuf_format[0]);
+   if (!util_format_colormask_full(cbuf0_format_desc,
+                                   key->blend.rt[0].colormask))
+      return;
+
+   if (!get_linear_blend(&key->blend.rt[0], &variant->linear_blend))
+      return;
+
+   if (shader->kind == LP_FS_KIND_BLIT_RGBA &&
+       (key->nr_samplers < 1 || !is_nearest_sampler(&key->samplers[0])))
+      return;
+
+   variant->linear = TRUE;
+}
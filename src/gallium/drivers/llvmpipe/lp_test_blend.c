@@ -624,6 +624,8 @@ blend_funcs[] = {
 const struct lp_type blend_types[] = {
    /* float, fixed,  sign,  norm, width, len */
    {   TRUE, FALSE,  TRUE, FALSE,    32,   4 }, /* f32 x 4 */
+   {   TRUE, FALSE,  TRUE, FALSE,    32,   8 }, /* f32 x 8 */
+   {   TRUE, FALSE,  TRUE, FALSE,    32,  16 }, /* f32 x 16 */
    {  FALSE, FALSE, FALSE,  TRUE,     8,  16 }, /* u8n x 16 */
 };
 
@@ -654,6 +656,10 @@ test_all(unsigned verbose, FILE *fp)
                   for(alpha_dst_factor = blend_factors; alpha_dst_factor <= alpha_src_factor; ++alpha_dst_factor) {
                      for(type = blend_types; type < &blend_types[num_types]; ++type) {
 
+                        /* only test the vector widths the host runs */
+                        if (lp_type_width(*type) > lp_native_vector_width)
+                           continue;
+
                         if(*rgb_dst_factor == PIPE_BLENDFACTOR_SRC_ALPHA_SATURATE ||
                            *alpha_dst_factor == PIPE_BLENDFACTOR_SRC_ALPHA_SATURATE)
                            continue;
@@ -712,7 +718,9 @@ test_some(unsigned verbose, FILE *fp,
          alpha_dst_factor = &blend_factors[rand() % num_factors];
       } while(*alpha_dst_factor == PIPE_BLENDFACTOR_SRC_ALPHA_SATURATE);
 
-      type = &blend_types[rand() % num_types];
+      do {
+         type = &blend_types[rand() % num_types];
+      } while(lp_type_width(*type) > lp_native_vector_width);
 
       memset(&blend, 0, sizeof blend);
       blend.rt[0].blend_enable      = 1;
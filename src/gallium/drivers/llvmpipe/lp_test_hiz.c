@@ -0,0 +1,375 @@
+/**************************************************************************
+ *
+ * Copyright 2021 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+
+/**
+ * @file
+ * Unit tests for the hierarchical-Z culling in lp_rast_hiz.c.
+ *
+ * A single depth tile holds the same depth everywhere except in one
+ * block.  Constant depth triangles are tested against every block, and
+ * must be culled exactly where the depth test fails for all of it.
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "util/format/u_format.h"
+#include "util/u_memory.h"
+
+#include "lp_rast.h"
+#include "lp_rast_priv.h"
+#include "lp_scene.h"
+#include "lp_state_fs.h"
+#include "lp_test.h"
+
+
+/** The block holding the other depth */
+#define OTHER_BLOCK 5
+
+
+struct hiz_test_case
+{
+   enum pipe_format format;
+   enum pipe_compare_func func;
+   float depth;        /**< depth buffer contents */
+   float other_depth;  /**< ... in OTHER_BLOCK */
+   float z;            /**< triangle depth */
+   boolean culled;     /**< expected for all blocks but OTHER_BLOCK */
+   boolean other_culled;
+};
+
+
+static const struct hiz_test_case
+test_cases[] =
+{
+   /* Behind everything but the other block */
+   { PIPE_FORMAT_Z32_FLOAT, PIPE_FUNC_LESS, 0.5f, 1.0f, 0.75f, TRUE, FALSE },
+   { PIPE_FORMAT_Z32_FLOAT, PIPE_FUNC_LEQUAL, 0.5f, 1.0f, 0.75f, TRUE, FALSE },
+   { PIPE_FORMAT_Z32_FLOAT, PIPE_FUNC_GREATER, 0.5f, 0.0f, 0.25f, TRUE, FALSE },
+   { PIPE_FORMAT_Z32_FLOAT, PIPE_FUNC_GEQUAL, 0.5f, 0.0f, 0.25f, TRUE, FALSE },
+   { PIPE_FORMAT_Z16_UNORM, PIPE_FUNC_LESS, 0.5f, 1.0f, 0.75f, TRUE, FALSE },
+   { PIPE_FORMAT_Z24_UNORM_S8_UINT, PIPE_FUNC_LESS, 0.5f, 1.0f, 0.75f, TRUE, FALSE },
+   { PIPE_FORMAT_S8_UINT_Z24_UNORM, PIPE_FUNC_LESS, 0.5f, 1.0f, 0.75f, TRUE, FALSE },
+   { PIPE_FORMAT_Z32_UNORM, PIPE_FUNC_GREATER, 0.5f, 0.0f, 0.25f, TRUE, FALSE },
+
+   /* In front of everything */
+   { PIPE_FORMAT_Z32_FLOAT, PIPE_FUNC_LESS, 0.5f, 1.0f, 0.25f, FALSE, FALSE },
+   { PIPE_FORMAT_Z16_UNORM, PIPE_FUNC_GREATER, 0.5f, 0.0f, 0.75f, FALSE, FALSE },
+
+   /* Equal, or too close to tell after rounding */
+   { PIPE_FORMAT_Z32_FLOAT, PIPE_FUNC_LEQUAL, 0.5f, 1.0f, 0.5f, FALSE, FALSE },
+   { PIPE_FORMAT_Z16_UNORM, PIPE_FUNC_LESS, 0.5f, 1.0f, 0.5f + 1.0f / 65535, FALSE, FALSE },
+   { PIPE_FORMAT_Z24_UNORM_S8_UINT, PIPE_FUNC_GEQUAL, 0.5f, 0.0f, 0.5f, FALSE, FALSE },
+
+   /* Unorm depth is clamped to [0, 1] before the test */
+   { PIPE_FORMAT_Z16_UNORM, PIPE_FUNC_LEQUAL, 1.0f, 1.0f, 1.5f, FALSE, FALSE },
+};
+
+
+struct hiz_test_context
+{
+   struct lp_scene *scene;
+   struct pipe_surface zsbuf;
+   struct lp_fragment_shader_variant *variant;
+   struct lp_rast_state state;
+   struct lp_jit_viewport viewport;
+   struct lp_rasterizer_task task;
+   uint8_t *depth;
+
+   struct {
+      struct lp_rast_shader_inputs inputs;
+      float coefs[3][4];   /**< a0, dadx, dady of the position */
+   } tri;
+};
+
+
+static boolean
+hiz_test_init(struct hiz_test_context *ctx, enum pipe_format format,
+              enum pipe_compare_func func)
+{
+   unsigned bytes = util_format_get_blocksize(format);
+
+   memset(ctx, 0, sizeof *ctx);
+
+   ctx->scene = CALLOC_STRUCT(lp_scene);
+   ctx->variant = CALLOC_STRUCT(lp_fragment_shader_variant);
+   ctx->depth = MALLOC(TILE_SIZE * TILE_SIZE * bytes);
+   if (!ctx->scene || !ctx->variant || !ctx->depth)
+      return FALSE;
+
+   ctx->zsbuf.format = format;
+   ctx->scene->fb.zsbuf = &ctx->zsbuf;
+   ctx->scene->zsbuf.map = ctx->depth;
+   ctx->scene->zsbuf.stride = TILE_SIZE * bytes;
+   ctx->scene->zsbuf.format_bytes = bytes;
+   ctx->scene->zsbuf.nr_samples = 1;
+
+   ctx->variant->key.depth.enabled = 1;
+   ctx->variant->key.depth.writemask = 1;
+   ctx->variant->key.depth.func = func;
+   ctx->variant->hiz_cull = TRUE;
+   ctx->variant->writes_depth = TRUE;
+
+   ctx->viewport.min_depth = 0.0f;
+   ctx->viewport.max_depth = 1.0f;
+   ctx->state.jit_context.viewports = &ctx->viewport;
+   ctx->state.variant = ctx->variant;
+
+   ctx->task.scene = ctx->scene;
+   ctx->task.state = &ctx->state;
+   ctx->task.width = TILE_SIZE;
+   ctx->task.height = TILE_SIZE;
+   ctx->task.depth_tile = ctx->depth;
+
+   ctx->tri.inputs.stride = sizeof ctx->tri.coefs[0];
+
+   return TRUE;
+}
+
+
+static void
+hiz_test_cleanup(struct hiz_test_context *ctx)
+{
+   FREE(ctx->depth);
+   FREE(ctx->variant);
+   FREE(ctx->scene);
+}
+
+
+/** Fill the 16x16 block b, or the whole tile if b is ~0, with depth z */
+static void
+fill_depth(struct hiz_test_context *ctx, unsigned b, float z)
+{
+   const unsigned bytes = ctx->scene->zsbuf.format_bytes;
+   const unsigned stride = ctx->scene->zsbuf.stride;
+   unsigned x0 = 0, y0 = 0, size = TILE_SIZE;
+   unsigned y;
+
+   if (b != ~0u) {
+      x0 = (b % LP_HIZ_BLOCKS) * LP_HIZ_BLOCK_SIZE;
+      y0 = (b / LP_HIZ_BLOCKS) * LP_HIZ_BLOCK_SIZE;
+      size = LP_HIZ_BLOCK_SIZE;
+   }
+
+   for (y = y0; y < y0 + size; y++) {
+      uint8_t *row = ctx->depth + y * stride + x0 * bytes;
+      unsigned x;
+
+      for (x = 0; x < size; x++)
+         util_format_pack_z_float(ctx->zsbuf.format, row + x * bytes, &z, 1);
+   }
+}
+
+
+/** Test a triangle of constant depth z against block b */
+static boolean
+test_block(struct hiz_test_context *ctx, unsigned b, float z)
+{
+   ctx->tri.coefs[0][2] = z;
+
+   return lp_rast_hiz_test(&ctx->task, &ctx->tri.inputs,
+                           (b % LP_HIZ_BLOCKS) * LP_HIZ_BLOCK_SIZE,
+                           (b / LP_HIZ_BLOCKS) * LP_HIZ_BLOCK_SIZE,
+                           LP_HIZ_BLOCK_SIZE, LP_HIZ_BLOCK_SIZE);
+}
+
+
+static boolean
+test_cull(unsigned verbose, const struct hiz_test_case *test)
+{
+   struct hiz_test_context ctx;
+   boolean success = TRUE;
+   unsigned b;
+
+   if (!hiz_test_init(&ctx, test->format, test->func)) {
+      hiz_test_cleanup(&ctx);
+      return FALSE;
+   }
+
+   fill_depth(&ctx, ~0u, test->depth);
+   fill_depth(&ctx, OTHER_BLOCK, test->other_depth);
+
+   lp_rast_hiz_begin_tile(&ctx.task);
+   if (!ctx.task.hiz.enabled) {
+      printf("%s: hiz not enabled\n", util_format_name(test->format));
+      success = FALSE;
+   }
+
+   for (b = 0; b < LP_HIZ_BLOCKS * LP_HIZ_BLOCKS && success; b++) {
+      boolean expected = b == OTHER_BLOCK ? test->other_culled : test->culled;
+
+      if (test_block(&ctx, b, test->z) != expected) {
+         printf("%s, func %u, depth %g, triangle %g: block %u %s\n",
+                util_format_name(test->format), test->func,
+                b == OTHER_BLOCK ? test->other_depth : test->depth,
+                test->z, b, expected ? "not culled" : "culled");
+         success = FALSE;
+      }
+   }
+
+   /* The tile as a whole is visible wherever any block is. */
+   if (success) {
+      ctx.tri.coefs[0][2] = test->z;
+      if (lp_rast_hiz_test(&ctx.task, &ctx.tri.inputs, 0, 0,
+                           TILE_SIZE, TILE_SIZE) !=
+          (test->culled && test->other_culled)) {
+         printf("%s, func %u, triangle %g: wrong result for the tile\n",
+                util_format_name(test->format), test->func, test->z);
+         success = FALSE;
+      }
+   }
+
+   if (verbose && success)
+      printf("%s, func %u, triangle %g: ok\n",
+             util_format_name(test->format), test->func, test->z);
+
+   hiz_test_cleanup(&ctx);
+   return success;
+}
+
+
+/**
+ * Depth writes keep the blocks' ranges valid and conservative, unless
+ * the shader computes the depth.
+ */
+static boolean
+test_write(unsigned verbose)
+{
+   struct hiz_test_context ctx;
+   const unsigned b = OTHER_BLOCK;
+   const unsigned bit = 1u << b;
+   boolean success = TRUE;
+
+   if (!hiz_test_init(&ctx, PIPE_FORMAT_Z32_FLOAT, PIPE_FUNC_LESS)) {
+      hiz_test_cleanup(&ctx);
+      return FALSE;
+   }
+
+   fill_depth(&ctx, ~0u, 0.5f);
+   lp_rast_hiz_begin_tile(&ctx.task);
+
+   if (!test_block(&ctx, b, 0.75f)) {
+      printf("write: block not culled before the write\n");
+      success = FALSE;
+   }
+
+   /* Draw a triangle at 0.25 over the block. */
+   ctx.tri.coefs[0][2] = 0.25f;
+   lp_rast_hiz_depth_written(&ctx.task, &ctx.tri.inputs,
+                             (b % LP_HIZ_BLOCKS) * LP_HIZ_BLOCK_SIZE,
+                             (b / LP_HIZ_BLOCKS) * LP_HIZ_BLOCK_SIZE,
+                             LP_HIZ_BLOCK_SIZE, LP_HIZ_BLOCK_SIZE);
+   fill_depth(&ctx, b, 0.25f);
+
+   if (!(ctx.task.hiz.valid & bit)) {
+      printf("write: block range forgotten\n");
+      success = FALSE;
+   }
+   if (!test_block(&ctx, b, 0.75f)) {
+      printf("write: block not culled after the write\n");
+      success = FALSE;
+   }
+   if (test_block(&ctx, b, 0.4f)) {
+      printf("write: written block culled\n");
+      success = FALSE;
+   }
+
+   ctx.variant->key.depth.func = PIPE_FUNC_GREATER;
+   if (test_block(&ctx, b, 0.3f)) {
+      printf("write: written block culled with GREATER\n");
+      success = FALSE;
+   }
+   if (!test_block(&ctx, b, 0.1f)) {
+      printf("write: block not culled with GREATER\n");
+      success = FALSE;
+   }
+
+   /* Shader written depth can be anything. */
+   ctx.variant->writes_shader_depth = TRUE;
+   lp_rast_hiz_depth_written(&ctx.task, &ctx.tri.inputs,
+                             (b % LP_HIZ_BLOCKS) * LP_HIZ_BLOCK_SIZE,
+                             (b / LP_HIZ_BLOCKS) * LP_HIZ_BLOCK_SIZE,
+                             4, 4);
+   if (ctx.task.hiz.valid & bit) {
+      printf("write: block range kept after shader depth write\n");
+      success = FALSE;
+   }
+
+   if (verbose && success)
+      printf("write: ok\n");
+
+   hiz_test_cleanup(&ctx);
+   return success;
+}
+
+
+void
+write_tsv_header(FILE *fp)
+{
+   fprintf(fp,
+           "result\t"
+           "format\n");
+
+   fflush(fp);
+}
+
+
+boolean
+test_all(unsigned verbose, FILE *fp)
+{
+   boolean success = TRUE;
+   unsigned i;
+
+   for (i = 0; i < ARRAY_SIZE(test_cases); i++) {
+      if (!test_cull(verbose, &test_cases[i]))
+         success = FALSE;
+   }
+
+   if (!test_write(verbose))
+      success = FALSE;
+
+   return success;
+}
+
+
+boolean
+test_some(unsigned verbose, FILE *fp,
+          unsigned long n)
+{
+   return test_all(verbose, fp);
+}
+
+
+boolean
+test_single(unsigned verbose, FILE *fp)
+{
+   printf("no test_single()");
+   return TRUE;
+}
@@ -0,0 +1,511 @@
+/**************************************************************************
+ *
+ * Copyright 2021 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+
+/**
+ * @file
+ * Unit tests for the linear rasterization path in lp_rast_linear.c.
+ *
+ * Each test case draws a textured blit or an interpolated color triangle
+ * over a patterned color buffer, once through the linear path and once
+ * through the JIT'ed shader (LP_PERF=no_linear_fs), and compares the
+ * results.  Blending may round differently by one, everything else must
+ * match exactly.
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "pipe/p_context.h"
+#include "pipe/p_screen.h"
+#include "pipe/p_state.h"
+#include "frontend/sw_winsys.h"
+#include "sw/null/null_sw_winsys.h"
+#include "tgsi/tgsi_text.h"
+#include "util/u_inlines.h"
+#include "util/u_memory.h"
+#include "util/u_sampler.h"
+
+#include "lp_debug.h"
+#include "lp_perf.h"
+#include "lp_public.h"
+#include "lp_state_fs.h"
+#include "lp_test.h"
+
+
+/* Not a multiple of the tile size, so that there are partial tiles */
+#define WIDTH 160
+#define HEIGHT 144
+
+#define TEX_SIZE 32
+
+
+struct linear_test_case
+{
+   const char *name;
+   boolean textured;
+   boolean perspective;
+   enum lp_linear_blend blend;
+   enum pipe_format cbuf_format;
+   enum pipe_format tex_format;
+};
+
+
+static const struct linear_test_case
+test_cases[] =
+{
+   { "blit", TRUE, FALSE, LP_LINEAR_BLEND_NONE,
+     PIPE_FORMAT_B8G8R8A8_UNORM, PIPE_FORMAT_B8G8R8A8_UNORM },
+   { "blit swizzled", TRUE, FALSE, LP_LINEAR_BLEND_NONE,
+     PIPE_FORMAT_B8G8R8A8_UNORM, PIPE_FORMAT_R8G8B8A8_UNORM },
+   { "blit no alpha", TRUE, FALSE, LP_LINEAR_BLEND_PREMUL,
+     PIPE_FORMAT_B8G8R8A8_UNORM, PIPE_FORMAT_B8G8R8X8_UNORM },
+   { "blit perspective", TRUE, TRUE, LP_LINEAR_BLEND_NONE,
+     PIPE_FORMAT_R8G8B8A8_UNORM, PIPE_FORMAT_R8G8B8A8_UNORM },
+   { "blit premul", TRUE, FALSE, LP_LINEAR_BLEND_PREMUL,
+     PIPE_FORMAT_B8G8R8A8_UNORM, PIPE_FORMAT_B8G8R8A8_UNORM },
+   { "blit alpha", TRUE, FALSE, LP_LINEAR_BLEND_ALPHA,
+     PIPE_FORMAT_B8G8R8A8_UNORM, PIPE_FORMAT_B8G8R8A8_UNORM },
+   { "color", FALSE, FALSE, LP_LINEAR_BLEND_NONE,
+     PIPE_FORMAT_B8G8R8A8_UNORM, PIPE_FORMAT_NONE },
+   { "color alpha", FALSE, FALSE, LP_LINEAR_BLEND_ALPHA,
+     PIPE_FORMAT_R8G8B8A8_UNORM, PIPE_FORMAT_NONE },
+};
+
+
+static const char *vs_text =
+   "VERT\n"
+   "DCL IN[0]\n"
+   "DCL IN[1]\n"
+   "DCL OUT[0], POSITION\n"
+   "DCL OUT[1], GENERIC[0]\n"
+   "  0: MOV OUT[0], IN[0]\n"
+   "  1: MOV OUT[1], IN[1]\n"
+   "  2: END\n";
+
+static const char *fs_blit_text =
+   "FRAG\n"
+   "DCL IN[0], GENERIC[0], %s\n"
+   "DCL OUT[0], COLOR\n"
+   "DCL SAMP[0]\n"
+   "DCL SVIEW[0], 2D, FLOAT\n"
+   "  0: TEX OUT[0], IN[0], SAMP[0], 2D\n"
+   "  1: END\n";
+
+static const char *fs_color_text =
+   "FRAG\n"
+   "DCL IN[0], GENERIC[0], %s\n"
+   "DCL OUT[0], COLOR\n"
+   "  0: MOV OUT[0], IN[0]\n"
+   "  1: END\n";
+
+
+static void *
+create_shader(struct pipe_context *ctx, const char *format,
+              boolean perspective, boolean fragment)
+{
+   struct tgsi_token tokens[1024];
+   struct pipe_shader_state state;
+   char text[1024];
+
+   snprintf(text, sizeof text, format,
+            perspective ? "PERSPECTIVE" : "LINEAR");
+   if (!tgsi_text_translate(text, tokens, ARRAY_SIZE(tokens)))
+      return NULL;
+
+   memset(&state, 0, sizeof state);
+   state.type = PIPE_SHADER_IR_TGSI;
+   state.tokens = tokens;
+
+   return fragment ? ctx->create_fs_state(ctx, &state)
+                   : ctx->create_vs_state(ctx, &state);
+}
+
+
+static struct pipe_resource *
+create_texture(struct pipe_screen *screen, enum pipe_format format,
+               unsigned width, unsigned height, unsigned bind)
+{
+   struct pipe_resource templ;
+
+   memset(&templ, 0, sizeof templ);
+   templ.target = PIPE_TEXTURE_2D;
+   templ.format = format;
+   templ.width0 = width;
+   templ.height0 = height;
+   templ.depth0 = 1;
+   templ.array_size = 1;
+   templ.bind = bind;
+
+   return screen->resource_create(screen, &templ);
+}
+
+
+/** Fill a width x height RGBA8 texture with varied colors and alphas */
+static void
+fill_texture(struct pipe_context *ctx, struct pipe_resource *res,
+             unsigned width, unsigned height, unsigned seed)
+{
+   uint32_t *data = MALLOC(width * height * 4);
+   struct pipe_box box;
+   unsigned i;
+
+   for (i = 0; i < width * height; i++) {
+      uint32_t x = (i + seed) * 2654435761u;
+      data[i] = x ^ (x >> 13);
+   }
+
+   u_box_2d(0, 0, width, height, &box);
+   ctx->texture_subdata(ctx, res, 0, 0, &box, data, width * 4, 0);
+   FREE(data);
+}
+
+
+/**
+ * Draw the test case into a fresh color buffer and read it back.
+ */
+static boolean
+render(struct pipe_screen *screen, const struct linear_test_case *test,
+       boolean linear, uint32_t *pixels)
+{
+   struct pipe_context *ctx;
+   struct pipe_resource *cbuf, *tex = NULL, *vbuf;
+   struct pipe_surface surf_templ, *surf;
+   struct pipe_sampler_view view_templ, *view = NULL;
+   struct pipe_framebuffer_state fb;
+   struct pipe_viewport_state viewport;
+   struct pipe_rasterizer_state rast;
+   struct pipe_blend_state blend;
+   struct pipe_depth_stencil_alpha_state dsa;
+   struct pipe_sampler_state sampler;
+   struct pipe_vertex_element velems[2];
+   struct pipe_vertex_buffer vb;
+   struct pipe_draw_info info;
+   struct pipe_draw_start_count range;
+   struct pipe_transfer *transfer;
+   void *vs, *fs, *rast_cso, *blend_cso, *dsa_cso, *velems_cso;
+   void *sampler_cso = NULL;
+   float verts[6][2][4];
+   unsigned num_verts, i;
+   const uint8_t *map;
+
+   if (linear)
+      LP_PERF &= ~PERF_NO_LINEAR_FS;
+   else
+      LP_PERF |= PERF_NO_LINEAR_FS;
+
+   ctx = screen->context_create(screen, NULL, 0);
+   if (!ctx)
+      return FALSE;
+
+   cbuf = create_texture(screen, test->cbuf_format, WIDTH, HEIGHT,
+                         PIPE_BIND_RENDER_TARGET);
+   fill_texture(ctx, cbuf, WIDTH, HEIGHT, 0);
+
+   memset(&surf_templ, 0, sizeof surf_templ);
+   surf_templ.format = test->cbuf_format;
+   surf = ctx->create_surface(ctx, cbuf, &surf_templ);
+
+   memset(&fb, 0, sizeof fb);
+   fb.width = WIDTH;
+   fb.height = HEIGHT;
+   fb.nr_cbufs = 1;
+   fb.cbufs[0] = surf;
+   ctx->set_framebuffer_state(ctx, &fb);
+
+   memset(&viewport, 0, sizeof viewport);
+   viewport.scale[0] = WIDTH / 2.0f;
+   viewport.scale[1] = HEIGHT / 2.0f;
+   viewport.scale[2] = 1.0f;
+   viewport.translate[0] = WIDTH / 2.0f;
+   viewport.translate[1] = HEIGHT / 2.0f;
+   ctx->set_viewport_states(ctx, 0, 1, &viewport);
+
+   memset(&rast, 0, sizeof rast);
+   rast.half_pixel_center = 1;
+   rast.depth_clip_near = 1;
+   rast.depth_clip_far = 1;
+   rast.cull_face = PIPE_FACE_NONE;
+   rast_cso = ctx->create_rasterizer_state(ctx, &rast);
+   ctx->bind_rasterizer_state(ctx, rast_cso);
+
+   memset(&blend, 0, sizeof blend);
+   blend.rt[0].colormask = PIPE_MASK_RGBA;
+   if (test->blend != LP_LINEAR_BLEND_NONE) {
+      blend.rt[0].blend_enable = 1;
+      blend.rt[0].rgb_func = PIPE_BLEND_ADD;
+      blend.rt[0].alpha_func = PIPE_BLEND_ADD;
+      blend.rt[0].rgb_src_factor =
+      blend.rt[0].alpha_src_factor =
+         test->blend == LP_LINEAR_BLEND_PREMUL ? PIPE_BLENDFACTOR_ONE
+                                               : PIPE_BLENDFACTOR_SRC_ALPHA;
+      blend.rt[0].rgb_dst_factor = PIPE_BLENDFACTOR_INV_SRC_ALPHA;
+      blend.rt[0].alpha_dst_factor = PIPE_BLENDFACTOR_INV_SRC_ALPHA;
+   }
+   blend_cso = ctx->create_blend_state(ctx, &blend);
+   ctx->bind_blend_state(ctx, blend_cso);
+
+   memset(&dsa, 0, sizeof dsa);
+   dsa_cso = ctx->create_depth_stencil_alpha_state(ctx, &dsa);
+   ctx->bind_depth_stencil_alpha_state(ctx, dsa_cso);
+
+   ctx->set_sample_mask(ctx, ~0);
+
+   vs = create_shader(ctx, vs_text, FALSE, FALSE);
+   fs = create_shader(ctx, test->textured ? fs_blit_text : fs_color_text,
+                      test->perspective, TRUE);
+   ctx->bind_vs_state(ctx, vs);
+   ctx->bind_fs_state(ctx, fs);
+
+   if (test->textured) {
+      tex = create_texture(screen, test->tex_format, TEX_SIZE, TEX_SIZE,
+                           PIPE_BIND_SAMPLER_VIEW);
+      fill_texture(ctx, tex, TEX_SIZE, TEX_SIZE, 1);
+
+      u_sampler_view_default_template(&view_templ, tex, test->tex_format);
+      view = ctx->create_sampler_view(ctx, tex, &view_templ);
+      ctx->set_sampler_views(ctx, PIPE_SHADER_FRAGMENT, 0, 1, 0, &view);
+
+      memset(&sampler, 0, sizeof sampler);
+      sampler.wrap_s = PIPE_TEX_WRAP_CLAMP_TO_EDGE;
+      sampler.wrap_t = PIPE_TEX_WRAP_CLAMP_TO_EDGE;
+      sampler.wrap_r = PIPE_TEX_WRAP_CLAMP_TO_EDGE;
+      sampler.min_img_filter = PIPE_TEX_FILTER_NEAREST;
+      sampler.mag_img_filter = PIPE_TEX_FILTER_NEAREST;
+      sampler.min_mip_filter = PIPE_TEX_MIPFILTER_NONE;
+      sampler.normalized_coords = 1;
+      sampler_cso = ctx->create_sampler_state(ctx, &sampler);
+      ctx->bind_sampler_states(ctx, PIPE_SHADER_FRAGMENT, 0, 1, &sampler_cso);
+
+      /*
+       * Magnify the texture 4x onto a rectangle at an odd position, so
+       * that it covers whole tiles as well as partial 4x4 blocks, and no
+       * pixel center maps near a texel edge.
+       */
+      static const float rect[6][2] = {
+         { 0, 0 }, { 1, 0 }, { 0, 1 }, { 1, 0 }, { 1, 1 }, { 0, 1 },
+      };
+      for (i = 0; i < 6; i++) {
+         float x = 10.0f + rect[i][0] * TEX_SIZE * 4;
+         float y = 6.0f + rect[i][1] * TEX_SIZE * 4;
+         verts[i][0][0] = x / WIDTH * 2.0f - 1.0f;
+         verts[i][0][1] = y / HEIGHT * 2.0f - 1.0f;
+         verts[i][0][2] = 0.0f;
+         verts[i][0][3] = 1.0f;
+         verts[i][1][0] = rect[i][0];
+         verts[i][1][1] = rect[i][1];
+         verts[i][1][2] = 0.0f;
+         verts[i][1][3] = 1.0f;
+      }
+      num_verts = 6;
+   } else {
+      /* A triangle with slanted edges and colors varying along them. */
+      static const float tri[3][2][4] = {
+         { { 5.0f, 3.0f }, { 1.0f, 0.0f, 0.2f, 0.9f } },
+         { { 150.0f, 20.0f }, { 0.0f, 1.0f, 0.5f, 0.3f } },
+         { { 40.0f, 140.0f }, { 0.1f, 0.4f, 1.0f, 0.6f } },
+      };
+      for (i = 0; i < 3; i++) {
+         verts[i][0][0] = tri[i][0][0] / WIDTH * 2.0f - 1.0f;
+         verts[i][0][1] = tri[i][0][1] / HEIGHT * 2.0f - 1.0f;
+         verts[i][0][2] = 0.0f;
+         verts[i][0][3] = 1.0f;
+         memcpy(verts[i][1], tri[i][1], sizeof verts[i][1]);
+      }
+      num_verts = 3;
+   }
+
+   memset(velems, 0, sizeof velems);
+   velems[0].src_format = PIPE_FORMAT_R32G32B32A32_FLOAT;
+   velems[1].src_offset = sizeof verts[0][0];
+   velems[1].src_format = PIPE_FORMAT_R32G32B32A32_FLOAT;
+   velems_cso = ctx->create_vertex_elements_state(ctx, 2, velems);
+   ctx->bind_vertex_elements_state(ctx, velems_cso);
+
+   vbuf = pipe_buffer_create_with_data(ctx, PIPE_BIND_VERTEX_BUFFER,
+                                       PIPE_USAGE_DEFAULT,
+                                       num_verts * sizeof verts[0], verts);
+   memset(&vb, 0, sizeof vb);
+   vb.stride = sizeof verts[0];
+   vb.buffer.resource = vbuf;
+   ctx->set_vertex_buffers(ctx, 0, 1, 0, false, &vb);
+
+   memset(&info, 0, sizeof info);
+   info.mode = PIPE_PRIM_TRIANGLES;
+   info.instance_count = 1;
+   info.max_index = num_verts - 1;
+   range.start = 0;
+   range.count = num_verts;
+   ctx->draw_vbo(ctx, &info, NULL, &range, 1);
+
+   map = pipe_transfer_map(ctx, cbuf, 0, 0, PIPE_MAP_READ,
+                           0, 0, WIDTH, HEIGHT, &transfer);
+   for (i = 0; i < HEIGHT; i++)
+      memcpy(pixels + i * WIDTH, map + i * transfer->stride, WIDTH * 4);
+   pipe_transfer_unmap(ctx, transfer);
+
+   ctx->set_vertex_buffers(ctx, 0, 0, 1, false, NULL);
+   pipe_resource_reference(&vbuf, NULL);
+   ctx->bind_vertex_elements_state(ctx, NULL);
+   ctx->delete_vertex_elements_state(ctx, velems_cso);
+   if (test->textured) {
+      ctx->set_sampler_views(ctx, PIPE_SHADER_FRAGMENT, 0, 0, 1, NULL);
+      pipe_sampler_view_reference(&view, NULL);
+      ctx->delete_sampler_state(ctx, sampler_cso);
+      pipe_resource_reference(&tex, NULL);
+   }
+   ctx->bind_fs_state(ctx, NULL);
+   ctx->delete_fs_state(ctx, fs);
+   ctx->bind_vs_state(ctx, NULL);
+   ctx->delete_vs_state(ctx, vs);
+   ctx->delete_depth_stencil_alpha_state(ctx, dsa_cso);
+   ctx->delete_blend_state(ctx, blend_cso);
+   ctx->delete_rasterizer_state(ctx, rast_cso);
+   memset(&fb, 0, sizeof fb);
+   ctx->set_framebuffer_state(ctx, &fb);
+   pipe_surface_reference(&surf, NULL);
+   pipe_resource_reference(&cbuf, NULL);
+   ctx->destroy(ctx);
+
+   return TRUE;
+}
+
+
+static boolean
+test_linear(struct pipe_screen *screen, unsigned verbose,
+            const struct linear_test_case *test)
+{
+   uint32_t *expected = MALLOC(WIDTH * HEIGHT * 4);
+   uint32_t *actual = MALLOC(WIDTH * HEIGHT * 4);
+   const unsigned tolerance = test->blend != LP_LINEAR_BLEND_NONE ||
+                              !test->textured ? 1 : 0;
+   unsigned errors = 0;
+   boolean success;
+   unsigned i, chan;
+
+   success = render(screen, test, FALSE, expected) &&
+             render(screen, test, TRUE, actual);
+
+#ifdef DEBUG
+   /* The counters are reset per context, so this is the second render. */
+   if (success && !LP_COUNT_GET(nr_linear_4)) {
+      printf("%s: linear path not taken\n", test->name);
+      success = FALSE;
+   }
+#endif
+
+   for (i = 0; i < WIDTH * HEIGHT && success; i++) {
+      for (chan = 0; chan < 4; chan++) {
+         int e = (expected[i] >> (8 * chan)) & 0xff;
+         int a = (actual[i] >> (8 * chan)) & 0xff;
+
+         if (abs(e - a) > tolerance) {
+            if (errors++ < 4) {
+               printf("%s: pixel %u, %u is 0x%08x, expected 0x%08x\n",
+                      test->name, i % WIDTH, i / WIDTH,
+                      actual[i], expected[i]);
+            }
+            break;
+         }
+      }
+   }
+
+   if (errors) {
+      printf("%s: %u pixels differ\n", test->name, errors);
+      success = FALSE;
+   }
+   else if (verbose && success) {
+      printf("%s: ok\n", test->name);
+   }
+
+   FREE(actual);
+   FREE(expected);
+   return success;
+}
+
+
+void
+write_tsv_header(FILE *fp)
+{
+   fprintf(fp,
+           "result\t"
+           "format\n");
+
+   fflush(fp);
+}
+
+
+boolean
+test_all(unsigned verbose, FILE *fp)
+{
+   struct sw_winsys *winsys = null_sw_create();
+   struct pipe_screen *screen;
+   int perf;
+   boolean success = TRUE;
+   unsigned i;
+
+   if (!winsys)
+      return FALSE;
+
+   screen = llvmpipe_create_screen(winsys);
+   if (!screen) {
+      winsys->destroy(winsys);
+      return FALSE;
+   }
+
+   /* The screen has parsed LP_PERF from the environment by now. */
+   perf = LP_PERF;
+
+   for (i = 0; i < ARRAY_SIZE(test_cases); i++) {
+      if (!test_linear(screen, verbose, &test_cases[i]))
+         success = FALSE;
+   }
+
+   LP_PERF = perf;
+   /* This destroys the winsys too. */
+   screen->destroy(screen);
+
+   return success;
+}
+
+
+boolean
+test_some(unsigned verbose, FILE *fp,
+          unsigned long n)
+{
+   return test_all(verbose, fp);
+}
+
+
+boolean
+test_single(unsigned verbose, FILE *fp)
+{
+   printf("no test_single()");
+   return TRUE;
+}
@@ -38,11 +38,14 @@
 #include "util/u_inlines.h"
 #include "util/u_cpu_detect.h"
 #include "util/format/u_format.h"
+#include "util/u_atomic.h"
 #include "util/u_math.h"
 #include "util/u_memory.h"
 #include "util/simple_list.h"
 #include "util/u_transfer.h"
 
+#include "draw/draw_context.h"
+
 #include "lp_context.h"
 #include "lp_flush.h"
 #include "lp_screen.h"
@@ -70,7 +73,7 @@ llvmpipe_texture_layout(struct llvmpipe_screen *screen,
                         struct llvmpipe_resource *lpr,
                         boolean allocate)
 {
-   struct pipe_resource *pt = &lpr->base;
+   struct pipe_resource *pt = &lpr->base.b;
    unsigned level;
    unsigned width = pt->width0;
    unsigned height = pt->height0;
@@ -109,7 +112,7 @@ llvmpipe_texture_layout(struct llvmpipe_screen *screen,
          align_x = align_y = 1;
       else {
          align_x = LP_RASTER_BLOCK_SIZE;
-         if (llvmpipe_resource_is_1d(&lpr->base))
+         if (llvmpipe_resource_is_1d(&lpr->base.b))
             align_y = 1;
          else
             align_y = LP_RASTER_BLOCK_SIZE;
@@ -135,16 +138,16 @@ llvmpipe_texture_layout(struct llvmpipe_screen *screen,
       lpr->img_stride[level] = lpr->row_stride[level] * nblocksy;
 
       /* Number of 3D image slices, cube faces or texture array layers */
-      if (lpr->base.target == PIPE_TEXTURE_CUBE) {
+      if (lpr->base.b.target == PIPE_TEXTURE_CUBE) {
          assert(layers == 6);
       }
 
-      if (lpr->base.target == PIPE_TEXTURE_3D)
+      if (lpr->base.b.target == PIPE_TEXTURE_3D)
          num_slices = depth;
-      else if (lpr->base.target == PIPE_TEXTURE_1D_ARRAY ||
-               lpr->base.target == PIPE_TEXTURE_2D_ARRAY ||
-               lpr->base.target == PIPE_TEXTURE_CUBE ||
-               lpr->base.target == PIPE_TEXTURE_CUBE_ARRAY)
+      else if (lpr->base.b.target == PIPE_TEXTURE_1D_ARRAY ||
+               lpr->base.b.target == PIPE_TEXTURE_2D_ARRAY ||
+               lpr->base.b.target == PIPE_TEXTURE_CUBE ||
+               lpr->base.b.target == PIPE_TEXTURE_CUBE_ARRAY)
          num_slices = layers;
       else
          num_slices = 1;
@@ -200,7 +203,7 @@ llvmpipe_can_create_resource(struct pipe_screen *screen,
 {
    struct llvmpipe_resource lpr;
    memset(&lpr, 0, sizeof(lpr));
-   lpr.base = *res;
+   lpr.base.b = *res;
    return llvmpipe_texture_layout(llvmpipe_screen(screen), &lpr, false);
 }
 
@@ -215,12 +218,12 @@ llvmpipe_displaytarget_layout(struct llvmpipe_screen *screen,
    /* Round up the surface size to a multiple of the tile size to
     * avoid tile clipping.
     */
-   const unsigned width = MAX2(1, align(lpr->base.width0, TILE_SIZE));
-   const unsigned height = MAX2(1, align(lpr->base.height0, TILE_SIZE));
+   const unsigned width = MAX2(1, align(lpr->base.b.width0, TILE_SIZE));
+   const unsigned height = MAX2(1, align(lpr->base.b.height0, TILE_SIZE));
 
    lpr->dt = winsys->displaytarget_create(winsys,
-                                          lpr->base.bind,
-                                          lpr->base.format,
+                                          lpr->base.b.bind,
+                                          lpr->base.b.format,
                                           width, height,
                                           64,
                                           map_front_private,
@@ -253,14 +256,14 @@ llvmpipe_resource_create_all(struct pipe_screen *_screen,
    if (!lpr)
       return NULL;
 
-   lpr->base = *templat;
-   pipe_reference_init(&lpr->base.reference, 1);
-   lpr->base.screen = &screen->base;
+   lpr->base.b = *templat;
+   pipe_reference_init(&lpr->base.b.reference, 1);
+   lpr->base.b.screen = &screen->base;
 
-   /* assert(lpr->base.bind); */
+   /* assert(lpr->base.b.bind); */
 
-   if (llvmpipe_resource_is_texture(&lpr->base)) {
-      if (lpr->base.bind & (PIPE_BIND_DISPLAY_TARGET |
+   if (llvmpipe_resource_is_texture(&lpr->base.b)) {
+      if (lpr->base.b.bind & (PIPE_BIND_DISPLAY_TARGET |
                             PIPE_BIND_SCANOUT |
                             PIPE_BIND_SHARED)) {
          /* displayable surface */
@@ -307,13 +310,15 @@ llvmpipe_resource_create_all(struct pipe_screen *_screen,
 
    lpr->id = id_counter++;
 
+   threaded_resource_init(&lpr->base.b);
+
 #ifdef DEBUG
    mtx_lock(&resource_list_mutex);
    insert_at_tail(&resource_list, lpr);
    mtx_unlock(&resource_list_mutex);
 #endif
 
-   return &lpr->base;
+   return &lpr->base.b;
 
  fail:
    FREE(lpr);
@@ -347,6 +352,8 @@ llvmpipe_resource_create_unbacked(struct pipe_screen *_screen,
       return pt;
    lpr = llvmpipe_resource(pt);
    lpr->backable = true;
+   /* The storage is bound later and must never be reallocated. */
+   lpr->base.is_shared = true;
    *size_required = lpr->size_required;
    return pt;
 }
@@ -358,7 +365,13 @@ llvmpipe_resource_destroy(struct pipe_screen *pscreen,
    struct llvmpipe_screen *screen = llvmpipe_screen(pscreen);
    struct llvmpipe_resource *lpr = llvmpipe_resource(pt);
 
-   if (!lpr->backable) {
+   threaded_resource_deinit(pt);
+
+   if (lpr->storage) {
+      /* data belongs to the buffer it was taken from */
+      pipe_resource_reference(&lpr->storage, NULL);
+   }
+   else if (!lpr->backable) {
       if (lpr->dt) {
          /* display target */
          struct sw_winsys *winsys = screen->winsys;
@@ -491,17 +504,17 @@ llvmpipe_resource_from_handle(struct pipe_screen *screen,
       goto no_lpr;
    }
 
-   lpr->base = *template;
-   pipe_reference_init(&lpr->base.reference, 1);
-   lpr->base.screen = screen;
+   lpr->base.b = *template;
+   pipe_reference_init(&lpr->base.b.reference, 1);
+   lpr->base.b.screen = screen;
 
    /*
     * Looks like unaligned displaytargets work just fine,
     * at least sampler/render ones.
     */
 #if 0
-   assert(lpr->base.width0 == width);
-   assert(lpr->base.height0 == height);
+   assert(lpr->base.b.width0 == width);
+   assert(lpr->base.b.height0 == height);
 #endif
 
    lpr->dt = winsys->displaytarget_from_handle(winsys,
@@ -514,13 +527,16 @@ llvmpipe_resource_from_handle(struct pipe_screen *screen,
 
    lpr->id = id_counter++;
 
+   threaded_resource_init(&lpr->base.b);
+   lpr->base.is_shared = true;
+
 #ifdef DEBUG
    mtx_lock(&resource_list_mutex);
    insert_at_tail(&resource_list, lpr);
    mtx_unlock(&resource_list_mutex);
 #endif
 
-   return &lpr->base;
+   return &lpr->base.b;
 
 no_dt:
    FREE(lpr);
@@ -556,7 +572,6 @@ llvmpipe_transfer_map_ms( struct pipe_context *pipe,
                           const struct pipe_box *box,
                           struct pipe_transfer **transfer )
 {
-   struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
    struct llvmpipe_screen *screen = llvmpipe_screen(pipe->screen);
    struct llvmpipe_resource *lpr = llvmpipe_resource(resource);
    struct llvmpipe_transfer *lpt;
@@ -590,23 +605,10 @@ llvmpipe_transfer_map_ms( struct pipe_context *pipe,
       }
    }
 
-   /* Check if we're mapping a current constant buffer */
-   if ((usage & PIPE_MAP_WRITE) &&
-       (resource->bind & PIPE_BIND_CONSTANT_BUFFER)) {
-      unsigned i;
-      for (i = 0; i < ARRAY_SIZE(llvmpipe->constants[PIPE_SHADER_FRAGMENT]); ++i) {
-         if (resource == llvmpipe->constants[PIPE_SHADER_FRAGMENT][i].buffer) {
-            /* constants may have changed */
-            llvmpipe->dirty |= LP_NEW_FS_CONSTANTS;
-            break;
-         }
-      }
-   }
-
    lpt = CALLOC_STRUCT(llvmpipe_transfer);
    if (!lpt)
       return NULL;
-   pt = &lpt->base;
+   pt = &lpt->base.b;
    pipe_resource_reference(&pt->resource, resource);
    pt->box = *box;
    pt->level = level;
@@ -638,7 +640,7 @@ llvmpipe_transfer_map_ms( struct pipe_context *pipe,
       printf("transfer map tex %u  mode %s\n", lpr->id, mode);
    }
 
-   format = lpr->base.format;
+   format = lpr->base.b.format;
 
    map = llvmpipe_resource_map(resource,
                                level,
@@ -653,6 +655,10 @@ llvmpipe_transfer_map_ms( struct pipe_context *pipe,
       /* Do something to notify sharing contexts of a texture change.
        */
       screen->timestamp++;
+
+      if ((usage & PIPE_MAP_PERSISTENT) &&
+          (resource->bind & PIPE_BIND_CONSTANT_BUFFER))
+         p_atomic_inc(&lpr->persistent_write_maps);
    }
 
    map +=
@@ -680,6 +686,19 @@ llvmpipe_transfer_unmap(struct pipe_context *pipe,
 {
    assert(transfer->resource);
 
+   /* Don't touch the context here: the threaded context calls this from
+    * the application thread for PIPE_MAP_THREAD_SAFE transfers.  Written
+    * constant buffers are picked up by the next draw instead.
+    */
+   if ((transfer->usage & PIPE_MAP_WRITE) &&
+       (transfer->resource->bind & PIPE_BIND_CONSTANT_BUFFER)) {
+      struct llvmpipe_resource *lpr = llvmpipe_resource(transfer->resource);
+
+      if (transfer->usage & PIPE_MAP_PERSISTENT)
+         p_atomic_dec(&lpr->persistent_write_maps);
+      p_atomic_inc(&lpr->constant_writes);
+   }
+
    llvmpipe_resource_unmap(transfer->resource,
                            transfer->level,
                            transfer->box.z);
@@ -710,6 +729,128 @@ llvmpipe_is_resource_referenced( struct pipe_context *pipe,
 }
 
 
+/**
+ * Update the bindings which cache the storage of the given buffer.
+ * Vertex, index and vertex stage texture/image data is looked up at
+ * each draw; everything else is either re-mapped here or marked dirty.
+ */
+static void
+llvmpipe_rebind_buffer(struct llvmpipe_context *llvmpipe,
+                       struct pipe_resource *buffer)
+{
+   ubyte *data = llvmpipe_resource(buffer)->data;
+   boolean so_rebound = FALSE;
+   unsigned sh, i;
+
+   for (sh = 0; sh < PIPE_SHADER_TYPES; sh++) {
+      const boolean draw_stage = sh != PIPE_SHADER_FRAGMENT &&
+                                 sh != PIPE_SHADER_COMPUTE;
+
+      for (i = 0; i < ARRAY_SIZE(llvmpipe->constants[sh]); i++) {
+         const struct pipe_constant_buffer *cb = &llvmpipe->constants[sh][i];
+
+         if (cb->buffer != buffer)
+            continue;
+
+         if (draw_stage)
+            draw_set_mapped_constant_buffer(llvmpipe->draw, sh, i,
+                                            data + cb->buffer_offset,
+                                            cb->buffer_size);
+         else if (sh == PIPE_SHADER_COMPUTE)
+            llvmpipe->cs_dirty |= LP_CSNEW_CONSTANTS;
+         else
+            llvmpipe->dirty |= LP_NEW_FS_CONSTANTS;
+      }
+
+      for (i = 0; i < ARRAY_SIZE(llvmpipe->ssbos[sh]); i++) {
+         const struct pipe_shader_buffer *sb = &llvmpipe->ssbos[sh][i];
+
+         if (sb->buffer != buffer)
+            continue;
+
+         if (draw_stage)
+            draw_set_mapped_shader_buffer(llvmpipe->draw, sh, i,
+                                          data + sb->buffer_offset,
+                                          sb->buffer_size);
+         else if (sh == PIPE_SHADER_COMPUTE)
+            llvmpipe->cs_dirty |= LP_CSNEW_SSBOS;
+         else
+            llvmpipe->dirty |= LP_NEW_FS_SSBOS;
+      }
+
+      if (draw_stage)
+         continue;
+
+      for (i = 0; i < ARRAY_SIZE(llvmpipe->images[sh]); i++) {
+         if (llvmpipe->images[sh][i].resource != buffer)
+            continue;
+
+         if (sh == PIPE_SHADER_COMPUTE)
+            llvmpipe->cs_dirty |= LP_CSNEW_IMAGES;
+         else
+            llvmpipe->dirty |= LP_NEW_FS_IMAGES;
+      }
+
+      for (i = 0; i < ARRAY_SIZE(llvmpipe->sampler_views[sh]); i++) {
+         if (!llvmpipe->sampler_views[sh][i] ||
+             llvmpipe->sampler_views[sh][i]->texture != buffer)
+            continue;
+
+         if (sh == PIPE_SHADER_COMPUTE)
+            llvmpipe->cs_dirty |= LP_CSNEW_SAMPLER_VIEW;
+         else
+            llvmpipe->dirty |= LP_NEW_SAMPLER_VIEW;
+      }
+   }
+
+   for (i = 0; i < llvmpipe->num_so_targets; i++) {
+      struct draw_so_target *target = llvmpipe->so_targets[i];
+
+      if (target && target->target.buffer == buffer) {
+         target->mapping = data;
+         so_rebound = TRUE;
+      }
+   }
+
+   if (so_rebound)
+      draw_set_mapped_so_targets(llvmpipe->draw, llvmpipe->num_so_targets,
+                                 llvmpipe->so_targets);
+}
+
+
+/**
+ * Replace the storage of dst with that of src, for the threaded context's
+ * buffer invalidation.  The threaded context may keep mapping src without
+ * synchronization afterwards, so both buffers share the storage: dst keeps
+ * a reference to the buffer owning it.
+ */
+void
+llvmpipe_replace_buffer_storage(struct pipe_context *pipe,
+                                struct pipe_resource *dst,
+                                struct pipe_resource *src)
+{
+   struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
+   struct llvmpipe_resource *lpr_dst = llvmpipe_resource(dst);
+   struct llvmpipe_resource *lpr_src = llvmpipe_resource(src);
+
+   assert(dst->target == PIPE_BUFFER && src->target == PIPE_BUFFER);
+   assert(!lpr_dst->userBuffer && !lpr_dst->backable);
+
+   /* Scenes in flight may still access the old storage. */
+   llvmpipe_flush_resource(pipe, dst, 0, FALSE, TRUE, FALSE, __FUNCTION__);
+   draw_flush(llvmpipe->draw);
+
+   if (!lpr_dst->storage)
+      align_free(lpr_dst->data);
+
+   pipe_resource_reference(&lpr_dst->storage,
+                           lpr_src->storage ? lpr_src->storage : src);
+   lpr_dst->data = lpr_src->data;
+
+   llvmpipe_rebind_buffer(llvmpipe, dst);
+}
+
+
 /**
  * Returns the largest possible alignment for a format in llvmpipe
  */
@@ -755,20 +896,25 @@ llvmpipe_user_buffer_create(struct pipe_screen *screen,
    if (!buffer)
       return NULL;
 
-   pipe_reference_init(&buffer->base.reference, 1);
-   buffer->base.screen = screen;
-   buffer->base.format = PIPE_FORMAT_R8_UNORM; /* ?? */
-   buffer->base.bind = bind_flags;
-   buffer->base.usage = PIPE_USAGE_IMMUTABLE;
-   buffer->base.flags = 0;
-   buffer->base.width0 = bytes;
-   buffer->base.height0 = 1;
-   buffer->base.depth0 = 1;
-   buffer->base.array_size = 1;
+   pipe_reference_init(&buffer->base.b.reference, 1);
+   buffer->base.b.screen = screen;
+   buffer->base.b.format = PIPE_FORMAT_R8_UNORM; /* ?? */
+   buffer->base.b.bind = bind_flags;
+   buffer->base.b.usage = PIPE_USAGE_IMMUTABLE;
+   buffer->base.b.flags = 0;
+   buffer->base.b.width0 = bytes;
+   buffer->base.b.height0 = 1;
+   buffer->base.b.depth0 = 1;
+   buffer->base.b.array_size = 1;
    buffer->userBuffer = TRUE;
    buffer->data = ptr;
 
-   return &buffer->base;
+   threaded_resource_init(&buffer->base.b);
+   buffer->base.is_user_ptr = true;
+   util_range_add(&buffer->base.b, &buffer->base.valid_buffer_range,
+                  0, bytes);
+
+   return &buffer->base.b;
 }
 
 
@@ -793,7 +939,7 @@ llvmpipe_get_texture_image_address(struct llvmpipe_resource *lpr,
 {
    unsigned offset;
 
-   assert(llvmpipe_resource_is_texture(&lpr->base));
+   assert(llvmpipe_resource_is_texture(&lpr->base.b));
 
    offset = lpr->mip_offsets[level];
 
@@ -852,7 +998,7 @@ static void llvmpipe_resource_bind_backing(struct pipe_screen *screen,
    if (!lpr->backable)
       return;
 
-   if (llvmpipe_resource_is_texture(&lpr->base))
+   if (llvmpipe_resource_is_texture(&lpr->base.b))
       lpr->tex_data = (char *)pmem + offset;
    else
       lpr->data = (char *)pmem + offset;
@@ -880,11 +1026,11 @@ llvmpipe_print_resources(void)
    debug_printf("LLVMPIPE: current resources:\n");
    mtx_lock(&resource_list_mutex);
    foreach(lpr, &resource_list) {
-      unsigned size = llvmpipe_resource_size(&lpr->base);
+      unsigned size = llvmpipe_resource_size(&lpr->base.b);
       debug_printf("resource %u at %p, size %ux%ux%u: %u bytes, refcount %u\n",
                    lpr->id, (void *) lpr,
-                   lpr->base.width0, lpr->base.height0, lpr->base.depth0,
-                   size, lpr->base.reference.count);
+                   lpr->base.b.width0, lpr->base.b.height0, lpr->base.b.depth0,
+                   size, lpr->base.b.reference.count);
       total += size;
       n++;
    }
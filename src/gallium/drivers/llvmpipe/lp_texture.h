@@ -31,6 +31,7 @@
 
 #include "pipe/p_state.h"
 #include "util/u_debug.h"
+#include "util/u_threaded_context.h"
 #include "lp_limits.h"
 
 
@@ -58,7 +59,7 @@ struct sw_displaytarget;
  */
 struct llvmpipe_resource
 {
-   struct pipe_resource base;
+   struct threaded_resource base;
 
    /** Row stride in bytes */
    unsigned row_stride[LP_MAX_TEXTURE_LEVELS];
@@ -85,9 +86,24 @@ struct llvmpipe_resource
     */
    void *data;
 
+   /**
+    * Buffer owning "data", when the storage of this buffer was replaced
+    * by the threaded context's buffer invalidation.
+    */
+   struct pipe_resource *storage;
+
    boolean userBuffer;  /** Is this a user-space buffer? */
    unsigned timestamp;
 
+   /**
+    * Constant buffer writes, checked at draw time by
+    * llvmpipe_check_fs_constants().  Bumped on every write unmap, while
+    * persistent write maps are counted since they can be written at any
+    * time.
+    */
+   unsigned constant_writes;
+   unsigned persistent_write_maps;
+
    unsigned id;  /**< temporary, for debugging */
 
    unsigned sample_stride;
@@ -104,7 +120,7 @@ struct llvmpipe_resource
 
 struct llvmpipe_transfer
 {
-   struct pipe_transfer base;
+   struct threaded_transfer base;
 
    unsigned long offset;
 };
@@ -247,6 +263,11 @@ llvmpipe_is_resource_referenced( struct pipe_context *pipe,
 unsigned
 llvmpipe_get_format_alignment(enum pipe_format format);
 
+void
+llvmpipe_replace_buffer_storage(struct pipe_context *pipe,
+                                struct pipe_resource *dst,
+                                struct pipe_resource *src);
+
 void *
 llvmpipe_transfer_map_ms( struct pipe_context *pipe,
 			  struct pipe_resource *resource,
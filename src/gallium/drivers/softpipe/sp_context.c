@@ -37,6 +37,7 @@
 #include "util/u_memory.h"
 #include "util/u_pstipple.h"
 #include "util/u_inlines.h"
+#include "util/u_threaded_context.h"
 #include "util/u_upload_mgr.h"
 #include "tgsi/tgsi_exec.h"
 #include "sp_buffer.h"
@@ -362,7 +363,16 @@ softpipe_create_context(struct pipe_screen *screen,
    softpipe->pstipple.sampler = util_pstipple_create_sampler(&softpipe->pipe);
 #endif
 
-   return &softpipe->pipe;
+   if (!(flags & PIPE_CONTEXT_PREFER_THREADED) ||
+       (flags & PIPE_CONTEXT_COMPUTE_ONLY))
+      return &softpipe->pipe;
+
+   /* Run state validation and rendering on a driver thread (disable with
+    * GALLIUM_THREAD=0).
+    */
+   return threaded_context_create(&softpipe->pipe, &sp_screen->transfer_pool,
+                                  softpipe_replace_buffer_storage,
+                                  NULL, NULL);
 
  fail:
    softpipe_destroy(&softpipe->pipe);
@@ -38,14 +38,14 @@ get_image_offset(const struct softpipe_resource *spr,
 {
    int base_layer = 0;
 
-   if (spr->base.target == PIPE_BUFFER)
+   if (spr->base.b.target == PIPE_BUFFER)
       return iview->u.buf.offset;
 
-   if (spr->base.target == PIPE_TEXTURE_1D_ARRAY ||
-       spr->base.target == PIPE_TEXTURE_2D_ARRAY ||
-       spr->base.target == PIPE_TEXTURE_CUBE_ARRAY ||
-       spr->base.target == PIPE_TEXTURE_CUBE ||
-       spr->base.target == PIPE_TEXTURE_3D)
+   if (spr->base.b.target == PIPE_TEXTURE_1D_ARRAY ||
+       spr->base.b.target == PIPE_TEXTURE_2D_ARRAY ||
+       spr->base.b.target == PIPE_TEXTURE_CUBE_ARRAY ||
+       spr->base.b.target == PIPE_TEXTURE_CUBE ||
+       spr->base.b.target == PIPE_TEXTURE_3D)
       base_layer = r_coord + iview->u.tex.first_layer;
    return softpipe_get_tex_image_offset(spr, iview->u.tex.level, base_layer);
 }
@@ -161,23 +161,23 @@ get_dimensions(const struct pipe_image_view *iview,
        * and the buffer size from the underlying buffer.
        */
       if (util_format_get_stride(pformat, *width) >
-          util_format_get_stride(spr->base.format, spr->base.width0))
+          util_format_get_stride(spr->base.b.format, spr->base.b.width0))
          return false;
    } else {
       unsigned level;
 
-      level = spr->base.target == PIPE_BUFFER ? 0 : iview->u.tex.level;
-      *width = u_minify(spr->base.width0, level);
-      *height = u_minify(spr->base.height0, level);
+      level = spr->base.b.target == PIPE_BUFFER ? 0 : iview->u.tex.level;
+      *width = u_minify(spr->base.b.width0, level);
+      *height = u_minify(spr->base.b.height0, level);
 
-      if (spr->base.target == PIPE_TEXTURE_3D)
-         *depth = u_minify(spr->base.depth0, level);
+      if (spr->base.b.target == PIPE_TEXTURE_3D)
+         *depth = u_minify(spr->base.b.depth0, level);
       else
-         *depth = spr->base.array_size;
+         *depth = spr->base.b.array_size;
 
       /* Make sure the resource and view have compatible formats */
       if (util_format_get_blocksize(pformat) >
-          util_format_get_blocksize(spr->base.format))
+          util_format_get_blocksize(spr->base.b.format))
          return false;
    }
    return true;
@@ -224,7 +224,7 @@ sp_tgsi_load(const struct tgsi_image *image,
    if (!spr)
       goto fail_write_all_zero;
 
-   if (!has_compat_target(spr->base.target, params->tgsi_tex_instr))
+   if (!has_compat_target(spr->base.b.target, params->tgsi_tex_instr))
       goto fail_write_all_zero;
 
    if (!get_dimensions(iview, spr, params->tgsi_tex_instr,
@@ -307,11 +307,11 @@ sp_tgsi_store(const struct tgsi_image *image,
    spr = (struct softpipe_resource *)iview->resource;
    if (!spr)
       return;
-   if (!has_compat_target(spr->base.target, params->tgsi_tex_instr))
+   if (!has_compat_target(spr->base.b.target, params->tgsi_tex_instr))
       return;
 
    if (params->format == PIPE_FORMAT_NONE)
-      pformat = spr->base.format;
+      pformat = spr->base.b.format;
 
    if (!get_dimensions(iview, spr, params->tgsi_tex_instr,
                        pformat, &width, &height, &depth))
@@ -639,14 +639,14 @@ sp_tgsi_op(const struct tgsi_image *image,
    spr = (struct softpipe_resource *)iview->resource;
    if (!spr)
       goto fail_write_all_zero;
-   if (!has_compat_target(spr->base.target, params->tgsi_tex_instr))
+   if (!has_compat_target(spr->base.b.target, params->tgsi_tex_instr))
       goto fail_write_all_zero;
 
    if (!get_dimensions(iview, spr, params->tgsi_tex_instr,
                        params->format, &width, &height, &depth))
       goto fail_write_all_zero;
 
-   stride = util_format_get_stride(spr->base.format, width);
+   stride = util_format_get_stride(spr->base.b.format, width);
 
    for (j = 0; j < TGSI_QUAD_SIZE; j++) {
       int s_coord, t_coord, r_coord;
@@ -725,7 +725,7 @@ sp_tgsi_get_dims(const struct tgsi_image *image,
    }
 
    level = iview->u.tex.level;
-   dims[0] = u_minify(spr->base.width0, level);
+   dims[0] = u_minify(spr->base.b.width0, level);
    switch (params->tgsi_tex_instr) {
    case TGSI_TEXTURE_1D_ARRAY:
       dims[1] = iview->u.tex.last_layer - iview->u.tex.first_layer + 1;
@@ -738,14 +738,14 @@ sp_tgsi_get_dims(const struct tgsi_image *image,
    case TGSI_TEXTURE_2D:
    case TGSI_TEXTURE_CUBE:
    case TGSI_TEXTURE_RECT:
-      dims[1] = u_minify(spr->base.height0, level);
+      dims[1] = u_minify(spr->base.b.height0, level);
       return;
    case TGSI_TEXTURE_3D:
-      dims[1] = u_minify(spr->base.height0, level);
-      dims[2] = u_minify(spr->base.depth0, level);
+      dims[1] = u_minify(spr->base.b.height0, level);
+      dims[2] = u_minify(spr->base.b.depth0, level);
       return;
    case TGSI_TEXTURE_CUBE_ARRAY:
-      dims[1] = u_minify(spr->base.height0, level);
+      dims[1] = u_minify(spr->base.b.height0, level);
       dims[2] = (iview->u.tex.last_layer - iview->u.tex.first_layer + 1) / 6;
       break;
    default:
@@ -472,6 +472,8 @@ softpipe_destroy_screen( struct pipe_screen *screen )
    if(winsys->destroy)
       winsys->destroy(winsys);
 
+   slab_destroy_parent(&sp_screen->transfer_pool);
+
    FREE(screen);
 }
 
@@ -589,5 +591,8 @@ softpipe_create_screen(struct sw_winsys *winsys)
    softpipe_init_screen_texture_funcs(&screen->base);
    softpipe_init_screen_fence_funcs(&screen->base);
 
+   slab_create_parent(&screen->transfer_pool,
+                      sizeof(struct softpipe_transfer), 16);
+
    return &screen->base;
 }
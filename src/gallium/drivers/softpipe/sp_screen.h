@@ -33,6 +33,7 @@
 
 #include "pipe/p_screen.h"
 #include "pipe/p_defines.h"
+#include "util/slab.h"
 
 
 struct sw_winsys;
@@ -47,6 +48,9 @@ struct softpipe_screen {
     */
    unsigned timestamp;
    boolean use_llvm;
+
+   /* Threaded context transfers */
+   struct slab_parent_pool transfer_pool;
 };
 
 static inline struct softpipe_screen *
@@ -38,9 +38,12 @@
 #include "util/u_memory.h"
 #include "util/u_transfer.h"
 #include "util/u_surface.h"
+#include "draw/draw_context.h"
 
 #include "sp_context.h"
 #include "sp_flush.h"
+#include "sp_state.h"
+#include "sp_tex_tile_cache.h"
 #include "sp_texture.h"
 #include "sp_screen.h"
 
@@ -56,7 +59,7 @@ softpipe_resource_layout(struct pipe_screen *screen,
                          struct softpipe_resource *spr,
                          boolean allocate)
 {
-   struct pipe_resource *pt = &spr->base;
+   struct pipe_resource *pt = &spr->base.b;
    unsigned level;
    unsigned width = pt->width0;
    unsigned height = pt->height0;
@@ -118,7 +121,7 @@ softpipe_can_create_resource(struct pipe_screen *screen,
 {
    struct softpipe_resource spr;
    memset(&spr, 0, sizeof(spr));
-   spr.base = *res;
+   spr.base.b = *res;
    return softpipe_resource_layout(screen, &spr, FALSE);
 }
 
@@ -136,10 +139,10 @@ softpipe_displaytarget_layout(struct pipe_screen *screen,
    /* Round up the surface size to a multiple of the tile size?
     */
    spr->dt = winsys->displaytarget_create(winsys,
-                                          spr->base.bind,
-                                          spr->base.format,
-                                          spr->base.width0, 
-                                          spr->base.height0,
+                                          spr->base.b.bind,
+                                          spr->base.b.format,
+                                          spr->base.b.width0, 
+                                          spr->base.b.height0,
                                           64,
                                           map_front_private,
                                           &spr->stride[0] );
@@ -162,15 +165,15 @@ softpipe_resource_create_front(struct pipe_screen *screen,
 
    assert(templat->format != PIPE_FORMAT_NONE);
 
-   spr->base = *templat;
-   pipe_reference_init(&spr->base.reference, 1);
-   spr->base.screen = screen;
+   spr->base.b = *templat;
+   pipe_reference_init(&spr->base.b.reference, 1);
+   spr->base.b.screen = screen;
 
    spr->pot = (util_is_power_of_two_or_zero(templat->width0) &&
                util_is_power_of_two_or_zero(templat->height0) &&
                util_is_power_of_two_or_zero(templat->depth0));
 
-   if (spr->base.bind & (PIPE_BIND_DISPLAY_TARGET |
+   if (spr->base.b.bind & (PIPE_BIND_DISPLAY_TARGET |
 			 PIPE_BIND_SCANOUT |
 			 PIPE_BIND_SHARED)) {
       if (!softpipe_displaytarget_layout(screen, spr, map_front_private))
@@ -180,8 +183,10 @@ softpipe_resource_create_front(struct pipe_screen *screen,
       if (!softpipe_resource_layout(screen, spr, TRUE))
          goto fail;
    }
-    
-   return &spr->base;
+
+   threaded_resource_init(&spr->base.b);
+
+   return &spr->base.b;
 
  fail:
    FREE(spr);
@@ -202,7 +207,13 @@ softpipe_resource_destroy(struct pipe_screen *pscreen,
    struct softpipe_screen *screen = softpipe_screen(pscreen);
    struct softpipe_resource *spr = softpipe_resource(pt);
 
-   if (spr->dt) {
+   threaded_resource_deinit(pt);
+
+   if (spr->storage) {
+      /* data belongs to the buffer it was taken from */
+      pipe_resource_reference(&spr->storage, NULL);
+   }
+   else if (spr->dt) {
       /* display target */
       struct sw_winsys *winsys = screen->winsys;
       winsys->displaytarget_destroy(winsys, spr->dt);
@@ -227,9 +238,9 @@ softpipe_resource_from_handle(struct pipe_screen *screen,
    if (!spr)
       return NULL;
 
-   spr->base = *templat;
-   pipe_reference_init(&spr->base.reference, 1);
-   spr->base.screen = screen;
+   spr->base.b = *templat;
+   pipe_reference_init(&spr->base.b.reference, 1);
+   spr->base.b.screen = screen;
 
    spr->pot = (util_is_power_of_two_or_zero(templat->width0) &&
                util_is_power_of_two_or_zero(templat->height0) &&
@@ -242,7 +253,10 @@ softpipe_resource_from_handle(struct pipe_screen *screen,
    if (!spr->dt)
       goto fail;
 
-   return &spr->base;
+   threaded_resource_init(&spr->base.b);
+   spr->base.is_shared = true;
+
+   return &spr->base.b;
 
  fail:
    FREE(spr);
@@ -415,7 +429,7 @@ softpipe_transfer_map(struct pipe_context *pipe,
    if (!spt)
       return NULL;
 
-   pt = &spt->base;
+   pt = &spt->base.b;
 
    pipe_resource_reference(&pt->resource, resource);
    pt->level = level;
@@ -427,7 +441,7 @@ softpipe_transfer_map(struct pipe_context *pipe,
    spt->offset = softpipe_get_tex_image_offset(spr, level, box->z);
 
    spt->offset +=
-         box->y / util_format_get_blockheight(format) * spt->base.stride +
+         box->y / util_format_get_blockheight(format) * spt->base.b.stride +
          box->x / util_format_get_blockwidth(format) * util_format_get_blocksize(format);
 
    /* resources backed by display target treated specially:
@@ -492,20 +506,90 @@ softpipe_user_buffer_create(struct pipe_screen *screen,
    if (!spr)
       return NULL;
 
-   pipe_reference_init(&spr->base.reference, 1);
-   spr->base.screen = screen;
-   spr->base.format = PIPE_FORMAT_R8_UNORM; /* ?? */
-   spr->base.bind = bind_flags;
-   spr->base.usage = PIPE_USAGE_IMMUTABLE;
-   spr->base.flags = 0;
-   spr->base.width0 = bytes;
-   spr->base.height0 = 1;
-   spr->base.depth0 = 1;
-   spr->base.array_size = 1;
+   pipe_reference_init(&spr->base.b.reference, 1);
+   spr->base.b.screen = screen;
+   spr->base.b.format = PIPE_FORMAT_R8_UNORM; /* ?? */
+   spr->base.b.bind = bind_flags;
+   spr->base.b.usage = PIPE_USAGE_IMMUTABLE;
+   spr->base.b.flags = 0;
+   spr->base.b.width0 = bytes;
+   spr->base.b.height0 = 1;
+   spr->base.b.depth0 = 1;
+   spr->base.b.array_size = 1;
    spr->userBuffer = TRUE;
    spr->data = ptr;
 
-   return &spr->base;
+   threaded_resource_init(&spr->base.b);
+   spr->base.is_user_ptr = true;
+   util_range_add(&spr->base.b, &spr->base.valid_buffer_range, 0, bytes);
+
+   return &spr->base.b;
+}
+
+
+/**
+ * Replace the storage of dst with that of src, for the threaded context's
+ * buffer invalidation.  The threaded context may keep mapping src without
+ * synchronization afterwards, so both buffers share the storage: dst keeps
+ * a reference to the buffer owning it.  Bindings which cache a pointer to
+ * the old storage are updated.
+ */
+void
+softpipe_replace_buffer_storage(struct pipe_context *pipe,
+                                struct pipe_resource *dst,
+                                struct pipe_resource *src)
+{
+   struct softpipe_context *softpipe = softpipe_context(pipe);
+   struct softpipe_resource *spr_dst = softpipe_resource(dst);
+   struct softpipe_resource *spr_src = softpipe_resource(src);
+   const char *old_data = spr_dst->data;
+   char *data = spr_src->data;
+   unsigned sh, i;
+
+   assert(dst->target == PIPE_BUFFER && src->target == PIPE_BUFFER);
+   assert(!spr_dst->userBuffer);
+
+   draw_flush(softpipe->draw);
+
+   for (sh = 0; sh < PIPE_SHADER_TYPES; sh++) {
+      for (i = 0; i < ARRAY_SIZE(softpipe->constants[sh]); i++) {
+         const char *mapped = softpipe->mapped_constants[sh][i];
+
+         if (softpipe->constants[sh][i] != dst)
+            continue;
+
+         mapped = data + (mapped - old_data);
+         softpipe->mapped_constants[sh][i] = mapped;
+         if (sh == PIPE_SHADER_VERTEX || sh == PIPE_SHADER_GEOMETRY)
+            draw_set_mapped_constant_buffer(softpipe->draw, sh, i, mapped,
+                                            softpipe->const_buffer_size[sh][i]);
+         softpipe->dirty |= SP_NEW_CONSTANTS;
+      }
+
+      /* Buffer textures are read through the texture tile cache. */
+      for (i = 0; i < ARRAY_SIZE(softpipe->tex_cache[sh]); i++) {
+         struct softpipe_tex_tile_cache *tc = softpipe->tex_cache[sh][i];
+
+         if (tc && tc->texture == dst)
+            sp_flush_tex_tile_cache(tc);
+      }
+   }
+
+   for (i = 0; i < softpipe->num_so_targets; i++) {
+      if (softpipe->so_targets[i] &&
+          softpipe->so_targets[i]->target.buffer == dst)
+         softpipe->so_targets[i]->mapping = data;
+   }
+   draw_set_mapped_so_targets(softpipe->draw, softpipe->num_so_targets,
+                              softpipe->so_targets);
+
+   if (!spr_dst->storage)
+      align_free(spr_dst->data);
+
+   pipe_resource_reference(&spr_dst->storage,
+                           spr_src->storage ? spr_src->storage : src);
+   spr_dst->data = data;
+   spr_dst->timestamp++;
 }
 
 
@@ -171,9 +171,9 @@ zink_batch_reference_resource_rw(struct zink_batch *batch, struct zink_resource
    struct set_entry *entry = _mesa_set_search(batch->resources, res);
    if (!entry) {
       entry = _mesa_set_add(batch->resources, res);
-      pipe_reference(NULL, &res->base.reference);
+      pipe_reference(NULL, &res->base.b.reference);
       if (stencil)
-         pipe_reference(NULL, &stencil->base.reference);
+         pipe_reference(NULL, &stencil->base.b.reference);
    }
    /* multiple array entries are fine */
    if (res->persistent_maps)
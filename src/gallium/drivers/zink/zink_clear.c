@@ -204,8 +204,8 @@ zink_clear(struct pipe_context *pctx,
             }
             struct zink_resource *res = zink_resource(psurf->texture);
             union pipe_color_union color = *pcolor;
-            if (psurf->format != res->base.format &&
-                !util_format_is_srgb(psurf->format) && util_format_is_srgb(res->base.format)) {
+            if (psurf->format != res->base.b.format &&
+                !util_format_is_srgb(psurf->format) && util_format_is_srgb(res->base.b.format)) {
                /* if SRGB mode is disabled for the fb with a backing srgb image then we have to
                 * convert this to srgb color
                 */
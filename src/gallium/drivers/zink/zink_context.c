@@ -48,6 +48,7 @@
 #include "nir.h"
 
 #include "util/u_memory.h"
+#include "util/u_threaded_context.h"
 #include "util/u_upload_mgr.h"
 
 static void
@@ -89,6 +90,7 @@ zink_context_destroy(struct pipe_context *pctx)
    util_primconvert_destroy(ctx->primconvert);
    u_upload_destroy(pctx->stream_uploader);
    slab_destroy_child(&ctx->transfer_pool);
+   slab_destroy_child(&ctx->transfer_pool_unsync);
    _mesa_hash_table_destroy(ctx->program_cache, NULL);
    _mesa_hash_table_destroy(ctx->compute_program_cache, NULL);
    _mesa_hash_table_destroy(ctx->render_pass_cache, NULL);
@@ -607,7 +609,7 @@ zink_set_shader_buffers(struct pipe_context *pctx,
       struct pipe_shader_buffer *ssbo = &ctx->ssbos[p_stage][start_slot + i];
       if (buffers && buffers[i].buffer) {
          struct zink_resource *res = zink_resource(buffers[i].buffer);
-         pipe_resource_reference(&ssbo->buffer, &res->base);
+         pipe_resource_reference(&ssbo->buffer, &res->base.b);
          ssbo->buffer_offset = buffers[i].buffer_offset;
          ssbo->buffer_size = MIN2(buffers[i].buffer_size, res->size - ssbo->buffer_offset);
       } else {
@@ -658,7 +660,7 @@ zink_set_shader_images(struct pipe_context *pctx,
             tmpl.u.tex.level = images[i].u.tex.level;
             tmpl.u.tex.first_layer = images[i].u.tex.first_layer;
             tmpl.u.tex.last_layer = images[i].u.tex.last_layer;
-            image_view->surface = zink_surface(pctx->create_surface(pctx, &res->base, &tmpl));
+            image_view->surface = zink_surface(pctx->create_surface(pctx, &res->base.b, &tmpl));
             assert(image_view->surface);
          }
       } else if (image_view->base.resource)
@@ -758,7 +760,7 @@ get_render_pass(struct zink_context *ctx)
    if (fb->zsbuf) {
       struct zink_resource *zsbuf = zink_resource(fb->zsbuf->texture);
       state.rts[fb->nr_cbufs].format = zsbuf->format;
-      state.rts[fb->nr_cbufs].samples = zsbuf->base.nr_samples > 0 ? zsbuf->base.nr_samples : VK_SAMPLE_COUNT_1_BIT;
+      state.rts[fb->nr_cbufs].samples = zsbuf->base.b.nr_samples > 0 ? zsbuf->base.b.nr_samples : VK_SAMPLE_COUNT_1_BIT;
       state.num_rts++;
    }
    state.have_zsbuf = fb->zsbuf != NULL;
@@ -1183,7 +1185,7 @@ zink_resource_buffer_barrier(VkCommandBuffer cmdbuf, struct zink_resource *res,
       VK_QUEUE_FAMILY_IGNORED,
       res->buffer,
       res->offset,
-      res->base.width0
+      res->base.b.width0
    };
 
    vkCmdPipelineBarrier(
@@ -1445,10 +1447,10 @@ zink_resource_copy_region(struct pipe_context *pctx,
    struct zink_resource *dst = zink_resource(pdst);
    struct zink_resource *src = zink_resource(psrc);
    struct zink_context *ctx = zink_context(pctx);
-   if (dst->base.target != PIPE_BUFFER && src->base.target != PIPE_BUFFER) {
+   if (dst->base.b.target != PIPE_BUFFER && src->base.b.target != PIPE_BUFFER) {
       VkImageCopy region = {};
-      if (util_format_get_num_planes(src->base.format) == 1 &&
-          util_format_get_num_planes(dst->base.format) == 1) {
+      if (util_format_get_num_planes(src->base.b.format) == 1 &&
+          util_format_get_num_planes(dst->base.b.format) == 1) {
       /* If neither the calling command’s srcImage nor the calling command’s dstImage
        * has a multi-planar image format then the aspectMask member of srcSubresource
        * and dstSubresource must match
@@ -1462,7 +1464,7 @@ zink_resource_copy_region(struct pipe_context *pctx,
       region.srcSubresource.aspectMask = src->aspect;
       region.srcSubresource.mipLevel = src_level;
       region.srcSubresource.layerCount = 1;
-      if (src->base.array_size > 1) {
+      if (src->base.b.array_size > 1) {
          region.srcSubresource.baseArrayLayer = src_box->z;
          region.srcSubresource.layerCount = src_box->depth;
          region.extent.depth = 1;
@@ -1477,7 +1479,7 @@ zink_resource_copy_region(struct pipe_context *pctx,
 
       region.dstSubresource.aspectMask = dst->aspect;
       region.dstSubresource.mipLevel = dst_level;
-      if (dst->base.array_size > 1) {
+      if (dst->base.b.array_size > 1) {
          region.dstSubresource.baseArrayLayer = dstz;
          region.dstSubresource.layerCount = src_box->depth;
       } else {
@@ -1498,8 +1500,8 @@ zink_resource_copy_region(struct pipe_context *pctx,
       vkCmdCopyImage(batch->cmdbuf, src->image, src->layout,
                      dst->image, dst->layout,
                      1, &region);
-   } else if (dst->base.target == PIPE_BUFFER &&
-              src->base.target == PIPE_BUFFER) {
+   } else if (dst->base.b.target == PIPE_BUFFER &&
+              src->base.b.target == PIPE_BUFFER) {
       VkBufferCopy region;
       region.srcOffset = src_box->x;
       region.dstOffset = dstx;
@@ -1696,6 +1698,7 @@ zink_context_create(struct pipe_screen *pscreen, void *priv, unsigned flags)
    zink_context_query_init(&ctx->base);
 
    slab_create_child(&ctx->transfer_pool, &screen->transfer_pool);
+   slab_create_child(&ctx->transfer_pool_unsync, &screen->transfer_pool);
 
    ctx->base.stream_uploader = u_upload_create_default(&ctx->base);
    ctx->base.const_uploader = ctx->base.stream_uploader;
@@ -1763,7 +1766,16 @@ zink_context_create(struct pipe_screen *pscreen, void *priv, unsigned flags)
    /* start the first batch */
    zink_start_batch(ctx, zink_curr_batch(ctx));
 
-   return &ctx->base;
+   if (!(flags & PIPE_CONTEXT_PREFER_THREADED) ||
+       flags & PIPE_CONTEXT_COMPUTE_ONLY)
+      return &ctx->base;
+
+   /* Buffers are never invalidated by the threaded context (see
+    * resource_create), so no storage replacement callback is needed.
+    * GALLIUM_THREAD=0 disables the thread as usual.
+    */
+   return threaded_context_create(&ctx->base, &screen->transfer_pool,
+                                  NULL, NULL, NULL);
 
 fail:
    if (ctx) {
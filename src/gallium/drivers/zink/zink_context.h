@@ -98,6 +98,7 @@ zink_so_target(struct pipe_stream_output_target *so_target)
 struct zink_context {
    struct pipe_context base;
    struct slab_child_pool transfer_pool;
+   struct slab_child_pool transfer_pool_unsync; /* for threaded_context */
    struct blitter_context *blitter;
 
    struct pipe_device_reset_callback reset;
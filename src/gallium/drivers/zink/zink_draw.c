@@ -316,7 +316,7 @@ update_descriptors(struct zink_context *ctx, struct zink_screen *screen, bool is
                   res = psampler_view ? zink_resource(psampler_view->texture) : NULL;
                   if (!res)
                      break;
-                  if (res->base.target == PIPE_BUFFER)
+                  if (res->base.b.target == PIPE_BUFFER)
                      wds[num_wds].pTexelBufferView = &sampler_view->buffer_view;
                   else {
                      imageview =sampler_view->image_view;
@@ -383,7 +383,7 @@ update_descriptors(struct zink_context *ctx, struct zink_screen *screen, bool is
                   default:
                      unreachable("unknown descriptor type");
                   }
-               } else if (res->base.target != PIPE_BUFFER) {
+               } else if (res->base.b.target != PIPE_BUFFER) {
                   assert(layout != VK_IMAGE_LAYOUT_UNDEFINED);
                   image_infos[num_image_info].imageLayout = layout;
                   image_infos[num_image_info].imageView = imageview;
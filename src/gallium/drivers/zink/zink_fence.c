@@ -37,6 +37,7 @@ destroy_fence(struct zink_screen *screen, struct zink_fence *fence)
    if (fence->fence)
       vkDestroyFence(screen->dev, fence->fence, NULL);
    util_dynarray_fini(&fence->resources);
+   simple_mtx_destroy(&fence->resource_mtx);
    FREE(fence);
 }
 
@@ -53,6 +54,7 @@ zink_create_fence(struct pipe_screen *pscreen, struct zink_batch *batch)
       debug_printf("CALLOC_STRUCT failed\n");
       return NULL;
    }
+   simple_mtx_init(&ret->resource_mtx, mtx_plain);
 
    if (vkCreateFence(screen->dev, &fci, NULL, &ret->fence) != VK_SUCCESS) {
       debug_printf("vkCreateFence failed\n");
@@ -113,6 +115,7 @@ zink_fence_finish(struct zink_screen *screen, struct zink_fence *fence,
    bool success = vkWaitForFences(screen->dev, 1, &fence->fence, VK_TRUE,
                                   timeout_ns) == VK_SUCCESS;
    if (success) {
+      simple_mtx_lock(&fence->resource_mtx);
       if (fence->active_queries)
          zink_prune_queries(screen, fence);
 
@@ -128,6 +131,7 @@ zink_fence_finish(struct zink_screen *screen, struct zink_fence *fence,
          pipe_resource_reference(pres, NULL);
       }
       util_dynarray_clear(&fence->resources);
+      simple_mtx_unlock(&fence->resource_mtx);
    }
    return success;
 }
@@ -26,6 +26,7 @@
 
 #include "util/u_inlines.h"
 #include "util/u_dynarray.h"
+#include "util/simple_mtx.h"
 
 #include <vulkan/vulkan.h>
 
@@ -38,6 +39,7 @@ struct zink_fence {
    VkFence fence;
    struct set *active_queries; /* zink_query objects which were active at some point in this batch */
    struct util_dynarray resources;
+   simple_mtx_t resource_mtx; /* finishing may race between the app and driver threads */
 };
 
 static inline struct zink_fence *
@@ -14,6 +14,7 @@
 #define NUM_QUERIES 50
 
 struct zink_query {
+   struct threaded_query base;
    enum pipe_query_type type;
 
    VkQueryPool query_pool;
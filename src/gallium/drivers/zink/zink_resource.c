@@ -52,12 +52,14 @@ zink_resource_destroy(struct pipe_screen *pscreen,
 {
    struct zink_screen *screen = zink_screen(pscreen);
    struct zink_resource *res = zink_resource(pres);
-   if (pres->target == PIPE_BUFFER)
+   if (pres->target == PIPE_BUFFER) {
+      vkUnmapMemory(screen->dev, res->mem);
       vkDestroyBuffer(screen->dev, res->buffer, NULL);
-   else
+   } else
       vkDestroyImage(screen->dev, res->image, NULL);
 
    vkFreeMemory(screen->dev, res->mem, NULL);
+   threaded_resource_deinit(pres);
    FREE(res);
 }
 
@@ -103,10 +105,10 @@ resource_create(struct pipe_screen *pscreen,
    struct zink_screen *screen = zink_screen(pscreen);
    struct zink_resource *res = CALLOC_STRUCT(zink_resource);
 
-   res->base = *templ;
+   res->base.b = *templ;
 
-   pipe_reference_init(&res->base.reference, 1);
-   res->base.screen = pscreen;
+   pipe_reference_init(&res->base.b.reference, 1);
+   res->base.b.screen = pscreen;
 
    VkMemoryRequirements reqs = {};
    VkMemoryPropertyFlags flags;
@@ -344,23 +346,36 @@ resource_create(struct pipe_screen *pscreen,
    res->offset = 0;
    res->size = reqs.size;
 
-   if (templ->target == PIPE_BUFFER)
+   if (templ->target == PIPE_BUFFER) {
       vkBindBufferMemory(screen->dev, res->buffer, res->mem, res->offset);
-   else
+      if (vkMapMemory(screen->dev, res->mem, res->offset, res->size, 0,
+                      &res->map) != VK_SUCCESS) {
+         vkFreeMemory(screen->dev, res->mem, NULL);
+         goto fail;
+      }
+   } else
       vkBindImageMemory(screen->dev, res->image, res->mem, res->offset);
 
+   threaded_resource_init(&res->base.b);
+   /* The storage of a buffer can't be replaced underneath descriptors and
+    * buffer views which were already created for it, so don't let the
+    * threaded context invalidate buffers; discarding maps fall back to
+    * staging uploads instead.
+    */
+   res->base.is_shared = templ->target == PIPE_BUFFER || whandle;
+
    if (screen->winsys && (templ->bind & PIPE_BIND_DISPLAY_TARGET)) {
       struct sw_winsys *winsys = screen->winsys;
       res->dt = winsys->displaytarget_create(screen->winsys,
-                                             res->base.bind,
-                                             res->base.format,
+                                             res->base.b.bind,
+                                             res->base.b.format,
                                              templ->width0,
                                              templ->height0,
                                              64, NULL,
                                              &res->dt_stride);
    }
 
-   return &res->base;
+   return &res->base.b;
 
 fail:
    if (templ->target == PIPE_BUFFER)
@@ -390,7 +405,7 @@ zink_resource_get_handle(struct pipe_screen *pscreen,
    struct zink_resource *res = zink_resource(tex);
    struct zink_screen *screen = zink_screen(pscreen);
 
-   if (res->base.target != PIPE_BUFFER) {
+   if (res->base.b.target != PIPE_BUFFER) {
       VkImageSubresource sub_res = {};
       VkSubresourceLayout sub_res_layout = {};
 
@@ -461,21 +476,21 @@ zink_transfer_copy_bufimage(struct zink_context *ctx,
    copyRegion.bufferOffset = staging_res->offset;
    copyRegion.bufferRowLength = 0;
    copyRegion.bufferImageHeight = 0;
-   copyRegion.imageSubresource.mipLevel = trans->base.level;
+   copyRegion.imageSubresource.mipLevel = trans->base.b.level;
    copyRegion.imageSubresource.layerCount = 1;
-   if (res->base.array_size > 1) {
-      copyRegion.imageSubresource.baseArrayLayer = trans->base.box.z;
-      copyRegion.imageSubresource.layerCount = trans->base.box.depth;
+   if (res->base.b.array_size > 1) {
+      copyRegion.imageSubresource.baseArrayLayer = trans->base.b.box.z;
+      copyRegion.imageSubresource.layerCount = trans->base.b.box.depth;
       copyRegion.imageExtent.depth = 1;
    } else {
-      copyRegion.imageOffset.z = trans->base.box.z;
-      copyRegion.imageExtent.depth = trans->base.box.depth;
+      copyRegion.imageOffset.z = trans->base.b.box.z;
+      copyRegion.imageExtent.depth = trans->base.b.box.depth;
    }
-   copyRegion.imageOffset.x = trans->base.box.x;
-   copyRegion.imageOffset.y = trans->base.box.y;
+   copyRegion.imageOffset.x = trans->base.b.box.x;
+   copyRegion.imageOffset.y = trans->base.b.box.y;
 
-   copyRegion.imageExtent.width = trans->base.box.width;
-   copyRegion.imageExtent.height = trans->base.box.height;
+   copyRegion.imageExtent.width = trans->base.b.box.width;
+   copyRegion.imageExtent.height = trans->base.b.box.height;
 
    zink_batch_reference_resource_rw(batch, res, buf2img);
    zink_batch_reference_resource_rw(batch, staging_res, !buf2img);
@@ -484,14 +499,14 @@ zink_transfer_copy_bufimage(struct zink_context *ctx,
     * to indicate whether to copy either the depth or stencil aspects
     */
    unsigned aspects = 0;
-   assert((trans->base.usage & (PIPE_MAP_DEPTH_ONLY | PIPE_MAP_STENCIL_ONLY)) !=
+   assert((trans->base.b.usage & (PIPE_MAP_DEPTH_ONLY | PIPE_MAP_STENCIL_ONLY)) !=
           (PIPE_MAP_DEPTH_ONLY | PIPE_MAP_STENCIL_ONLY));
-   if (trans->base.usage & PIPE_MAP_DEPTH_ONLY)
+   if (trans->base.b.usage & PIPE_MAP_DEPTH_ONLY)
       aspects = VK_IMAGE_ASPECT_DEPTH_BIT;
-   else if (trans->base.usage & PIPE_MAP_STENCIL_ONLY)
+   else if (trans->base.b.usage & PIPE_MAP_STENCIL_ONLY)
       aspects = VK_IMAGE_ASPECT_STENCIL_BIT;
    else {
-      aspects = aspect_from_format(res->base.format);
+      aspects = aspect_from_format(res->base.b.format);
    }
    while (aspects) {
       int aspect = 1 << u_bit_scan(&aspects);
@@ -536,17 +551,22 @@ zink_transfer_map(struct pipe_context *pctx,
    struct zink_resource *res = zink_resource(pres);
    uint32_t batch_uses = zink_get_resource_usage(res);
 
-   struct zink_transfer *trans = slab_alloc(&ctx->transfer_pool);
+   struct zink_transfer *trans;
+
+   if (usage & TC_TRANSFER_MAP_THREADED_UNSYNC)
+      trans = slab_alloc(&ctx->transfer_pool_unsync);
+   else
+      trans = slab_alloc(&ctx->transfer_pool);
    if (!trans)
       return NULL;
 
    memset(trans, 0, sizeof(*trans));
-   pipe_resource_reference(&trans->base.resource, pres);
+   pipe_resource_reference(&trans->base.b.resource, pres);
 
-   trans->base.resource = pres;
-   trans->base.level = level;
-   trans->base.usage = usage;
-   trans->base.box = *box;
+   trans->base.b.resource = pres;
+   trans->base.b.level = level;
+   trans->base.b.usage = usage;
+   trans->base.b.box = *box;
 
    void *ptr;
    if (pres->target == PIPE_BUFFER) {
@@ -564,10 +584,7 @@ zink_transfer_map(struct pipe_context *pctx,
          }
       }
 
-
-      VkResult result = vkMapMemory(screen->dev, res->mem, res->offset, res->size, 0, &ptr);
-      if (result != VK_SUCCESS)
-         return NULL;
+      ptr = res->map;
 
 #if defined(__APPLE__)
       if (!(usage & PIPE_MAP_DISCARD_WHOLE_RESOURCE)) {
@@ -582,14 +599,14 @@ zink_transfer_map(struct pipe_context *pctx,
             res->offset,
             res->size
          };
-         result = vkFlushMappedMemoryRanges(screen->dev, 1, &range);
+         VkResult result = vkFlushMappedMemoryRanges(screen->dev, 1, &range);
          if (result != VK_SUCCESS)
             return NULL;
       }
 #endif
 
-      trans->base.stride = 0;
-      trans->base.layer_stride = 0;
+      trans->base.b.stride = 0;
+      trans->base.b.layer_stride = 0;
       ptr = ((uint8_t *)ptr) + box->x;
    } else {
       if (res->optimal_tiling || !res->host_visible) {
@@ -598,9 +615,9 @@ zink_transfer_map(struct pipe_context *pctx,
             format = util_format_get_depth_only(pres->format);
          else if (usage & PIPE_MAP_STENCIL_ONLY)
             format = PIPE_FORMAT_S8_UINT;
-         trans->base.stride = util_format_get_stride(format, box->width);
-         trans->base.layer_stride = util_format_get_2d_size(format,
-                                                            trans->base.stride,
+         trans->base.b.stride = util_format_get_stride(format, box->width);
+         trans->base.b.layer_stride = util_format_get_2d_size(format,
+                                                              trans->base.b.stride,
                                                             box->height);
 
          struct pipe_resource templ = *pres;
@@ -608,7 +625,7 @@ zink_transfer_map(struct pipe_context *pctx,
          templ.usage = PIPE_USAGE_STAGING;
          templ.target = PIPE_BUFFER;
          templ.bind = 0;
-         templ.width0 = trans->base.layer_stride * box->depth;
+         templ.width0 = trans->base.b.layer_stride * box->depth;
          templ.height0 = templ.depth0 = 0;
          templ.last_level = 0;
          templ.array_size = 1;
@@ -635,12 +652,8 @@ zink_transfer_map(struct pipe_context *pctx,
             zink_fence_wait(pctx);
          }
 
-         VkResult result = vkMapMemory(screen->dev, staging_res->mem,
-                                       staging_res->offset,
-                                       staging_res->size, 0, &ptr);
-         if (result != VK_SUCCESS)
-            return NULL;
-
+         /* buffers stay mapped for their whole lifetime */
+         ptr = staging_res->map;
       } else {
          assert(!res->optimal_tiling);
          if (batch_uses >= ZINK_RESOURCE_ACCESS_WRITE) {
@@ -658,9 +671,9 @@ zink_transfer_map(struct pipe_context *pctx,
          };
          VkSubresourceLayout srl;
          vkGetImageSubresourceLayout(screen->dev, res->image, &isr, &srl);
-         trans->base.stride = srl.rowPitch;
-         trans->base.layer_stride = srl.arrayPitch;
-         const struct util_format_description *desc = util_format_description(res->base.format);
+         trans->base.b.stride = srl.rowPitch;
+         trans->base.b.layer_stride = srl.arrayPitch;
+         const struct util_format_description *desc = util_format_description(res->base.b.format);
          unsigned offset = srl.offset +
                            box->z * srl.depthPitch +
                            (box->y / desc->block.height) * srl.rowPitch +
@@ -669,9 +682,9 @@ zink_transfer_map(struct pipe_context *pctx,
       }
    }
    if ((usage & PIPE_MAP_PERSISTENT) && !(usage & PIPE_MAP_COHERENT))
-      res->persistent_maps++;
+      p_atomic_inc(&res->persistent_maps);
 
-   *transfer = &trans->base;
+   *transfer = &trans->base.b;
    return ptr;
 }
 
@@ -685,9 +698,8 @@ zink_transfer_unmap(struct pipe_context *pctx,
    struct zink_transfer *trans = (struct zink_transfer *)ptrans;
    if (trans->staging_res) {
       struct zink_resource *staging_res = zink_resource(trans->staging_res);
-      vkUnmapMemory(screen->dev, staging_res->mem);
 
-      if (trans->base.usage & PIPE_MAP_WRITE) {
+      if (trans->base.b.usage & PIPE_MAP_WRITE) {
          struct zink_context *ctx = zink_context(pctx);
          uint32_t batch_uses = zink_get_resource_usage(res);
          if (batch_uses >= ZINK_RESOURCE_ACCESS_WRITE) {
@@ -699,12 +711,16 @@ zink_transfer_unmap(struct pipe_context *pctx,
       }
 
       pipe_resource_reference(&trans->staging_res, NULL);
-   } else
+   } else if (res->base.b.target != PIPE_BUFFER)
       vkUnmapMemory(screen->dev, res->mem);
-   if ((trans->base.usage & PIPE_MAP_PERSISTENT) && !(trans->base.usage & PIPE_MAP_COHERENT))
-      res->persistent_maps--;
+   if ((trans->base.b.usage & PIPE_MAP_PERSISTENT) && !(trans->base.b.usage & PIPE_MAP_COHERENT))
+      p_atomic_dec(&res->persistent_maps);
 
-   pipe_resource_reference(&trans->base.resource, NULL);
+   pipe_resource_reference(&trans->base.b.resource, NULL);
+
+   /* Don't use transfer_pool_unsync. We are always in the driver
+    * thread. Freeing an object into a different pool is allowed.
+    */
    slab_free(&ctx->transfer_pool, ptrans);
 }
 
@@ -29,6 +29,7 @@ struct sw_displaytarget;
 struct zink_batch;
 
 #include "util/u_transfer.h"
+#include "util/u_threaded_context.h"
 
 #include <vulkan/vulkan.h>
 
@@ -36,7 +37,7 @@ struct zink_batch;
 #define ZINK_RESOURCE_ACCESS_WRITE 32
 
 struct zink_resource {
-   struct pipe_resource base;
+   struct threaded_resource base;
 
    enum pipe_format internal_format:16;
 
@@ -58,6 +59,11 @@ struct zink_resource {
    VkDeviceMemory mem;
    VkDeviceSize offset, size;
 
+   /* buffers are host-visible and stay mapped for their whole lifetime, so
+    * that unsynchronized maps never need to call into vulkan
+    */
+   void *map;
+
    struct sw_displaytarget *dt;
    unsigned dt_stride;
    unsigned persistent_maps; //if nonzero, requires vkFlushMappedMemoryRanges during batch use
@@ -68,7 +74,7 @@ struct zink_resource {
 };
 
 struct zink_transfer {
-   struct pipe_transfer base;
+   struct threaded_transfer base;
    struct pipe_resource *staging_res;
 };
 
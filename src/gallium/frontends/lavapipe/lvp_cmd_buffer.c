@@ -41,7 +41,7 @@ static VkResult lvp_create_cmd_buffer(
                        VK_OBJECT_TYPE_COMMAND_BUFFER);
    cmd_buffer->device = device;
    cmd_buffer->pool = pool;
-   list_inithead(&cmd_buffer->cmds);
+   list_inithead(&cmd_buffer->cmd_blocks);
    cmd_buffer->status = LVP_CMD_BUFFER_STATUS_INITIAL;
    if (pool) {
       list_addtail(&cmd_buffer->pool_link, &pool->cmd_buffers);
@@ -59,17 +59,25 @@ static VkResult lvp_create_cmd_buffer(
 static void
 lvp_cmd_buffer_free_all_cmds(struct lvp_cmd_buffer *cmd_buffer)
 {
-   struct lvp_cmd_buffer_entry *tmp, *cmd;
-   LIST_FOR_EACH_ENTRY_SAFE(cmd, tmp, &cmd_buffer->cmds, cmd_link) {
-      list_del(&cmd->cmd_link);
-      vk_free(&cmd_buffer->pool->alloc, cmd);
+   list_for_each_entry_safe(struct lvp_cmd_block, block,
+                            &cmd_buffer->cmd_blocks, link) {
+      list_del(&block->link);
+      vk_free(&cmd_buffer->pool->alloc, block);
    }
 }
 
 static VkResult lvp_reset_cmd_buffer(struct lvp_cmd_buffer *cmd_buffer)
 {
-   lvp_cmd_buffer_free_all_cmds(cmd_buffer);
-   list_inithead(&cmd_buffer->cmds);
+   /* Keep the first block around for re-recording, free the rest. */
+   if (!list_is_empty(&cmd_buffer->cmd_blocks)) {
+      struct lvp_cmd_block *first =
+         list_first_entry(&cmd_buffer->cmd_blocks, struct lvp_cmd_block, link);
+
+      list_del(&first->link);
+      lvp_cmd_buffer_free_all_cmds(cmd_buffer);
+      first->used = 0;
+      list_add(&first->link, &cmd_buffer->cmd_blocks);
+   }
    cmd_buffer->status = LVP_CMD_BUFFER_STATUS_INITIAL;
    return VK_SUCCESS;
 }
@@ -262,19 +270,107 @@ VKAPI_ATTR void VKAPI_CALL lvp_TrimCommandPool(
    }
 }
 
+/* Size of the union member each command uses, so entries only take the
+ * space they need instead of the size of the largest command.
+ */
+static const uint16_t lvp_cmd_payload_size[] = {
+   [LVP_CMD_BIND_PIPELINE] = sizeof(struct lvp_cmd_bind_pipeline),
+   [LVP_CMD_SET_VIEWPORT] = sizeof(struct lvp_cmd_set_viewport),
+   [LVP_CMD_SET_SCISSOR] = sizeof(struct lvp_cmd_set_scissor),
+   [LVP_CMD_SET_LINE_WIDTH] = sizeof(struct lvp_cmd_set_line_width),
+   [LVP_CMD_SET_DEPTH_BIAS] = sizeof(struct lvp_cmd_set_depth_bias),
+   [LVP_CMD_SET_BLEND_CONSTANTS] = sizeof(struct lvp_cmd_set_blend_constants),
+   [LVP_CMD_SET_DEPTH_BOUNDS] = sizeof(struct lvp_cmd_set_depth_bounds),
+   [LVP_CMD_SET_STENCIL_COMPARE_MASK] = sizeof(struct lvp_cmd_set_stencil_vals),
+   [LVP_CMD_SET_STENCIL_WRITE_MASK] = sizeof(struct lvp_cmd_set_stencil_vals),
+   [LVP_CMD_SET_STENCIL_REFERENCE] = sizeof(struct lvp_cmd_set_stencil_vals),
+   [LVP_CMD_BIND_DESCRIPTOR_SETS] = sizeof(struct lvp_cmd_bind_descriptor_sets),
+   [LVP_CMD_BIND_INDEX_BUFFER] = sizeof(struct lvp_cmd_bind_index_buffer),
+   [LVP_CMD_BIND_VERTEX_BUFFERS] = sizeof(struct lvp_cmd_bind_vertex_buffers),
+   [LVP_CMD_DRAW] = sizeof(struct lvp_cmd_draw),
+   [LVP_CMD_DRAW_INDEXED] = sizeof(struct lvp_cmd_draw_indexed),
+   [LVP_CMD_DRAW_INDIRECT] = sizeof(struct lvp_cmd_draw_indirect),
+   [LVP_CMD_DRAW_INDEXED_INDIRECT] = sizeof(struct lvp_cmd_draw_indirect),
+   [LVP_CMD_DISPATCH] = sizeof(struct lvp_cmd_dispatch),
+   [LVP_CMD_DISPATCH_INDIRECT] = sizeof(struct lvp_cmd_dispatch_indirect),
+   [LVP_CMD_COPY_BUFFER] = sizeof(struct lvp_cmd_copy_buffer),
+   [LVP_CMD_COPY_IMAGE] = sizeof(struct lvp_cmd_copy_image),
+   [LVP_CMD_BLIT_IMAGE] = sizeof(struct lvp_cmd_blit_image),
+   [LVP_CMD_COPY_BUFFER_TO_IMAGE] = sizeof(struct lvp_cmd_copy_buffer_to_image),
+   [LVP_CMD_COPY_IMAGE_TO_BUFFER] = sizeof(struct lvp_cmd_copy_image_to_buffer),
+   [LVP_CMD_UPDATE_BUFFER] = sizeof(struct lvp_cmd_update_buffer),
+   [LVP_CMD_FILL_BUFFER] = sizeof(struct lvp_cmd_fill_buffer),
+   [LVP_CMD_CLEAR_COLOR_IMAGE] = sizeof(struct lvp_cmd_clear_color_image),
+   [LVP_CMD_CLEAR_DEPTH_STENCIL_IMAGE] = sizeof(struct lvp_cmd_clear_ds_image),
+   [LVP_CMD_CLEAR_ATTACHMENTS] = sizeof(struct lvp_cmd_clear_attachments),
+   [LVP_CMD_RESOLVE_IMAGE] = sizeof(struct lvp_cmd_resolve_image),
+   [LVP_CMD_SET_EVENT] = sizeof(struct lvp_cmd_event_set),
+   [LVP_CMD_RESET_EVENT] = sizeof(struct lvp_cmd_event_set),
+   [LVP_CMD_WAIT_EVENTS] = sizeof(struct lvp_cmd_wait_events),
+   [LVP_CMD_PIPELINE_BARRIER] = sizeof(struct lvp_cmd_pipeline_barrier),
+   [LVP_CMD_BEGIN_QUERY] = sizeof(struct lvp_cmd_query_cmd),
+   [LVP_CMD_END_QUERY] = sizeof(struct lvp_cmd_query_cmd),
+   [LVP_CMD_RESET_QUERY_POOL] = sizeof(struct lvp_cmd_query_cmd),
+   [LVP_CMD_WRITE_TIMESTAMP] = sizeof(struct lvp_cmd_query_cmd),
+   [LVP_CMD_COPY_QUERY_POOL_RESULTS] = sizeof(struct lvp_cmd_copy_query_pool_results),
+   [LVP_CMD_PUSH_CONSTANTS] = sizeof(struct lvp_cmd_push_constants),
+   [LVP_CMD_BEGIN_RENDER_PASS] = sizeof(struct lvp_cmd_begin_render_pass),
+   [LVP_CMD_NEXT_SUBPASS] = sizeof(struct lvp_cmd_next_subpass),
+   [LVP_CMD_END_RENDER_PASS] = 0,
+   [LVP_CMD_EXECUTE_COMMANDS] = sizeof(struct lvp_cmd_execute_commands),
+   [LVP_CMD_DRAW_INDIRECT_COUNT] = sizeof(struct lvp_cmd_draw_indirect_count),
+   [LVP_CMD_DRAW_INDEXED_INDIRECT_COUNT] = sizeof(struct lvp_cmd_draw_indirect_count),
+   [LVP_CMD_PUSH_DESCRIPTOR_SET] = sizeof(struct lvp_cmd_push_descriptor_set),
+   [LVP_CMD_BIND_TRANSFORM_FEEDBACK_BUFFERS] = sizeof(struct lvp_cmd_bind_transform_feedback_buffers),
+   [LVP_CMD_BEGIN_TRANSFORM_FEEDBACK] = sizeof(struct lvp_cmd_begin_transform_feedback),
+   [LVP_CMD_END_TRANSFORM_FEEDBACK] = sizeof(struct lvp_cmd_end_transform_feedback),
+   [LVP_CMD_DRAW_INDIRECT_BYTE_COUNT] = sizeof(struct lvp_cmd_draw_indirect_byte_count),
+   [LVP_CMD_BEGIN_CONDITIONAL_RENDERING] = sizeof(struct lvp_cmd_begin_conditional_rendering),
+   [LVP_CMD_END_CONDITIONAL_RENDERING] = 0,
+};
+
+/* Variable sized data recorded along with a command follows its payload. */
+static inline void *cmd_buf_entry_extra(struct lvp_cmd_buffer_entry *cmd)
+{
+   return (uint8_t *)&cmd->u + align(lvp_cmd_payload_size[cmd->cmd_type], 8);
+}
+
+/*
+ * Commands are packed back to back into large blocks rather than being
+ * allocated individually, so recording is a pointer bump and replay walks
+ * memory linearly.  The entry only becomes part of the stream once
+ * cmd_buf_queue() is called.
+ */
 static struct lvp_cmd_buffer_entry *cmd_buf_entry_alloc_size(struct lvp_cmd_buffer *cmd_buffer,
                                                              uint32_t extra_size,
                                                              enum lvp_cmds type)
 {
    struct lvp_cmd_buffer_entry *cmd;
-   uint32_t cmd_size = sizeof(*cmd) + extra_size;
-   cmd = vk_alloc(&cmd_buffer->pool->alloc,
-                  cmd_size,
-                  8, VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
-   if (!cmd)
-      return NULL;
+   struct lvp_cmd_block *block = NULL;
+   uint32_t cmd_size = align(offsetof(struct lvp_cmd_buffer_entry, u) +
+                             align(lvp_cmd_payload_size[type], 8) +
+                             extra_size, 8);
+
+   if (!list_is_empty(&cmd_buffer->cmd_blocks))
+      block = list_last_entry(&cmd_buffer->cmd_blocks, struct lvp_cmd_block, link);
+
+   if (!block || block->used + cmd_size > block->size) {
+      uint32_t block_size = MAX2(cmd_size, LVP_CMD_BLOCK_SIZE);
+
+      block = vk_alloc(&cmd_buffer->pool->alloc,
+                       sizeof(*block) + block_size,
+                       8, VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
+      if (!block)
+         return NULL;
+
+      block->size = block_size;
+      block->used = 0;
+      list_addtail(&block->link, &cmd_buffer->cmd_blocks);
+   }
 
+   cmd = (struct lvp_cmd_buffer_entry *)(block->data + block->used);
    cmd->cmd_type = type;
+   cmd->cmd_size = cmd_size;
    return cmd;
 }
 
@@ -287,7 +383,11 @@ static struct lvp_cmd_buffer_entry *cmd_buf_entry_alloc(struct lvp_cmd_buffer *c
 static void cmd_buf_queue(struct lvp_cmd_buffer *cmd_buffer,
                           struct lvp_cmd_buffer_entry *cmd)
 {
-   list_addtail(&cmd->cmd_link, &cmd_buffer->cmds);
+   struct lvp_cmd_block *block =
+      list_last_entry(&cmd_buffer->cmd_blocks, struct lvp_cmd_block, link);
+
+   assert((uint8_t *)cmd == block->data + block->used);
+   block->used += cmd->cmd_size;
 }
 
 static void
@@ -343,7 +443,7 @@ VKAPI_ATTR void VKAPI_CALL lvp_CmdBeginRenderPass(
    cmd->u.begin_render_pass.framebuffer = framebuffer;
    cmd->u.begin_render_pass.render_area = pRenderPassBegin->renderArea;
 
-   cmd->u.begin_render_pass.attachments = (struct lvp_attachment_state *)(cmd + 1);
+   cmd->u.begin_render_pass.attachments = (struct lvp_attachment_state *)cmd_buf_entry_extra(cmd);
    state_setup_attachments(cmd->u.begin_render_pass.attachments, pass, pRenderPassBegin->pClearValues);
 
    cmd_buf_queue(cmd_buffer, cmd);
@@ -386,7 +486,7 @@ VKAPI_ATTR void VKAPI_CALL lvp_CmdBindVertexBuffers(
    cmd->u.vertex_buffers.first = firstBinding;
    cmd->u.vertex_buffers.binding_count = bindingCount;
 
-   buffers = (struct lvp_buffer **)(cmd + 1);
+   buffers = (struct lvp_buffer **)cmd_buf_entry_extra(cmd);
    offsets = (VkDeviceSize *)(buffers + bindingCount);
    for (i = 0; i < bindingCount; i++) {
       buffers[i] = lvp_buffer_from_handle(pBuffers[i]);
@@ -444,7 +544,7 @@ VKAPI_ATTR void VKAPI_CALL lvp_CmdBindDescriptorSets(
    cmd->u.descriptor_sets.first = firstSet;
    cmd->u.descriptor_sets.count = descriptorSetCount;
 
-   sets = (struct lvp_descriptor_set **)(cmd + 1);
+   sets = (struct lvp_descriptor_set **)cmd_buf_entry_extra(cmd);
    for (i = 0; i < descriptorSetCount; i++) {
       sets[i] = lvp_descriptor_set_from_handle(pDescriptorSets[i]);
    }
@@ -905,7 +1005,7 @@ VKAPI_ATTR void VKAPI_CALL lvp_CmdWaitEvents(VkCommandBuffer commandBuffer,
    cmd->u.wait_events.src_stage_mask = srcStageMask;
    cmd->u.wait_events.dst_stage_mask = dstStageMask;
    cmd->u.wait_events.event_count = eventCount;
-   cmd->u.wait_events.events = (struct lvp_event **)(cmd + 1);
+   cmd->u.wait_events.events = (struct lvp_event **)cmd_buf_entry_extra(cmd);
    for (unsigned i = 0; i < eventCount; i++)
       cmd->u.wait_events.events[i] = lvp_event_from_handle(pEvents[i]);
    cmd->u.wait_events.memory_barrier_count = memoryBarrierCount;
@@ -943,7 +1043,7 @@ VKAPI_ATTR void VKAPI_CALL lvp_CmdCopyBufferToImage(
    {
       VkBufferImageCopy *regions;
 
-      regions = (VkBufferImageCopy *)(cmd + 1);
+      regions = (VkBufferImageCopy *)cmd_buf_entry_extra(cmd);
       memcpy(regions, pRegions, regionCount * sizeof(VkBufferImageCopy));
       cmd->u.buffer_to_img.regions = regions;
    }
@@ -977,7 +1077,7 @@ VKAPI_ATTR void VKAPI_CALL lvp_CmdCopyImageToBuffer(
    {
       VkBufferImageCopy *regions;
 
-      regions = (VkBufferImageCopy *)(cmd + 1);
+      regions = (VkBufferImageCopy *)cmd_buf_entry_extra(cmd);
       memcpy(regions, pRegions, regionCount * sizeof(VkBufferImageCopy));
       cmd->u.img_to_buffer.regions = regions;
    }
@@ -1013,7 +1113,7 @@ VKAPI_ATTR void VKAPI_CALL lvp_CmdCopyImage(
    {
       VkImageCopy *regions;
 
-      regions = (VkImageCopy *)(cmd + 1);
+      regions = (VkImageCopy *)cmd_buf_entry_extra(cmd);
       memcpy(regions, pRegions, regionCount * sizeof(VkImageCopy));
       cmd->u.copy_image.regions = regions;
    }
@@ -1046,7 +1146,7 @@ VKAPI_ATTR void VKAPI_CALL lvp_CmdCopyBuffer(
    {
       VkBufferCopy *regions;
 
-      regions = (VkBufferCopy *)(cmd + 1);
+      regions = (VkBufferCopy *)cmd_buf_entry_extra(cmd);
       memcpy(regions, pRegions, regionCount * sizeof(VkBufferCopy));
       cmd->u.copy_buffer.regions = regions;
    }
@@ -1084,7 +1184,7 @@ VKAPI_ATTR void VKAPI_CALL lvp_CmdBlitImage(
    {
       VkImageBlit *regions;
 
-      regions = (VkImageBlit *)(cmd + 1);
+      regions = (VkImageBlit *)cmd_buf_entry_extra(cmd);
       memcpy(regions, pRegions, regionCount * sizeof(VkImageBlit));
       cmd->u.blit_image.regions = regions;
    }
@@ -1108,7 +1208,7 @@ VKAPI_ATTR void VKAPI_CALL lvp_CmdClearAttachments(
       return;
 
    cmd->u.clear_attachments.attachment_count = attachmentCount;
-   cmd->u.clear_attachments.attachments = (VkClearAttachment *)(cmd + 1);
+   cmd->u.clear_attachments.attachments = (VkClearAttachment *)cmd_buf_entry_extra(cmd);
    for (unsigned i = 0; i < attachmentCount; i++)
       cmd->u.clear_attachments.attachments[i] = pAttachments[i];
    cmd->u.clear_attachments.rect_count = rectCount;
@@ -1186,7 +1286,7 @@ VKAPI_ATTR void VKAPI_CALL lvp_CmdClearColorImage(
    cmd->u.clear_color_image.layout = imageLayout;
    cmd->u.clear_color_image.clear_val = *pColor;
    cmd->u.clear_color_image.range_count = rangeCount;
-   cmd->u.clear_color_image.ranges = (VkImageSubresourceRange *)(cmd + 1);
+   cmd->u.clear_color_image.ranges = (VkImageSubresourceRange *)cmd_buf_entry_extra(cmd);
    for (unsigned i = 0; i < rangeCount; i++)
       cmd->u.clear_color_image.ranges[i] = pRanges[i];
 
@@ -1214,7 +1314,7 @@ VKAPI_ATTR void VKAPI_CALL lvp_CmdClearDepthStencilImage(
    cmd->u.clear_ds_image.layout = imageLayout;
    cmd->u.clear_ds_image.clear_val = *pDepthStencil;
    cmd->u.clear_ds_image.range_count = rangeCount;
-   cmd->u.clear_ds_image.ranges = (VkImageSubresourceRange *)(cmd + 1);
+   cmd->u.clear_ds_image.ranges = (VkImageSubresourceRange *)cmd_buf_entry_extra(cmd);
    for (unsigned i = 0; i < rangeCount; i++)
       cmd->u.clear_ds_image.ranges[i] = pRanges[i];
 
@@ -1246,7 +1346,7 @@ VKAPI_ATTR void VKAPI_CALL lvp_CmdResolveImage(
    cmd->u.resolve_image.src_layout = srcImageLayout;
    cmd->u.resolve_image.dst_layout = destImageLayout;
    cmd->u.resolve_image.region_count = regionCount;
-   cmd->u.resolve_image.regions = (VkImageResolve *)(cmd + 1);
+   cmd->u.resolve_image.regions = (VkImageResolve *)cmd_buf_entry_extra(cmd);
    for (unsigned i = 0; i < regionCount; i++)
       cmd->u.resolve_image.regions[i] = regions[i];
 
@@ -1506,7 +1606,7 @@ VKAPI_ATTR void VKAPI_CALL lvp_CmdPushDescriptorSetKHR(
    cmd->u.push_descriptor_set.layout = layout;
    cmd->u.push_descriptor_set.set = set;
    cmd->u.push_descriptor_set.descriptor_write_count = descriptorWriteCount;
-   cmd->u.push_descriptor_set.descriptors = (struct lvp_write_descriptor *)(cmd + 1);
+   cmd->u.push_descriptor_set.descriptors = (struct lvp_write_descriptor *)cmd_buf_entry_extra(cmd);
    cmd->u.push_descriptor_set.infos = (union lvp_descriptor_info *)(cmd->u.push_descriptor_set.descriptors + descriptorWriteCount);
 
    unsigned descriptor_index = 0;
@@ -1586,7 +1686,7 @@ VKAPI_ATTR void VKAPI_CALL lvp_CmdPushDescriptorSetWithTemplateKHR(
    cmd->u.push_descriptor_set.layout = templ->pipeline_layout;
    cmd->u.push_descriptor_set.set = templ->set;
    cmd->u.push_descriptor_set.descriptor_write_count = templ->entry_count;
-   cmd->u.push_descriptor_set.descriptors = (struct lvp_write_descriptor *)(cmd + 1);
+   cmd->u.push_descriptor_set.descriptors = (struct lvp_write_descriptor *)cmd_buf_entry_extra(cmd);
    cmd->u.push_descriptor_set.infos = (union lvp_descriptor_info *)(cmd->u.push_descriptor_set.descriptors + templ->entry_count);
 
    unsigned descriptor_index = 0;
@@ -1666,7 +1766,7 @@ VKAPI_ATTR void VKAPI_CALL lvp_CmdBindTransformFeedbackBuffersEXT(
 
    cmd->u.bind_transform_feedback_buffers.first_binding = firstBinding;
    cmd->u.bind_transform_feedback_buffers.binding_count = bindingCount;
-   cmd->u.bind_transform_feedback_buffers.buffers = (struct lvp_buffer **)(cmd + 1);
+   cmd->u.bind_transform_feedback_buffers.buffers = (struct lvp_buffer **)cmd_buf_entry_extra(cmd);
    cmd->u.bind_transform_feedback_buffers.offsets = (VkDeviceSize *)(cmd->u.bind_transform_feedback_buffers.buffers + bindingCount);
    cmd->u.bind_transform_feedback_buffers.sizes = (VkDeviceSize *)(cmd->u.bind_transform_feedback_buffers.offsets + bindingCount);
 
@@ -1697,7 +1797,7 @@ VKAPI_ATTR void VKAPI_CALL lvp_CmdBeginTransformFeedbackEXT(
 
    cmd->u.begin_transform_feedback.first_counter_buffer = firstCounterBuffer;
    cmd->u.begin_transform_feedback.counter_buffer_count = counterBufferCount;
-   cmd->u.begin_transform_feedback.counter_buffers = (struct lvp_buffer **)(cmd + 1);
+   cmd->u.begin_transform_feedback.counter_buffers = (struct lvp_buffer **)cmd_buf_entry_extra(cmd);
    cmd->u.begin_transform_feedback.counter_buffer_offsets = (VkDeviceSize *)(cmd->u.begin_transform_feedback.counter_buffers + counterBufferCount);
 
    for (unsigned i = 0; i < counterBufferCount; i++) {
@@ -1729,7 +1829,7 @@ VKAPI_ATTR void VKAPI_CALL lvp_CmdEndTransformFeedbackEXT(
 
    cmd->u.begin_transform_feedback.first_counter_buffer = firstCounterBuffer;
    cmd->u.begin_transform_feedback.counter_buffer_count = counterBufferCount;
-   cmd->u.begin_transform_feedback.counter_buffers = (struct lvp_buffer **)(cmd + 1);
+   cmd->u.begin_transform_feedback.counter_buffers = (struct lvp_buffer **)cmd_buf_entry_extra(cmd);
    cmd->u.begin_transform_feedback.counter_buffer_offsets = (VkDeviceSize *)(cmd->u.begin_transform_feedback.counter_buffers + counterBufferCount);
 
    for (unsigned i = 0; i < counterBufferCount; i++) {
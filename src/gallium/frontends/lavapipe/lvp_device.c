@@ -606,7 +606,7 @@ static void lvp_get_physical_device_queue_family_properties(
       .queueFlags = VK_QUEUE_GRAPHICS_BIT |
       VK_QUEUE_COMPUTE_BIT |
       VK_QUEUE_TRANSFER_BIT,
-      .queueCount = 1,
+      .queueCount = LVP_MAX_QUEUES,
       .timestampValidBits = 64,
       .minImageTransferGranularity = (VkExtent3D) { 1, 1, 1 },
    };
@@ -725,14 +725,44 @@ static int queue_thread(void *data)
                               list);
 
       mtx_unlock(&queue->m);
+
+      /* Semaphores signalled by other queues: wait for those submissions
+       * to have executed before starting on this one.
+       */
+      for (unsigned i = 0; i < task->wait_count; i++) {
+         struct lvp_queue *other = task->waits[i].queue;
+         mtx_lock(&other->m);
+         while (other->completed < task->waits[i].serial && !other->shutdown)
+            cnd_wait(&other->work_done, &other->m);
+         mtx_unlock(&other->m);
+      }
+
       //execute
+      mtx_lock(&queue->ctx_lock);
       for (unsigned i = 0; i < task->cmd_buffer_count; i++) {
          lvp_execute_cmds(queue->device, queue, task->fence, task->cmd_buffers[i]);
       }
       if (!task->cmd_buffer_count && task->fence)
          task->fence->signaled = true;
+
+      /* Semaphore and idle waits only look at the queue's counters, so the
+       * rendering must be done before the submission counts as completed.
+       */
+      if (task->cmd_buffer_count) {
+         struct pipe_screen *pscreen = queue->device->pscreen;
+         struct pipe_fence_handle *handle = NULL;
+
+         queue->ctx->flush(queue->ctx, &handle, 0);
+         if (handle) {
+            pscreen->fence_finish(pscreen, NULL, handle, PIPE_TIMEOUT_INFINITE);
+            pscreen->fence_reference(pscreen, &handle, NULL);
+         }
+      }
+      mtx_unlock(&queue->ctx_lock);
       p_atomic_dec(&queue->count);
       mtx_lock(&queue->m);
+      queue->completed = task->serial;
+      cnd_broadcast(&queue->work_done);
       list_del(&task->list);
       free(task);
    }
@@ -741,16 +771,25 @@ static int queue_thread(void *data)
 }
 
 static VkResult
-lvp_queue_init(struct lvp_device *device, struct lvp_queue *queue)
+lvp_queue_init(struct lvp_device *device, struct lvp_queue *queue,
+               VkDeviceQueueCreateFlags flags, unsigned index)
 {
    queue->_loader_data.loaderMagic = ICD_LOADER_MAGIC;
    queue->device = device;
 
-   queue->flags = 0;
+   queue->flags = flags;
+   queue->index = index;
    queue->ctx = device->pscreen->context_create(device->pscreen, NULL, PIPE_CONTEXT_ROBUST_BUFFER_ACCESS);
+   if (!queue->ctx)
+      return VK_ERROR_INITIALIZATION_FAILED;
    list_inithead(&queue->workqueue);
    p_atomic_set(&queue->count, 0);
+   queue->submitted = 0;
+   queue->completed = 0;
    mtx_init(&queue->m, mtx_plain);
+   mtx_init(&queue->ctx_lock, mtx_plain);
+   cnd_init(&queue->new_work);
+   cnd_init(&queue->work_done);
    queue->exec_thread = u_thread_create(queue_thread, queue);
 
    return VK_SUCCESS;
@@ -766,8 +805,10 @@ lvp_queue_finish(struct lvp_queue *queue)
 
    thrd_join(queue->exec_thread, NULL);
 
+   cnd_destroy(&queue->work_done);
    cnd_destroy(&queue->new_work);
    mtx_destroy(&queue->m);
+   mtx_destroy(&queue->ctx_lock);
    queue->ctx->destroy(queue->ctx);
 }
 
@@ -822,12 +863,30 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateDevice(
    mtx_init(&device->fence_lock, mtx_plain);
    device->pscreen = physical_device->pscreen;
 
-   lvp_queue_init(device, &device->queue);
+   for (uint32_t i = 0; i < pCreateInfo->queueCreateInfoCount; i++) {
+      const VkDeviceQueueCreateInfo *queue_create = &pCreateInfo->pQueueCreateInfos[i];
+
+      for (uint32_t j = 0; j < queue_create->queueCount; j++) {
+         assert(device->queue_count < LVP_MAX_QUEUES);
+         result = lvp_queue_init(device, &device->queues[device->queue_count],
+                                 queue_create->flags, device->queue_count);
+         if (result != VK_SUCCESS)
+            goto fail_queues;
+         device->queue_count++;
+      }
+   }
 
    *pDevice = lvp_device_to_handle(device);
 
    return VK_SUCCESS;
 
+ fail_queues:
+   for (uint32_t i = 0; i < device->queue_count; i++)
+      lvp_queue_finish(&device->queues[i]);
+   mtx_destroy(&device->fence_lock);
+   vk_device_finish(&device->vk);
+   vk_free(&device->vk.alloc, device);
+   return vk_error(instance, result);
 }
 
 VKAPI_ATTR void VKAPI_CALL lvp_DestroyDevice(
@@ -836,7 +895,8 @@ VKAPI_ATTR void VKAPI_CALL lvp_DestroyDevice(
 {
    LVP_FROM_HANDLE(lvp_device, device, _device);
 
-   lvp_queue_finish(&device->queue);
+   for (uint32_t i = 0; i < device->queue_count; i++)
+      lvp_queue_finish(&device->queues[i]);
    vk_device_finish(&device->vk);
    vk_free(&device->vk.alloc, device);
 }
@@ -886,10 +946,20 @@ VKAPI_ATTR void VKAPI_CALL lvp_GetDeviceQueue2(
    VkQueue*                                    pQueue)
 {
    LVP_FROM_HANDLE(lvp_device, device, _device);
-   struct lvp_queue *queue;
+   struct lvp_queue *queue = NULL;
+   uint32_t index = 0;
+
+   /* Queues with different creation flags are counted separately. */
+   for (uint32_t i = 0; i < device->queue_count; i++) {
+      if (device->queues[i].flags != pQueueInfo->flags)
+         continue;
+      if (index++ == pQueueInfo->queueIndex) {
+         queue = &device->queues[i];
+         break;
+      }
+   }
 
-   queue = &device->queue;
-   if (pQueueInfo->flags != queue->flags) {
+   if (!queue) {
       /* From the Vulkan 1.1.70 spec:
        *
        * "The queue returned by vkGetDeviceQueue2 must have the same
@@ -934,8 +1004,12 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_QueueSubmit(
    if (submitCount == 0)
       goto just_signal_fence;
    for (uint32_t i = 0; i < submitCount; i++) {
-      uint32_t task_size = sizeof(struct lvp_queue_work) + pSubmits[i].commandBufferCount * sizeof(struct lvp_cmd_buffer *);
+      uint32_t task_size = sizeof(struct lvp_queue_work) +
+         pSubmits[i].commandBufferCount * sizeof(struct lvp_cmd_buffer *) +
+         pSubmits[i].waitSemaphoreCount * sizeof(struct lvp_semaphore_wait);
       struct lvp_queue_work *task = malloc(task_size);
+      if (!task)
+         return vk_error(queue->device->instance, VK_ERROR_OUT_OF_HOST_MEMORY);
 
       task->cmd_buffer_count = pSubmits[i].commandBufferCount;
       task->fence = fence;
@@ -943,8 +1017,29 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_QueueSubmit(
       for (uint32_t j = 0; j < pSubmits[i].commandBufferCount; j++) {
          task->cmd_buffers[j] = lvp_cmd_buffer_from_handle(pSubmits[i].pCommandBuffers[j]);
       }
+      task->waits = (struct lvp_semaphore_wait *)(task->cmd_buffers + task->cmd_buffer_count);
+      task->wait_count = 0;
 
       mtx_lock(&queue->m);
+      task->serial = ++queue->submitted;
+
+      /* Work on this queue executes in order, so only semaphores last
+       * signalled from another queue need an actual wait.
+       */
+      for (uint32_t j = 0; j < pSubmits[i].waitSemaphoreCount; j++) {
+         LVP_FROM_HANDLE(lvp_semaphore, sema, pSubmits[i].pWaitSemaphores[j]);
+         if (!sema->queue || sema->queue == queue)
+            continue;
+         task->waits[task->wait_count].queue = sema->queue;
+         task->waits[task->wait_count].serial = sema->serial;
+         task->wait_count++;
+      }
+      for (uint32_t j = 0; j < pSubmits[i].signalSemaphoreCount; j++) {
+         LVP_FROM_HANDLE(lvp_semaphore, sema, pSubmits[i].pSignalSemaphores[j]);
+         sema->queue = queue;
+         sema->serial = task->serial;
+      }
+
       p_atomic_inc(&queue->count);
       list_addtail(&task->list, &queue->workqueue);
       cnd_signal(&queue->new_work);
@@ -952,7 +1047,8 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_QueueSubmit(
    }
    return VK_SUCCESS;
  just_signal_fence:
-   fence->signaled = true;
+   if (fence)
+      fence->signaled = true;
    return VK_SUCCESS;
 }
 
@@ -976,6 +1072,24 @@ static VkResult queue_wait_idle(struct lvp_queue *queue, uint64_t timeout)
    return VK_SUCCESS;
 }
 
+/* Wait for all queues of the device against a single deadline. */
+static VkResult device_wait_idle(struct lvp_device *device, uint64_t timeout)
+{
+   int64_t abs_timeout = os_time_get_absolute_timeout(timeout);
+
+   for (uint32_t i = 0; i < device->queue_count; i++) {
+      uint64_t remaining = timeout;
+      if (timeout != 0 && timeout != UINT64_MAX && abs_timeout != OS_TIMEOUT_INFINITE) {
+         int64_t now = os_time_get_nano();
+         remaining = abs_timeout > now ? abs_timeout - now : 0;
+      }
+      VkResult ret = queue_wait_idle(&device->queues[i], remaining);
+      if (ret != VK_SUCCESS)
+         return ret;
+   }
+   return VK_SUCCESS;
+}
+
 VKAPI_ATTR VkResult VKAPI_CALL lvp_QueueWaitIdle(
    VkQueue                                     _queue)
 {
@@ -989,7 +1103,7 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_DeviceWaitIdle(
 {
    LVP_FROM_HANDLE(lvp_device, device, _device);
 
-   return queue_wait_idle(&device->queue, UINT64_MAX);
+   return device_wait_idle(device, UINT64_MAX);
 }
 
 VKAPI_ATTR VkResult VKAPI_CALL lvp_AllocateMemory(
@@ -1390,7 +1504,7 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_WaitForFences(
 {
    LVP_FROM_HANDLE(lvp_device, device, _device);
 
-   VkResult qret = queue_wait_idle(&device->queue, timeout);
+   VkResult qret = device_wait_idle(device, timeout);
    bool timeout_status = false;
    if (qret == VK_TIMEOUT)
       return VK_TIMEOUT;
@@ -1437,6 +1551,8 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateSemaphore(
       return vk_error(device->instance, VK_ERROR_OUT_OF_HOST_MEMORY);
    vk_object_base_init(&device->vk, &sema->base,
                        VK_OBJECT_TYPE_SEMAPHORE);
+   sema->queue = NULL;
+   sema->serial = 0;
    *pSemaphore = lvp_semaphore_to_handle(sema);
 
    return VK_SUCCESS;
@@ -44,6 +44,7 @@
 
 struct rendering_state {
    struct pipe_context *pctx;
+   unsigned queue_index;
 
    bool blend_dirty;
    bool rs_dirty;
@@ -329,7 +330,7 @@ static void handle_compute_pipeline(struct lvp_cmd_buffer_entry *cmd,
    state->dispatch_info.block[0] = pipeline->pipeline_nir[MESA_SHADER_COMPUTE]->info.cs.local_size[0];
    state->dispatch_info.block[1] = pipeline->pipeline_nir[MESA_SHADER_COMPUTE]->info.cs.local_size[1];
    state->dispatch_info.block[2] = pipeline->pipeline_nir[MESA_SHADER_COMPUTE]->info.cs.local_size[2];
-   state->pctx->bind_compute_state(state->pctx, pipeline->shader_cso[PIPE_SHADER_COMPUTE]);
+   state->pctx->bind_compute_state(state->pctx, pipeline->shader_cso[state->queue_index][PIPE_SHADER_COMPUTE]);
 }
 
 static void
@@ -384,23 +385,23 @@ static void handle_graphics_pipeline(struct lvp_cmd_buffer_entry *cmd,
          const VkPipelineShaderStageCreateInfo *sh = &pipeline->graphics_create_info.pStages[i];
          switch (sh->stage) {
          case VK_SHADER_STAGE_FRAGMENT_BIT:
-            state->pctx->bind_fs_state(state->pctx, pipeline->shader_cso[PIPE_SHADER_FRAGMENT]);
+            state->pctx->bind_fs_state(state->pctx, pipeline->shader_cso[state->queue_index][PIPE_SHADER_FRAGMENT]);
             has_stage[PIPE_SHADER_FRAGMENT] = true;
             break;
          case VK_SHADER_STAGE_VERTEX_BIT:
-            state->pctx->bind_vs_state(state->pctx, pipeline->shader_cso[PIPE_SHADER_VERTEX]);
+            state->pctx->bind_vs_state(state->pctx, pipeline->shader_cso[state->queue_index][PIPE_SHADER_VERTEX]);
             has_stage[PIPE_SHADER_VERTEX] = true;
             break;
          case VK_SHADER_STAGE_GEOMETRY_BIT:
-            state->pctx->bind_gs_state(state->pctx, pipeline->shader_cso[PIPE_SHADER_GEOMETRY]);
+            state->pctx->bind_gs_state(state->pctx, pipeline->shader_cso[state->queue_index][PIPE_SHADER_GEOMETRY]);
             has_stage[PIPE_SHADER_GEOMETRY] = true;
             break;
          case VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT:
-            state->pctx->bind_tcs_state(state->pctx, pipeline->shader_cso[PIPE_SHADER_TESS_CTRL]);
+            state->pctx->bind_tcs_state(state->pctx, pipeline->shader_cso[state->queue_index][PIPE_SHADER_TESS_CTRL]);
             has_stage[PIPE_SHADER_TESS_CTRL] = true;
             break;
          case VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT:
-            state->pctx->bind_tes_state(state->pctx, pipeline->shader_cso[PIPE_SHADER_TESS_EVAL]);
+            state->pctx->bind_tes_state(state->pctx, pipeline->shader_cso[state->queue_index][PIPE_SHADER_TESS_EVAL]);
             has_stage[PIPE_SHADER_TESS_EVAL] = true;
             break;
          default:
@@ -412,7 +413,7 @@ static void handle_graphics_pipeline(struct lvp_cmd_buffer_entry *cmd,
 
    /* there should always be a dummy fs. */
    if (!has_stage[PIPE_SHADER_FRAGMENT])
-      state->pctx->bind_fs_state(state->pctx, pipeline->shader_cso[PIPE_SHADER_FRAGMENT]);
+      state->pctx->bind_fs_state(state->pctx, pipeline->shader_cso[state->queue_index][PIPE_SHADER_FRAGMENT]);
    if (state->pctx->bind_gs_state && !has_stage[PIPE_SHADER_GEOMETRY])
       state->pctx->bind_gs_state(state->pctx, NULL);
    if (state->pctx->bind_tcs_state && !has_stage[PIPE_SHADER_TESS_CTRL])
@@ -2056,6 +2057,7 @@ static void handle_begin_query(struct lvp_cmd_buffer_entry *cmd,
          qtype = PIPE_QUERY_OCCLUSION_PREDICATE;
       pool->queries[qcmd->query] = state->pctx->create_query(state->pctx,
                                                              qtype, qcmd->index);
+      pool->query_queue[qcmd->query] = state->queue_index;
    }
 
    state->pctx->begin_query(state->pctx, pool->queries[qcmd->query]);
@@ -2092,6 +2094,7 @@ static void handle_write_timestamp(struct lvp_cmd_buffer_entry *cmd,
    if (!pool->queries[qcmd->query]) {
       pool->queries[qcmd->query] = state->pctx->create_query(state->pctx,
                                                              PIPE_QUERY_TIMESTAMP, 0);
+      pool->query_queue[qcmd->query] = state->queue_index;
    }
 
    if (qcmd->flush)
@@ -2564,9 +2567,7 @@ static void handle_end_conditional_rendering(struct rendering_state *state)
 static void lvp_execute_cmd_buffer(struct lvp_cmd_buffer *cmd_buffer,
                                    struct rendering_state *state)
 {
-   struct lvp_cmd_buffer_entry *cmd;
-
-   LIST_FOR_EACH_ENTRY(cmd, &cmd_buffer->cmds, cmd_link) {
+   lvp_foreach_cmd(cmd, cmd_buffer) {
       switch (cmd->cmd_type) {
       case LVP_CMD_BIND_PIPELINE:
          handle_pipeline(cmd, state);
@@ -2747,6 +2748,7 @@ VkResult lvp_execute_cmds(struct lvp_device *device,
    struct pipe_fence_handle *handle = NULL;
    memset(&state, 0, sizeof(state));
    state.pctx = queue->ctx;
+   state.queue_index = queue->index;
    state.blend_dirty = true;
    state.dsa_dirty = true;
    state.rs_dirty = true;
@@ -30,6 +30,8 @@
 #include "pipe/p_state.h"
 #include "pipe/p_context.h"
 #include "nir/nir_xfb_info.h"
+#include "tgsi/tgsi_from_mesa.h"
+#include "util/mesa-sha1.h"
 
 #define SPIR_V_MAGIC_NUMBER 0x07230203
 
@@ -62,6 +64,7 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateShaderModule(
                        VK_OBJECT_TYPE_SHADER_MODULE);
    module->size = pCreateInfo->codeSize;
    memcpy(module->data, pCreateInfo->pCode, module->size);
+   _mesa_sha1_compute(module->data, module->size, module->sha1);
 
    *pShaderModule = lvp_shader_module_to_handle(module);
 
@@ -94,18 +97,26 @@ VKAPI_ATTR void VKAPI_CALL lvp_DestroyPipeline(
    if (!_pipeline)
       return;
 
-   if (pipeline->shader_cso[PIPE_SHADER_VERTEX])
-      device->queue.ctx->delete_vs_state(device->queue.ctx, pipeline->shader_cso[PIPE_SHADER_VERTEX]);
-   if (pipeline->shader_cso[PIPE_SHADER_FRAGMENT])
-      device->queue.ctx->delete_fs_state(device->queue.ctx, pipeline->shader_cso[PIPE_SHADER_FRAGMENT]);
-   if (pipeline->shader_cso[PIPE_SHADER_GEOMETRY])
-      device->queue.ctx->delete_gs_state(device->queue.ctx, pipeline->shader_cso[PIPE_SHADER_GEOMETRY]);
-   if (pipeline->shader_cso[PIPE_SHADER_TESS_CTRL])
-      device->queue.ctx->delete_tcs_state(device->queue.ctx, pipeline->shader_cso[PIPE_SHADER_TESS_CTRL]);
-   if (pipeline->shader_cso[PIPE_SHADER_TESS_EVAL])
-      device->queue.ctx->delete_tes_state(device->queue.ctx, pipeline->shader_cso[PIPE_SHADER_TESS_EVAL]);
-   if (pipeline->shader_cso[PIPE_SHADER_COMPUTE])
-      device->queue.ctx->delete_compute_state(device->queue.ctx, pipeline->shader_cso[PIPE_SHADER_COMPUTE]);
+   for (unsigned q = 0; q < device->queue_count; q++) {
+      struct lvp_queue *queue = &device->queues[q];
+      struct pipe_context *ctx = queue->ctx;
+      void **cso = pipeline->shader_cso[q];
+
+      mtx_lock(&queue->ctx_lock);
+      if (cso[PIPE_SHADER_VERTEX])
+         ctx->delete_vs_state(ctx, cso[PIPE_SHADER_VERTEX]);
+      if (cso[PIPE_SHADER_FRAGMENT])
+         ctx->delete_fs_state(ctx, cso[PIPE_SHADER_FRAGMENT]);
+      if (cso[PIPE_SHADER_GEOMETRY])
+         ctx->delete_gs_state(ctx, cso[PIPE_SHADER_GEOMETRY]);
+      if (cso[PIPE_SHADER_TESS_CTRL])
+         ctx->delete_tcs_state(ctx, cso[PIPE_SHADER_TESS_CTRL]);
+      if (cso[PIPE_SHADER_TESS_EVAL])
+         ctx->delete_tes_state(ctx, cso[PIPE_SHADER_TESS_EVAL]);
+      if (cso[PIPE_SHADER_COMPUTE])
+         ctx->delete_compute_state(ctx, cso[PIPE_SHADER_COMPUTE]);
+      mtx_unlock(&queue->ctx_lock);
+   }
 
    ralloc_free(pipeline->mem_ctx);
    vk_object_base_finish(&pipeline->base);
@@ -445,8 +456,65 @@ shared_var_info(const struct glsl_type *type, unsigned *size, unsigned *align)
          this_progress;                                         \
       })
 
+/**
+ * Hash everything the NIR produced by lvp_shader_compile_to_ir depends on:
+ * the SPIR-V, entrypoint, specialization and the resource layout that
+ * lvp_lower_pipeline_layout bakes into the shader.
+ */
+static void
+lvp_hash_shader(unsigned char *sha1_out,
+                const struct lvp_shader_module *module,
+                const char *entrypoint_name,
+                gl_shader_stage stage,
+                const VkSpecializationInfo *spec_info,
+                const struct lvp_pipeline_layout *layout)
+{
+   struct mesa_sha1 ctx;
+
+   _mesa_sha1_init(&ctx);
+   _mesa_sha1_update(&ctx, module->sha1, sizeof(module->sha1));
+   _mesa_sha1_update(&ctx, entrypoint_name, strlen(entrypoint_name));
+   _mesa_sha1_update(&ctx, &stage, sizeof(stage));
+   if (spec_info && spec_info->mapEntryCount) {
+      _mesa_sha1_update(&ctx, spec_info->pMapEntries,
+                        spec_info->mapEntryCount * sizeof(*spec_info->pMapEntries));
+      _mesa_sha1_update(&ctx, spec_info->pData, spec_info->dataSize);
+   }
+
+   _mesa_sha1_update(&ctx, &layout->num_sets, sizeof(layout->num_sets));
+   _mesa_sha1_update(&ctx, &layout->push_constant_size,
+                     sizeof(layout->push_constant_size));
+   for (unsigned s = 0; s < layout->num_sets; s++) {
+      const struct lvp_descriptor_set_layout *set_layout = layout->set[s].layout;
+
+      _mesa_sha1_update(&ctx, &layout->set[s].dynamic_offset_start,
+                        sizeof(layout->set[s].dynamic_offset_start));
+      _mesa_sha1_update(&ctx, &set_layout->binding_count,
+                        sizeof(set_layout->binding_count));
+      _mesa_sha1_update(&ctx, set_layout->stage, sizeof(set_layout->stage));
+      _mesa_sha1_update(&ctx, &set_layout->dynamic_offset_count,
+                        sizeof(set_layout->dynamic_offset_count));
+      for (unsigned b = 0; b < set_layout->binding_count; b++) {
+         const struct lvp_descriptor_set_binding_layout *binding =
+            &set_layout->binding[b];
+
+         _mesa_sha1_update(&ctx, &binding->descriptor_index,
+                           sizeof(binding->descriptor_index));
+         _mesa_sha1_update(&ctx, &binding->type, sizeof(binding->type));
+         _mesa_sha1_update(&ctx, &binding->array_size,
+                           sizeof(binding->array_size));
+         _mesa_sha1_update(&ctx, &binding->valid, sizeof(binding->valid));
+         _mesa_sha1_update(&ctx, &binding->dynamic_index,
+                           sizeof(binding->dynamic_index));
+         _mesa_sha1_update(&ctx, binding->stage, sizeof(binding->stage));
+      }
+   }
+   _mesa_sha1_final(&ctx, sha1_out);
+}
+
 static void
 lvp_shader_compile_to_ir(struct lvp_pipeline *pipeline,
+                         struct lvp_pipeline_cache *cache,
                          struct lvp_shader_module *module,
                          const char *entrypoint_name,
                          gl_shader_stage stage,
@@ -454,7 +522,19 @@ lvp_shader_compile_to_ir(struct lvp_pipeline *pipeline,
 {
    nir_shader *nir;
    const nir_shader_compiler_options *drv_options = pipeline->device->pscreen->get_compiler_options(pipeline->device->pscreen, PIPE_SHADER_IR_NIR, st_shader_stage_to_ptarget(stage));
+   unsigned char sha1[20];
    bool progress;
+
+   if (cache) {
+      lvp_hash_shader(sha1, module, entrypoint_name, stage, spec_info,
+                      pipeline->layout);
+      nir = lvp_pipeline_cache_search_nir(cache, sha1, drv_options);
+      if (nir) {
+         pipeline->pipeline_nir[stage] = nir;
+         return;
+      }
+   }
+
    uint32_t *spirv = (uint32_t *) module->data;
    assert(spirv[0] == SPIR_V_MAGIC_NUMBER);
    assert(module->size % 4 == 0);
@@ -622,12 +702,9 @@ lvp_shader_compile_to_ir(struct lvp_pipeline *pipeline,
    nir_assign_io_var_locations(nir, nir_var_shader_out, &nir->num_outputs,
                                nir->info.stage);
    pipeline->pipeline_nir[stage] = nir;
-}
 
-static void fill_shader_prog(struct pipe_shader_state *state, gl_shader_stage stage, struct lvp_pipeline *pipeline)
-{
-   state->type = PIPE_SHADER_IR_NIR;
-   state->ir.nir = pipeline->pipeline_nir[stage];
+   if (cache)
+      lvp_pipeline_cache_upload_nir(cache, sha1, nir);
 }
 
 static void
@@ -691,34 +768,41 @@ lvp_shader_stage(VkShaderStageFlagBits stage)
    }
 }
 
-static VkResult
-lvp_pipeline_compile(struct lvp_pipeline *pipeline,
-                     gl_shader_stage stage)
+/**
+ * Create the gallium shader state for one stage on one queue's context.
+ * The driver takes ownership of the NIR it is given, while the pipeline
+ * keeps its own copy, so every context gets a clone.
+ */
+static void *
+lvp_pipeline_create_cso(struct lvp_pipeline *pipeline,
+                        struct pipe_context *ctx,
+                        gl_shader_stage stage)
 {
-   struct lvp_device *device = pipeline->device;
-   device->physical_device->pscreen->finalize_nir(device->physical_device->pscreen, pipeline->pipeline_nir[stage], true);
+   nir_shader *nir = pipeline->pipeline_nir[stage];
+
    if (stage == MESA_SHADER_COMPUTE) {
       struct pipe_compute_state shstate = {};
-      shstate.prog = (void *)pipeline->pipeline_nir[MESA_SHADER_COMPUTE];
+      shstate.prog = (void *)nir_shader_clone(NULL, nir);
       shstate.ir_type = PIPE_SHADER_IR_NIR;
-      shstate.req_local_mem = pipeline->pipeline_nir[MESA_SHADER_COMPUTE]->info.cs.shared_size;
-      pipeline->shader_cso[PIPE_SHADER_COMPUTE] = device->queue.ctx->create_compute_state(device->queue.ctx, &shstate);
+      shstate.req_local_mem = nir->info.cs.shared_size;
+      return ctx->create_compute_state(ctx, &shstate);
    } else {
       struct pipe_shader_state shstate = {};
-      fill_shader_prog(&shstate, stage, pipeline);
+      shstate.type = PIPE_SHADER_IR_NIR;
+      shstate.ir.nir = nir_shader_clone(NULL, nir);
 
       nir_xfb_info *xfb_info = NULL;
       if (stage == MESA_SHADER_VERTEX ||
           stage == MESA_SHADER_GEOMETRY ||
           stage == MESA_SHADER_TESS_EVAL) {
-         xfb_info = nir_gather_xfb_info(pipeline->pipeline_nir[stage], NULL);
+         xfb_info = nir_gather_xfb_info(nir, NULL);
          if (xfb_info) {
             unsigned num_outputs = 0;
             uint8_t output_mapping[VARYING_SLOT_TESS_MAX];
             memset(output_mapping, 0, sizeof(output_mapping));
 
             for (unsigned attr = 0; attr < VARYING_SLOT_MAX; attr++) {
-               if (pipeline->pipeline_nir[stage]->info.outputs_written & BITFIELD64_BIT(attr))
+               if (nir->info.outputs_written & BITFIELD64_BIT(attr))
                   output_mapping[attr] = num_outputs++;
             }
 
@@ -736,30 +820,58 @@ lvp_pipeline_compile(struct lvp_pipeline *pipeline,
                shstate.stream_output.output[i].start_component = ffs(xfb_info->outputs[i].component_mask) - 1;
                shstate.stream_output.output[i].stream = xfb_info->buffer_to_stream[xfb_info->outputs[i].buffer];
             }
+            ralloc_free(xfb_info);
          }
       }
 
       switch (stage) {
       case MESA_SHADER_FRAGMENT:
-         pipeline->shader_cso[PIPE_SHADER_FRAGMENT] = device->queue.ctx->create_fs_state(device->queue.ctx, &shstate);
-         break;
+         return ctx->create_fs_state(ctx, &shstate);
       case MESA_SHADER_VERTEX:
-         pipeline->shader_cso[PIPE_SHADER_VERTEX] = device->queue.ctx->create_vs_state(device->queue.ctx, &shstate);
-         break;
+         return ctx->create_vs_state(ctx, &shstate);
       case MESA_SHADER_GEOMETRY:
-         pipeline->shader_cso[PIPE_SHADER_GEOMETRY] = device->queue.ctx->create_gs_state(device->queue.ctx, &shstate);
-         break;
+         return ctx->create_gs_state(ctx, &shstate);
       case MESA_SHADER_TESS_CTRL:
-         pipeline->shader_cso[PIPE_SHADER_TESS_CTRL] = device->queue.ctx->create_tcs_state(device->queue.ctx, &shstate);
-         break;
+         return ctx->create_tcs_state(ctx, &shstate);
       case MESA_SHADER_TESS_EVAL:
-         pipeline->shader_cso[PIPE_SHADER_TESS_EVAL] = device->queue.ctx->create_tes_state(device->queue.ctx, &shstate);
-         break;
+         return ctx->create_tes_state(ctx, &shstate);
       default:
          unreachable("illegal shader");
-         break;
+         return NULL;
       }
    }
+}
+
+/* The queue threads may be using their contexts, so each queue's shader
+ * state is created under its ctx_lock.
+ */
+static void
+lvp_pipeline_create_csos(struct lvp_pipeline *pipeline,
+                         gl_shader_stage stage)
+{
+   struct lvp_device *device = pipeline->device;
+
+   for (unsigned q = 0; q < device->queue_count; q++) {
+      struct lvp_queue *queue = &device->queues[q];
+
+      mtx_lock(&queue->ctx_lock);
+      pipeline->shader_cso[q][pipe_shader_type_from_mesa(stage)] =
+         lvp_pipeline_create_cso(pipeline, queue->ctx, stage);
+      mtx_unlock(&queue->ctx_lock);
+   }
+}
+
+static VkResult
+lvp_pipeline_compile(struct lvp_pipeline *pipeline,
+                     gl_shader_stage stage)
+{
+   struct lvp_device *device = pipeline->device;
+   device->physical_device->pscreen->finalize_nir(device->physical_device->pscreen, pipeline->pipeline_nir[stage], true);
+
+   /* The pipeline owns the NIR, the shader states get clones of it. */
+   ralloc_steal(pipeline->mem_ctx, pipeline->pipeline_nir[stage]);
+
+   lvp_pipeline_create_csos(pipeline, stage);
    return VK_SUCCESS;
 }
 
@@ -785,7 +897,7 @@ lvp_graphics_pipeline_init(struct lvp_pipeline *pipeline,
       LVP_FROM_HANDLE(lvp_shader_module, module,
                       pCreateInfo->pStages[i].module);
       gl_shader_stage stage = lvp_shader_stage(pCreateInfo->pStages[i].stage);
-      lvp_shader_compile_to_ir(pipeline, module,
+      lvp_shader_compile_to_ir(pipeline, cache, module,
                                pCreateInfo->pStages[i].pName,
                                stage,
                                pCreateInfo->pStages[i].pSpecializationInfo);
@@ -818,10 +930,8 @@ lvp_graphics_pipeline_init(struct lvp_pipeline *pipeline,
                                                      "dummy_frag");
 
       pipeline->pipeline_nir[MESA_SHADER_FRAGMENT] = b.shader;
-      struct pipe_shader_state shstate = {};
-      shstate.type = PIPE_SHADER_IR_NIR;
-      shstate.ir.nir = pipeline->pipeline_nir[MESA_SHADER_FRAGMENT];
-      pipeline->shader_cso[PIPE_SHADER_FRAGMENT] = device->queue.ctx->create_fs_state(device->queue.ctx, &shstate);
+      ralloc_steal(pipeline->mem_ctx, b.shader);
+      lvp_pipeline_create_csos(pipeline, MESA_SHADER_FRAGMENT);
    }
    return VK_SUCCESS;
 }
@@ -906,7 +1016,7 @@ lvp_compute_pipeline_init(struct lvp_pipeline *pipeline,
                                  &pipeline->compute_create_info, pCreateInfo);
    pipeline->is_compute_pipeline = true;
 
-   lvp_shader_compile_to_ir(pipeline, module,
+   lvp_shader_compile_to_ir(pipeline, cache, module,
                             pCreateInfo->stage.pName,
                             MESA_SHADER_COMPUTE,
                             pCreateInfo->stage.pSpecializationInfo);
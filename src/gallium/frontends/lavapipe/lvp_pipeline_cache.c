@@ -22,6 +22,178 @@
  */
 
 #include "lvp_private.h"
+#include "util/blob.h"
+#include "util/hash_table.h"
+#include "compiler/nir/nir_serialize.h"
+
+/*
+ * The pipeline cache stores the NIR each shader stage is lowered to before
+ * it is handed to the gallium driver, so that warm pipeline creation skips
+ * spirv_to_nir and the lavapipe lowering/optimization loop.  llvmpipe keys
+ * its own on-disk cache of JIT'd machine code on the same NIR, which then
+ * hits as well.
+ *
+ * Serialized layout (after the standard 32 byte header):
+ *    struct lvp_cache_entry, followed by `size` bytes of serialized NIR,
+ *    padded to 8 bytes, repeated.
+ */
+
+#define LVP_CACHE_HEADER_SIZE 32
+
+struct lvp_cache_entry {
+   unsigned char sha1[20];
+   uint32_t size;
+   uint8_t data[0];
+};
+
+static uint32_t
+sha1_hash_func(const void *sha1)
+{
+   return _mesa_hash_data(sha1, 20);
+}
+
+static bool
+sha1_compare_func(const void *sha1_a, const void *sha1_b)
+{
+   return memcmp(sha1_a, sha1_b, 20) == 0;
+}
+
+void
+lvp_pipeline_cache_init(struct lvp_pipeline_cache *cache,
+                        struct lvp_device *device)
+{
+   cache->device = device;
+   mtx_init(&cache->mutex, mtx_plain);
+   cache->nir_cache = _mesa_hash_table_create(NULL, sha1_hash_func,
+                                              sha1_compare_func);
+}
+
+void
+lvp_pipeline_cache_finish(struct lvp_pipeline_cache *cache)
+{
+   if (cache->nir_cache) {
+      hash_table_foreach(cache->nir_cache, entry)
+         vk_free(&cache->alloc, entry->data);
+      _mesa_hash_table_destroy(cache->nir_cache, NULL);
+   }
+   mtx_destroy(&cache->mutex);
+}
+
+/* Takes the cache mutex. Returns false if the entry could not be stored. */
+static bool
+lvp_pipeline_cache_add_entry(struct lvp_pipeline_cache *cache,
+                             const unsigned char sha1[20],
+                             const void *data, uint32_t size)
+{
+   struct lvp_cache_entry *entry;
+   bool added = true;
+
+   mtx_lock(&cache->mutex);
+   if (_mesa_hash_table_search(cache->nir_cache, sha1))
+      goto out;
+
+   entry = vk_alloc(&cache->alloc, sizeof(*entry) + size, 8,
+                    VK_SYSTEM_ALLOCATION_SCOPE_CACHE);
+   if (!entry) {
+      added = false;
+      goto out;
+   }
+
+   memcpy(entry->sha1, sha1, sizeof(entry->sha1));
+   entry->size = size;
+   memcpy(entry->data, data, size);
+   _mesa_hash_table_insert(cache->nir_cache, entry->sha1, entry);
+out:
+   mtx_unlock(&cache->mutex);
+   return added;
+}
+
+void
+lvp_pipeline_cache_load(struct lvp_pipeline_cache *cache,
+                        const void *data, size_t size)
+{
+   struct blob_reader blob;
+   uint8_t uuid[VK_UUID_SIZE];
+   uint32_t hdr[4];
+
+   if (size < LVP_CACHE_HEADER_SIZE)
+      return;
+
+   blob_reader_init(&blob, data, size);
+   blob_copy_bytes(&blob, hdr, sizeof(hdr));
+   if (hdr[0] < LVP_CACHE_HEADER_SIZE ||
+       hdr[1] != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+       hdr[2] != VK_VENDOR_ID_MESA ||
+       hdr[3] != 0)
+      return;
+
+   lvp_device_get_cache_uuid(uuid);
+   if (memcmp(blob_read_bytes(&blob, VK_UUID_SIZE), uuid, VK_UUID_SIZE))
+      return;
+
+   blob_skip_bytes(&blob, hdr[0] - LVP_CACHE_HEADER_SIZE);
+
+   while (blob.current < blob.end) {
+      const unsigned char *sha1 = blob_read_bytes(&blob, 20);
+      uint32_t entry_size = blob_read_uint32(&blob);
+      const void *entry_data = blob_read_bytes(&blob, entry_size);
+      if (blob.overrun)
+         break;
+
+      if (!lvp_pipeline_cache_add_entry(cache, sha1, entry_data, entry_size))
+         break;
+
+      blob_skip_bytes(&blob, align(entry_size, 8) - entry_size);
+   }
+}
+
+nir_shader *
+lvp_pipeline_cache_search_nir(struct lvp_pipeline_cache *cache,
+                              const unsigned char sha1[20],
+                              const nir_shader_compiler_options *options)
+{
+   const struct lvp_cache_entry *cached = NULL;
+   struct blob_reader blob;
+   struct hash_entry *entry;
+   nir_shader *nir;
+
+   if (!cache)
+      return NULL;
+
+   mtx_lock(&cache->mutex);
+   entry = _mesa_hash_table_search(cache->nir_cache, sha1);
+   if (entry)
+      cached = entry->data;
+   mtx_unlock(&cache->mutex);
+   if (!cached)
+      return NULL;
+
+   /* Entries are never removed while the cache is alive. */
+   blob_reader_init(&blob, cached->data, cached->size);
+   nir = nir_deserialize(NULL, options, &blob);
+   if (blob.overrun) {
+      ralloc_free(nir);
+      return NULL;
+   }
+   return nir;
+}
+
+void
+lvp_pipeline_cache_upload_nir(struct lvp_pipeline_cache *cache,
+                              const unsigned char sha1[20],
+                              const nir_shader *nir)
+{
+   struct blob blob;
+
+   if (!cache)
+      return;
+
+   blob_init(&blob);
+   nir_serialize(&blob, nir, false);
+   if (!blob.out_of_memory)
+      lvp_pipeline_cache_add_entry(cache, sha1, blob.data, blob.size);
+   blob_finish(&blob);
+}
 
 VKAPI_ATTR VkResult VKAPI_CALL lvp_CreatePipelineCache(
     VkDevice                                    _device,
@@ -48,7 +220,18 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_CreatePipelineCache(
    else
      cache->alloc = device->vk.alloc;
 
-   cache->device = device;
+   lvp_pipeline_cache_init(cache, device);
+   if (!cache->nir_cache) {
+      lvp_pipeline_cache_finish(cache);
+      vk_object_base_finish(&cache->base);
+      vk_free2(&device->vk.alloc, pAllocator, cache);
+      return vk_error(device->instance, VK_ERROR_OUT_OF_HOST_MEMORY);
+   }
+
+   if (pCreateInfo->initialDataSize > 0)
+      lvp_pipeline_cache_load(cache, pCreateInfo->pInitialData,
+                              pCreateInfo->initialDataSize);
+
    *pPipelineCache = lvp_pipeline_cache_to_handle(cache);
 
    return VK_SUCCESS;
@@ -64,7 +247,7 @@ VKAPI_ATTR void VKAPI_CALL lvp_DestroyPipelineCache(
 
    if (!_cache)
       return;
-//   lvp_pipeline_cache_finish(cache);
+   lvp_pipeline_cache_finish(cache);
    vk_object_base_finish(&cache->base);
    vk_free2(&device->vk.alloc, pAllocator, cache);
 }
@@ -75,21 +258,54 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_GetPipelineCacheData(
         size_t*                                     pDataSize,
         void*                                       pData)
 {
+   LVP_FROM_HANDLE(lvp_pipeline_cache, cache, _cache);
    VkResult result = VK_SUCCESS;
-   if (pData) {
-      if (*pDataSize < 32) {
-         *pDataSize = 0;
+   size_t size = LVP_CACHE_HEADER_SIZE;
+
+   mtx_lock(&cache->mutex);
+
+   if (!pData) {
+      hash_table_foreach(cache->nir_cache, entry) {
+         const struct lvp_cache_entry *cached = entry->data;
+         size += sizeof(*cached) + align(cached->size, 8);
+      }
+      *pDataSize = size;
+      goto out;
+   }
+
+   if (*pDataSize < LVP_CACHE_HEADER_SIZE) {
+      *pDataSize = 0;
+      result = VK_INCOMPLETE;
+      goto out;
+   }
+
+   uint32_t *hdr = (uint32_t *)pData;
+   hdr[0] = LVP_CACHE_HEADER_SIZE;
+   hdr[1] = VK_PIPELINE_CACHE_HEADER_VERSION_ONE;
+   hdr[2] = VK_VENDOR_ID_MESA;
+   hdr[3] = 0;
+   lvp_device_get_cache_uuid(&hdr[4]);
+
+   /* Only whole entries are written, the rest is reported incomplete. */
+   hash_table_foreach(cache->nir_cache, entry) {
+      const struct lvp_cache_entry *cached = entry->data;
+      size_t entry_size = sizeof(*cached) + align(cached->size, 8);
+
+      if (size + entry_size > *pDataSize) {
          result = VK_INCOMPLETE;
-      } else {
-         uint32_t *hdr = (uint32_t *)pData;
-         hdr[0] = 32;
-         hdr[1] = 1;
-         hdr[2] = VK_VENDOR_ID_MESA;
-         hdr[3] = 0;
-         lvp_device_get_cache_uuid(&hdr[4]);
+         break;
       }
-   } else
-      *pDataSize = 32;
+
+      uint8_t *p = (uint8_t *)pData + size;
+      memcpy(p, cached, sizeof(*cached) + cached->size);
+      memset(p + sizeof(*cached) + cached->size, 0,
+             align(cached->size, 8) - cached->size);
+      size += entry_size;
+   }
+   *pDataSize = size;
+
+out:
+   mtx_unlock(&cache->mutex);
    return result;
 }
 
@@ -99,5 +315,23 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_MergePipelineCaches(
         uint32_t                                    srcCacheCount,
         const VkPipelineCache*                      pSrcCaches)
 {
+   LVP_FROM_HANDLE(lvp_pipeline_cache, dst, destCache);
+
+   for (uint32_t i = 0; i < srcCacheCount; i++) {
+      LVP_FROM_HANDLE(lvp_pipeline_cache, src, pSrcCaches[i]);
+
+      mtx_lock(&src->mutex);
+      hash_table_foreach(src->nir_cache, entry) {
+         const struct lvp_cache_entry *cached = entry->data;
+         if (!lvp_pipeline_cache_add_entry(dst, cached->sha1,
+                                           cached->data, cached->size)) {
+            mtx_unlock(&src->mutex);
+            return vk_error(dst->device->instance,
+                            VK_ERROR_OUT_OF_HOST_MEMORY);
+         }
+      }
+      mtx_unlock(&src->mutex);
+   }
+
    return VK_SUCCESS;
 }
@@ -64,6 +64,7 @@ extern "C" {
 #endif
 
 #define MAX_SETS         8
+#define LVP_MAX_QUEUES   4
 #define MAX_PUSH_CONSTANTS_SIZE 128
 #define MAX_PUSH_DESCRIPTORS 32
 
@@ -176,6 +177,7 @@ void __lvp_finishme(const char *file, int line, const char *format, ...)
 
 struct lvp_shader_module {
    struct vk_object_base base;
+   unsigned char                                sha1[20];
    uint32_t                                     size;
    char                                         data[0];
 };
@@ -236,17 +238,38 @@ struct lvp_queue {
    VK_LOADER_DATA                              _loader_data;
    VkDeviceQueueCreateFlags flags;
    struct lvp_device *                         device;
+   unsigned index;   /**< into device->queues[] and per-queue pipeline state */
    struct pipe_context *ctx;
+   /* Held by the queue thread while executing, by query pool destruction
+    * and readback, which use the context owning the query, and around
+    * creating and deleting each queue's pipeline shader states.
+    */
+   mtx_t ctx_lock;
    bool shutdown;
    thrd_t exec_thread;
    mtx_t m;
    cnd_t new_work;
    struct list_head workqueue;
    uint32_t count;
+
+   /* Submissions are numbered in order; other queues wait on these to
+    * implement semaphores.  Both are protected by `m`.
+    */
+   uint64_t submitted;
+   uint64_t completed;
+   cnd_t work_done;
+};
+
+struct lvp_semaphore_wait {
+   struct lvp_queue *queue;
+   uint64_t serial;
 };
 
 struct lvp_queue_work {
    struct list_head list;
+   uint64_t serial;
+   uint32_t wait_count;
+   struct lvp_semaphore_wait *waits;
    uint32_t cmd_buffer_count;
    struct lvp_cmd_buffer **cmd_buffers;
    struct lvp_fence *fence;
@@ -256,12 +279,30 @@ struct lvp_pipeline_cache {
    struct vk_object_base                        base;
    struct lvp_device *                          device;
    VkAllocationCallbacks                        alloc;
+
+   /* Serialized NIR of compiled shader stages, keyed by SHA-1 */
+   mtx_t                                        mutex;
+   struct hash_table *                          nir_cache;
 };
 
+void lvp_pipeline_cache_init(struct lvp_pipeline_cache *cache,
+                             struct lvp_device *device);
+void lvp_pipeline_cache_finish(struct lvp_pipeline_cache *cache);
+void lvp_pipeline_cache_load(struct lvp_pipeline_cache *cache,
+                             const void *data, size_t size);
+
+nir_shader *lvp_pipeline_cache_search_nir(struct lvp_pipeline_cache *cache,
+                                          const unsigned char sha1[20],
+                                          const nir_shader_compiler_options *options);
+void lvp_pipeline_cache_upload_nir(struct lvp_pipeline_cache *cache,
+                                   const unsigned char sha1[20],
+                                   const nir_shader *nir);
+
 struct lvp_device {
    struct vk_device vk;
 
-   struct lvp_queue queue;
+   struct lvp_queue queues[LVP_MAX_QUEUES];
+   uint32_t queue_count;
    struct lvp_instance *                       instance;
    struct lvp_physical_device *physical_device;
    struct pipe_screen *pscreen;
@@ -518,7 +559,8 @@ struct lvp_pipeline {
    bool is_compute_pipeline;
    bool force_min_sample;
    nir_shader *pipeline_nir[MESA_SHADER_STAGES];
-   void *shader_cso[PIPE_SHADER_TYPES];
+   /* Gallium shader states are per context, so there is one set per queue */
+   void *shader_cso[LVP_MAX_QUEUES][PIPE_SHADER_TYPES];
    VkGraphicsPipelineCreateInfo graphics_create_info;
    VkComputePipelineCreateInfo compute_create_info;
 };
@@ -536,7 +578,9 @@ struct lvp_fence {
 
 struct lvp_semaphore {
    struct vk_object_base base;
-   bool dummy;
+   /* The last submission signalling the semaphore, if any */
+   struct lvp_queue *queue;
+   uint64_t serial;
 };
 
 struct lvp_buffer {
@@ -566,6 +610,8 @@ struct lvp_query_pool {
    uint32_t count;
    VkQueryPipelineStatisticFlags pipeline_stats;
    enum pipe_query_type base_type;
+   /** Index of the queue whose context created each query */
+   uint32_t *query_queue;
    struct pipe_query *queries[0];
 };
 
@@ -595,7 +641,8 @@ struct lvp_cmd_buffer {
    struct lvp_cmd_pool *                        pool;
    struct list_head                             pool_link;
 
-   struct list_head                             cmds;
+   /* Recorded commands, packed back to back into lvp_cmd_blocks */
+   struct list_head                             cmd_blocks;
 
    uint8_t push_constants[MAX_PUSH_CONSTANTS_SIZE];
 };
@@ -985,8 +1032,8 @@ struct lvp_cmd_begin_conditional_rendering {
 };
 
 struct lvp_cmd_buffer_entry {
-   struct list_head cmd_link;
    uint32_t cmd_type;
+   uint32_t cmd_size;   /**< whole entry incl. trailing data, 8 byte aligned */
    union {
       struct lvp_cmd_bind_pipeline pipeline;
       struct lvp_cmd_set_viewport set_viewport;
@@ -1034,6 +1081,23 @@ struct lvp_cmd_buffer_entry {
    } u;
 };
 
+#define LVP_CMD_BLOCK_SIZE (16 * 1024)
+
+struct lvp_cmd_block {
+   struct list_head link;
+   uint32_t size;   /**< bytes available in data[] */
+   uint32_t used;
+   uint8_t data[0];
+};
+
+#define lvp_foreach_cmd(cmd, cmd_buffer)                                    \
+   list_for_each_entry(struct lvp_cmd_block, __block,                      \
+                       &(cmd_buffer)->cmd_blocks, link)                    \
+      for (struct lvp_cmd_buffer_entry *cmd =                              \
+              (struct lvp_cmd_buffer_entry *)__block->data;                \
+           (uint8_t *)cmd < __block->data + __block->used;                 \
+           cmd = (struct lvp_cmd_buffer_entry *)((uint8_t *)cmd + cmd->cmd_size))
+
 VkResult lvp_execute_cmds(struct lvp_device *device,
                           struct lvp_queue *queue,
                           struct lvp_fence *fence,
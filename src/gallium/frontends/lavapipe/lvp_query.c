@@ -50,7 +50,8 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateQueryPool(
       return VK_ERROR_FEATURE_NOT_PRESENT;
    }
    struct lvp_query_pool *pool;
-   uint32_t pool_size = sizeof(*pool) + pCreateInfo->queryCount * sizeof(struct pipe_query *);
+   uint32_t pool_size = sizeof(*pool) + pCreateInfo->queryCount *
+      (sizeof(struct pipe_query *) + sizeof(uint32_t));
 
    pool = vk_zalloc2(&device->vk.alloc, pAllocator,
                     pool_size, 8,
@@ -64,6 +65,7 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateQueryPool(
    pool->count = pCreateInfo->queryCount;
    pool->base_type = pipeq;
    pool->pipeline_stats = pCreateInfo->pipelineStatistics;
+   pool->query_queue = (uint32_t *)&pool->queries[pool->count];
 
    *pQueryPool = lvp_query_pool_to_handle(pool);
    return VK_SUCCESS;
@@ -80,9 +82,15 @@ VKAPI_ATTR void VKAPI_CALL lvp_DestroyQueryPool(
    if (!pool)
       return;
 
-   for (unsigned i = 0; i < pool->count; i++)
-      if (pool->queries[i])
-         device->queue.ctx->destroy_query(device->queue.ctx, pool->queries[i]);
+   for (unsigned i = 0; i < pool->count; i++) {
+      if (pool->queries[i]) {
+         struct lvp_queue *queue = &device->queues[pool->query_queue[i]];
+
+         mtx_lock(&queue->ctx_lock);
+         queue->ctx->destroy_query(queue->ctx, pool->queries[i]);
+         mtx_unlock(&queue->ctx_lock);
+      }
+   }
    vk_object_base_finish(&pool->base);
    vk_free2(&device->vk.alloc, pAllocator, pool);
 }
@@ -108,10 +116,14 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_GetQueryPoolResults(
       union pipe_query_result result;
       bool ready = false;
       if (pool->queries[i]) {
-        ready = device->queue.ctx->get_query_result(device->queue.ctx,
-                                                    pool->queries[i],
-                                                    (flags & VK_QUERY_RESULT_WAIT_BIT),
-                                                    &result);
+        struct lvp_queue *queue = &device->queues[pool->query_queue[i]];
+
+        mtx_lock(&queue->ctx_lock);
+        ready = queue->ctx->get_query_result(queue->ctx,
+                                             pool->queries[i],
+                                             (flags & VK_QUERY_RESULT_WAIT_BIT),
+                                             &result);
+        mtx_unlock(&queue->ctx_lock);
       } else {
         result.u64 = 0;
       }
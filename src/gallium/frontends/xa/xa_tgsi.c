@@ -471,7 +471,8 @@ shader_from_cache(struct pipe_context *pipe,
 	    shader = create_vs(pipe, key);
 	else
 	    shader = create_fs(pipe, key);
-	cso_hash_insert(hash, key, shader);
+	if (shader)
+	    cso_hash_insert(hash, key, shader);
     } else
 	shader = (void *)cso_hash_iter_data(iter);
 
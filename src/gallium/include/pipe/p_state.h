@@ -559,6 +559,13 @@ struct pipe_resource
    unsigned bind;            /**< bitmask of PIPE_BIND_x */
    unsigned flags;           /**< bitmask of PIPE_RESOURCE_FLAG_x */
 
+   /**
+    * Incremented whenever the frontend modifies the contents of a buffer,
+    * so that data derived from it can be revalidated.  Only maintained by
+    * frontends that create their CSO context with CSO_TRACK_BUFFER_WRITES.
+    */
+   unsigned write_count;
+
    /**
     * For planar images, ie. YUV EGLImage external, etc, pointer to the
     * next plane.
@@ -0,0 +1,365 @@
+/**************************************************************************
+ *
+ * Copyright 2021 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+/*
+ * Test case for cso_hash and the state caching of cso_context, using a
+ * dummy driver that only counts created, deleted and bound states.
+ *
+ * Run with "bench" as the argument to time cso_set_* instead.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cso_cache/cso_context.h"
+#include "cso_cache/cso_hash.h"
+#include "pipe/p_context.h"
+#include "pipe/p_screen.h"
+#include "util/os_time.h"
+#include "util/u_memory.h"
+#include "dummy_pipe.h"
+
+
+static unsigned num_created, num_deleted, num_binds;
+
+
+static void *
+dummy_create_state(struct pipe_context *pipe, const void *state)
+{
+   num_created++;
+   return MALLOC(1);
+}
+
+static void *
+dummy_create_velems(struct pipe_context *pipe, unsigned count,
+                    const struct pipe_vertex_element *velems)
+{
+   return dummy_create_state(pipe, velems);
+}
+
+static void
+dummy_delete_state(struct pipe_context *pipe, void *state)
+{
+   num_deleted++;
+   FREE(state);
+}
+
+static void
+dummy_bind_state(struct pipe_context *pipe, void *state)
+{
+   num_binds++;
+}
+
+static void
+dummy_set_constant_buffer(struct pipe_context *pipe,
+                          enum pipe_shader_type shader, uint index,
+                          bool take_ownership,
+                          const struct pipe_constant_buffer *buf)
+{
+}
+
+
+static void
+init_dummy_context(struct pipe_screen *screen, struct pipe_context *pipe)
+{
+   dummy_pipe_init(screen, pipe);
+   pipe->create_blend_state = (void *)dummy_create_state;
+   pipe->create_depth_stencil_alpha_state = (void *)dummy_create_state;
+   pipe->create_rasterizer_state = (void *)dummy_create_state;
+   pipe->create_vertex_elements_state = dummy_create_velems;
+   pipe->delete_blend_state = dummy_delete_state;
+   pipe->delete_depth_stencil_alpha_state = dummy_delete_state;
+   pipe->delete_rasterizer_state = dummy_delete_state;
+   pipe->delete_vertex_elements_state = dummy_delete_state;
+   pipe->bind_blend_state = dummy_bind_state;
+   pipe->bind_depth_stencil_alpha_state = dummy_bind_state;
+   pipe->bind_rasterizer_state = dummy_bind_state;
+   pipe->bind_vertex_elements_state = dummy_bind_state;
+   pipe->bind_fs_state = dummy_bind_state;
+   pipe->bind_vs_state = dummy_bind_state;
+   pipe->set_constant_buffer = dummy_set_constant_buffer;
+}
+
+
+static void
+make_blend(struct pipe_blend_state *blend, unsigned i)
+{
+   memset(blend, 0, sizeof(*blend));
+   blend->rt[0].blend_enable = 1;
+   blend->rt[0].rgb_src_factor = i & 0x1f;
+   blend->rt[0].alpha_src_factor = (i >> 5) & 0x1f;
+   blend->rt[0].rgb_dst_factor = (i >> 10) & 0x1f;
+}
+
+static void
+make_dsa(struct pipe_depth_stencil_alpha_state *dsa, unsigned i)
+{
+   memset(dsa, 0, sizeof(*dsa));
+   dsa->depth_enabled = 1;
+   dsa->depth_func = i & 7;
+   dsa->stencil[0].enabled = 1;
+   dsa->stencil[0].valuemask = i >> 3;
+}
+
+static void
+make_rasterizer(struct pipe_rasterizer_state *rast, unsigned i)
+{
+   memset(rast, 0, sizeof(*rast));
+   rast->cull_face = i & 3;
+   rast->line_width = 1 + i / 4;
+   rast->half_pixel_center = 1;
+}
+
+
+static unsigned
+test_hash(void)
+{
+   const unsigned num_keys = 5000;
+   unsigned fails = 0;
+   unsigned *values = malloc(num_keys * 2 * sizeof(unsigned));
+   struct cso_hash hash;
+   struct cso_hash_iter iter;
+
+   cso_hash_init(&hash);
+
+   if (!cso_hash_iter_is_null(cso_hash_find(&hash, 0)) ||
+       !cso_hash_iter_is_null(cso_hash_first_node(&hash)))
+      fails++;
+
+   /* Two entries per key, keys which only differ in their high bits. */
+   for (unsigned i = 0; i < num_keys * 2; i++) {
+      values[i] = i;
+      cso_hash_insert(&hash, (i / 2) << 18, &values[i]);
+   }
+
+   if (cso_hash_size(&hash) != num_keys * 2)
+      fails++;
+
+   for (unsigned k = 0; k < num_keys; k++) {
+      unsigned found = 0;
+
+      for (iter = cso_hash_find(&hash, k << 18); !cso_hash_iter_is_null(iter);
+           iter = cso_hash_find_next(iter)) {
+         unsigned *value = cso_hash_iter_data(iter);
+
+         if (cso_hash_iter_key(iter) != k << 18 || *value / 2 != k)
+            fails++;
+         found |= 1 << (*value % 2);
+      }
+      if (found != 3)
+         fails++;
+   }
+
+   /* Erase the odd values while iterating. */
+   unsigned count = 0;
+   iter = cso_hash_first_node(&hash);
+   while (!cso_hash_iter_is_null(iter)) {
+      unsigned *value = cso_hash_iter_data(iter);
+
+      count++;
+      if (*value % 2)
+         iter = cso_hash_erase(&hash, iter);
+      else
+         iter = cso_hash_iter_next(iter);
+   }
+
+   if (count != num_keys * 2 || cso_hash_size(&hash) != num_keys)
+      fails++;
+
+   for (unsigned k = 0; k < num_keys; k++) {
+      unsigned *value = cso_hash_take(&hash, k << 18);
+
+      if (!value || *value != k * 2 || cso_hash_contains(&hash, k << 18))
+         fails++;
+
+      /* Reinsert half of them, reusing the erased slots. */
+      if (k % 2)
+         cso_hash_insert(&hash, k << 18, value);
+   }
+
+   if (cso_hash_size(&hash) != num_keys / 2)
+      fails++;
+
+   for (unsigned k = 0; k < num_keys; k++) {
+      if (cso_hash_contains(&hash, k << 18) != (k % 2))
+         fails++;
+   }
+
+   cso_hash_deinit(&hash);
+   free(values);
+
+   if (fails)
+      printf("cso_hash: %u errors\n", fails);
+   return fails;
+}
+
+
+static unsigned
+test_context(void)
+{
+   struct pipe_screen screen;
+   struct pipe_context pipe;
+   struct cso_context *cso;
+   unsigned fails = 0;
+
+   init_dummy_context(&screen, &pipe);
+   num_created = num_deleted = num_binds = 0;
+
+   cso = cso_create_context(&pipe, CSO_NO_USER_VERTEX_BUFFERS);
+
+   /* Each state is created once and only bound when it changes. */
+   for (unsigned pass = 0; pass < 3; pass++) {
+      for (unsigned i = 0; i < 300; i++) {
+         struct pipe_blend_state blend;
+         struct pipe_depth_stencil_alpha_state dsa;
+         struct pipe_rasterizer_state rast;
+
+         make_blend(&blend, i);
+         make_dsa(&dsa, i);
+         make_rasterizer(&rast, i);
+         cso_set_blend(cso, &blend);
+         cso_set_blend(cso, &blend);
+         cso_set_depth_stencil_alpha(cso, &dsa);
+         cso_set_rasterizer(cso, &rast);
+      }
+   }
+
+   if (num_created != 900 || num_deleted != 0 || num_binds != 2700) {
+      printf("cso_context: created %u, deleted %u, bound %u\n",
+             num_created, num_deleted, num_binds);
+      fails++;
+   }
+
+   /* Go over the maximum cache size, so that states are evicted. */
+   for (unsigned i = 0; i < 6000; i++) {
+      struct pipe_blend_state blend;
+
+      make_blend(&blend, i);
+      cso_set_blend(cso, &blend);
+   }
+
+   if (!num_deleted)
+      fails++;
+
+   cso_destroy_context(cso);
+
+   if (num_created != num_deleted) {
+      printf("cso_context: created %u, deleted %u\n",
+             num_created, num_deleted);
+      fails++;
+   }
+
+   return fails;
+}
+
+
+static void
+bench(void)
+{
+   static const unsigned working_sets[] = { 1, 4, 64, 1024, 4096 };
+   struct pipe_screen screen;
+   struct pipe_context pipe;
+
+   init_dummy_context(&screen, &pipe);
+
+   printf("%8s %12s %12s %12s\n",
+          "states", "blend ns", "dsa ns", "rast ns");
+
+   for (unsigned w = 0; w < ARRAY_SIZE(working_sets); w++) {
+      const unsigned num_states = working_sets[w];
+      struct cso_context *cso =
+         cso_create_context(&pipe, CSO_NO_USER_VERTEX_BUFFERS);
+      struct pipe_blend_state *blend = malloc(num_states * sizeof(*blend));
+      struct pipe_depth_stencil_alpha_state *dsa =
+         malloc(num_states * sizeof(*dsa));
+      struct pipe_rasterizer_state *rast = malloc(num_states * sizeof(*rast));
+      const unsigned iterations = 1 << 20;
+      double ns[3];
+
+      for (unsigned i = 0; i < num_states; i++) {
+         make_blend(&blend[i], i);
+         make_dsa(&dsa[i], i);
+         make_rasterizer(&rast[i], i);
+      }
+
+      for (unsigned type = 0; type < 3; type++) {
+         int64_t start = 0;
+
+         /* The first pass creates the states. */
+         for (unsigned pass = 0; pass < 2; pass++) {
+            if (pass)
+               start = os_time_get_nano();
+
+            for (unsigned i = 0; i < (pass ? iterations : num_states); i++) {
+               unsigned s = i % num_states;
+
+               switch (type) {
+               case 0:
+                  cso_set_blend(cso, &blend[s]);
+                  break;
+               case 1:
+                  cso_set_depth_stencil_alpha(cso, &dsa[s]);
+                  break;
+               default:
+                  cso_set_rasterizer(cso, &rast[s]);
+                  break;
+               }
+            }
+         }
+         ns[type] = (double)(os_time_get_nano() - start) / iterations;
+      }
+
+      printf("%8u %12.1f %12.1f %12.1f\n", num_states, ns[0], ns[1], ns[2]);
+
+      cso_destroy_context(cso);
+      free(blend);
+      free(dsa);
+      free(rast);
+   }
+}
+
+
+int
+main(int argc, char **argv)
+{
+   unsigned fails;
+
+   if (argc > 1 && !strcmp(argv[1], "bench")) {
+      bench();
+      return 0;
+   }
+
+   fails = test_hash() + test_context();
+   if (fails) {
+      printf("Failure! %u errors.\n", fails);
+      return 1;
+   }
+
+   printf("Success!\n");
+   return 0;
+}
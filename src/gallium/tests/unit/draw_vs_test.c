@@ -0,0 +1,241 @@
+/**************************************************************************
+ *
+ * Copyright 2021 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+/*
+ * Test case for the vertex shader system values of draw's llvm path when a
+ * draw is shaded on several helper threads.  Each point's vertex shader
+ * outputs its fetched attribute, first vertex and vertex id, which a final
+ * pipeline stage checks.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "compiler/nir/nir_builder.h"
+#include "draw/draw_context.h"
+#include "draw/draw_pipe.h"
+#include "draw/draw_private.h"
+#include "pipe/p_context.h"
+#include "pipe/p_screen.h"
+#include "pipe/p_state.h"
+#include "dummy_pipe.h"
+
+
+#define START 1000
+#define COUNT 1024
+
+struct check_stage {
+   struct draw_stage base;
+   unsigned num_points;
+   unsigned fails;
+};
+
+
+static void
+check_point(struct draw_stage *stage, struct prim_header *header)
+{
+   struct check_stage *check = (struct check_stage *)stage;
+   const float *result = header->v[0]->data[1];
+   unsigned vertex = START + check->num_points++;
+
+   if (result[0] != vertex || result[1] != START || result[2] != vertex) {
+      if (check->fails++ < 8) {
+         printf("vertex %u: attrib %g, first vertex %g, vertex id %g\n",
+                vertex, result[0], result[1], result[2]);
+      }
+   }
+}
+
+
+static void
+check_flush(struct draw_stage *stage, unsigned flags)
+{
+}
+
+
+static void
+check_reset_stipple_counter(struct draw_stage *stage)
+{
+}
+
+
+static void
+check_destroy(struct draw_stage *stage)
+{
+}
+
+
+static nir_shader *
+create_vs(void)
+{
+   static const nir_shader_compiler_options options = { 0 };
+   nir_builder b =
+      nir_builder_init_simple_shader(MESA_SHADER_VERTEX, &options,
+                                     "draw_vs_test");
+   nir_variable *in, *pos, *result;
+   nir_ssa_def *attrib, *first_vertex, *vertex_id;
+
+   in = nir_variable_create(b.shader, nir_var_shader_in, glsl_vec4_type(),
+                            "in");
+   in->data.location = VERT_ATTRIB_GENERIC0;
+   in->data.driver_location = 0;
+
+   pos = nir_variable_create(b.shader, nir_var_shader_out, glsl_vec4_type(),
+                             "pos");
+   pos->data.location = VARYING_SLOT_POS;
+   pos->data.driver_location = 0;
+
+   result = nir_variable_create(b.shader, nir_var_shader_out,
+                                glsl_vec4_type(), "result");
+   result->data.location = VARYING_SLOT_VAR0;
+   result->data.driver_location = 1;
+
+   attrib = nir_channel(&b, nir_load_var(&b, in), 0);
+   first_vertex = nir_i2f32(&b, nir_load_first_vertex(&b));
+   vertex_id = nir_i2f32(&b, nir_load_vertex_id(&b));
+
+   nir_store_var(&b, pos, nir_imm_vec4(&b, 0.0f, 0.0f, 0.0f, 1.0f), 0xf);
+   nir_store_var(&b, result,
+                 nir_vec4(&b, attrib, first_vertex, vertex_id,
+                          nir_imm_float(&b, 1.0f)), 0xf);
+
+   b.shader->num_inputs = 1;
+   b.shader->num_outputs = 2;
+   nir_shader_gather_info(b.shader, b.impl);
+
+   return b.shader;
+}
+
+
+static unsigned
+test_first_vertex(void)
+{
+   struct pipe_screen screen;
+   struct pipe_context pipe;
+   struct draw_context *draw;
+   struct check_stage check;
+   struct pipe_shader_state vs_state;
+   struct draw_vertex_shader *vs;
+   struct pipe_rasterizer_state rast;
+   struct pipe_viewport_state viewport;
+   struct pipe_vertex_element velem;
+   struct pipe_vertex_buffer vbuf;
+   struct pipe_draw_info info;
+   struct pipe_draw_start_count range;
+   static float vertices[START + COUNT][4];
+   unsigned i;
+
+   dummy_pipe_init(&screen, &pipe);
+
+   /* Several jobs of at least 128 vertices each. */
+   setenv("DRAW_VS_THREADS", "3", 1);
+
+   draw = draw_create(&pipe);
+   if (!draw) {
+      printf("failed to create draw context\n");
+      return 1;
+   }
+
+   memset(&check, 0, sizeof(check));
+   check.base.draw = draw;
+   check.base.name = "check";
+   check.base.point = check_point;
+   check.base.flush = check_flush;
+   check.base.reset_stipple_counter = check_reset_stipple_counter;
+   check.base.destroy = check_destroy;
+   draw_set_rasterize_stage(draw, &check.base);
+
+   memset(&rast, 0, sizeof(rast));
+   rast.point_size = 1.0f;
+   rast.half_pixel_center = 1;
+   draw_set_rasterizer_state(draw, &rast, &rast);
+
+   memset(&viewport, 0, sizeof(viewport));
+   for (i = 0; i < 3; i++)
+      viewport.scale[i] = 1.0f;
+   draw_set_viewport_states(draw, 0, 1, &viewport);
+
+   memset(&vs_state, 0, sizeof(vs_state));
+   vs_state.type = PIPE_SHADER_IR_NIR;
+   vs_state.ir.nir = create_vs();
+   vs = draw_create_vertex_shader(draw, &vs_state);
+   draw_bind_vertex_shader(draw, vs);
+
+   for (i = 0; i < START + COUNT; i++)
+      vertices[i][0] = i;
+
+   memset(&velem, 0, sizeof(velem));
+   velem.src_format = PIPE_FORMAT_R32G32B32A32_FLOAT;
+   draw_set_vertex_elements(draw, 1, &velem);
+
+   memset(&vbuf, 0, sizeof(vbuf));
+   vbuf.stride = sizeof(vertices[0]);
+   vbuf.buffer.user = vertices;
+   vbuf.is_user_buffer = true;
+   draw_set_vertex_buffers(draw, 0, 1, 0, &vbuf);
+   draw_set_mapped_vertex_buffer(draw, 0, vertices, sizeof(vertices));
+
+   memset(&info, 0, sizeof(info));
+   info.mode = PIPE_PRIM_POINTS;
+   info.instance_count = 1;
+   info.max_index = ~0;
+   range.start = START;
+   range.count = COUNT;
+   draw_vbo(draw, &info, NULL, &range, 1);
+   draw_flush(draw);
+
+   if (check.num_points != COUNT) {
+      printf("got %u points, expected %u\n", check.num_points, COUNT);
+      check.fails++;
+   }
+
+   draw_bind_vertex_shader(draw, NULL);
+   draw_delete_vertex_shader(draw, vs);
+   draw_destroy(draw);
+
+   return check.fails;
+}
+
+
+int
+main(int argc, char **argv)
+{
+   unsigned fails;
+
+   glsl_type_singleton_init_or_ref();
+   fails = test_first_vertex();
+   glsl_type_singleton_decref();
+
+   if (fails) {
+      printf("Failure! %u errors.\n", fails);
+      return 1;
+   }
+
+   printf("Success!\n");
+   return 0;
+}
@@ -0,0 +1,76 @@
+/**************************************************************************
+ *
+ * Copyright 2021 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+/*
+ * Screen and context scaffolding shared by the unit tests that drive
+ * auxiliary modules through a dummy driver.
+ */
+
+#include <string.h>
+
+#include "pipe/p_context.h"
+#include "pipe/p_screen.h"
+#include "dummy_pipe.h"
+
+
+static int
+dummy_get_param(struct pipe_screen *screen, enum pipe_cap param)
+{
+   return param == PIPE_CAP_MAX_VERTEX_BUFFERS ? 16 : 0;
+}
+
+static int
+dummy_get_shader_param(struct pipe_screen *screen,
+                       enum pipe_shader_type shader,
+                       enum pipe_shader_cap param)
+{
+   return param == PIPE_SHADER_CAP_MAX_INPUTS ? 16 : 0;
+}
+
+static bool
+dummy_is_format_supported(struct pipe_screen *screen,
+                          enum pipe_format format,
+                          enum pipe_texture_target target,
+                          unsigned sample_count,
+                          unsigned storage_sample_count,
+                          unsigned bindings)
+{
+   return true;
+}
+
+
+void
+dummy_pipe_init(struct pipe_screen *screen, struct pipe_context *pipe)
+{
+   memset(screen, 0, sizeof(*screen));
+   screen->get_param = dummy_get_param;
+   screen->get_shader_param = dummy_get_shader_param;
+   screen->is_format_supported = dummy_is_format_supported;
+
+   memset(pipe, 0, sizeof(*pipe));
+   pipe->screen = screen;
+}
@@ -0,0 +1,216 @@
+/**************************************************************************
+ *
+ * Copyright 2021 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+/*
+ * Checks the output of the fixed function tessellator for all domains and
+ * partitioning modes over a range of tessellation factors.
+ *
+ * Run with "bench" as the argument to time it instead.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pipe/p_defines.h"
+#include "tessellator/p_tessellator.h"
+#include "util/os_time.h"
+#include "util/u_math.h"
+
+static const enum pipe_prim_type prim_modes[] = {
+   PIPE_PRIM_TRIANGLES,
+   PIPE_PRIM_QUADS,
+   PIPE_PRIM_LINES,
+};
+
+static const char *prim_names[] = { "tri", "quad", "isoline" };
+
+static const enum pipe_tess_spacing spacings[] = {
+   PIPE_TESS_SPACING_EQUAL,
+   PIPE_TESS_SPACING_FRACTIONAL_ODD,
+   PIPE_TESS_SPACING_FRACTIONAL_EVEN,
+};
+
+static const char *spacing_names[] = { "equal", "odd", "even" };
+
+static const float factors[] = {
+   1.0f, 1.5f, 2.0f, 3.7f, 4.0f, 7.3f, 8.0f, 16.0f, 21.9f, 32.0f, 47.5f, 64.0f,
+};
+
+
+static void
+set_factors(struct pipe_tessellation_factors *tf, float outer, float inner)
+{
+   memset(tf, 0, sizeof *tf);
+   for (unsigned i = 0; i < 4; i++)
+      tf->outer_tf[i] = outer;
+   for (unsigned i = 0; i < 2; i++)
+      tf->inner_tf[i] = inner;
+}
+
+
+static unsigned
+check(enum pipe_prim_type prim_mode, bool point_mode,
+      const struct pipe_tessellator_data *data)
+{
+   unsigned verts_per_prim = point_mode ? 1 :
+                             prim_mode == PIPE_PRIM_LINES ? 2 : 3;
+   unsigned padded = align(data->num_domain_points,
+                           PIPE_TESS_DOMAIN_POINT_ALIGN);
+   unsigned fails = 0;
+
+   if (!data->num_domain_points || data->num_indices % verts_per_prim)
+      fails++;
+
+   for (unsigned i = 0; i < data->num_domain_points; i++) {
+      float u = data->domain_points_u[i];
+      float v = data->domain_points_v[i];
+      if (!(u >= 0.0f && u <= 1.0f && v >= 0.0f && v <= 1.0f))
+         fails++;
+      else if (prim_mode == PIPE_PRIM_TRIANGLES && u + v > 1.0f + 1e-6f)
+         fails++;
+   }
+
+   /* the padding must be readable and zeroed */
+   for (unsigned i = data->num_domain_points; i < padded; i++) {
+      if (data->domain_points_u[i] != 0.0f ||
+          data->domain_points_v[i] != 0.0f)
+         fails++;
+   }
+
+   for (unsigned i = 0; i < data->num_indices; i++) {
+      if (data->indices[i] >= data->num_domain_points)
+         fails++;
+   }
+
+   return fails;
+}
+
+
+static unsigned
+test(void)
+{
+   unsigned fails = 0;
+
+   for (unsigned p = 0; p < ARRAY_SIZE(prim_modes); p++) {
+      for (unsigned s = 0; s < ARRAY_SIZE(spacings); s++) {
+         for (unsigned point_mode = 0; point_mode < 2; point_mode++) {
+            struct pipe_tessellator *ptess =
+               p_tess_init(prim_modes[p], spacings[s], false, point_mode);
+
+            for (unsigned o = 0; o < ARRAY_SIZE(factors); o++) {
+               for (unsigned i = 0; i < ARRAY_SIZE(factors); i++) {
+                  struct pipe_tessellation_factors tf;
+                  struct pipe_tessellator_data data = { 0 };
+                  unsigned f;
+
+                  set_factors(&tf, factors[o], factors[i]);
+                  p_tessellate(ptess, &tf, &data);
+
+                  f = check(prim_modes[p], point_mode, &data);
+                  if (f) {
+                     printf("%s %s%s outer %f inner %f: %u errors\n",
+                            prim_names[p], spacing_names[s],
+                            point_mode ? " points" : "",
+                            factors[o], factors[i], f);
+                     fails += f;
+                  }
+               }
+            }
+
+            p_tess_destroy(ptess);
+         }
+      }
+   }
+
+   return fails;
+}
+
+
+static void
+bench(void)
+{
+   static const float bench_factors[] = { 4.0f, 16.0f, 32.0f, 64.0f };
+
+   printf("%-8s %-6s %7s %10s %10s\n",
+          "domain", "mode", "factor", "us/patch", "Mpoints/s");
+
+   for (unsigned p = 0; p < ARRAY_SIZE(prim_modes); p++) {
+      for (unsigned s = 0; s < ARRAY_SIZE(spacings); s++) {
+         struct pipe_tessellator *ptess =
+            p_tess_init(prim_modes[p], spacings[s], false, false);
+
+         for (unsigned f = 0; f < ARRAY_SIZE(bench_factors); f++) {
+            struct pipe_tessellation_factors tf;
+            struct pipe_tessellator_data data = { 0 };
+            unsigned iterations = 0;
+            uint64_t points = 0;
+            int64_t start, end;
+
+            set_factors(&tf, bench_factors[f], bench_factors[f]);
+
+            start = os_time_get_nano();
+            do {
+               for (unsigned i = 0; i < 64; i++) {
+                  p_tessellate(ptess, &tf, &data);
+                  points += data.num_domain_points;
+               }
+               iterations += 64;
+               end = os_time_get_nano();
+            } while (end - start < 100000000);
+
+            printf("%-8s %-6s %7.1f %10.2f %10.1f\n",
+                   prim_names[p], spacing_names[s], bench_factors[f],
+                   (end - start) / 1000.0 / iterations,
+                   points * 1000.0 / (end - start));
+         }
+
+         p_tess_destroy(ptess);
+      }
+   }
+}
+
+
+int
+main(int argc, char **argv)
+{
+   unsigned fails;
+
+   if (argc > 1 && !strcmp(argv[1], "bench")) {
+      bench();
+      return 0;
+   }
+
+   fails = test();
+   if (fails) {
+      printf("Failure! %u errors.\n", fails);
+      return 1;
+   }
+
+   printf("Success!\n");
+   return 0;
+}
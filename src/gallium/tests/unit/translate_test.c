@@ -46,9 +46,87 @@ static double rand_double()
    return v;
 }
 
+/**
+ * Run the translate objects created by create_fn and ref_fn over the same
+ * input, with and without instancing and with every index type, and compare
+ * the output byte for byte.  Returns -1 if either can't handle the key.
+ */
+static int
+compare_to_reference(struct translate *(*create_fn)(const struct translate_key *key),
+                     struct translate *(*ref_fn)(const struct translate_key *key),
+                     struct translate_key *key,
+                     const void *input, unsigned input_stride,
+                     unsigned char *output, unsigned char *ref_output)
+{
+   static const unsigned elts[4] = {3, 0, 2, 1};
+   static const uint16_t elts16[4] = {3, 0, 2, 1};
+   static const uint8_t elts8[4] = {3, 0, 2, 1};
+   const unsigned count = ARRAY_SIZE(elts);
+   const unsigned size = count * key->output_stride;
+   unsigned divisor, mode;
+   int fail = 0;
+
+   for (divisor = 0; divisor < 2; ++divisor)
+   {
+      struct translate *t, *ref;
+
+      key->element[0].instance_divisor = divisor;
+      t = create_fn(key);
+      ref = ref_fn(key);
+      if (!t || !ref)
+      {
+         if (t)
+            t->release(t);
+         if (ref)
+            ref->release(ref);
+         fail = -1;
+         break;
+      }
+
+      t->set_buffer(t, 0, input, input_stride, count - 1);
+      ref->set_buffer(ref, 0, input, input_stride, count - 1);
+
+      for (mode = 0; mode < 4; ++mode)
+      {
+         memset(output, 0xcd, size);
+         memset(ref_output, 0xcd, size);
+
+         switch (mode)
+         {
+         case 0:
+            t->run(t, 0, count, 1, 2, output);
+            ref->run(ref, 0, count, 1, 2, ref_output);
+            break;
+         case 1:
+            t->run_elts(t, elts, count, 1, 2, output);
+            ref->run_elts(ref, elts, count, 1, 2, ref_output);
+            break;
+         case 2:
+            t->run_elts16(t, elts16, count, 1, 2, output);
+            ref->run_elts16(ref, elts16, count, 1, 2, ref_output);
+            break;
+         case 3:
+            t->run_elts8(t, elts8, count, 1, 2, output);
+            ref->run_elts8(ref, elts8, count, 1, 2, ref_output);
+            break;
+         }
+
+         if (memcmp(output, ref_output, size))
+            fail = 1;
+      }
+
+      t->release(t);
+      ref->release(ref);
+   }
+
+   key->element[0].instance_divisor = 0;
+   return fail;
+}
+
 int main(int argc, char** argv)
 {
    struct translate *(*create_fn)(const struct translate_key *key) = 0;
+   struct translate *(*ref_fn)(const struct translate_key *key) = 0;
 
    struct translate_key key;
    unsigned output_format;
@@ -75,6 +153,13 @@ int main(int argc, char** argv)
       create_fn = translate_create;
    else if (!strcmp(argv[1], "generic"))
       create_fn = translate_generic_create;
+#ifdef LLVM_AVAILABLE
+   else if (!strcmp(argv[1], "llvm"))
+   {
+      create_fn = translate_llvm_create;
+      ref_fn = translate_generic_create;
+   }
+#endif
    else if (!strcmp(argv[1], "x86"))
       create_fn = translate_sse2_create;
    else if (!strcmp(argv[1], "nosse"))
@@ -130,7 +215,7 @@ int main(int argc, char** argv)
 
    if (!create_fn)
    {
-      printf("Usage: ./translate_test [default|generic|x86|nosse|sse|sse2|sse3|sse4.1]\n");
+      printf("Usage: ./translate_test [default|generic|llvm|x86|nosse|sse|sse2|sse3|sse4.1]\n");
       return 2;
    }
 
@@ -228,6 +313,42 @@ int main(int argc, char** argv)
                input_normalized |= (1 << input_format_desc->channel[i].normalized);
          }
 
+         if(input_is_float && input_format_desc->channel[0].size == 32)
+            buffer[0] = (unsigned char*)float_buffer;
+         else if(input_is_float && input_format_desc->channel[0].size == 64)
+            buffer[0] = (unsigned char*)double_buffer;
+         else if(input_is_float && input_format_desc->channel[0].size == 16)
+            buffer[0] = (unsigned char*)half_buffer;
+         else if(input_is_float)
+            abort();
+         else
+            buffer[0] = byte_buffer;
+
+         /* Compare directly against the reference instead of round-tripping,
+          * so every conversion the backend accepts is checked.
+          */
+         if (ref_fn)
+         {
+            int result;
+
+            key.element[0].input_format = input_format;
+            key.element[0].output_format = output_format;
+            key.output_stride = output_format_size;
+            result = compare_to_reference(create_fn, ref_fn, &key,
+                                          buffer[0], input_format_size,
+                                          buffer[1], buffer[2]);
+            if (result < 0)
+               continue;
+
+            printf("%s: %s -> %s\n", result ? "FAIL" : "PASS",
+                   input_format_desc->name, output_format_desc->name);
+
+            if (!result)
+               ++passed;
+            ++total;
+            continue;
+         }
+
          if(((input_normalized | output_normalized) == 3)
                || ((input_normalized & 1) && (output_normalized & 1)
                      && input_format_size * output_format_desc->nr_channels > output_format_size * input_format_desc->nr_channels))
@@ -255,17 +376,6 @@ int main(int argc, char** argv)
          for(i = 1; i < 5; ++i)
             memset(buffer[i], 0xcd - (0x22 * i), 4096);
 
-         if(input_is_float && input_format_desc->channel[0].size == 32)
-            buffer[0] = (unsigned char*)float_buffer;
-         else if(input_is_float && input_format_desc->channel[0].size == 64)
-            buffer[0] = (unsigned char*)double_buffer;
-         else if(input_is_float && input_format_desc->channel[0].size == 16)
-            buffer[0] = (unsigned char*)half_buffer;
-         else if(input_is_float)
-            abort();
-         else
-            buffer[0] = byte_buffer;
-
          translate[0]->set_buffer(translate[0], 0, buffer[0], input_format_size, count - 1);
          translate[0]->run_elts(translate[0], elts, count, 0, 0, buffer[1]);
          translate[1]->set_buffer(translate[1], 0, buffer[1], output_format_size, count - 1);
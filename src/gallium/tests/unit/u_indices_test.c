@@ -0,0 +1,380 @@
+/**************************************************************************
+ *
+ * Copyright 2021 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+/*
+ * Test case for the index translation and generation functions.  The
+ * SSE4.1 paths are compared with the scalar loops, and primitive restart
+ * without any restart index in the draw is compared with restart disabled.
+ *
+ * Run with "bench" as the argument to time the translations instead.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "indices/u_indices.h"
+#include "util/os_time.h"
+#include "util/u_cpu_detect.h"
+#include "util/u_math.h"
+#include "util/u_memory.h"
+#include "util/u_prim.h"
+
+
+#define NR_INDICES  2000
+#define CANARY      0xcd
+
+/* Everything the hardware is asked to draw gets translated. */
+#define HW_MASK ((1 << PIPE_PRIM_POINTS) | \
+                 (1 << PIPE_PRIM_LINES) | \
+                 (1 << PIPE_PRIM_TRIANGLES) | \
+                 (1 << PIPE_PRIM_LINES_ADJACENCY) | \
+                 (1 << PIPE_PRIM_TRIANGLES_ADJACENCY))
+
+static bool has_sse4_1;
+
+
+static void
+fill_indices(void *in, unsigned index_size, unsigned count,
+             unsigned restart_index, unsigned restart_every)
+{
+   unsigned max = index_size == 4 ? 0xfffffff : (1u << (index_size * 8)) - 2;
+
+   for (unsigned i = 0; i < count; i++) {
+      unsigned v = rand() % max;
+
+      if (restart_every && rand() % restart_every == 0)
+         v = restart_index;
+
+      switch (index_size) {
+      case 1:
+         ((uint8_t *)in)[i] = v;
+         break;
+      case 2:
+         ((uint16_t *)in)[i] = v;
+         break;
+      default:
+         ((uint32_t *)in)[i] = v;
+         break;
+      }
+   }
+}
+
+
+/* Run trans_func with and without SSE4.1 into separate buffers and compare
+ * them, including the bytes after the output.
+ */
+static bool
+run_translate(u_translate_func trans_func, const void *in, unsigned start,
+              unsigned in_nr, unsigned out_nr, unsigned restart_index,
+              unsigned out_size, uint8_t *out)
+{
+   unsigned size = (out_nr + 16) * out_size;
+   uint8_t *ref = MALLOC(size);
+   bool ok;
+
+   memset(out, CANARY, size);
+   memset(ref, CANARY, size);
+
+   util_cpu_caps.has_sse4_1 = has_sse4_1;
+   trans_func(in, start, in_nr, out_nr, restart_index, out);
+   util_cpu_caps.has_sse4_1 = false;
+   trans_func(in, start, in_nr, out_nr, restart_index, ref);
+   util_cpu_caps.has_sse4_1 = has_sse4_1;
+
+   ok = !memcmp(out, ref, size);
+   FREE(ref);
+   return ok;
+}
+
+
+static bool
+test_translate(void)
+{
+   static const unsigned counts[] = { 0, 1, 3, 4, 5, 7, 9, 16, 17, 33, 64, 97,
+                                      NR_INDICES - 8, NR_INDICES - 1 };
+   static const unsigned index_sizes[] = { 1, 2, 4 };
+   uint8_t *out = MALLOC((NR_INDICES * 6 + 16) * 4);
+   uint8_t *ref = MALLOC((NR_INDICES * 6 + 16) * 4);
+   uint8_t *in = NULL;
+   unsigned failures = 0;
+
+   for (unsigned s = 0; s < ARRAY_SIZE(index_sizes); s++) {
+      unsigned index_size = index_sizes[s];
+      unsigned restart_index = index_size == 4 ? 0xffffffff :
+                               (1u << (index_size * 8)) - 1;
+
+      /* Exactly sized, so reads past the end show up in valgrind. */
+      FREE(in);
+      in = MALLOC(NR_INDICES * index_size);
+
+      for (unsigned prim = 0; prim <= PIPE_PRIM_TRIANGLE_STRIP_ADJACENCY; prim++)
+      for (unsigned in_pv = 0; in_pv < PV_COUNT; in_pv++)
+      for (unsigned out_pv = 0; out_pv < PV_COUNT; out_pv++)
+      for (unsigned c = 0; c < ARRAY_SIZE(counts); c++)
+      for (unsigned start = 0; start < 8; start += 7) {
+         unsigned count = MIN2(counts[c], NR_INDICES - start);
+         u_translate_func trans_func[PR_COUNT];
+         enum pipe_prim_type out_prim;
+         unsigned out_size, out_nr;
+
+         if (!u_trim_pipe_prim(prim, &count))
+            continue;
+
+         for (unsigned pr = 0; pr < PR_COUNT; pr++) {
+            u_index_translator(HW_MASK, prim, index_size, count,
+                               in_pv, out_pv, pr, &out_prim, &out_size,
+                               &out_nr, &trans_func[pr]);
+         }
+
+         /* No restart index in the draw, so restart changes nothing. */
+         fill_indices(in, index_size, NR_INDICES, restart_index, 0);
+         if (!run_translate(trans_func[PR_DISABLE], in, start, start + count,
+                            out_nr, restart_index, out_size, ref) ||
+             !run_translate(trans_func[PR_ENABLE], in, start, start + count,
+                            out_nr, restart_index, out_size, out) ||
+             memcmp(out, ref, out_nr * out_size)) {
+            printf("prim %u index size %u pv %u->%u count %u start %u failed\n",
+                   prim, index_size, in_pv, out_pv, count, start);
+            failures++;
+         }
+
+         /* Restart indices going through the slow path.  Line loops
+          * close the last loop from past the restart index, which may be
+          * beyond the draw, so they are only checked without restarts.
+          */
+         if (prim == PIPE_PRIM_LINE_LOOP)
+            continue;
+
+         fill_indices(in, index_size, NR_INDICES, restart_index, 8);
+         if (!run_translate(trans_func[PR_ENABLE], in, start, start + count,
+                            out_nr, restart_index, out_size, out)) {
+            printf("prim %u index size %u pv %u->%u count %u start %u "
+                   "with restart failed\n",
+                   prim, index_size, in_pv, out_pv, count, start);
+            failures++;
+         }
+      }
+   }
+
+   /* Check the shuffles against the primitive definition once. */
+   FREE(in);
+   in = MALLOC(NR_INDICES * 4);
+   for (unsigned s = 0; s < ARRAY_SIZE(index_sizes); s++) {
+      unsigned index_size = index_sizes[s];
+      u_translate_func trans_func;
+      enum pipe_prim_type out_prim;
+      unsigned out_size, out_nr;
+
+      u_index_translator(HW_MASK, PIPE_PRIM_QUADS, index_size, NR_INDICES,
+                         PV_FIRST, PV_FIRST, PR_DISABLE, &out_prim, &out_size,
+                         &out_nr, &trans_func);
+      fill_indices(in, index_size, NR_INDICES, 0, 0);
+      trans_func(in, 0, NR_INDICES, out_nr, 0, out);
+
+      for (unsigned q = 0; q < NR_INDICES / 4; q++) {
+         static const unsigned verts[6] = { 0, 1, 2, 0, 2, 3 };
+
+         for (unsigned v = 0; v < 6; v++) {
+            unsigned i = q * 4 + verts[v];
+            unsigned expected = index_size == 1 ? in[i] :
+                                index_size == 2 ? ((uint16_t *)in)[i] :
+                                ((uint32_t *)in)[i];
+            unsigned got = out_size == 2 ? ((uint16_t *)out)[q * 6 + v] :
+                           ((uint32_t *)out)[q * 6 + v];
+
+            if (got != expected) {
+               printf("quads index size %u: vertex %u is %u, expected %u\n",
+                      index_size, q * 6 + v, got, expected);
+               failures++;
+               q = NR_INDICES;
+               break;
+            }
+         }
+      }
+   }
+
+   FREE(in);
+   FREE(out);
+   FREE(ref);
+   return failures == 0;
+}
+
+
+static bool
+test_generate(void)
+{
+   static const unsigned starts[] = { 0, 5, 0xfff0, 0x10000 };
+   uint8_t *out = MALLOC((NR_INDICES * 6 + 16) * 4);
+   uint8_t *ref = MALLOC((NR_INDICES * 6 + 16) * 4);
+   unsigned failures = 0;
+
+   for (unsigned prim = 0; prim <= PIPE_PRIM_TRIANGLE_STRIP_ADJACENCY; prim++)
+   for (unsigned in_pv = 0; in_pv < PV_COUNT; in_pv++)
+   for (unsigned out_pv = 0; out_pv < PV_COUNT; out_pv++)
+   for (unsigned s = 0; s < ARRAY_SIZE(starts); s++)
+   for (unsigned count = 4; count < NR_INDICES; count = count * 3 + 1) {
+      u_generate_func gen_func;
+      enum pipe_prim_type out_prim;
+      unsigned out_size, out_nr, size;
+      unsigned nr = count;
+
+      if (!u_trim_pipe_prim(prim, &nr))
+         continue;
+
+      u_index_generator(HW_MASK, prim, starts[s], nr, in_pv, out_pv,
+                        &out_prim, &out_size, &out_nr, &gen_func);
+      size = (out_nr + 16) * out_size;
+
+      memset(out, CANARY, size);
+      memset(ref, CANARY, size);
+      gen_func(starts[s], out_nr, out);
+      util_cpu_caps.has_sse4_1 = false;
+      gen_func(starts[s], out_nr, ref);
+      util_cpu_caps.has_sse4_1 = has_sse4_1;
+
+      if (memcmp(out, ref, size)) {
+         printf("generate prim %u pv %u->%u start %u count %u failed\n",
+                prim, in_pv, out_pv, starts[s], nr);
+         failures++;
+      }
+   }
+
+   FREE(out);
+   FREE(ref);
+   return failures == 0;
+}
+
+
+static void
+bench(void)
+{
+   static const struct {
+      enum pipe_prim_type prim;
+      unsigned in_pv, out_pv;
+      const char *name;
+   } cases[] = {
+      { PIPE_PRIM_QUADS, PV_LAST, PV_LAST, "quads" },
+      { PIPE_PRIM_QUAD_STRIP, PV_LAST, PV_LAST, "quadstrip" },
+      { PIPE_PRIM_TRIANGLE_FAN, PV_LAST, PV_LAST, "trifan" },
+      { PIPE_PRIM_POLYGON, PV_LAST, PV_LAST, "polygon" },
+      { PIPE_PRIM_TRIANGLES, PV_LAST, PV_FIRST, "tris pv" },
+      { PIPE_PRIM_LINES, PV_LAST, PV_FIRST, "lines pv" },
+   };
+   static const unsigned index_sizes[] = { 1, 2, 4 };
+   const unsigned count = 60000, iterations = 2000;
+   uint8_t *in = MALLOC(count * 4);
+   uint8_t *out = MALLOC(count * 6 * 4);
+
+   for (unsigned c = 0; c < ARRAY_SIZE(cases); c++) {
+      for (unsigned s = 0; s < ARRAY_SIZE(index_sizes); s++) {
+         unsigned index_size = index_sizes[s];
+         unsigned restart_index = index_size == 4 ? 0xffffffff :
+                                  (1u << (index_size * 8)) - 1;
+         double ns[2][PR_COUNT];
+         unsigned out_nr;
+
+         fill_indices(in, index_size, count, restart_index, 0);
+
+         for (unsigned sse = 0; sse < 2; sse++) {
+            util_cpu_caps.has_sse4_1 = sse && has_sse4_1;
+
+            for (unsigned pr = 0; pr < PR_COUNT; pr++) {
+               u_translate_func trans_func;
+               enum pipe_prim_type out_prim;
+               unsigned out_size;
+               int64_t t;
+
+               u_index_translator(HW_MASK, cases[c].prim, index_size, count,
+                                  cases[c].in_pv, cases[c].out_pv, pr,
+                                  &out_prim, &out_size, &out_nr, &trans_func);
+
+               t = os_time_get_nano();
+               for (unsigned i = 0; i < iterations; i++)
+                  trans_func(in, 0, count, out_nr, restart_index, out);
+               ns[sse][pr] = (os_time_get_nano() - t) /
+                             ((double)iterations * out_nr);
+            }
+         }
+
+         printf("%-10s %u byte: scalar %.3f ns/index (restart %.3f), "
+                "sse4.1 %.3f ns/index (restart %.3f)\n",
+                cases[c].name, index_size,
+                ns[0][PR_DISABLE], ns[0][PR_ENABLE],
+                ns[1][PR_DISABLE], ns[1][PR_ENABLE]);
+      }
+   }
+
+   for (unsigned c = 0; c < ARRAY_SIZE(cases); c++) {
+      double ns[2];
+
+      for (unsigned sse = 0; sse < 2; sse++) {
+         u_generate_func gen_func;
+         enum pipe_prim_type out_prim;
+         unsigned out_size, out_nr;
+         int64_t t;
+
+         util_cpu_caps.has_sse4_1 = sse && has_sse4_1;
+         u_index_generator(HW_MASK, cases[c].prim, 0, count,
+                           cases[c].in_pv, cases[c].out_pv,
+                           &out_prim, &out_size, &out_nr, &gen_func);
+
+         t = os_time_get_nano();
+         for (unsigned i = 0; i < iterations; i++)
+            gen_func(0, out_nr, out);
+         ns[sse] = (os_time_get_nano() - t) / ((double)iterations * out_nr);
+      }
+
+      printf("%-10s generate: scalar %.3f ns/index, sse4.1 %.3f ns/index\n",
+             cases[c].name, ns[0], ns[1]);
+   }
+
+   util_cpu_caps.has_sse4_1 = has_sse4_1;
+   FREE(in);
+   FREE(out);
+}
+
+
+int
+main(int argc, char **argv)
+{
+   bool pass = true;
+
+   util_cpu_detect();
+   has_sse4_1 = util_cpu_caps.has_sse4_1;
+
+   if (argc > 1 && !strcmp(argv[1], "bench")) {
+      bench();
+      return 0;
+   }
+
+   pass = test_translate() && pass;
+   pass = test_generate() && pass;
+
+   printf("%s\n", pass ? "Success!" : "Failure!");
+   return pass ? 0 : 1;
+}
@@ -0,0 +1,289 @@
+/**************************************************************************
+ *
+ * Copyright 2021 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+/*
+ * Test case for the call merging and batch sizing of u_threaded_context,
+ * using a dummy driver that logs the calls it gets.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pipe/p_context.h"
+#include "pipe/p_screen.h"
+#include "util/os_time.h"
+#include "util/u_threaded_context.h"
+#include "util/u_upload_mgr.h"
+#include "dummy_pipe.h"
+
+
+enum log_kind {
+   LOG_BLEND,
+   LOG_SAMPLE_MASK,
+   LOG_DRAW,
+};
+
+struct log_entry {
+   enum log_kind kind;
+   unsigned value;   /* CSO, sample mask or draw_vbo call number */
+   unsigned start;
+   unsigned count;
+};
+
+static struct log_entry log_entries[64];
+static unsigned num_log_entries;
+static unsigned num_draw_calls;
+
+/* Time the driver spends in each draw_vbo, in nanoseconds. */
+static int64_t draw_time;
+
+
+static void
+log_call(enum log_kind kind, unsigned value, unsigned start, unsigned count)
+{
+   if (num_log_entries < ARRAY_SIZE(log_entries)) {
+      struct log_entry *entry = &log_entries[num_log_entries];
+
+      entry->kind = kind;
+      entry->value = value;
+      entry->start = start;
+      entry->count = count;
+   }
+   num_log_entries++;
+}
+
+
+static void
+dummy_bind_blend_state(struct pipe_context *pipe, void *cso)
+{
+   log_call(LOG_BLEND, (unsigned)(uintptr_t)cso, 0, 0);
+}
+
+
+static void
+dummy_set_sample_mask(struct pipe_context *pipe, unsigned mask)
+{
+   log_call(LOG_SAMPLE_MASK, mask, 0, 0);
+}
+
+
+static void
+dummy_draw_vbo(struct pipe_context *pipe, const struct pipe_draw_info *info,
+               const struct pipe_draw_indirect_info *indirect,
+               const struct pipe_draw_start_count *draws, unsigned num_draws)
+{
+   if (draw_time) {
+      int64_t end = os_time_get_nano() + draw_time;
+      while (os_time_get_nano() < end);
+      return;
+   }
+
+   for (unsigned i = 0; i < num_draws; i++)
+      log_call(LOG_DRAW, num_draw_calls, draws[i].start, draws[i].count);
+   num_draw_calls++;
+}
+
+
+static void
+dummy_flush(struct pipe_context *pipe, struct pipe_fence_handle **fence,
+            unsigned flags)
+{
+}
+
+
+static void
+dummy_destroy(struct pipe_context *pipe)
+{
+}
+
+
+static void
+draw(struct pipe_context *tc, enum pipe_prim_type mode,
+     const struct pipe_draw_start_count *draws, unsigned num_draws)
+{
+   struct pipe_draw_info info;
+
+   memset(&info, 0, sizeof(info));
+   info.mode = mode;
+   info.instance_count = 1;
+   tc->draw_vbo(tc, &info, NULL, draws, num_draws);
+}
+
+
+/*
+ * Check that redundant state calls are merged, that draws with the same
+ * draw info are appended to the previous multi draw, and that no call is
+ * moved past a draw.
+ */
+static unsigned
+test_merge(struct pipe_context *tc, struct threaded_context *threaded)
+{
+   static const struct pipe_draw_start_count draws[] = {
+      { 0, 3 }, { 3, 3 }, { 6, 3 }, { 9, 3 }, { 12, 3 },
+   };
+   static const struct log_entry expected[] = {
+      { LOG_BLEND, 3 },
+      { LOG_SAMPLE_MASK, 0xf },
+      { LOG_DRAW, 0, 0, 3 },
+      { LOG_DRAW, 0, 3, 3 },
+      { LOG_DRAW, 0, 6, 3 },
+      { LOG_BLEND, 5 },
+      { LOG_DRAW, 1, 9, 3 },
+      { LOG_SAMPLE_MASK, 0x1 },
+      { LOG_BLEND, 6 },
+      { LOG_DRAW, 2, 12, 3 },
+   };
+   unsigned fails = 0;
+   unsigned i;
+
+   num_log_entries = 0;
+   num_draw_calls = 0;
+
+   /* The second and third bind replace the first one. */
+   tc->bind_blend_state(tc, (void *)1);
+   tc->bind_blend_state(tc, (void *)2);
+   tc->set_sample_mask(tc, 0xf);
+   tc->bind_blend_state(tc, (void *)3);
+
+   /* The single draw is appended to the multi draw. */
+   draw(tc, PIPE_PRIM_TRIANGLES, &draws[0], 2);
+   draw(tc, PIPE_PRIM_TRIANGLES, &draws[2], 1);
+
+   /* The draws separate the binds, so none of them are merged. */
+   tc->bind_blend_state(tc, (void *)4);
+   tc->bind_blend_state(tc, (void *)5);
+   draw(tc, PIPE_PRIM_TRIANGLES, &draws[3], 1);
+   tc->set_sample_mask(tc, 0x1);
+   tc->bind_blend_state(tc, (void *)6);
+   draw(tc, PIPE_PRIM_POINTS, &draws[4], 1);
+
+   tc->flush(tc, NULL, 0);
+
+   if (num_log_entries != ARRAY_SIZE(expected)) {
+      printf("merge: got %u calls, expected %u\n", num_log_entries,
+             (unsigned)ARRAY_SIZE(expected));
+      fails++;
+   }
+
+   for (i = 0; i < MIN2(num_log_entries, ARRAY_SIZE(expected)); i++) {
+      if (memcmp(&log_entries[i], &expected[i], sizeof(expected[i]))) {
+         printf("merge: call %u is %u (%u, %u, %u), expected %u (%u, %u, %u)\n",
+                i, log_entries[i].kind, log_entries[i].value,
+                log_entries[i].start, log_entries[i].count,
+                expected[i].kind, expected[i].value,
+                expected[i].start, expected[i].count);
+         fails++;
+      }
+   }
+
+   if (threaded->num_merged_calls != 4) {
+      printf("merge: %u merged calls, expected 4\n",
+             threaded->num_merged_calls);
+      fails++;
+   }
+
+   return fails;
+}
+
+
+/*
+ * Check that batches shrink to TC_MIN_CALLS_PER_BATCH, and no further,
+ * when the driver is slow.
+ */
+static unsigned
+test_batch_size(struct pipe_context *tc, struct threaded_context *threaded)
+{
+   static const struct pipe_draw_start_count draws[] = { { 0, 3 } };
+   unsigned i;
+
+   /* Much slower per call slot than TC_BATCH_TARGET_TIME allows for batches
+    * of TC_MIN_CALLS_PER_BATCH.
+    */
+   draw_time = 20000;
+
+   /* Alternate the primitive type so that the draws aren't merged. */
+   for (i = 0; i < 2000; i++)
+      draw(tc, i % 2 ? PIPE_PRIM_POINTS : PIPE_PRIM_TRIANGLES, draws, 1);
+   tc->flush(tc, NULL, 0);
+
+   draw_time = 0;
+
+   if (threaded->batch_size != TC_MIN_CALLS_PER_BATCH) {
+      printf("batch size: %u call slots, expected %u\n",
+             threaded->batch_size, TC_MIN_CALLS_PER_BATCH);
+      return 1;
+   }
+
+   return 0;
+}
+
+
+int
+main(int argc, char **argv)
+{
+   struct pipe_screen screen;
+   struct pipe_context pipe;
+   struct pipe_context *tc;
+   struct threaded_context *threaded = NULL;
+   struct slab_parent_pool transfer_pool;
+   unsigned fails = 0;
+
+   dummy_pipe_init(&screen, &pipe);
+   pipe.bind_blend_state = dummy_bind_blend_state;
+   pipe.set_sample_mask = dummy_set_sample_mask;
+   pipe.draw_vbo = dummy_draw_vbo;
+   pipe.flush = dummy_flush;
+   pipe.destroy = dummy_destroy;
+   pipe.stream_uploader = u_upload_create_default(&pipe);
+   pipe.const_uploader = pipe.stream_uploader;
+
+   /* Don't fall back to the driver context on a single CPU. */
+   setenv("GALLIUM_THREAD", "1", 1);
+
+   slab_create_parent(&transfer_pool, sizeof(struct threaded_transfer), 16);
+   tc = threaded_context_create(&pipe, &transfer_pool, NULL, NULL, &threaded);
+   if (!tc || !threaded) {
+      printf("failed to create threaded context\n");
+      return 1;
+   }
+
+   fails += test_merge(tc, threaded);
+   fails += test_batch_size(tc, threaded);
+
+   tc->destroy(tc);
+   u_upload_destroy(pipe.stream_uploader);
+   slab_destroy_parent(&transfer_pool);
+
+   if (fails) {
+      printf("Failure! %u errors.\n", fails);
+      return 1;
+   }
+
+   printf("Success!\n");
+   return 0;
+}
@@ -0,0 +1,387 @@
+/**************************************************************************
+ *
+ * Copyright 2021 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+/*
+ * Test case for the caching of translated vertex buffers in u_vbuf, using
+ * a dummy driver without fixed point vertex formats, which keeps buffers in
+ * malloc'ed memory and checks the vertices of each draw.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cso_cache/cso_cache.h"
+#include "pipe/p_context.h"
+#include "pipe/p_screen.h"
+#include "util/format/u_format.h"
+#include "util/u_inlines.h"
+#include "util/u_memory.h"
+#include "util/u_upload_mgr.h"
+#include "util/u_vbuf.h"
+#include "dummy_pipe.h"
+
+
+#define NUM_VERTICES 64
+
+struct dummy_resource {
+   struct pipe_resource base;
+   uint8_t *data;
+};
+
+struct dummy_velems {
+   unsigned count;
+   struct pipe_vertex_element velems[PIPE_MAX_ATTRIBS];
+};
+
+/* Buffers created by u_vbuf to keep translations in. */
+static unsigned num_kept_buffers;
+
+static struct pipe_vertex_buffer bound_vbs[PIPE_MAX_ATTRIBS];
+static struct dummy_velems *bound_velems;
+
+/* Value added to the expected vertex data, bumped on every write. */
+static unsigned generation;
+static unsigned num_bad_draws;
+static struct pipe_resource *last_draw_buffer;
+
+
+static bool
+dummy_is_format_supported_no_fixed(struct pipe_screen *screen,
+                          enum pipe_format format,
+                          enum pipe_texture_target target,
+                          unsigned sample_count,
+                          unsigned storage_sample_count,
+                          unsigned bindings)
+{
+   const struct util_format_description *desc =
+      util_format_description(format);
+
+   return desc->channel[0].type != UTIL_FORMAT_TYPE_FIXED;
+}
+
+static struct pipe_resource *
+dummy_resource_create(struct pipe_screen *screen,
+                      const struct pipe_resource *templ)
+{
+   struct dummy_resource *res = CALLOC_STRUCT(dummy_resource);
+
+   res->base = *templ;
+   res->base.screen = screen;
+   pipe_reference_init(&res->base.reference, 1);
+   res->data = CALLOC(1, templ->width0);
+
+   if (templ->usage == PIPE_USAGE_DEFAULT)
+      num_kept_buffers++;
+   return &res->base;
+}
+
+static void
+dummy_resource_destroy(struct pipe_screen *screen,
+                       struct pipe_resource *resource)
+{
+   struct dummy_resource *res = (struct dummy_resource *)resource;
+
+   FREE(res->data);
+   FREE(res);
+}
+
+static void *
+dummy_transfer_map(struct pipe_context *pipe,
+                   struct pipe_resource *resource,
+                   unsigned level, unsigned usage,
+                   const struct pipe_box *box,
+                   struct pipe_transfer **out_transfer)
+{
+   struct pipe_transfer *transfer = CALLOC_STRUCT(pipe_transfer);
+
+   pipe_resource_reference(&transfer->resource, resource);
+   transfer->usage = usage;
+   transfer->box = *box;
+   *out_transfer = transfer;
+   return ((struct dummy_resource *)resource)->data + box->x;
+}
+
+static void
+dummy_transfer_flush_region(struct pipe_context *pipe,
+                            struct pipe_transfer *transfer,
+                            const struct pipe_box *box)
+{
+}
+
+static void
+dummy_transfer_unmap(struct pipe_context *pipe,
+                     struct pipe_transfer *transfer)
+{
+   pipe_resource_reference(&transfer->resource, NULL);
+   FREE(transfer);
+}
+
+static void *
+dummy_create_velems(struct pipe_context *pipe, unsigned count,
+                    const struct pipe_vertex_element *velems)
+{
+   struct dummy_velems *state = CALLOC_STRUCT(dummy_velems);
+
+   state->count = count;
+   memcpy(state->velems, velems, count * sizeof(*velems));
+   return state;
+}
+
+static void
+dummy_bind_velems(struct pipe_context *pipe, void *state)
+{
+   bound_velems = state;
+}
+
+static void
+dummy_delete_velems(struct pipe_context *pipe, void *state)
+{
+   FREE(state);
+}
+
+static void
+dummy_set_vertex_buffers(struct pipe_context *pipe,
+                         unsigned start_slot, unsigned count,
+                         unsigned unbind_num_trailing_slots,
+                         bool take_ownership,
+                         const struct pipe_vertex_buffer *buffers)
+{
+   for (unsigned i = 0; i < count; i++) {
+      struct pipe_vertex_buffer *vb = &bound_vbs[start_slot + i];
+
+      if (!buffers) {
+         pipe_vertex_buffer_unreference(vb);
+      } else if (take_ownership) {
+         pipe_vertex_buffer_unreference(vb);
+         *vb = buffers[i];
+      } else {
+         pipe_vertex_buffer_reference(vb, &buffers[i]);
+      }
+   }
+   for (unsigned i = 0; i < unbind_num_trailing_slots; i++)
+      pipe_vertex_buffer_unreference(&bound_vbs[start_slot + count + i]);
+}
+
+/* Check that the draw sees the translated source data. */
+static void
+dummy_draw_vbo(struct pipe_context *pipe,
+               const struct pipe_draw_info *info,
+               const struct pipe_draw_indirect_info *indirect,
+               const struct pipe_draw_start_count *draws,
+               unsigned num_draws)
+{
+   const struct pipe_vertex_element *ve = &bound_velems->velems[0];
+   const struct pipe_vertex_buffer *vb = &bound_vbs[ve->vertex_buffer_index];
+   const struct dummy_resource *res =
+      (const struct dummy_resource *)vb->buffer.resource;
+   bool ok = ve->src_format == PIPE_FORMAT_R32G32B32A32_FLOAT && res;
+
+   for (unsigned i = 0; ok && i < draws[0].count; i++) {
+      unsigned v = draws[0].start + i;
+      const float *attr = (const float *)(res->data + vb->buffer_offset +
+                                          ve->src_offset + vb->stride * v);
+
+      for (unsigned c = 0; c < 4; c++) {
+         if (attr[c] != (float)(generation + v * 4 + c))
+            ok = false;
+      }
+   }
+
+   if (!ok)
+      num_bad_draws++;
+   last_draw_buffer = vb->buffer.resource;
+}
+
+
+static void
+init_dummy_context(struct pipe_screen *screen, struct pipe_context *pipe)
+{
+   dummy_pipe_init(screen, pipe);
+   screen->is_format_supported = dummy_is_format_supported_no_fixed;
+   screen->resource_create = dummy_resource_create;
+   screen->resource_destroy = dummy_resource_destroy;
+
+   pipe->transfer_map = dummy_transfer_map;
+   pipe->transfer_flush_region = dummy_transfer_flush_region;
+   pipe->transfer_unmap = dummy_transfer_unmap;
+   pipe->create_vertex_elements_state = dummy_create_velems;
+   pipe->bind_vertex_elements_state = dummy_bind_velems;
+   pipe->delete_vertex_elements_state = dummy_delete_velems;
+   pipe->set_vertex_buffers = dummy_set_vertex_buffers;
+   pipe->draw_vbo = dummy_draw_vbo;
+   pipe->stream_uploader = u_upload_create_default(pipe);
+}
+
+
+/* Write the source vertices and count the write, as a frontend creating
+ * its CSO context with CSO_TRACK_BUFFER_WRITES does.
+ */
+static void
+write_vertices(struct pipe_resource *buffer)
+{
+   int32_t *data = (int32_t *)((struct dummy_resource *)buffer)->data;
+
+   generation += 1000;
+   for (unsigned i = 0; i < NUM_VERTICES * 4; i++)
+      data[i] = (generation + i) * 65536;
+   buffer->write_count++;
+}
+
+static void
+draw(struct u_vbuf *mgr, unsigned start, unsigned count)
+{
+   struct pipe_draw_info info;
+   struct pipe_draw_start_count range = { start, count };
+
+   memset(&info, 0, sizeof(info));
+   info.mode = PIPE_PRIM_POINTS;
+   info.instance_count = 1;
+   info.max_index = ~0;
+
+   u_vbuf_draw_vbo(mgr, &info, NULL, range);
+}
+
+
+static unsigned
+test_cache(void)
+{
+   struct pipe_screen screen;
+   struct pipe_context pipe;
+   struct pipe_resource templ;
+   struct pipe_resource *buffer;
+   struct pipe_resource *kept;
+   struct pipe_vertex_buffer vb;
+   struct cso_velems_state velems;
+   struct u_vbuf_caps caps;
+   struct u_vbuf *mgr;
+   unsigned fails = 0;
+
+   init_dummy_context(&screen, &pipe);
+
+   u_vbuf_get_caps(&screen, &caps, false);
+   if (!caps.fallback_always || !caps.cache_translated_buffers) {
+      printf("u_vbuf: translation caching not enabled\n");
+      return 1;
+   }
+   mgr = u_vbuf_create(&pipe, &caps);
+
+   memset(&templ, 0, sizeof(templ));
+   templ.target = PIPE_BUFFER;
+   templ.format = PIPE_FORMAT_R8_UNORM;
+   templ.bind = PIPE_BIND_VERTEX_BUFFER;
+   templ.usage = PIPE_USAGE_IMMUTABLE;
+   templ.width0 = NUM_VERTICES * 16;
+   templ.height0 = templ.depth0 = templ.array_size = 1;
+   buffer = screen.resource_create(&screen, &templ);
+   write_vertices(buffer);
+
+   memset(&velems, 0, sizeof(velems));
+   velems.count = 1;
+   velems.velems[0].src_format = PIPE_FORMAT_R32G32B32A32_FIXED;
+   u_vbuf_set_vertex_elements(mgr, &velems);
+
+   memset(&vb, 0, sizeof(vb));
+   vb.stride = 16;
+   vb.buffer.resource = buffer;
+   u_vbuf_set_vertex_buffers(mgr, 0, 1, 0, false, &vb);
+
+   /* The first draw of a range goes through the uploader, the second keeps
+    * its translation, which the third reuses.
+    */
+   num_kept_buffers = 0;
+   draw(mgr, 4, 8);
+   if (num_kept_buffers != 0)
+      fails++;
+   draw(mgr, 4, 8);
+   kept = last_draw_buffer;
+   if (num_kept_buffers != 1 || !kept || kept->usage != PIPE_USAGE_DEFAULT)
+      fails++;
+   draw(mgr, 4, 8);
+   if (num_kept_buffers != 1 || last_draw_buffer != kept)
+      fails++;
+
+   /* A write invalidates the translation, and the next unchanged draw
+    * translates it again.
+    */
+   write_vertices(buffer);
+   draw(mgr, 4, 8);
+   if (num_kept_buffers != 1 || last_draw_buffer == kept)
+      fails++;
+   draw(mgr, 4, 8);
+   if (num_kept_buffers != 2)
+      fails++;
+   kept = last_draw_buffer;
+   draw(mgr, 4, 8);
+   if (num_kept_buffers != 2 || last_draw_buffer != kept)
+      fails++;
+
+   /* Data written before every draw never gets its own buffer. */
+   for (unsigned i = 0; i < 4; i++) {
+      write_vertices(buffer);
+      draw(mgr, 4, 8);
+   }
+   if (num_kept_buffers != 2)
+      fails++;
+
+   /* Neither do more ranges than the cache holds, drawn in turn. */
+   num_kept_buffers = 0;
+   for (unsigned pass = 0; pass < 3; pass++) {
+      for (unsigned i = 0; i < 12; i++)
+         draw(mgr, i * 4, 4);
+   }
+   if (num_kept_buffers != 0)
+      fails++;
+
+   if (num_bad_draws) {
+      printf("u_vbuf: %u draws with wrong vertices\n", num_bad_draws);
+      fails++;
+   }
+
+   u_vbuf_destroy(mgr);
+   pipe_resource_reference(&buffer, NULL);
+   for (unsigned i = 0; i < ARRAY_SIZE(bound_vbs); i++)
+      pipe_vertex_buffer_unreference(&bound_vbs[i]);
+   u_upload_destroy(pipe.stream_uploader);
+
+   return fails;
+}
+
+
+int
+main(int argc, char **argv)
+{
+   unsigned fails = test_cache();
+
+   if (fails) {
+      printf("Failure! %u errors.\n", fails);
+      return 1;
+   }
+
+   printf("Success!\n");
+   return 0;
+}
@@ -511,6 +511,16 @@ brw_nir_lower_fs_outputs(nir_shader *nir)
    this_progress;                                          \
 })
 
+/* OPT() for the optimization loop, see NIR_LOOP_PASS(). */
+#define LOOP_OPT(changes, pass, ...) ({                    \
+   bool this_progress = false;                             \
+   NIR_LOOP_PASS(this_progress, skip, nir, changes,        \
+                 pass, ##__VA_ARGS__);                     \
+   if (this_progress)                                      \
+      progress = true;                                     \
+   this_progress;                                          \
+})
+
 static nir_variable_mode
 brw_nir_no_indirect_mask(const struct brw_compiler *compiler,
                          gl_shader_stage stage)
@@ -574,39 +584,52 @@ brw_nir_optimize(nir_shader *nir, const struct brw_compiler *compiler,
       (nir->options->lower_flrp32 ? 32 : 0) |
       (nir->options->lower_flrp64 ? 64 : 0);
 
+   /* Passes whose inputs didn't change since they last ran without progress
+    * are skipped.  The variable passes look at derefs, the intrinsics using
+    * them and calls, and what they can do depends on control flow.
+    */
+   struct hash_table *skip = _mesa_pointer_hash_table_create(NULL);
+   const nir_change_class vars = nir_change_deref | nir_change_intrinsic |
+                                 nir_change_call | nir_change_cf;
+
    do {
       progress = false;
-      OPT(nir_split_array_vars, nir_var_function_temp);
-      OPT(nir_shrink_vec_array_vars, nir_var_function_temp);
-      OPT(nir_opt_deref);
-      OPT(nir_lower_vars_to_ssa);
+      LOOP_OPT(vars, nir_split_array_vars, nir_var_function_temp);
+      LOOP_OPT(vars | nir_change_alu,
+               nir_shrink_vec_array_vars, nir_var_function_temp);
+      LOOP_OPT(vars | nir_change_alu | nir_change_load_const, nir_opt_deref);
+      LOOP_OPT(vars, nir_lower_vars_to_ssa);
       if (allow_copies) {
          /* Only run this pass in the first call to brw_nir_optimize.  Later
           * calls assume that we've lowered away any copy_deref instructions
           * and we don't want to introduce any more.
           */
-         OPT(nir_opt_find_array_copies);
+         LOOP_OPT(vars, nir_opt_find_array_copies);
       }
-      OPT(nir_opt_copy_prop_vars);
-      OPT(nir_opt_dead_write_vars);
-      OPT(nir_opt_combine_stores, nir_var_all);
+      LOOP_OPT(vars, nir_opt_copy_prop_vars);
+      LOOP_OPT(vars, nir_opt_dead_write_vars);
+      LOOP_OPT(vars, nir_opt_combine_stores, nir_var_all);
 
       if (is_scalar) {
-         OPT(nir_lower_alu_to_scalar, NULL, NULL);
+         LOOP_OPT(nir_change_alu, nir_lower_alu_to_scalar, NULL, NULL);
       } else {
-         OPT(nir_opt_shrink_vectors);
+         LOOP_OPT(nir_change_alu | nir_change_intrinsic |
+                  nir_change_load_const | nir_change_ssa_undef,
+                  nir_opt_shrink_vectors);
       }
 
-      OPT(nir_copy_prop);
+      LOOP_OPT(nir_change_alu, nir_copy_prop);
 
       if (is_scalar) {
-         OPT(nir_lower_phis_to_scalar);
+         LOOP_OPT(nir_change_phi | nir_change_alu | nir_change_intrinsic |
+                  nir_change_load_const | nir_change_ssa_undef,
+                  nir_lower_phis_to_scalar);
       }
 
-      OPT(nir_copy_prop);
-      OPT(nir_opt_dce);
-      OPT(nir_opt_cse);
-      OPT(nir_opt_combine_stores, nir_var_all);
+      LOOP_OPT(nir_change_alu, nir_copy_prop);
+      LOOP_OPT(nir_change_all, nir_opt_dce);
+      LOOP_OPT(nir_change_all, nir_opt_cse);
+      LOOP_OPT(vars, nir_opt_combine_stores, nir_var_all);
 
       /* Passing 0 to the peephole select pass causes it to convert
        * if-statements that contain only move instructions in the branches
@@ -628,14 +651,19 @@ brw_nir_optimize(nir_shader *nir, const struct brw_compiler *compiler,
       const bool is_vec4_tessellation = !is_scalar &&
          (nir->info.stage == MESA_SHADER_TESS_CTRL ||
           nir->info.stage == MESA_SHADER_TESS_EVAL);
-      OPT(nir_opt_peephole_select, 0, !is_vec4_tessellation, false);
-      OPT(nir_opt_peephole_select, 8, !is_vec4_tessellation,
-          compiler->devinfo->gen >= 6);
-
-      OPT(nir_opt_intrinsics);
-      OPT(nir_opt_idiv_const, 32);
-      OPT(nir_opt_algebraic);
-      OPT(nir_opt_constant_folding);
+      LOOP_OPT(nir_change_all,
+               nir_opt_peephole_select, 0, !is_vec4_tessellation, false);
+      LOOP_OPT(nir_change_all,
+               nir_opt_peephole_select, 8, !is_vec4_tessellation,
+               compiler->devinfo->gen >= 6);
+
+      LOOP_OPT(nir_change_intrinsic | nir_change_alu, nir_opt_intrinsics);
+      LOOP_OPT(nir_change_alu | nir_change_load_const,
+               nir_opt_idiv_const, 32);
+      LOOP_OPT(nir_change_alu | nir_change_load_const, nir_opt_algebraic);
+      LOOP_OPT(nir_change_alu | nir_change_load_const |
+               nir_change_intrinsic | nir_change_deref,
+               nir_opt_constant_folding);
 
       if (lower_flrp != 0) {
          if (OPT(nir_lower_flrp,
@@ -650,25 +678,33 @@ brw_nir_optimize(nir_shader *nir, const struct brw_compiler *compiler,
          lower_flrp = 0;
       }
 
-      OPT(nir_opt_dead_cf);
-      if (OPT(nir_opt_trivial_continues)) {
+      LOOP_OPT(nir_change_all, nir_opt_dead_cf);
+      if (LOOP_OPT(nir_change_cf | nir_change_jump,
+                   nir_opt_trivial_continues)) {
          /* If nir_opt_trivial_continues makes progress, then we need to clean
           * things up if we want any hope of nir_opt_if or nir_opt_loop_unroll
           * to make progress.
           */
-         OPT(nir_copy_prop);
-         OPT(nir_opt_dce);
+         LOOP_OPT(nir_change_alu, nir_copy_prop);
+         LOOP_OPT(nir_change_all, nir_opt_dce);
       }
-      OPT(nir_opt_if, false);
-      OPT(nir_opt_conditional_discard);
+      LOOP_OPT(nir_change_all, nir_opt_if, false);
+      LOOP_OPT(nir_change_cf | nir_change_intrinsic,
+               nir_opt_conditional_discard);
       if (nir->options->max_unroll_iterations != 0) {
-         OPT(nir_opt_loop_unroll, loop_indirect_mask);
+         LOOP_OPT(nir_change_all, nir_opt_loop_unroll, loop_indirect_mask);
       }
-      OPT(nir_opt_remove_phis);
-      OPT(nir_opt_undef);
-      OPT(nir_lower_pack);
+      /* remove_phis looks through movs feeding the phis, and opt_undef
+       * edits vecs, csels and store write masks in place.
+       */
+      LOOP_OPT(nir_change_phi | nir_change_alu, nir_opt_remove_phis);
+      LOOP_OPT(nir_change_ssa_undef | nir_change_alu | nir_change_intrinsic,
+               nir_opt_undef);
+      LOOP_OPT(nir_change_alu, nir_lower_pack);
    } while (progress);
 
+   _mesa_hash_table_destroy(skip, NULL);
+
    /* Workaround Gfxbench unused local sampler variable which will trigger an
     * assert in the opt_large_constants pass.
     */
@@ -416,9 +416,14 @@ draw_arrays(GLenum mode, GLint first, GLsizei count, GLsizei instance_count,
 struct marshal_cmd_MultiDrawArrays
 {
    struct marshal_cmd_base cmd_base;
+   bool heap;
    GLenum mode;
    GLsizei draw_count;
    GLuint user_buffer_mask;
+   /* first[] and count[] if they don't fit in a batch, NULL if the
+    * allocation failed.
+    */
+   void *heap_data;
 };
 
 void
@@ -430,12 +435,14 @@ _mesa_unmarshal_MultiDrawArrays(struct gl_context *ctx,
    const GLuint user_buffer_mask = cmd->user_buffer_mask;
 
    const char *variable_data = (const char *)(cmd + 1);
-   const GLint *first = (GLint *)variable_data;
-   variable_data += sizeof(GLint) * draw_count;
-   const GLsizei *count = (GLsizei *)variable_data;
-   variable_data += sizeof(GLsizei) * draw_count;
+   const char *draw_data = cmd->heap ? cmd->heap_data : variable_data;
+   const GLint *first = (GLint *)draw_data;
+   draw_data += sizeof(GLint) * draw_count;
+   const GLsizei *count = (GLsizei *)draw_data;
+   draw_data += sizeof(GLsizei) * draw_count;
    const struct glthread_attrib_binding *buffers =
-      (const struct glthread_attrib_binding *)variable_data;
+      (const struct glthread_attrib_binding *)
+      (cmd->heap ? variable_data : draw_data);
 
    /* Bind uploaded buffers if needed. */
    if (user_buffer_mask) {
@@ -443,14 +450,20 @@ _mesa_unmarshal_MultiDrawArrays(struct gl_context *ctx,
                                       false);
    }
 
-   CALL_MultiDrawArrays(ctx->CurrentServerDispatch,
-                        (mode, first, count, draw_count));
+   if (cmd->heap && !cmd->heap_data) {
+      _mesa_error(ctx, GL_OUT_OF_MEMORY, "glMultiDrawArrays");
+   } else {
+      CALL_MultiDrawArrays(ctx->CurrentServerDispatch,
+                           (mode, first, count, draw_count));
+   }
 
    /* Restore states. */
    if (user_buffer_mask) {
       _mesa_InternalBindVertexBuffers(ctx, buffers, user_buffer_mask,
                                       true);
    }
+
+   free(cmd->heap_data);
 }
 
 static ALWAYS_INLINE void
@@ -461,24 +474,34 @@ multi_draw_arrays_async(struct gl_context *ctx, GLenum mode,
 {
    int first_size = sizeof(GLint) * draw_count;
    int count_size = sizeof(GLsizei) * draw_count;
+   int draw_size = first_size + count_size;
    int buffers_size = util_bitcount(user_buffer_mask) * sizeof(buffers[0]);
-   int cmd_size = sizeof(struct marshal_cmd_MultiDrawArrays) +
-                  first_size + count_size + buffers_size;
+   int cmd_size = sizeof(struct marshal_cmd_MultiDrawArrays) + buffers_size;
+   bool heap = cmd_size + draw_size > MARSHAL_MAX_CMD_SIZE;
    struct marshal_cmd_MultiDrawArrays *cmd;
 
+   if (!heap)
+      cmd_size += draw_size;
+
    cmd = _mesa_glthread_allocate_command(ctx, DISPATCH_CMD_MultiDrawArrays,
                                          cmd_size);
+   cmd->heap = heap;
    cmd->mode = mode;
    cmd->draw_count = draw_count;
    cmd->user_buffer_mask = user_buffer_mask;
+   cmd->heap_data = heap ? malloc(draw_size) : NULL;
 
    char *variable_data = (char*)(cmd + 1);
-   memcpy(variable_data, first, first_size);
-   variable_data += first_size;
-   memcpy(variable_data, count, count_size);
+   char *draw_data = heap ? cmd->heap_data : variable_data;
+
+   if (draw_data) {
+      memcpy(draw_data, first, first_size);
+      memcpy(draw_data + first_size, count, count_size);
+   }
 
    if (user_buffer_mask) {
-      variable_data += count_size;
+      if (!heap)
+         variable_data += draw_size;
       memcpy(variable_data, buffers, buffers_size);
    }
 }
@@ -501,9 +524,8 @@ _mesa_marshal_MultiDrawArrays(GLenum mode, const GLint *first,
       return;
    }
 
-   /* If the draw count is too high or negative, the queue can't be used. */
-   if (!ctx->GLThread.SupportsNonVBOUploads ||
-       draw_count < 0 || draw_count > MARSHAL_MAX_CMD_SIZE / 16)
+   /* If the draw count is negative, the queue can't be used. */
+   if (!ctx->GLThread.SupportsNonVBOUploads || draw_count < 0)
       goto sync;
 
    unsigned min_index = ~0;
@@ -864,11 +886,16 @@ struct marshal_cmd_MultiDrawElementsBaseVertex
 {
    struct marshal_cmd_base cmd_base;
    bool has_base_vertex;
+   bool heap;
    GLenum mode;
    GLenum type;
    GLsizei draw_count;
    GLuint user_buffer_mask;
    struct gl_buffer_object *index_buffer;
+   /* count[], indices[] and basevertex[] if they don't fit in a batch,
+    * NULL if the allocation failed.
+    */
+   void *heap_data;
 };
 
 void
@@ -883,17 +910,19 @@ _mesa_unmarshal_MultiDrawElementsBaseVertex(struct gl_context *ctx,
    const bool has_base_vertex = cmd->has_base_vertex;
 
    const char *variable_data = (const char *)(cmd + 1);
-   const GLsizei *count = (GLsizei *)variable_data;
-   variable_data += sizeof(GLsizei) * draw_count;
-   const GLvoid *const *indices = (const GLvoid *const *)variable_data;
-   variable_data += sizeof(const GLvoid *const *) * draw_count;
+   const char *draw_data = cmd->heap ? cmd->heap_data : variable_data;
+   const GLsizei *count = (GLsizei *)draw_data;
+   draw_data += sizeof(GLsizei) * draw_count;
+   const GLvoid *const *indices = (const GLvoid *const *)draw_data;
+   draw_data += sizeof(const GLvoid *const *) * draw_count;
    const GLsizei *basevertex = NULL;
    if (has_base_vertex) {
-      basevertex = (GLsizei *)variable_data;
-      variable_data += sizeof(GLsizei) * draw_count;
+      basevertex = (GLsizei *)draw_data;
+      draw_data += sizeof(GLsizei) * draw_count;
    }
    const struct glthread_attrib_binding *buffers =
-      (const struct glthread_attrib_binding *)variable_data;
+      (const struct glthread_attrib_binding *)
+      (cmd->heap ? variable_data : draw_data);
 
    /* Bind uploaded buffers if needed. */
    if (user_buffer_mask) {
@@ -905,7 +934,9 @@ _mesa_unmarshal_MultiDrawElementsBaseVertex(struct gl_context *ctx,
    }
 
    /* Draw. */
-   if (has_base_vertex) {
+   if (cmd->heap && !cmd->heap_data) {
+      _mesa_error(ctx, GL_OUT_OF_MEMORY, "glMultiDrawElements");
+   } else if (has_base_vertex) {
       CALL_MultiDrawElementsBaseVertex(ctx->CurrentServerDispatch,
                                        (mode, count, type, indices, draw_count,
                                         basevertex));
@@ -922,6 +953,8 @@ _mesa_unmarshal_MultiDrawElementsBaseVertex(struct gl_context *ctx,
       _mesa_InternalBindVertexBuffers(ctx, buffers, user_buffer_mask,
                                       true);
    }
+
+   free(cmd->heap_data);
 }
 
 static ALWAYS_INLINE void
@@ -936,11 +969,16 @@ multi_draw_elements_async(struct gl_context *ctx, GLenum mode,
    int count_size = sizeof(GLsizei) * draw_count;
    int indices_size = sizeof(indices[0]) * draw_count;
    int basevertex_size = basevertex ? sizeof(GLsizei) * draw_count : 0;
+   int draw_size = count_size + indices_size + basevertex_size;
    int buffers_size = util_bitcount(user_buffer_mask) * sizeof(buffers[0]);
    int cmd_size = sizeof(struct marshal_cmd_MultiDrawElementsBaseVertex) +
-                  count_size + indices_size + basevertex_size + buffers_size;
+                  buffers_size;
+   bool heap = cmd_size + draw_size > MARSHAL_MAX_CMD_SIZE;
    struct marshal_cmd_MultiDrawElementsBaseVertex *cmd;
 
+   if (!heap)
+      cmd_size += draw_size;
+
    cmd = _mesa_glthread_allocate_command(ctx, DISPATCH_CMD_MultiDrawElementsBaseVertex, cmd_size);
    cmd->mode = mode;
    cmd->type = type;
@@ -948,20 +986,27 @@ multi_draw_elements_async(struct gl_context *ctx, GLenum mode,
    cmd->user_buffer_mask = user_buffer_mask;
    cmd->index_buffer = index_buffer;
    cmd->has_base_vertex = basevertex != NULL;
+   cmd->heap = heap;
+   cmd->heap_data = heap ? malloc(draw_size) : NULL;
 
    char *variable_data = (char*)(cmd + 1);
-   memcpy(variable_data, count, count_size);
-   variable_data += count_size;
-   memcpy(variable_data, indices, indices_size);
-   variable_data += indices_size;
+   char *draw_data = heap ? cmd->heap_data : variable_data;
 
-   if (basevertex) {
-      memcpy(variable_data, basevertex, basevertex_size);
-      variable_data += basevertex_size;
+   if (draw_data) {
+      memcpy(draw_data, count, count_size);
+      draw_data += count_size;
+      memcpy(draw_data, indices, indices_size);
+      draw_data += indices_size;
+
+      if (basevertex)
+         memcpy(draw_data, basevertex, basevertex_size);
    }
 
-   if (user_buffer_mask)
+   if (user_buffer_mask) {
+      if (!heap)
+         variable_data += draw_size;
       memcpy(variable_data, buffers, buffers_size);
+   }
 }
 
 void GLAPIENTRY
@@ -992,14 +1037,13 @@ _mesa_marshal_MultiDrawElementsBaseVertex(GLenum mode, const GLsizei *count,
 
    bool need_index_bounds = user_buffer_mask & ~vao->NonZeroDivisorMask;
 
-   /* If the draw count is too high or negative, the queue can't be used.
+   /* If the draw count is negative, the queue can't be used.
     *
     * Sync if indices come from a buffer and vertices come from memory
     * and index bounds are not valid. We would have to map the indices
     * to compute the index bounds, and for that we would have to sync anyway.
     */
-   if (!ctx->GLThread.SupportsNonVBOUploads ||
-       draw_count < 0 || draw_count > MARSHAL_MAX_CMD_SIZE / 32 ||
+   if (!ctx->GLThread.SupportsNonVBOUploads || draw_count < 0 ||
        (need_index_bounds && !has_user_indices))
       goto sync;
 
@@ -1078,18 +1122,32 @@ _mesa_marshal_MultiDrawElementsBaseVertex(GLenum mode, const GLsizei *count,
       }
    }
 
+   /* Large draw counts don't fit on the stack. */
+   const GLvoid **out_indices = NULL;
+   bool out_indices_on_heap = false;
+   if (has_user_indices) {
+      size_t out_indices_size = sizeof(indices[0]) * draw_count;
+
+      out_indices_on_heap = out_indices_size > MARSHAL_MAX_CMD_SIZE;
+      out_indices = out_indices_on_heap ? malloc(out_indices_size) :
+                                          alloca(out_indices_size);
+      if (!out_indices)
+         goto sync;
+   }
+
    /* Upload vertices. */
    struct glthread_attrib_binding buffers[VERT_ATTRIB_MAX];
    if (user_buffer_mask &&
        !upload_vertices(ctx, user_buffer_mask, min_index, num_vertices,
-                        0, 1, buffers))
+                        0, 1, buffers)) {
+      if (out_indices_on_heap)
+         free(out_indices);
       goto sync;
+   }
 
    /* Upload indices. */
    struct gl_buffer_object *index_buffer = NULL;
    if (has_user_indices) {
-      const GLvoid **out_indices = alloca(sizeof(indices[0]) * draw_count);
-
       index_buffer = upload_multi_indices(ctx, total_count, index_size,
                                           draw_count, count, indices,
                                           out_indices);
@@ -1100,6 +1158,8 @@ _mesa_marshal_MultiDrawElementsBaseVertex(GLenum mode, const GLsizei *count,
    multi_draw_elements_async(ctx, mode, count, type, indices, draw_count,
                              basevertex, index_buffer, user_buffer_mask,
                              buffers);
+   if (out_indices_on_heap)
+      free(out_indices);
    return;
 
 sync:
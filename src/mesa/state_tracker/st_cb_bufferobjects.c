@@ -158,6 +158,7 @@ st_bufferobj_subdata(struct gl_context *ctx,
                         _mesa_bufferobj_mapped(obj, MAP_USER) ?
                            PIPE_MAP_DIRECTLY : 0,
                         offset, size, data);
+   st_buffer_written(st_obj->buffer);
 }
 
 
@@ -334,11 +335,13 @@ bufferobj_data(struct gl_context *ctx,
                               is_mapped ? PIPE_MAP_DIRECTLY :
                                           PIPE_MAP_DISCARD_WHOLE_RESOURCE,
                               0, size, data);
+         st_buffer_written(st_obj->buffer);
          return GL_TRUE;
       } else if (is_mapped) {
          return GL_TRUE; /* can't reallocate, nothing to do */
       } else if (screen->get_param(screen, PIPE_CAP_INVALIDATE_BUFFER)) {
          pipe->invalidate_resource(pipe, st_obj->buffer);
+         st_buffer_written(st_obj->buffer);
          return GL_TRUE;
       }
    }
@@ -468,6 +471,7 @@ st_bufferobj_invalidate(struct gl_context *ctx,
       return;
 
    pipe->invalidate_resource(pipe, st_obj->buffer);
+   st_buffer_written(st_obj->buffer);
 }
 
 
@@ -598,6 +602,9 @@ st_bufferobj_unmap(struct gl_context *ctx, struct gl_buffer_object *obj,
    if (obj->Mappings[index].Length)
       pipe_buffer_unmap(pipe, st_obj->transfer[index]);
 
+   if (obj->Mappings[index].AccessFlags & GL_MAP_WRITE_BIT)
+      st_buffer_written(st_obj->buffer);
+
    st_obj->transfer[index] = NULL;
    obj->Mappings[index].Pointer = NULL;
    obj->Mappings[index].Offset = 0;
@@ -632,6 +639,7 @@ st_copy_buffer_subdata(struct gl_context *ctx,
 
    pipe->resource_copy_region(pipe, dstObj->buffer, 0, writeOffset, 0, 0,
                               srcObj->buffer, 0, &box);
+   st_buffer_written(dstObj->buffer);
 }
 
 /**
@@ -659,6 +667,7 @@ st_clear_buffer_subdata(struct gl_context *ctx,
 
    pipe->clear_buffer(pipe, buf->buffer, offset, size,
                       clearValue, clearValueSize);
+   st_buffer_written(buf->buffer);
 }
 
 static void
@@ -82,6 +82,17 @@ extern void
 st_init_bufferobject_functions(struct pipe_screen *screen,
                                struct dd_function_table *functions);
 
+/**
+ * Called whenever the contents of a buffer have been changed, see
+ * pipe_resource::write_count.
+ */
+static inline void
+st_buffer_written(struct pipe_resource *buffer)
+{
+   if (buffer)
+      p_atomic_inc(&buffer->write_count);
+}
+
 static inline struct pipe_resource *
 st_get_buffer_reference(struct gl_context *ctx, struct gl_buffer_object *obj)
 {
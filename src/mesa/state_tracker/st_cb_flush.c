@@ -45,6 +45,7 @@
 #include "pipe/p_defines.h"
 #include "pipe/p_screen.h"
 #include "util/u_gen_mipmap.h"
+#include "util/u_upload_mgr.h"
 
 
 void
@@ -57,7 +58,27 @@ st_flush(struct st_context *st,
     */
    st_context_free_zombie_objects(st);
 
-   st->pipe->flush(st->pipe, fence, flags);
+   struct pipe_context *pipe = st->pipe;
+   struct pipe_fence_handle *upload_fence = NULL;
+   bool fence_uploads =
+      u_upload_needs_fence(pipe->stream_uploader) ||
+      (pipe->const_uploader != pipe->stream_uploader &&
+       u_upload_needs_fence(pipe->const_uploader));
+
+   /* Ask for a fence when filled upload buffers wait for one to be reused. */
+   if (!fence && fence_uploads)
+      fence = &upload_fence;
+
+   pipe->flush(pipe, fence, flags);
+
+   if (fence_uploads && *fence) {
+      u_upload_fence(pipe->stream_uploader, *fence);
+      if (pipe->const_uploader != pipe->stream_uploader)
+         u_upload_fence(pipe->const_uploader, *fence);
+   }
+
+   if (upload_fence)
+      st->screen->fence_reference(st->screen, &upload_fence, NULL);
 }
 
 
@@ -411,6 +411,7 @@ st_StoreQueryResult(struct gl_context *ctx, struct gl_query_object *q,
                         (ptype == GL_INT64_ARB ||
                          ptype == GL_UNSIGNED_INT64_ARB) ? 8 : 4,
                         data);
+      st_buffer_written(stObj->buffer);
       return;
    }
 
@@ -616,6 +616,9 @@ st_create_context_priv(struct gl_context *ctx, struct pipe_context *pipe,
       break;
    }
 
+   /* Buffer writes call st_buffer_written. */
+   cso_flags |= CSO_TRACK_BUFFER_WRITES;
+
    st->cso_context = cso_create_context(pipe, cso_flags);
 
    st_init_atoms(st);
@@ -39,6 +39,7 @@
 
 #include "util/crc32.h"
 #include "util/debug.h"
+#include "util/hash_table.h"
 #include "util/rand_xor.h"
 #include "util/u_atomic.h"
 #include "util/mesa-sha1.h"
@@ -68,6 +69,58 @@ do {                                       \
    _dst += _src_size;                      \
 } while (0);
 
+/* Parse a size such as "64M", in multiples of default_unit if there is no
+ * unit. Returns 0 if str is NULL or not a number.
+ */
+static uint64_t
+parse_cache_size(const char *str, uint64_t default_unit)
+{
+   uint64_t size = 0;
+
+   if (str) {
+      char *end;
+      size = strtoul(str, &end, 10);
+      if (end == str) {
+         size = 0;
+      } else {
+         switch (*end) {
+         case 'K':
+         case 'k':
+            size *= 1024;
+            break;
+         case 'M':
+         case 'm':
+            size *= 1024*1024;
+            break;
+         case 'G':
+         case 'g':
+            size *= 1024*1024*1024;
+            break;
+         default:
+            size *= default_unit;
+            break;
+         }
+      }
+   }
+
+   return size;
+}
+
+static uint32_t
+hash_cache_key(const void *key)
+{
+   /* The keys are SHA-1 hashes already. */
+   uint32_t hash;
+   memcpy(&hash, key, sizeof(hash));
+   return hash;
+}
+
+static bool
+cache_keys_equal(const void *a, const void *b)
+{
+   return memcmp(a, b, CACHE_KEY_SIZE) == 0;
+}
+
 struct disk_cache *
 disk_cache_create(const char *gpu_name, const char *driver_id,
                   uint64_t driver_flags)
@@ -110,8 +163,6 @@ disk_cache_create(const char *gpu_name, const char *driver_id,
    if (!disk_cache_mmap_cache_index(local, cache, path))
       goto path_fail;
 
-   max_size = 0;
-
    max_size_str = getenv("MESA_GLSL_CACHE_MAX_SIZE");
    
    #ifdef MESA_GLSL_CACHE_MAX_SIZE
@@ -120,30 +171,7 @@ disk_cache_create(const char *gpu_name, const char *driver_id,
    }
    #endif
 
-   if (max_size_str) {
-      char *end;
-      max_size = strtoul(max_size_str, &end, 10);
-      if (end == max_size_str) {
-         max_size = 0;
-      } else {
-         switch (*end) {
-         case 'K':
-         case 'k':
-            max_size *= 1024;
-            break;
-         case 'M':
-         case 'm':
-            max_size *= 1024*1024;
-            break;
-         case '\0':
-         case 'G':
-         case 'g':
-         default:
-            max_size *= 1024*1024*1024;
-            break;
-         }
-      }
-   }
+   max_size = parse_cache_size(max_size_str, 1024*1024*1024);
 
    /* Default to 1GB for maximum cache size. */
    if (max_size == 0) {
@@ -168,6 +196,29 @@ disk_cache_create(const char *gpu_name, const char *driver_id,
                         UTIL_QUEUE_INIT_SET_FULL_THREAD_AFFINITY))
       goto fail;
 
+   /* Open the single file database last, so nothing above has to close it
+    * on failure. If it can't be opened we keep using one file per entry.
+    */
+   cache->use_cache_db = env_var_as_boolean("MESA_DISK_CACHE_SINGLE_FILE",
+                                            false);
+   if (cache->use_cache_db && !disk_cache_db_load_cache_index(cache))
+      cache->use_cache_db = false;
+
+   /* The in-memory cache defaults to 16MB. An explicit 0 disables it. */
+   const char *mem_size_str = getenv("MESA_DISK_CACHE_MEMORY_SIZE");
+   cache->mem_max_size = mem_size_str ?
+                         parse_cache_size(mem_size_str, 1024*1024) :
+                         16 * 1024 * 1024;
+   if (cache->mem_max_size) {
+      cache->mem_entries = _mesa_hash_table_create(cache, hash_cache_key,
+                                                   cache_keys_equal);
+      if (!cache->mem_entries)
+         cache->mem_max_size = 0;
+   }
+   list_inithead(&cache->mem_lru);
+   mtx_init(&cache->mem_mtx, mtx_plain);
+   cnd_init(&cache->mem_cond);
+
    cache->path_init_failed = false;
 
  path_fail:
@@ -221,8 +272,25 @@ void
 disk_cache_destroy(struct disk_cache *cache)
 {
    if (cache && !cache->path_init_failed) {
+      if (cache->get_queue_initialized) {
+         util_queue_finish(&cache->get_queue);
+         util_queue_destroy(&cache->get_queue);
+      }
+
       util_queue_finish(&cache->cache_queue);
       util_queue_destroy(&cache->cache_queue);
+
+      list_for_each_entry_safe(struct disk_cache_mem_entry, entry,
+                               &cache->mem_lru, link) {
+         free(entry->data);
+         free(entry);
+      }
+      mtx_destroy(&cache->mem_mtx);
+      cnd_destroy(&cache->mem_cond);
+
+      if (cache->use_cache_db)
+         mesa_cache_db_close(&cache->cache_db);
+
       disk_cache_destroy_mmap(cache);
    }
 
@@ -232,12 +300,106 @@ disk_cache_destroy(struct disk_cache *cache)
 void
 disk_cache_wait_for_idle(struct disk_cache *cache)
 {
+   if (cache->get_queue_initialized)
+      util_queue_finish(&cache->get_queue);
    util_queue_finish(&cache->cache_queue);
 }
 
+/* Look up an entry of the in-memory cache, waiting for a prefetch of it to
+ * finish. Called with mem_mtx held.
+ */
+static struct disk_cache_mem_entry *
+mem_cache_search(struct disk_cache *cache, const cache_key key)
+{
+   while (true) {
+      struct hash_entry *he = _mesa_hash_table_search(cache->mem_entries, key);
+      if (!he)
+         return NULL;
+
+      struct disk_cache_mem_entry *entry = he->data;
+      if (!entry->loading)
+         return entry;
+
+      /* The entry may be gone once we wake up, so look it up again. */
+      cnd_wait(&cache->mem_cond, &cache->mem_mtx);
+   }
+}
+
+static void
+mem_cache_evict(struct disk_cache *cache, struct disk_cache_mem_entry *entry)
+{
+   _mesa_hash_table_remove_key(cache->mem_entries, entry->key);
+   list_del(&entry->link);
+   cache->mem_size -= entry->size;
+   free(entry->data);
+   free(entry);
+}
+
+/* Add a loaded entry, evicting the least recently used ones beyond
+ * mem_max_size. Called with mem_mtx held.
+ */
+static void
+mem_cache_add(struct disk_cache *cache, struct disk_cache_mem_entry *entry)
+{
+   list_add(&entry->link, &cache->mem_lru);
+   cache->mem_size += entry->size;
+
+   while (cache->mem_size > cache->mem_max_size) {
+      struct disk_cache_mem_entry *lru =
+         list_last_entry(&cache->mem_lru, struct disk_cache_mem_entry, link);
+      mem_cache_evict(cache, lru);
+   }
+}
+
+/* Keep a copy of an item read from the disk. */
+static void
+mem_cache_insert(struct disk_cache *cache, const cache_key key,
+                 const void *data, size_t size)
+{
+   if (size > cache->mem_max_size)
+      return;
+
+   struct disk_cache_mem_entry *entry = malloc(sizeof(*entry));
+   if (!entry)
+      return;
+
+   entry->data = malloc(size);
+   if (!entry->data) {
+      free(entry);
+      return;
+   }
+
+   memcpy(entry->key, key, CACHE_KEY_SIZE);
+   memcpy(entry->data, data, size);
+   entry->size = size;
+   entry->loading = false;
+
+   mtx_lock(&cache->mem_mtx);
+   if (_mesa_hash_table_search(cache->mem_entries, key)) {
+      /* Loaded by another thread meanwhile. */
+      free(entry->data);
+      free(entry);
+   } else {
+      _mesa_hash_table_insert(cache->mem_entries, entry->key, entry);
+      mem_cache_add(cache, entry);
+   }
+   mtx_unlock(&cache->mem_mtx);
+}
+
 void
 disk_cache_remove(struct disk_cache *cache, const cache_key key)
 {
+   if (cache->mem_max_size) {
+      mtx_lock(&cache->mem_mtx);
+      struct disk_cache_mem_entry *entry = mem_cache_search(cache, key);
+      if (entry)
+         mem_cache_evict(cache, entry);
+      mtx_unlock(&cache->mem_mtx);
+   }
+
+   if (cache->use_cache_db)
+      mesa_cache_db_entry_remove(&cache->cache_db, key);
+
    char *filename = disk_cache_get_cache_filename(cache, key);
    if (filename == NULL) {
       return;
@@ -311,6 +473,16 @@ cache_put(void *job, int thread_index)
    char *filename = NULL;
    struct disk_cache_put_job *dc_job = (struct disk_cache_put_job *) job;
 
+   if (dc_job->cache->use_cache_db) {
+      /* The database evicts by itself when it grows past max_size. */
+      struct cache_entry_file_data cf_data;
+      cf_data.crc32 = util_hash_crc32(dc_job->data, dc_job->size);
+      cf_data.uncompressed_size = dc_job->size;
+
+      disk_cache_db_write_item_to_disk(dc_job, &cf_data);
+      return;
+   }
+
    filename = disk_cache_get_cache_filename(dc_job->cache, dc_job->key);
    if (filename == NULL)
       goto done;
@@ -358,8 +530,38 @@ disk_cache_put(struct disk_cache *cache, const cache_key key,
    }
 }
 
-void *
-disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size)
+/* Move an entry written with one file per entry into the single file
+ * database. This way switching MESA_DISK_CACHE_SINGLE_FILE on doesn't throw
+ * the existing cache away, entries are moved over as they are used and the
+ * rest is evicted as usual.
+ */
+static void *
+migrate_item(struct disk_cache *cache, const cache_key key, size_t *size)
+{
+   size_t item_size;
+
+   char *filename = disk_cache_get_cache_filename(cache, key);
+   if (filename == NULL)
+      return NULL;
+
+   void *data = disk_cache_load_item(cache, filename, &item_size);
+   if (data == NULL)
+      return NULL;
+
+   disk_cache_put(cache, key, data, item_size, NULL);
+
+   filename = disk_cache_get_cache_filename(cache, key);
+   if (filename)
+      disk_cache_evict_item(cache, filename);
+
+   if (size)
+      *size = item_size;
+   return data;
+}
+
+/* Read an item from the disk or through the blob callbacks. */
+static void *
+load_item(struct disk_cache *cache, const cache_key key, size_t *size)
 {
    if (size)
       *size = 0;
@@ -386,6 +588,18 @@ disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size)
       return blob;
    }
 
+   if (cache->use_cache_db) {
+      void *data = disk_cache_db_load_item(cache, key, size);
+
+      /* Only look for a file of the multiple file layout while some are
+       * left, see migrate_item().
+       */
+      if (data || cache->path_init_failed || *cache->size == 0)
+         return data;
+
+      return migrate_item(cache, key, size);
+   }
+
    char *filename = disk_cache_get_cache_filename(cache, key);
    if (filename == NULL)
       return NULL;
@@ -393,6 +607,138 @@ disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size)
    return disk_cache_load_item(cache, filename, size);
 }
 
+void *
+disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size)
+{
+   size_t item_size;
+   void *data;
+
+   if (size)
+      *size = 0;
+
+   if (!cache->mem_max_size)
+      return load_item(cache, key, size);
+
+   mtx_lock(&cache->mem_mtx);
+   struct disk_cache_mem_entry *entry = mem_cache_search(cache, key);
+   if (entry) {
+      data = malloc(entry->size);
+      if (data) {
+         memcpy(data, entry->data, entry->size);
+         if (size)
+            *size = entry->size;
+      }
+
+      list_del(&entry->link);
+      list_add(&entry->link, &cache->mem_lru);
+      mtx_unlock(&cache->mem_mtx);
+      return data;
+   }
+   mtx_unlock(&cache->mem_mtx);
+
+   data = load_item(cache, key, &item_size);
+   if (!data)
+      return NULL;
+
+   mem_cache_insert(cache, key, data, item_size);
+
+   if (size)
+      *size = item_size;
+   return data;
+}
+
+static void
+cache_prefetch(void *job, int thread_index)
+{
+   struct disk_cache_get_job *gc_job = (struct disk_cache_get_job *) job;
+   struct disk_cache *cache = gc_job->cache;
+   struct disk_cache_mem_entry *entry = gc_job->entry;
+   size_t size;
+
+   void *data = load_item(cache, entry->key, &size);
+
+   mtx_lock(&cache->mem_mtx);
+   entry->loading = false;
+   if (data && size <= cache->mem_max_size) {
+      entry->data = data;
+      entry->size = size;
+      mem_cache_add(cache, entry);
+   } else {
+      /* Not found, let disk_cache_get() report the miss. */
+      _mesa_hash_table_remove_key(cache->mem_entries, entry->key);
+      free(data);
+      free(entry);
+   }
+   cnd_broadcast(&cache->mem_cond);
+   mtx_unlock(&cache->mem_mtx);
+}
+
+static void
+destroy_get_job(void *job, int thread_index)
+{
+   free(job);
+}
+
+void
+disk_cache_prefetch(struct disk_cache *cache, const cache_key *keys,
+                    unsigned num_keys)
+{
+   if (cache->path_init_failed || !cache->mem_max_size)
+      return;
+
+   mtx_lock(&cache->mem_mtx);
+
+   /* Loading doesn't run at the minimum priority of the put queue, somebody
+    * is about to wait for it.
+    */
+   if (!cache->get_queue_initialized) {
+      cache->get_queue_initialized =
+         util_queue_init(&cache->get_queue, "disk_get", 32, 4,
+                         UTIL_QUEUE_INIT_RESIZE_IF_FULL |
+                         UTIL_QUEUE_INIT_SET_FULL_THREAD_AFFINITY);
+      if (!cache->get_queue_initialized) {
+         mtx_unlock(&cache->mem_mtx);
+         return;
+      }
+   }
+
+   for (unsigned i = 0; i < num_keys; i++) {
+      if (_mesa_hash_table_search(cache->mem_entries, keys[i]))
+         continue;
+
+      struct disk_cache_mem_entry *entry = calloc(1, sizeof(*entry));
+      struct disk_cache_get_job *gc_job = malloc(sizeof(*gc_job));
+      if (!entry || !gc_job) {
+         free(entry);
+         free(gc_job);
+         break;
+      }
+
+      memcpy(entry->key, keys[i], CACHE_KEY_SIZE);
+      entry->loading = true;
+      list_inithead(&entry->link);
+      _mesa_hash_table_insert(cache->mem_entries, entry->key, entry);
+
+      gc_job->cache = cache;
+      gc_job->entry = entry;
+      util_queue_fence_init(&gc_job->fence);
+      util_queue_add_job(&cache->get_queue, gc_job, &gc_job->fence,
+                         cache_prefetch, destroy_get_job, 0);
+   }
+
+   mtx_unlock(&cache->mem_mtx);
+}
+
+void
+disk_cache_get_batch(struct disk_cache *cache, const cache_key *keys,
+                     unsigned num_keys, void **data, size_t *sizes)
+{
+   disk_cache_prefetch(cache, keys, num_keys);
+
+   for (unsigned i = 0; i < num_keys; i++)
+      data[i] = disk_cache_get(cache, keys[i], sizes ? &sizes[i] : NULL);
+}
+
 void
 disk_cache_put_key(struct disk_cache *cache, const cache_key key)
 {
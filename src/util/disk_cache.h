@@ -222,6 +222,27 @@ disk_cache_put(struct disk_cache *cache, const cache_key key,
 void *
 disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size);
 
+/**
+ * Start loading the items stored under \keys in the background.
+ *
+ * The items are kept in memory, so that later disk_cache_get() calls for
+ * them don't have to wait for the disk, (or only wait for the load that is
+ * already in progress).
+ */
+void
+disk_cache_prefetch(struct disk_cache *cache, const cache_key *keys,
+                    unsigned num_keys);
+
+/**
+ * Retrieve several items at once, loading them in parallel.
+ *
+ * Equivalent to calling disk_cache_get() for each of \keys, with the
+ * results in \data and, if \sizes is non-NULL, \sizes.
+ */
+void
+disk_cache_get_batch(struct disk_cache *cache, const cache_key *keys,
+                     unsigned num_keys, void **data, size_t *sizes);
+
 /**
  * Store the name \key within the cache, (without any associated data).
  *
@@ -292,6 +313,24 @@ disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size)
    return NULL;
 }
 
+static inline void
+disk_cache_prefetch(struct disk_cache *cache, const cache_key *keys,
+                    unsigned num_keys)
+{
+   return;
+}
+
+static inline void
+disk_cache_get_batch(struct disk_cache *cache, const cache_key *keys,
+                     unsigned num_keys, void **data, size_t *sizes)
+{
+   for (unsigned i = 0; i < num_keys; i++) {
+      data[i] = NULL;
+      if (sizes)
+         sizes[i] = 0;
+   }
+}
+
 static inline void
 disk_cache_put_key(struct disk_cache *cache, const cache_key key)
 {
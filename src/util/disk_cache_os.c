@@ -35,6 +35,8 @@
 
 #include "zlib.h"
 
+#include "util/blob.h"
+
 #ifdef HAVE_ZSTD
 #include "zstd.h"
 #endif
@@ -142,6 +144,43 @@ deflate_and_write_to_disk(const void *in_data, size_t in_data_size, int dest)
 # endif
 }
 
+/**
+ * Compresses cache entry in memory and appends it to the blob. Returns
+ * false on failure.
+ */
+static bool
+deflate_to_blob(const void *in_data, size_t in_data_size, struct blob *blob)
+{
+#ifdef HAVE_ZSTD
+   size_t out_size = ZSTD_compressBound(in_data_size);
+   void *out = malloc(out_size);
+   if (!out)
+      return false;
+
+   size_t ret = ZSTD_compress(out, out_size, in_data, in_data_size,
+                              ZSTD_COMPRESSION_LEVEL);
+   if (ZSTD_isError(ret)) {
+      free(out);
+      return false;
+   }
+#else
+   uLongf ret = compressBound(in_data_size);
+   void *out = malloc(ret);
+   if (!out)
+      return false;
+
+   if (compress2(out, &ret, in_data, in_data_size,
+                 Z_BEST_COMPRESSION) != Z_OK) {
+      free(out);
+      return false;
+   }
+#endif
+
+   bool written = blob_write_bytes(blob, out, ret);
+   free(out);
+   return written;
+}
+
 /**
  * Decompresses cache entry, returns true if successful.
  */
@@ -518,56 +557,39 @@ disk_cache_evict_item(struct disk_cache *cache, char *filename)
       p_atomic_add(cache->size, - (uint64_t)sb.st_blocks * 512);
 }
 
-void *
-disk_cache_load_item(struct disk_cache *cache, char *filename, size_t *size)
+/* Check the header of a cache item against our driver keys and return
+ * its uncompressed data, or NULL if it is corrupt.
+ */
+static void *
+parse_and_validate_cache_item(struct disk_cache *cache, const void *item,
+                              size_t item_size, size_t *size)
 {
-   int fd = -1, ret;
-   struct stat sb;
-   uint8_t *data = NULL;
+   struct blob_reader blob;
    uint8_t *uncompressed_data = NULL;
-   uint8_t *file_header = NULL;
-
-   fd = open(filename, O_RDONLY | O_CLOEXEC);
-   if (fd == -1)
-      goto fail;
-
-   if (fstat(fd, &sb) == -1)
-      goto fail;
 
-   data = malloc(sb.st_size);
-   if (data == NULL)
-      goto fail;
+   blob_reader_init(&blob, item, item_size);
 
    size_t ck_size = cache->driver_keys_blob_size;
-   file_header = malloc(ck_size);
-   if (!file_header)
-      goto fail;
-
-   if (sb.st_size < ck_size)
-      goto fail;
-
-   ret = read_all(fd, file_header, ck_size);
-   if (ret == -1)
-      goto fail;
+   const void *keys = blob_read_bytes(&blob, ck_size);
+   if (blob.overrun)
+      return NULL;
 
    /* Check for extremely unlikely hash collisions */
-   if (memcmp(cache->driver_keys_blob, file_header, ck_size) != 0) {
+   if (memcmp(cache->driver_keys_blob, keys, ck_size) != 0) {
       assert(!"Mesa cache keys mismatch!");
-      goto fail;
+      return NULL;
    }
 
-   size_t cache_item_md_size = sizeof(uint32_t);
    uint32_t md_type;
-   ret = read_all(fd, &md_type, cache_item_md_size);
-   if (ret == -1)
-      goto fail;
+   blob_copy_bytes(&blob, &md_type, sizeof(md_type));
+   if (blob.overrun)
+      return NULL;
 
    if (md_type == CACHE_ITEM_TYPE_GLSL) {
       uint32_t num_keys;
-      cache_item_md_size += sizeof(uint32_t);
-      ret = read_all(fd, &num_keys, sizeof(uint32_t));
-      if (ret == -1)
-         goto fail;
+      blob_copy_bytes(&blob, &num_keys, sizeof(num_keys));
+      if (blob.overrun)
+         return NULL;
 
       /* The cache item metadata is currently just used for distributing
        * precompiled shaders, they are not used by Mesa so just skip them for
@@ -575,30 +597,26 @@ disk_cache_load_item(struct disk_cache *cache, char *filename, size_t *size)
        * TODO: pass the metadata back to the caller and do some basic
        * validation.
        */
-      cache_item_md_size += num_keys * sizeof(cache_key);
-      ret = lseek(fd, num_keys * sizeof(cache_key), SEEK_CUR);
-      if (ret == -1)
-         goto fail;
+      blob_skip_bytes(&blob, num_keys * sizeof(cache_key));
    }
 
    /* Load the CRC that was created when the file was written. */
    struct cache_entry_file_data cf_data;
-   size_t cf_data_size = sizeof(cf_data);
-   ret = read_all(fd, &cf_data, cf_data_size);
-   if (ret == -1)
-      goto fail;
+   blob_copy_bytes(&blob, &cf_data, sizeof(cf_data));
+   if (blob.overrun)
+      return NULL;
 
-   /* Load the actual cache data. */
-   size_t cache_data_size =
-      sb.st_size - cf_data_size - ck_size - cache_item_md_size;
-   ret = read_all(fd, data, cache_data_size);
-   if (ret == -1)
-      goto fail;
+   /* The rest is the compressed cache data. */
+   size_t cache_data_size = blob.end - blob.current;
+   const uint8_t *data = blob_read_bytes(&blob, cache_data_size);
 
    /* Uncompress the cache data */
    uncompressed_data = malloc(cf_data.uncompressed_size);
-   if (!inflate_cache_data(data, cache_data_size, uncompressed_data,
-                           cf_data.uncompressed_size))
+   if (!uncompressed_data)
+      return NULL;
+
+   if (!inflate_cache_data((uint8_t *)data, cache_data_size,
+                           uncompressed_data, cf_data.uncompressed_size))
       goto fail;
 
    /* Check the data for corruption */
@@ -606,29 +624,52 @@ disk_cache_load_item(struct disk_cache *cache, char *filename, size_t *size)
                                         cf_data.uncompressed_size))
       goto fail;
 
-   free(data);
-   free(filename);
-   free(file_header);
-   close(fd);
-
    if (size)
       *size = cf_data.uncompressed_size;
 
    return uncompressed_data;
 
+ fail:
+   free(uncompressed_data);
+   return NULL;
+}
+
+void *
+disk_cache_load_item(struct disk_cache *cache, char *filename, size_t *size)
+{
+   int fd = -1, ret;
+   struct stat sb;
+   uint8_t *data = NULL;
+   uint8_t *uncompressed_data = NULL;
+
+   fd = open(filename, O_RDONLY | O_CLOEXEC);
+   if (fd == -1)
+      goto fail;
+
+   if (fstat(fd, &sb) == -1)
+      goto fail;
+
+   data = malloc(sb.st_size);
+   if (data == NULL)
+      goto fail;
+
+   /* Load the whole file, header included. */
+   ret = read_all(fd, data, sb.st_size);
+   if (ret == -1)
+      goto fail;
+
+   uncompressed_data = parse_and_validate_cache_item(cache, data, sb.st_size,
+                                                     size);
+
  fail:
    if (data)
       free(data);
    if (filename)
       free(filename);
-   if (uncompressed_data)
-      free(uncompressed_data);
-   if (file_header)
-      free(file_header);
    if (fd != -1)
       close(fd);
 
-   return NULL;
+   return uncompressed_data;
 }
 
 /* Return a filename within the cache's directory corresponding to 'key'.
@@ -799,6 +840,73 @@ disk_cache_write_item_to_disk(struct disk_cache_put_job *dc_job,
    free(filename_tmp);
 }
 
+void *
+disk_cache_db_load_item(struct disk_cache *cache, const cache_key key,
+                        size_t *size)
+{
+   size_t cache_item_size;
+
+   void *cache_item = mesa_cache_db_read_entry(&cache->cache_db, key,
+                                               &cache_item_size);
+   if (!cache_item)
+      return NULL;
+
+   void *data = parse_and_validate_cache_item(cache, cache_item,
+                                              cache_item_size, size);
+   free(cache_item);
+
+   return data;
+}
+
+bool
+disk_cache_db_write_item_to_disk(struct disk_cache_put_job *dc_job,
+                                 struct cache_entry_file_data *cf_data)
+{
+   struct disk_cache *cache = dc_job->cache;
+   struct blob cache_blob;
+   bool ret = false;
+
+   /* Same layout as the files written by disk_cache_write_item_to_disk(),
+    * so that both are read by parse_and_validate_cache_item().
+    */
+   blob_init(&cache_blob);
+   blob_write_bytes(&cache_blob, cache->driver_keys_blob,
+                    cache->driver_keys_blob_size);
+   blob_write_bytes(&cache_blob, &dc_job->cache_item_metadata.type,
+                    sizeof(uint32_t));
+
+   if (dc_job->cache_item_metadata.type == CACHE_ITEM_TYPE_GLSL) {
+      blob_write_bytes(&cache_blob, &dc_job->cache_item_metadata.num_keys,
+                       sizeof(uint32_t));
+      blob_write_bytes(&cache_blob, dc_job->cache_item_metadata.keys[0],
+                       dc_job->cache_item_metadata.num_keys *
+                       sizeof(cache_key));
+   }
+
+   blob_write_bytes(&cache_blob, cf_data, sizeof(*cf_data));
+
+   if (!deflate_to_blob(dc_job->data, dc_job->size, &cache_blob) ||
+       cache_blob.out_of_memory)
+      goto done;
+
+   ret = mesa_cache_db_entry_write(&cache->cache_db, dc_job->key,
+                                   cache_blob.data, cache_blob.size);
+
+ done:
+   blob_finish(&cache_blob);
+   return ret;
+}
+
+bool
+disk_cache_db_load_cache_index(struct disk_cache *cache)
+{
+   if (!mesa_cache_db_open(&cache->cache_db, cache->path))
+      return false;
+
+   mesa_cache_db_set_size_limit(&cache->cache_db, cache->max_size);
+   return true;
+}
+
 /* Determine path for cache based on the first defined name as follows:
  *
  *   $MESA_GLSL_CACHE_DIR
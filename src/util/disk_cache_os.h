@@ -24,6 +24,9 @@
 #ifndef DISK_CACHE_OS_H
 #define DISK_CACHE_OS_H
 
+#include "c11/threads.h"
+#include "util/list.h"
+#include "util/mesa_cache_db.h"
 #include "util/u_queue.h"
 
 #if DETECT_OS_WINDOWS
@@ -65,6 +68,31 @@ struct disk_cache {
    /* Maximum size of all cached objects (in bytes). */
    uint64_t max_size;
 
+   /* Entries go to a single file database instead of one file each, see
+    * MESA_DISK_CACHE_SINGLE_FILE.
+    */
+   bool use_cache_db;
+   struct mesa_cache_db cache_db;
+
+   /* Recently read items, in front of the disk. Sized by
+    * MESA_DISK_CACHE_MEMORY_SIZE, 0 disables it.
+    */
+   uint64_t mem_max_size;
+   uint64_t mem_size;
+   mtx_t mem_mtx;
+   /* Signalled whenever a prefetch has finished loading an item. */
+   cnd_t mem_cond;
+   /* Maps a cache key to its struct disk_cache_mem_entry. */
+   struct hash_table *mem_entries;
+   /* Loaded entries, most recently used first. */
+   struct list_head mem_lru;
+
+   /* Threads loading items for disk_cache_prefetch(), started on first
+    * use.
+    */
+   struct util_queue get_queue;
+   bool get_queue_initialized;
+
    /* Driver cache keys. */
    uint8_t *driver_keys_blob;
    size_t driver_keys_blob_size;
@@ -89,6 +117,27 @@ struct disk_cache_put_job {
    struct cache_item_metadata cache_item_metadata;
 };
 
+struct disk_cache_mem_entry {
+   cache_key key;
+
+   /* Link in disk_cache::mem_lru, once loaded. */
+   struct list_head link;
+
+   /* Set while a prefetch is loading the item. */
+   bool loading;
+
+   void *data;
+   size_t size;
+};
+
+struct disk_cache_get_job {
+   struct util_queue_fence fence;
+
+   struct disk_cache *cache;
+
+   struct disk_cache_mem_entry *entry;
+};
+
 struct cache_entry_file_data {
    uint32_t crc32;
    uint32_t uncompressed_size;
@@ -114,6 +163,17 @@ disk_cache_write_item_to_disk(struct disk_cache_put_job *dc_job,
                               struct cache_entry_file_data *cf_data,
                               char *filename);
 
+void *
+disk_cache_db_load_item(struct disk_cache *cache, const cache_key key,
+                        size_t *size);
+
+bool
+disk_cache_db_write_item_to_disk(struct disk_cache_put_job *dc_job,
+                                 struct cache_entry_file_data *cf_data);
+
+bool
+disk_cache_db_load_cache_index(struct disk_cache *cache);
+
 bool
 disk_cache_enabled(void);
 
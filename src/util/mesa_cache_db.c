@@ -0,0 +1,751 @@
+/*
+ * Copyright © 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "util/detect_os.h"
+
+#if defined(ENABLE_SHADER_CACHE) && !DETECT_OS_WINDOWS
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "util/crc32.h"
+#include "util/disk_cache.h"
+#include "util/hash_table.h"
+#include "util/macros.h"
+#include "util/mesa_cache_db.h"
+#include "util/ralloc.h"
+#include "util/rand_xor.h"
+
+#define MESA_CACHE_DB_VERSION 1
+#define MESA_CACHE_DB_MAGIC "MESA_DB"
+
+/* Both the data and the index file start with this header. */
+struct PACKED mesa_cache_db_file_header {
+   char magic[8];
+   uint32_t version;
+   uint64_t uuid;
+};
+
+/* The index file is a list of these. An entry with a size of 0 removes
+ * the key again.
+ */
+struct PACKED mesa_cache_db_index_file_entry {
+   uint8_t key[CACHE_KEY_SIZE];
+   uint32_t crc;
+   uint32_t size;
+   uint64_t offset;
+};
+
+struct mesa_cache_db_index_entry {
+   uint8_t key[CACHE_KEY_SIZE];
+   uint32_t crc;
+   uint32_t size;
+   uint64_t offset;
+
+   /* Value of mesa_cache_db::access_seq at the last hit, 0 if none. */
+   uint64_t last_access;
+};
+
+static uint32_t
+hash_cache_key(const void *key)
+{
+   /* The keys are SHA-1 hashes already. */
+   uint32_t hash;
+   memcpy(&hash, key, sizeof(hash));
+   return hash;
+}
+
+static bool
+cache_keys_equal(const void *a, const void *b)
+{
+   return memcmp(a, b, CACHE_KEY_SIZE) == 0;
+}
+
+static ssize_t
+pread_all(int fd, void *buf, size_t count, off_t offset)
+{
+   char *in = buf;
+   ssize_t read_ret;
+   size_t done;
+
+   for (done = 0; done < count; done += read_ret) {
+      read_ret = pread(fd, in + done, count - done, offset + done);
+      if (read_ret == -1 || read_ret == 0)
+         return -1;
+   }
+   return done;
+}
+
+static ssize_t
+pwrite_all(int fd, const void *buf, size_t count, off_t offset)
+{
+   const char *out = buf;
+   ssize_t written;
+   size_t done;
+
+   for (done = 0; done < count; done += written) {
+      written = pwrite(fd, out + done, count - done, offset + done);
+      if (written == -1)
+         return -1;
+   }
+   return done;
+}
+
+static bool
+lock_file(int fd)
+{
+#ifdef HAVE_FLOCK
+   return flock(fd, LOCK_EX) == 0;
+#else
+   struct flock lock = {
+      .l_start = 0,
+      .l_len = 0, /* entire file */
+      .l_type = F_WRLCK,
+      .l_whence = SEEK_SET
+   };
+   return fcntl(fd, F_SETLKW, &lock) == 0;
+#endif
+}
+
+static void
+unlock_file(int fd)
+{
+#ifdef HAVE_FLOCK
+   flock(fd, LOCK_UN);
+#else
+   struct flock lock = {
+      .l_start = 0,
+      .l_len = 0, /* entire file */
+      .l_type = F_UNLCK,
+      .l_whence = SEEK_SET
+   };
+   fcntl(fd, F_SETLK, &lock);
+#endif
+}
+
+static uint64_t
+new_uuid(void)
+{
+   uint64_t seed[2];
+
+   s_rand_xorshift128plus(seed, true);
+   return rand_xorshift128plus(seed);
+}
+
+static bool
+write_header(int fd, uint64_t uuid)
+{
+   struct mesa_cache_db_file_header header;
+
+   memset(&header, 0, sizeof(header));
+   memcpy(header.magic, MESA_CACHE_DB_MAGIC, sizeof(MESA_CACHE_DB_MAGIC));
+   header.version = MESA_CACHE_DB_VERSION;
+   header.uuid = uuid;
+
+   return pwrite_all(fd, &header, sizeof(header), 0) != -1;
+}
+
+static bool
+read_header(int fd, uint64_t *uuid)
+{
+   struct mesa_cache_db_file_header header;
+
+   if (pread_all(fd, &header, sizeof(header), 0) == -1)
+      return false;
+
+   if (memcmp(header.magic, MESA_CACHE_DB_MAGIC,
+              sizeof(MESA_CACHE_DB_MAGIC)) != 0 ||
+       header.version != MESA_CACHE_DB_VERSION)
+      return false;
+
+   *uuid = header.uuid;
+   return true;
+}
+
+static struct mesa_cache_db_index_entry *
+lookup_entry(struct mesa_cache_db *db, const uint8_t *cache_key)
+{
+   struct hash_entry *entry;
+
+   if (!db->index)
+      return NULL;
+
+   entry = _mesa_hash_table_search(db->index, cache_key);
+   return entry ? entry->data : NULL;
+}
+
+/* Load the index entries appended since the last call, up to index_size.
+ * A partially written entry at the end is left for the next call.
+ */
+static bool
+load_index(struct mesa_cache_db *db, uint64_t index_size)
+{
+   const size_t entry_size = sizeof(struct mesa_cache_db_index_file_entry);
+
+   if (index_size <= db->index_loaded_size)
+      return true;
+
+   size_t count = (index_size - db->index_loaded_size) / entry_size;
+   if (count == 0)
+      return true;
+
+   struct mesa_cache_db_index_file_entry *entries =
+      malloc(count * entry_size);
+   if (!entries)
+      return false;
+
+   if (pread_all(db->index_fd, entries, count * entry_size,
+                 db->index_loaded_size) == -1) {
+      free(entries);
+      return false;
+   }
+
+   for (size_t i = 0; i < count; i++) {
+      struct mesa_cache_db_index_file_entry *file_entry = &entries[i];
+      struct mesa_cache_db_index_entry *entry =
+         lookup_entry(db, file_entry->key);
+
+      if (file_entry->size == 0) {
+         if (entry) {
+            _mesa_hash_table_remove_key(db->index, entry->key);
+            ralloc_free(entry);
+         }
+         continue;
+      }
+
+      if (file_entry->offset < sizeof(struct mesa_cache_db_file_header))
+         continue;
+
+      if (!entry) {
+         entry = rzalloc(db->index, struct mesa_cache_db_index_entry);
+         if (!entry)
+            break;
+
+         memcpy(entry->key, file_entry->key, CACHE_KEY_SIZE);
+         _mesa_hash_table_insert(db->index, entry->key, entry);
+      }
+
+      entry->crc = file_entry->crc;
+      entry->size = file_entry->size;
+      entry->offset = file_entry->offset;
+   }
+
+   free(entries);
+
+   db->index_loaded_size += count * entry_size;
+   return true;
+}
+
+/* Map the whole data file, after it has grown past the current mapping. */
+static bool
+map_db(struct mesa_cache_db *db)
+{
+   struct stat sb;
+
+   if (fstat(db->db_fd, &sb) == -1)
+      return false;
+
+   if (db->db_map && sb.st_size == db->db_map_size)
+      return true;
+
+   void *map = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, db->db_fd, 0);
+   if (map == MAP_FAILED)
+      return false;
+
+   if (db->db_map)
+      munmap(db->db_map, db->db_map_size);
+
+   db->db_map = map;
+   db->db_map_size = sb.st_size;
+   return true;
+}
+
+static void
+close_files(struct mesa_cache_db *db)
+{
+   if (db->db_map)
+      munmap(db->db_map, db->db_map_size);
+   if (db->db_fd != -1)
+      close(db->db_fd);
+   if (db->index_fd != -1)
+      close(db->index_fd);
+
+   db->db_map = NULL;
+   db->db_map_size = 0;
+   db->db_fd = -1;
+   db->index_fd = -1;
+
+   ralloc_free(db->index);
+   db->index = NULL;
+   db->index_loaded_size = 0;
+}
+
+/* Create empty data and index files and rename them over the current ones.
+ * Renaming instead of truncating keeps the mappings of other processes
+ * valid. The caller holds the lock file.
+ */
+static bool
+create_files(struct mesa_cache_db *db, uint64_t uuid,
+             int *tmp_db_fd, int *tmp_index_fd,
+             char **tmp_db_path, char **tmp_index_path)
+{
+   *tmp_db_path = ralloc_asprintf(db->mem_ctx, "%s.tmp", db->db_path);
+   *tmp_index_path = ralloc_asprintf(db->mem_ctx, "%s.tmp", db->index_path);
+   if (!*tmp_db_path || !*tmp_index_path)
+      return false;
+
+   *tmp_db_fd = open(*tmp_db_path,
+                     O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+   *tmp_index_fd = open(*tmp_index_path,
+                        O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+   if (*tmp_db_fd == -1 || *tmp_index_fd == -1)
+      return false;
+
+   return write_header(*tmp_db_fd, uuid) &&
+          write_header(*tmp_index_fd, uuid);
+}
+
+static bool
+replace_files(struct mesa_cache_db *db,
+              const char *tmp_db_path, const char *tmp_index_path)
+{
+   /* Readers notice the new files by the inode of the index file, so
+    * rename it last.
+    */
+   if (rename(tmp_db_path, db->db_path) == -1)
+      return false;
+
+   return rename(tmp_index_path, db->index_path) == 0;
+}
+
+static bool
+open_files(struct mesa_cache_db *db);
+
+static bool
+reset_files(struct mesa_cache_db *db)
+{
+   char *tmp_db_path = NULL, *tmp_index_path = NULL;
+   int tmp_db_fd = -1, tmp_index_fd = -1;
+   bool ret = false;
+
+   if (!create_files(db, new_uuid(), &tmp_db_fd, &tmp_index_fd,
+                     &tmp_db_path, &tmp_index_path))
+      goto fail;
+
+   ret = replace_files(db, tmp_db_path, tmp_index_path);
+
+fail:
+   if (tmp_db_fd != -1)
+      close(tmp_db_fd);
+   if (tmp_index_fd != -1)
+      close(tmp_index_fd);
+   if (!ret) {
+      if (tmp_db_path)
+         unlink(tmp_db_path);
+      if (tmp_index_path)
+         unlink(tmp_index_path);
+   }
+   ralloc_free(tmp_db_path);
+   ralloc_free(tmp_index_path);
+
+   return ret;
+}
+
+/* Open the data and index files, creating them if needed, and load the
+ * index. The caller holds the lock file.
+ */
+static bool
+open_files(struct mesa_cache_db *db)
+{
+   uint64_t db_uuid, index_uuid;
+   struct stat db_sb, index_sb;
+
+   db->index = _mesa_hash_table_create(db->mem_ctx, hash_cache_key,
+                                       cache_keys_equal);
+   if (!db->index)
+      return false;
+
+   db->db_fd = open(db->db_path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+   db->index_fd = open(db->index_path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+   if (db->db_fd == -1 || db->index_fd == -1)
+      goto fail;
+
+   if (fstat(db->db_fd, &db_sb) == -1 || fstat(db->index_fd, &index_sb) == -1)
+      goto fail;
+
+   if (db_sb.st_size == 0 && index_sb.st_size == 0) {
+      db->uuid = new_uuid();
+      if (!write_header(db->db_fd, db->uuid) ||
+          !write_header(db->index_fd, db->uuid))
+         goto fail;
+   } else if (!read_header(db->db_fd, &db_uuid) ||
+              !read_header(db->index_fd, &index_uuid) ||
+              db_uuid != index_uuid) {
+      /* Left behind by an older version or a crash between the renames of
+       * a compaction, start over.
+       */
+      close_files(db);
+      if (!reset_files(db))
+         return false;
+      return open_files(db);
+   } else {
+      db->uuid = db_uuid;
+   }
+
+   db->index_loaded_size = sizeof(struct mesa_cache_db_file_header);
+
+   if (fstat(db->index_fd, &index_sb) == -1 ||
+       !load_index(db, index_sb.st_size) || !map_db(db))
+      goto fail;
+
+   return true;
+
+fail:
+   close_files(db);
+   return false;
+}
+
+/* Pick up entries appended by other processes, or reopen the files if
+ * another process has compacted them. locked tells whether the caller
+ * already holds the lock file.
+ */
+static bool
+refresh(struct mesa_cache_db *db, bool locked)
+{
+   struct stat path_sb, fd_sb;
+   bool ret;
+
+   if (db->index_fd != -1) {
+      if (stat(db->index_path, &path_sb) == -1 ||
+          fstat(db->index_fd, &fd_sb) == -1)
+         return false;
+
+      if (path_sb.st_ino == fd_sb.st_ino && path_sb.st_dev == fd_sb.st_dev)
+         return load_index(db, fd_sb.st_size);
+
+      close_files(db);
+   }
+
+   if (!locked && !lock_file(db->lock_fd))
+      return false;
+   ret = open_files(db);
+   if (!locked)
+      unlock_file(db->lock_fd);
+
+   return ret;
+}
+
+static int
+compare_entries_by_age(const void *a, const void *b)
+{
+   const struct mesa_cache_db_index_entry *ea =
+      *(const struct mesa_cache_db_index_entry **)a;
+   const struct mesa_cache_db_index_entry *eb =
+      *(const struct mesa_cache_db_index_entry **)b;
+
+   /* Most recently hit first, then most recently written. */
+   if (ea->last_access != eb->last_access)
+      return ea->last_access > eb->last_access ? -1 : 1;
+   if (ea->offset != eb->offset)
+      return ea->offset > eb->offset ? -1 : 1;
+   return 0;
+}
+
+/* Rewrite the files, keeping the most recently used entries that fit into
+ * half of the size limit minus reserve bytes. The caller holds the lock
+ * file.
+ */
+static bool
+compact(struct mesa_cache_db *db, uint64_t reserve)
+{
+   struct mesa_cache_db_index_entry **entries = NULL;
+   char *tmp_db_path = NULL, *tmp_index_path = NULL;
+   int tmp_db_fd = -1, tmp_index_fd = -1;
+   uint64_t db_size = sizeof(struct mesa_cache_db_file_header);
+   uint64_t index_size = sizeof(struct mesa_cache_db_file_header);
+   unsigned num_entries = 0;
+   bool ret = false;
+
+   if (!map_db(db))
+      return false;
+
+   entries = malloc(db->index->entries * sizeof(*entries));
+   if (db->index->entries && !entries)
+      return false;
+
+   hash_table_foreach(db->index, he)
+      entries[num_entries++] = he->data;
+
+   qsort(entries, num_entries, sizeof(*entries), compare_entries_by_age);
+
+   if (!create_files(db, new_uuid(), &tmp_db_fd, &tmp_index_fd,
+                     &tmp_db_path, &tmp_index_path))
+      goto fail;
+
+   for (unsigned i = 0; i < num_entries; i++) {
+      struct mesa_cache_db_index_entry *entry = entries[i];
+
+      if (db_size + entry->size + reserve > db->max_size / 2)
+         break;
+
+      if (entry->offset + entry->size > db->db_map_size)
+         continue;
+
+      struct mesa_cache_db_index_file_entry file_entry;
+      memcpy(file_entry.key, entry->key, CACHE_KEY_SIZE);
+      file_entry.crc = entry->crc;
+      file_entry.size = entry->size;
+      file_entry.offset = db_size;
+
+      if (pwrite_all(tmp_db_fd, db->db_map + entry->offset, entry->size,
+                     db_size) == -1 ||
+          pwrite_all(tmp_index_fd, &file_entry, sizeof(file_entry),
+                     index_size) == -1)
+         goto fail;
+
+      db_size += entry->size;
+      index_size += sizeof(file_entry);
+   }
+
+   if (!replace_files(db, tmp_db_path, tmp_index_path))
+      goto fail;
+
+   close_files(db);
+   ret = open_files(db);
+
+fail:
+   if (tmp_db_fd != -1)
+      close(tmp_db_fd);
+   if (tmp_index_fd != -1)
+      close(tmp_index_fd);
+   if (!ret && tmp_db_path) {
+      unlink(tmp_db_path);
+      unlink(tmp_index_path);
+   }
+   ralloc_free(tmp_db_path);
+   ralloc_free(tmp_index_path);
+   free(entries);
+
+   return ret;
+}
+
+/* Append an index entry for the key. The caller holds the lock file. */
+static bool
+append_index_entry(struct mesa_cache_db *db, const uint8_t *cache_key,
+                   uint32_t crc, uint32_t size, uint64_t offset)
+{
+   struct mesa_cache_db_index_file_entry file_entry;
+   struct stat sb;
+
+   if (fstat(db->index_fd, &sb) == -1)
+      return false;
+
+   memcpy(file_entry.key, cache_key, CACHE_KEY_SIZE);
+   file_entry.crc = crc;
+   file_entry.size = size;
+   file_entry.offset = offset;
+
+   if (pwrite_all(db->index_fd, &file_entry, sizeof(file_entry),
+                  sb.st_size) == -1)
+      return false;
+
+   return load_index(db, sb.st_size + sizeof(file_entry));
+}
+
+bool
+mesa_cache_db_open(struct mesa_cache_db *db, const char *cache_path)
+{
+   memset(db, 0, sizeof(*db));
+   db->db_fd = -1;
+   db->index_fd = -1;
+   db->lock_fd = -1;
+   db->max_size = UINT64_MAX;
+
+   db->mem_ctx = ralloc_context(NULL);
+   if (!db->mem_ctx)
+      return false;
+
+   db->db_path = ralloc_asprintf(db->mem_ctx, "%s/mesa_cache.db", cache_path);
+   db->index_path = ralloc_asprintf(db->mem_ctx, "%s/mesa_cache.idx",
+                                    cache_path);
+   db->lock_path = ralloc_asprintf(db->mem_ctx, "%s/mesa_cache.lock",
+                                   cache_path);
+   if (!db->db_path || !db->index_path || !db->lock_path)
+      goto fail;
+
+   db->lock_fd = open(db->lock_path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+   if (db->lock_fd == -1)
+      goto fail;
+
+   if (!lock_file(db->lock_fd))
+      goto fail;
+   bool opened = open_files(db);
+   unlock_file(db->lock_fd);
+
+   if (!opened)
+      goto fail;
+
+   simple_mtx_init(&db->mtx, mtx_plain);
+   return true;
+
+fail:
+   if (db->lock_fd != -1)
+      close(db->lock_fd);
+   ralloc_free(db->mem_ctx);
+   db->mem_ctx = NULL;
+   return false;
+}
+
+void
+mesa_cache_db_close(struct mesa_cache_db *db)
+{
+   close_files(db);
+   close(db->lock_fd);
+   simple_mtx_destroy(&db->mtx);
+   ralloc_free(db->mem_ctx);
+}
+
+void
+mesa_cache_db_set_size_limit(struct mesa_cache_db *db, uint64_t max_size)
+{
+   simple_mtx_lock(&db->mtx);
+   db->max_size = max_size;
+   simple_mtx_unlock(&db->mtx);
+}
+
+void *
+mesa_cache_db_read_entry(struct mesa_cache_db *db, const uint8_t *cache_key,
+                         size_t *size)
+{
+   void *data = NULL;
+
+   simple_mtx_lock(&db->mtx);
+
+   /* The index file is only read on a miss. */
+   struct mesa_cache_db_index_entry *entry = lookup_entry(db, cache_key);
+   if (!entry) {
+      if (!refresh(db, false))
+         goto out;
+
+      entry = lookup_entry(db, cache_key);
+      if (!entry)
+         goto out;
+   }
+
+   if (entry->offset + entry->size > db->db_map_size &&
+       (!map_db(db) || entry->offset + entry->size > db->db_map_size))
+      goto out;
+
+   const uint8_t *src = db->db_map + entry->offset;
+   if (util_hash_crc32(src, entry->size) != entry->crc)
+      goto out;
+
+   data = malloc(entry->size);
+   if (!data)
+      goto out;
+
+   memcpy(data, src, entry->size);
+   entry->last_access = ++db->access_seq;
+
+   if (size)
+      *size = entry->size;
+
+out:
+   simple_mtx_unlock(&db->mtx);
+   return data;
+}
+
+bool
+mesa_cache_db_entry_write(struct mesa_cache_db *db, const uint8_t *cache_key,
+                          const void *blob, size_t blob_size)
+{
+   bool ret = false;
+   struct stat sb;
+
+   if (blob_size == 0 || blob_size > UINT32_MAX)
+      return false;
+
+   simple_mtx_lock(&db->mtx);
+
+   if (!lock_file(db->lock_fd))
+      goto out;
+
+   if (!refresh(db, true))
+      goto out_unlock;
+
+   /* Another process may have written it meanwhile. */
+   if (lookup_entry(db, cache_key)) {
+      ret = true;
+      goto out_unlock;
+   }
+
+   if (fstat(db->db_fd, &sb) == -1)
+      goto out_unlock;
+
+   if (sb.st_size + blob_size > db->max_size) {
+      if (sizeof(struct mesa_cache_db_file_header) + blob_size > db->max_size ||
+          !compact(db, blob_size) || fstat(db->db_fd, &sb) == -1)
+         goto out_unlock;
+   }
+
+   /* Data first: if we don't get to the index entry, the data is just
+    * unreferenced until the next compaction.
+    */
+   if (pwrite_all(db->db_fd, blob, blob_size, sb.st_size) == -1)
+      goto out_unlock;
+
+   ret = append_index_entry(db, cache_key, util_hash_crc32(blob, blob_size),
+                            blob_size, sb.st_size);
+
+out_unlock:
+   unlock_file(db->lock_fd);
+out:
+   simple_mtx_unlock(&db->mtx);
+   return ret;
+}
+
+void
+mesa_cache_db_entry_remove(struct mesa_cache_db *db, const uint8_t *cache_key)
+{
+   simple_mtx_lock(&db->mtx);
+
+   if (!lock_file(db->lock_fd))
+      goto out;
+
+   if (refresh(db, true) && lookup_entry(db, cache_key))
+      append_index_entry(db, cache_key, 0, 0, 0);
+
+   unlock_file(db->lock_fd);
+out:
+   simple_mtx_unlock(&db->mtx);
+}
+
+#endif /* ENABLE_SHADER_CACHE && !DETECT_OS_WINDOWS */
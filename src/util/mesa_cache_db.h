@@ -0,0 +1,117 @@
+/*
+ * Copyright © 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* A single file cache database.
+ *
+ * Instead of one file per entry, all entries of a cache are appended to
+ * one data file, with their keys and offsets appended to a separate index
+ * file. The index is loaded into a hash table when the database is opened
+ * and the data file is memory-mapped for reads, so a lookup doesn't need
+ * any syscalls.
+ *
+ * Other processes may append to the same files. Their entries are picked up
+ * when a lookup misses. Writers serialize with a lock file, and a full
+ * database is compacted into new files which are renamed over the old ones,
+ * so memory mappings of other processes stay valid.
+ */
+
+#ifndef MESA_CACHE_DB_H
+#define MESA_CACHE_DB_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "util/simple_mtx.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct hash_table;
+
+struct mesa_cache_db {
+   /* Paths of the data, index and lock files. */
+   char *db_path;
+   char *index_path;
+   char *lock_path;
+
+   int db_fd;
+   int index_fd;
+   int lock_fd;
+
+   /* Random number shared by the headers of the data and index files. */
+   uint64_t uuid;
+
+   /* How much of the index file has been loaded into the hash table. */
+   uint64_t index_loaded_size;
+
+   /* Read-only mapping of the data file. */
+   uint8_t *db_map;
+   size_t db_map_size;
+
+   /* Maps a cache key to its struct mesa_cache_db_index_entry. */
+   struct hash_table *index;
+
+   /* Size at which the data file is compacted. */
+   uint64_t max_size;
+
+   /* Incremented on every hit, entries hit most recently are kept when
+    * the data file is compacted.
+    */
+   uint64_t access_seq;
+
+   /* Protects all of the above, the put jobs and lookups run in
+    * different threads.
+    */
+   simple_mtx_t mtx;
+
+   void *mem_ctx;
+};
+
+bool
+mesa_cache_db_open(struct mesa_cache_db *db, const char *cache_path);
+
+void
+mesa_cache_db_close(struct mesa_cache_db *db);
+
+void
+mesa_cache_db_set_size_limit(struct mesa_cache_db *db, uint64_t max_size);
+
+/* Return a malloc'ed copy of the entry, or NULL if there is none. */
+void *
+mesa_cache_db_read_entry(struct mesa_cache_db *db, const uint8_t *cache_key,
+                         size_t *size);
+
+bool
+mesa_cache_db_entry_write(struct mesa_cache_db *db, const uint8_t *cache_key,
+                          const void *blob, size_t blob_size);
+
+void
+mesa_cache_db_entry_remove(struct mesa_cache_db *db, const uint8_t *cache_key);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MESA_CACHE_DB_H */
@@ -28,6 +28,7 @@
 #include <string.h>
 #include <stdint.h>
 
+#include "util/list.h"
 #include "util/macros.h"
 #include "util/u_math.h"
 
@@ -934,3 +935,330 @@ linear_strcat(void *parent, char **dest, const char *str)
 {
    return linear_cat(parent, dest, str, strlen(str));
 }
+
+/*
+ * Garbage collected slab allocator.
+ *
+ * Objects are carved out of slabs, each slab only holding blocks of one size
+ * class (bucket). Freed blocks go on a per-slab freelist and are reused by
+ * later allocations of the same size, and a slab is returned to ralloc once
+ * all of its blocks are free. Allocations that don't fit a bucket are
+ * individually ralloc'd but still tracked by the context.
+ *
+ * Every block carries a generation bit. gc_sweep_start() flips the current
+ * generation, gc_mark_live() moves blocks to it and gc_sweep_end() frees every
+ * block that wasn't marked. Everything allocated from a gc_ctx is also a
+ * ralloc child of it, so freeing the context (or its ralloc parent) releases
+ * all of it at once.
+ */
+
+#define GC_BUCKET_STEP 16
+#define GC_MAX_BLOCK_SIZE 512
+#define GC_NUM_BUCKETS (GC_MAX_BLOCK_SIZE / GC_BUCKET_STEP)
+#define GC_MIN_SLAB_BLOCKS 32
+#define GC_MIN_SLAB_SIZE 4096
+#define GC_ALIGNMENT 8
+
+#define GC_IS_USED      0x1
+#define GC_GENERATION   0x2
+#define GC_IS_LARGE     0x4
+
+typedef struct {
+   /* Distance from the start of the slab, unused for large blocks. */
+   uint32_t slab_offset;
+   uint8_t bucket;
+   uint8_t flags;
+   uint16_t _padding;
+} gc_block_header;
+
+typedef struct gc_slab {
+   gc_ctx *ctx;
+
+   /* Link in the bucket's list of slabs. */
+   struct list_head link;
+
+   /* Link in the bucket's list of slabs with free blocks. */
+   struct list_head free_link;
+
+   /* Freed blocks, linked through their payload. */
+   void *freelist;
+
+   /* Blocks past this point have never been handed out. */
+   char *next_available;
+   char *end;
+
+   unsigned num_used;
+} gc_slab;
+
+typedef struct {
+   gc_ctx *ctx;
+   struct list_head link;
+} gc_large_block;
+
+struct gc_ctx {
+   struct {
+      struct list_head slabs;
+      struct list_head free_slabs;
+   } buckets[GC_NUM_BUCKETS];
+
+   struct list_head large_blocks;
+
+   uint8_t current_gen;
+};
+
+#define GC_SLAB_HEADER_SIZE ALIGN_POT(sizeof(gc_slab), GC_ALIGNMENT)
+#define GC_LARGE_HEADER_SIZE \
+   ALIGN_POT(sizeof(gc_large_block) + sizeof(gc_block_header), 16)
+
+static inline gc_block_header *
+gc_header_from_ptr(const void *ptr)
+{
+   return (gc_block_header *)((char *)ptr - sizeof(gc_block_header));
+}
+
+static inline gc_slab *
+gc_slab_from_header(gc_block_header *header)
+{
+   assert(!(header->flags & GC_IS_LARGE));
+   return (gc_slab *)((char *)header - header->slab_offset);
+}
+
+static inline gc_large_block *
+gc_large_from_header(gc_block_header *header)
+{
+   assert(header->flags & GC_IS_LARGE);
+   return (gc_large_block *)((char *)header + sizeof(gc_block_header) -
+                             GC_LARGE_HEADER_SIZE);
+}
+
+static inline unsigned
+gc_bucket_block_size(unsigned bucket)
+{
+   return (bucket + 1) * GC_BUCKET_STEP;
+}
+
+gc_ctx *
+gc_context(const void *parent)
+{
+   gc_ctx *ctx = rzalloc(parent, gc_ctx);
+   if (unlikely(!ctx))
+      return NULL;
+
+   for (unsigned i = 0; i < GC_NUM_BUCKETS; i++) {
+      list_inithead(&ctx->buckets[i].slabs);
+      list_inithead(&ctx->buckets[i].free_slabs);
+   }
+   list_inithead(&ctx->large_blocks);
+
+   return ctx;
+}
+
+static gc_slab *
+gc_create_slab(gc_ctx *ctx, unsigned bucket)
+{
+   unsigned block_size = gc_bucket_block_size(bucket);
+   unsigned num_blocks = MAX2(GC_MIN_SLAB_BLOCKS,
+                              GC_MIN_SLAB_SIZE / block_size);
+   gc_slab *slab = ralloc_size(ctx, GC_SLAB_HEADER_SIZE +
+                                    block_size * num_blocks);
+   if (unlikely(!slab))
+      return NULL;
+
+   slab->ctx = ctx;
+   slab->freelist = NULL;
+   slab->next_available = (char *)slab + GC_SLAB_HEADER_SIZE;
+   slab->end = slab->next_available + block_size * num_blocks;
+   slab->num_used = 0;
+
+   list_add(&slab->link, &ctx->buckets[bucket].slabs);
+   list_add(&slab->free_link, &ctx->buckets[bucket].free_slabs);
+   return slab;
+}
+
+static void *
+gc_alloc_large(gc_ctx *ctx, size_t size)
+{
+   gc_large_block *large = ralloc_size(ctx, GC_LARGE_HEADER_SIZE + size);
+   if (unlikely(!large))
+      return NULL;
+
+   large->ctx = ctx;
+   list_add(&large->link, &ctx->large_blocks);
+
+   void *ptr = (char *)large + GC_LARGE_HEADER_SIZE;
+   gc_block_header *header = gc_header_from_ptr(ptr);
+   header->slab_offset = 0;
+   header->bucket = 0;
+   header->flags = GC_IS_USED | GC_IS_LARGE | ctx->current_gen;
+   return ptr;
+}
+
+void *
+gc_alloc_size(gc_ctx *ctx, size_t size, size_t alignment)
+{
+   assert(ctx);
+   assert(util_is_power_of_two_nonzero(alignment));
+
+   size_t block_size = ALIGN_POT(size + sizeof(gc_block_header),
+                                 GC_BUCKET_STEP);
+
+   if (unlikely(alignment > GC_ALIGNMENT || block_size > GC_MAX_BLOCK_SIZE))
+      return gc_alloc_large(ctx, size);
+
+   unsigned bucket = block_size / GC_BUCKET_STEP - 1;
+
+   gc_slab *slab;
+   if (list_is_empty(&ctx->buckets[bucket].free_slabs)) {
+      slab = gc_create_slab(ctx, bucket);
+      if (unlikely(!slab))
+         return NULL;
+   } else {
+      slab = list_first_entry(&ctx->buckets[bucket].free_slabs, gc_slab,
+                              free_link);
+   }
+
+   gc_block_header *header;
+   if (slab->freelist) {
+      void *ptr = slab->freelist;
+      slab->freelist = *(void **)ptr;
+      header = gc_header_from_ptr(ptr);
+   } else {
+      header = (gc_block_header *)slab->next_available;
+      slab->next_available += block_size;
+   }
+
+   if (!slab->freelist && slab->next_available == slab->end)
+      list_delinit(&slab->free_link);
+
+   slab->num_used++;
+
+   header->slab_offset = (char *)header - (char *)slab;
+   header->bucket = bucket;
+   header->flags = GC_IS_USED | ctx->current_gen;
+
+   void *ptr = (char *)header + sizeof(gc_block_header);
+   assert((uintptr_t)ptr % GC_ALIGNMENT == 0);
+   return ptr;
+}
+
+void *
+gc_zalloc_size(gc_ctx *ctx, size_t size, size_t alignment)
+{
+   void *ptr = gc_alloc_size(ctx, size, alignment);
+
+   if (likely(ptr))
+      memset(ptr, 0, size);
+
+   return ptr;
+}
+
+static void
+gc_free_block(gc_ctx *ctx, gc_block_header *header)
+{
+   assert(header->flags & GC_IS_USED);
+
+   if (header->flags & GC_IS_LARGE) {
+      gc_large_block *large = gc_large_from_header(header);
+      list_del(&large->link);
+      ralloc_free(large);
+      return;
+   }
+
+   unsigned bucket = header->bucket;
+   gc_slab *slab = gc_slab_from_header(header);
+   void *ptr = (char *)header + sizeof(gc_block_header);
+
+   header->flags = 0;
+   *(void **)ptr = slab->freelist;
+
+   if (list_is_empty(&slab->free_link))
+      list_add(&slab->free_link, &ctx->buckets[bucket].free_slabs);
+
+   slab->freelist = ptr;
+   slab->num_used--;
+
+   /* Give empty slabs back, but keep one around per bucket so that a size
+    * which is freed and allocated in turn doesn't hit malloc every time.
+    */
+   if (slab->num_used == 0 &&
+       !list_is_singular(&ctx->buckets[bucket].slabs)) {
+      list_del(&slab->link);
+      list_del(&slab->free_link);
+      ralloc_free(slab);
+   }
+}
+
+void
+gc_free(void *ptr)
+{
+   if (!ptr)
+      return;
+
+   gc_block_header *header = gc_header_from_ptr(ptr);
+   gc_free_block(gc_get_context(ptr), header);
+}
+
+gc_ctx *
+gc_get_context(void *ptr)
+{
+   gc_block_header *header = gc_header_from_ptr(ptr);
+   assert(header->flags & GC_IS_USED);
+
+   if (header->flags & GC_IS_LARGE)
+      return gc_large_from_header(header)->ctx;
+   else
+      return gc_slab_from_header(header)->ctx;
+}
+
+void
+gc_sweep_start(gc_ctx *ctx)
+{
+   ctx->current_gen ^= GC_GENERATION;
+}
+
+void
+gc_mark_live(gc_ctx *ctx, const void *mem)
+{
+   gc_block_header *header = gc_header_from_ptr(mem);
+   assert(header->flags & GC_IS_USED);
+   header->flags = (header->flags & ~GC_GENERATION) | ctx->current_gen;
+}
+
+static void
+gc_sweep_slab(gc_ctx *ctx, gc_slab *slab, unsigned bucket)
+{
+   unsigned block_size = gc_bucket_block_size(bucket);
+   char *start = (char *)slab + GC_SLAB_HEADER_SIZE;
+   uint8_t gen = ctx->current_gen;
+
+   /* Freeing the last used block can release the slab itself, so stop as
+    * soon as there is nothing left to look at.
+    */
+   for (char *p = start; p < slab->next_available; p += block_size) {
+      gc_block_header *header = (gc_block_header *)p;
+      if (!(header->flags & GC_IS_USED) ||
+          (header->flags & GC_GENERATION) == gen)
+         continue;
+
+      bool last = slab->num_used == 1;
+      gc_free_block(ctx, header);
+      if (last)
+         return;
+   }
+}
+
+void
+gc_sweep_end(gc_ctx *ctx)
+{
+   for (unsigned i = 0; i < GC_NUM_BUCKETS; i++) {
+      list_for_each_entry_safe(gc_slab, slab, &ctx->buckets[i].slabs, link)
+         gc_sweep_slab(ctx, slab, i);
+   }
+
+   list_for_each_entry_safe(gc_large_block, large, &ctx->large_blocks, link) {
+      gc_block_header *header = (gc_block_header *)
+         ((char *)large + GC_LARGE_HEADER_SIZE - sizeof(gc_block_header));
+      if ((header->flags & GC_GENERATION) != ctx->current_gen)
+         gc_free_block(ctx, header);
+   }
+}
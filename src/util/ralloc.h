@@ -597,6 +597,57 @@ bool linear_vasprintf_rewrite_tail(void *parent, char **str, size_t *start,
                                    const char *fmt, va_list args);
 bool linear_strcat(void *parent, char **dest, const char *str);
 
+/**
+ * \def gc_alloc(ctx, type, count)
+ * Allocate \p count objects of \p type from a garbage collected context.
+ *
+ * Unlike ralloc, allocations from a gc_ctx can't have children of their own.
+ * In exchange they are carved out of size-class slabs, which makes
+ * allocating and freeing many small, short lived objects cheap, and they can
+ * be reclaimed in bulk with a mark and sweep pass, see gc_sweep_start().
+ */
+#define gc_alloc(ctx, type, count) \
+   ((type *) gc_alloc_size(ctx, sizeof(type) * (count), alignof(type)))
+
+/**
+ * \def gc_zalloc(ctx, type, count)
+ * Same as gc_alloc, but also clears memory.
+ */
+#define gc_zalloc(ctx, type, count) \
+   ((type *) gc_zalloc_size(ctx, sizeof(type) * (count), alignof(type)))
+
+typedef struct gc_ctx gc_ctx;
+
+/**
+ * Create a garbage collected context. It is a ralloc child of \p parent, and
+ * freeing it (or its parent) frees everything allocated from it.
+ */
+gc_ctx *gc_context(const void *parent);
+
+void *gc_alloc_size(gc_ctx *ctx, size_t size, size_t alignment) MALLOCLIKE;
+void *gc_zalloc_size(gc_ctx *ctx, size_t size, size_t alignment) MALLOCLIKE;
+
+/**
+ * Free a single allocation right away instead of waiting for a sweep.
+ */
+void gc_free(void *ptr);
+
+/**
+ * Return the context \p ptr was allocated from.
+ */
+gc_ctx *gc_get_context(void *ptr);
+
+/**
+ * Start a mark and sweep pass over \p ctx.
+ *
+ * Every allocation that isn't passed to gc_mark_live() before the matching
+ * gc_sweep_end() is freed, except for those made after gc_sweep_start().
+ * Slabs which end up empty are released.
+ */
+void gc_sweep_start(gc_ctx *ctx);
+void gc_mark_live(gc_ctx *ctx, const void *mem);
+void gc_sweep_end(gc_ctx *ctx);
+
 #ifdef __cplusplus
 } /* end of extern "C" */
 #endif
@@ -0,0 +1,122 @@
+/*
+ * Copyright © 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <string.h>
+#include <gtest/gtest.h>
+
+#include "util/ralloc.h"
+
+struct node {
+   struct node *next;
+   unsigned value;
+};
+
+TEST(gc, alloc_and_free)
+{
+   void *mem_ctx = ralloc_context(NULL);
+   gc_ctx *ctx = gc_context(mem_ctx);
+
+   ASSERT_NE(ctx, nullptr);
+
+   /* Cover the slab buckets and the large allocation path. */
+   for (size_t size = 1; size < 2048; size += 7) {
+      char *p = (char *)gc_zalloc_size(ctx, size, 8);
+      ASSERT_NE(p, nullptr);
+      EXPECT_EQ((uintptr_t)p % 8, 0);
+      for (size_t i = 0; i < size; i++)
+         EXPECT_EQ(p[i], 0);
+      memset(p, 0xff, size);
+      EXPECT_EQ(gc_get_context(p), ctx);
+      gc_free(p);
+   }
+
+   /* Aligned allocations take the large path. */
+   void *aligned = gc_alloc_size(ctx, 24, 64);
+   EXPECT_EQ((uintptr_t)aligned % 16, 0);
+   EXPECT_EQ(gc_get_context(aligned), ctx);
+
+   gc_free(NULL);
+
+   ralloc_free(mem_ctx);
+}
+
+TEST(gc, reuse_freed_blocks)
+{
+   gc_ctx *ctx = gc_context(NULL);
+
+   struct node *a = gc_alloc(ctx, struct node, 1);
+   gc_free(a);
+   struct node *b = gc_alloc(ctx, struct node, 1);
+   EXPECT_EQ(a, b);
+
+   ralloc_free(ctx);
+}
+
+TEST(gc, sweep)
+{
+   gc_ctx *ctx = gc_context(NULL);
+   struct node *nodes[1000];
+   char *large[10];
+
+   for (unsigned i = 0; i < ARRAY_SIZE(nodes); i++) {
+      nodes[i] = gc_alloc(ctx, struct node, 1);
+      nodes[i]->value = i;
+   }
+   for (unsigned i = 0; i < ARRAY_SIZE(large); i++) {
+      large[i] = (char *)gc_alloc_size(ctx, 4096, 8);
+      large[i][0] = i;
+   }
+
+   gc_sweep_start(ctx);
+
+   for (unsigned i = 0; i < ARRAY_SIZE(nodes); i += 2)
+      gc_mark_live(ctx, nodes[i]);
+   for (unsigned i = 0; i < ARRAY_SIZE(large); i += 2)
+      gc_mark_live(ctx, large[i]);
+
+   /* Allocations made during the sweep survive it. */
+   struct node *fresh = gc_alloc(ctx, struct node, 1);
+   fresh->value = 1234;
+
+   gc_sweep_end(ctx);
+
+   EXPECT_EQ(fresh->value, 1234);
+   for (unsigned i = 0; i < ARRAY_SIZE(nodes); i += 2) {
+      EXPECT_EQ(nodes[i]->value, i);
+      EXPECT_EQ(gc_get_context(nodes[i]), ctx);
+   }
+   for (unsigned i = 0; i < ARRAY_SIZE(large); i += 2)
+      EXPECT_EQ(large[i][0], (char)i);
+
+   /* Sweeping again without marking anything frees everything, including
+    * the blocks the previous sweep kept.
+    */
+   gc_sweep_start(ctx);
+   gc_sweep_end(ctx);
+
+   struct node *again = gc_alloc(ctx, struct node, 1);
+   ASSERT_NE(again, nullptr);
+   gc_free(again);
+
+   ralloc_free(ctx);
+}